@@ -0,0 +1,27 @@
+#ifndef AGENT_H
+#define AGENT_H
+
+#include "GameState.h"
+
+#include <thread>
+
+// Something that picks moves, for the Autoplayer and headless tools
+class Agent
+{
+public:
+	virtual ~Agent() { }
+
+	// Finds the move to make from a position, returning false if there
+	// is none. May block for as long as the agent thinks.
+	virtual bool search(const GameState& state, GameMove& move) = 0;
+
+	// Threads to search with while a game is being shown, one per core
+	// but one so the game and rendering keep theirs
+	static int getBackgroundThreads()
+	{
+		int threads = (int)std::thread::hardware_concurrency();
+		return threads > 1 ? threads - 1 : 1;
+	}
+};
+
+#endif
@@ -0,0 +1,297 @@
+#include "Autoplayer.h"
+#include "BeamSearch.h"
+
+#include <string.h>
+
+// Starts the worker thread if searching in the background. Takes
+// ownership of the agent, playing with a BeamSearch if not given one.
+Autoplayer::Autoplayer(Agent* pAgent, bool background)
+	: background(background)
+{
+	agent = pAgent ? pAgent : new BeamSearch(BEAM_WIDTH, BEAM_DEPTH, background ? Agent::getBackgroundThreads() : 1);
+	nextAgent = NULL;
+	solver = NULL;
+	clearStep = 0;
+	clearLength = 0;
+	perfectClearing = false;
+	requestTicket = 0;
+	resultTicket = 0;
+	resultLength = 0;
+	stopping = false;
+	reset();
+	if (background)
+	{
+		worker = std::thread(&Autoplayer::run, this);
+	}
+}
+
+// Stops the worker once it finishes any search in progress
+Autoplayer::~Autoplayer()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	signal.notify_one();
+	if (worker.joinable())
+	{
+		worker.join();
+	}
+	delete agent;
+	delete nextAgent;
+	delete solver;
+}
+
+// Forgets the current block, so the next call to getInput() starts a
+// new search. Call when the game is reset.
+void Autoplayer::reset()
+{
+	piece = -1;
+	planned = false;
+	pathLength = 0;
+	step = 0;
+}
+
+// Hands over the agent to play with from the next block on. Takes
+// ownership of it, the current agent is deleted once it is done.
+void Autoplayer::setAgent(Agent* pAgent)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	delete nextAgent;
+	nextAgent = pAgent;
+}
+
+// Sets whether to play perfect clears when there are any in reach,
+// from the next block on
+void Autoplayer::setPerfectClearing(bool pPerfectClearing)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	perfectClearing = pPerfectClearing;
+}
+
+// Whether perfect clears are played when there are any in reach
+bool Autoplayer::isPerfectClearing()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return perfectClearing;
+}
+
+// Returns the inputs for the next tick of the simulation
+int Autoplayer::getInput(const GameSimulation& simulation)
+{
+	if (simulation.getActiveType() == NO_BLOCK)
+	{
+		return 0;
+	}
+
+	// Search for a move for each new block
+	if (simulation.getPieces() != piece)
+	{
+		piece = simulation.getPieces();
+		planned = false;
+		if (!background)
+		{
+			simulation.getState(request);
+			resultLength = plan(request, result);
+			resultTicket = ++requestTicket;
+		}
+		else
+		{
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				simulation.getState(request);
+				requestTicket++;
+			}
+			signal.notify_one();
+		}
+	}
+
+	// Wait for the move without holding up the game
+	if (!planned)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (resultTicket != requestTicket)
+		{
+			return 0;
+		}
+		pathLength = resultLength;
+		for (int i = 0; i < pathLength; i++)
+		{
+			path[i] = result[i];
+		}
+		planned = true;
+		step = 0;
+		pathY = SPAWN_Y;
+		startStep(simulation);
+	}
+	return followPath(simulation);
+}
+
+// Moves on through the path past the steps the simulation has made,
+// returning the inputs for the first one still to happen
+int Autoplayer::followPath(const GameSimulation& simulation)
+{
+	while (step < pathLength)
+	{
+		bool finished = false;
+		bool falling = false;
+		int input = 0;
+		switch (path[step])
+		{
+		case PATH_LEFT:
+			finished = simulation.getX() == stepX - 1;
+			input = INPUT_LEFT;
+			break;
+		case PATH_RIGHT:
+			finished = simulation.getX() == stepX + 1;
+			input = INPUT_RIGHT;
+			break;
+		case PATH_ROTATE:
+			finished = simulation.getRotation() == (stepRotation + 1) % NUM_ROTATIONS;
+			input = INPUT_ROTATE;
+			break;
+		case PATH_DOWN:
+			finished = simulation.getY() <= pathY - 1;
+			falling = true;
+			input = INPUT_FAST_FALL;
+			break;
+		case PATH_DROP:
+			// A dropped block locks at once, so fall instead if the path goes on from the landing
+			if (step == pathLength - 1)
+			{
+				finished = stepTicks > 0;
+				input = INPUT_DROP;
+			}
+			else
+			{
+				finished = simulation.getY() <= stepLanding;
+				falling = true;
+				input = INPUT_FAST_FALL;
+			}
+			break;
+		case PATH_HOLD:
+			finished = stepTicks > 0;
+			input = INPUT_HOLD;
+			break;
+		}
+
+		if (finished)
+		{
+			pathY = path[step] == PATH_DOWN ? pathY - 1 : (path[step] == PATH_DROP ? stepLanding : pathY);
+			step++;
+			startStep(simulation);
+		}
+		else if (falling || stepTicks++ < STEP_TIMEOUT)
+		{
+			return input;
+		}
+		else
+		{
+			step = pathLength;
+		}
+	}
+	return 0;
+}
+
+// Notes where the block is before the next step of the path
+void Autoplayer::startStep(const GameSimulation& simulation)
+{
+	stepTicks = 0;
+	stepX = simulation.getX();
+	stepRotation = simulation.getRotation();
+	stepLanding = simulation.getGhostY();
+}
+
+// Searches for a move from a position and fills in the path to it,
+// returning its length. With no move the block is left to fall.
+int Autoplayer::plan(const GameState& state, uint8_t* steps)
+{
+	bool clearing;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (nextAgent)
+		{
+			delete agent;
+			agent = nextAgent;
+			nextAgent = NULL;
+		}
+		clearing = perfectClearing;
+	}
+
+	GameMove move;
+	if ((clearing && findClearMove(state, move)) || agent->search(state, move))
+	{
+		int count = finder.find(state, move.hold);
+		for (int i = 0; i < count; i++)
+		{
+			const GameMove& found = finder.getPlacement(i).move;
+			if (found.x == move.x && found.y == move.y && found.rotation == move.rotation)
+			{
+				return finder.getPath(i, steps);
+			}
+		}
+	}
+	return 0;
+}
+
+// Finds the next placement of a perfect clear, carrying on with the
+// one being played if the game went the way it expected and otherwise
+// looking for a new one. Returns false if there is none in reach.
+bool Autoplayer::findClearMove(const GameState& state, GameMove& move)
+{
+	if (clearStep >= clearLength || memcmp(&state, &clearExpected, sizeof(GameState)) != 0)
+	{
+		if (!solver)
+		{
+			solver = new PerfectClearSolver(background ? Agent::getBackgroundThreads() : 1);
+			solver->setNodeLimit(PC_AUTOPLAY_NODES);
+		}
+		clearStep = 0;
+		clearLength = solver->solve(state) ? solver->getSolutionLength() : 0;
+		if (clearLength == 0)
+		{
+			return false;
+		}
+	}
+
+	move = solver->getSolutionMove(clearStep++);
+	clearExpected = state;
+	clearExpected.apply(move);
+	return true;
+}
+
+// Worker thread loop, searches for a move for the latest block and the
+// path to it
+void Autoplayer::run()
+{
+	uint8_t steps[SEARCH_MAX_STEPS + 2];
+	while (true)
+	{
+		GameState state;
+		uint32_t ticket;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			signal.wait(lock, [this] { return requestTicket != resultTicket || stopping; });
+			if (stopping)
+			{
+				return;
+			}
+			state = request;
+			ticket = requestTicket;
+		}
+
+		int length = plan(state, steps);
+
+		// Only the latest request is answered, older ones are dropped
+		std::lock_guard<std::mutex> lock(mutex);
+		if (ticket == requestTicket)
+		{
+			for (int i = 0; i < length; i++)
+			{
+				result[i] = steps[i];
+			}
+			resultLength = length;
+			resultTicket = ticket;
+		}
+	}
+}
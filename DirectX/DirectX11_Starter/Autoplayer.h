@@ -0,0 +1,101 @@
+#ifndef AUTOPLAYER_H
+#define AUTOPLAYER_H
+
+#include "Agent.h"
+#include "GameSimulation.h"
+#include "PerfectClearSolver.h"
+#include "PlacementFinder.h"
+
+#include <stdint.h>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+// Ticks a move, rotation or hold can take before the autoplayer stops
+// following the path
+#define STEP_TIMEOUT 30
+
+// Positions each thread of the perfect clear solver may search for a
+// block before the autoplayer falls back on its agent
+#define PC_AUTOPLAY_NODES (1 << 14)
+
+// Plays a game in place of the player. Each new block is handed to an
+// Agent on a worker thread, and once it has picked a placement the
+// autoplayer presses the inputs of the path to it, one tick at a time.
+// getInput() never waits for the search: the block just falls until the
+// move is known.
+//
+// The path is followed by watching the simulation rather than by
+// timing, so moves held back by the smooth movement are pressed again
+// until they happen, and the block falls to each row the path goes
+// down to. A step that can't be made (e.g. the block fell past a gap
+// before reaching it) is given up on after STEP_TIMEOUT ticks and the
+// block is left to fall where it is.
+//
+// Without a background thread the search runs inside getInput() instead,
+// so a headless game plays out the same way every time whatever the
+// machine's speed.
+//
+// With perfect clears on, each block first asks a PerfectClearSolver
+// for a way to empty the board, and once one is found its placements
+// are played for as long as the game follows it. The agent picks the
+// move whenever there is no perfect clear in reach.
+class Autoplayer
+{
+public:
+	Autoplayer(Agent* pAgent = NULL, bool background = true);
+	~Autoplayer();
+
+	void reset();
+	int getInput(const GameSimulation& simulation);
+	void setAgent(Agent* pAgent);
+	void setPerfectClearing(bool pPerfectClearing);
+	bool isPerfectClearing();
+
+private:
+	Agent* agent;
+	Agent* nextAgent;
+	PlacementFinder finder;
+
+	// The perfect clear being played, used by the worker alone
+	PerfectClearSolver* solver;
+	GameState clearExpected;
+	int clearStep;
+	int clearLength;
+	bool perfectClearing;
+
+	// Searches waiting for and finished by the worker, matched up by ticket
+	std::thread worker;
+	std::mutex mutex;
+	std::condition_variable signal;
+	GameState request;
+	uint32_t requestTicket;
+	uint32_t resultTicket;
+	uint8_t result[SEARCH_MAX_STEPS + 2];
+	int resultLength;
+	bool background;
+	bool stopping;
+
+	// The path being followed on the game thread
+	uint8_t path[SEARCH_MAX_STEPS + 2];
+	int pathLength;
+	int step;
+	int stepTicks;
+	int stepX;
+	int stepRotation;
+	int stepLanding;
+	int pathY;
+	int piece;
+	bool planned;
+
+	int followPath(const GameSimulation& simulation);
+	void startStep(const GameSimulation& simulation);
+	int plan(const GameState& state, uint8_t* steps);
+	bool findClearMove(const GameState& state, GameMove& move);
+	void run();
+
+	Autoplayer(const Autoplayer& rhs);
+	Autoplayer& operator=(const Autoplayer& rhs);
+};
+
+#endif
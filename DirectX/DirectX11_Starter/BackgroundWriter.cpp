@@ -0,0 +1,85 @@
+#include "BackgroundWriter.h"
+
+BackgroundWriter::BackgroundWriter()
+{
+	closing = false;
+}
+
+// Finishes writing anything left before going away
+BackgroundWriter::~BackgroundWriter()
+{
+	close();
+}
+
+// Opens the file, replacing any existing one, and starts the worker thread
+bool BackgroundWriter::open(const char* path)
+{
+	close();
+	file.open(path, std::ios::out | std::ios::binary | std::ios::trunc);
+	if (!file.is_open())
+	{
+		return false;
+	}
+	closing = false;
+	worker = std::thread(&BackgroundWriter::run, this);
+	return true;
+}
+
+// Queues bytes to be written to the end of the file
+void BackgroundWriter::write(const void* data, size_t size)
+{
+	if (!file.is_open() || size == 0)
+	{
+		return;
+	}
+
+	const uint8_t* bytes = (const uint8_t*)data;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		pending.insert(pending.end(), bytes, bytes + size);
+	}
+	signal.notify_one();
+}
+
+// Writes everything still queued and closes the file
+void BackgroundWriter::close()
+{
+	if (!worker.joinable())
+	{
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		closing = true;
+	}
+	signal.notify_one();
+	worker.join();
+	file.close();
+}
+
+// Worker thread loop, writes out the pending bytes as they come in
+void BackgroundWriter::run()
+{
+	std::vector<uint8_t> writing;
+	while (true)
+	{
+		bool done;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			signal.wait(lock, [this] { return !pending.empty() || closing; });
+			writing.swap(pending);
+			done = closing;
+		}
+
+		if (!writing.empty())
+		{
+			file.write((const char*)&writing[0], writing.size());
+			writing.clear();
+		}
+		if (done)
+		{
+			file.flush();
+			return;
+		}
+	}
+}
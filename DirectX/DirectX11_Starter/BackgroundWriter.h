@@ -0,0 +1,39 @@
+#ifndef BACKGROUNDWRITER_H
+#define BACKGROUNDWRITER_H
+
+#include <stdint.h>
+#include <fstream>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+// Appends bytes to a file from a worker thread so the caller never
+// waits on the disk. Writes are copied into a pending buffer that the
+// worker swaps out and flushes whenever it has something to write.
+class BackgroundWriter
+{
+public:
+	BackgroundWriter();
+	~BackgroundWriter();
+
+	bool open(const char* path);
+	void write(const void* data, size_t size);
+	void close();
+	bool isOpen() const { return file.is_open(); }
+
+private:
+	std::ofstream file;
+	std::vector<uint8_t> pending;
+	std::mutex mutex;
+	std::condition_variable signal;
+	std::thread worker;
+	bool closing;
+
+	void run();
+
+	BackgroundWriter(const BackgroundWriter& rhs);
+	BackgroundWriter& operator=(const BackgroundWriter& rhs);
+};
+
+#endif
@@ -0,0 +1,645 @@
+#include "BatchEnvironment.h"
+#include "BitOps.h"
+#include "Random.h"
+
+// A board row with every cell and wall filled, in the padded layout
+#define ENV_FULL_ROW 0xFFFF
+
+// Fills a bag with one of each block type in a random order,
+// the same way GameState does
+static uint32_t shuffleBag(Random& random)
+{
+	int order[NUM_BLOCK_TYPES];
+	for (int i = 0; i < NUM_BLOCK_TYPES; i++)
+	{
+		order[i] = i;
+	}
+	for (int i = NUM_BLOCK_TYPES - 1; i > 0; i--)
+	{
+		int index = random.nextInt(i + 1);
+		int type = order[index];
+		order[index] = order[i];
+		order[i] = type;
+	}
+
+	uint32_t bag = 0;
+	for (int i = 0; i < NUM_BLOCK_TYPES; i++)
+	{
+		bag |= (uint32_t)order[i] << (i * 3);
+	}
+	return bag;
+}
+
+// Creates the games, rounding the lanes up to whole batches. The extra
+// lanes play along but nothing reads them.
+BatchEnvironment::BatchEnvironment(int lanes, uint64_t seed)
+	: lanes(lanes > 0 ? lanes : 1)
+{
+	stride = (this->lanes + ENV_BATCH - 1) / ENV_BATCH * ENV_BATCH;
+	vectorized = hasAvx2();
+
+	rows.resize(GRID_HEIGHT * stride);
+	piece.resize(4 * stride);
+	x.resize(stride);
+	y.resize(stride);
+	type.resize(stride);
+	rotation.resize(stride);
+	canSwap.resize(stride);
+	actions.resize(stride);
+	held.resize(stride);
+	random.resize(stride);
+	bag.resize(stride);
+	bagIndex.resize(stride);
+	seeds.resize(stride);
+	score.resize(stride);
+	lines.resize(stride);
+	pieces.resize(stride);
+	rewards.resize(stride);
+	done.resize(stride);
+	reset(seed);
+}
+
+// Starts every game again, lane i with seed + i. Games that top out
+// move on to seeds a whole stride further, so no two lanes share one.
+void BatchEnvironment::reset(uint64_t seed)
+{
+	games = 0;
+	for (int i = 0; i < stride; i++)
+	{
+		seeds[i] = seed + (uint64_t)i;
+		startGame(i);
+		rewards[i] = 0;
+		done[i] = 0;
+	}
+}
+
+// Abandons the game in a lane and starts its next one
+void BatchEnvironment::resetLane(int lane)
+{
+	seeds[lane] += (uint64_t)stride;
+	startGame(lane);
+}
+
+// Steps every game once, taking an action per lane. Afterwards the
+// rewards hold the points each game scored and done marks the games
+// that topped out, which have already started again.
+void BatchEnvironment::step(const uint8_t* laneActions)
+{
+	for (int i = 0; i < stride; i++)
+	{
+		actions[i] = i < lanes && laneActions[i] < NUM_ACTIONS ? laneActions[i] : (uint8_t)ACTION_NONE;
+		rewards[i] = 0;
+		done[i] = 0;
+	}
+	if (vectorized)
+	{
+		for (int first = 0; first < stride; first += ENV_BATCH)
+		{
+			stepBatch(first);
+		}
+	}
+	else
+	{
+		for (int i = 0; i < stride; i++)
+		{
+			stepLane(i, actions[i]);
+		}
+	}
+}
+
+// Copies a game into a compact state, e.g. for an agent to search from
+void BatchEnvironment::getState(int lane, GameState& state) const
+{
+	for (int j = 0; j < GRID_HEIGHT; j++)
+	{
+		state.rows[j] = (uint16_t)((rows[j * stride + lane] >> ENV_PAD) & FULL_ROW);
+	}
+	state.random = random[lane];
+	state.score = score[lane];
+	state.bag = bag[lane];
+	state.lines = (uint16_t)lines[lane];
+	state.type = (int8_t)type[lane];
+	state.rotation = (int8_t)rotation[lane];
+	state.x = (int8_t)x[lane];
+	state.y = (int8_t)y[lane];
+	state.held = held[lane];
+	state.flags = (uint8_t)(bagIndex[lane] | (canSwap[lane] ? STATE_CAN_SWAP : 0));
+}
+
+// Chooses between the vector kernel and stepping a lane at a time.
+// The vector kernel is only used if the processor has AVX2.
+void BatchEnvironment::setVectorized(bool enable)
+{
+	vectorized = enable && hasAvx2();
+}
+
+// Starts a new game in a lane from its seed
+void BatchEnvironment::startGame(int i)
+{
+	for (int j = 0; j < GRID_HEIGHT; j++)
+	{
+		rows[j * stride + i] = ENV_WALLS;
+	}
+	Random generator;
+	generator.seed(seeds[i]);
+	random[i] = generator.state;
+	bag[i] = 0;
+	bagIndex[i] = NUM_BLOCK_TYPES - 1;
+	held[i] = NO_BLOCK;
+	canSwap[i] = 1;
+	score[i] = 0;
+	lines[i] = 0;
+	pieces[i] = 0;
+	spawnLane(i);
+}
+
+// Steps one game, following GameSimulation's single actions
+void BatchEnvironment::stepLane(int i, int action)
+{
+	uint16_t masks[4];
+	switch (action)
+	{
+	case ACTION_LEFT:
+	case ACTION_RIGHT:
+		for (int k = 0; k < 4; k++)
+		{
+			uint16_t mask = piece[k * stride + i];
+			masks[k] = (uint16_t)(action == ACTION_LEFT ? mask >> 1 : mask << 1);
+		}
+		if (fits(i, masks, y[i]))
+		{
+			for (int k = 0; k < 4; k++)
+			{
+				piece[k * stride + i] = masks[k];
+			}
+			x[i] = (int16_t)(x[i] + (action == ACTION_LEFT ? -1 : 1));
+		}
+		break;
+
+	case ACTION_ROTATE:
+	{
+		// Try the next orientation in place, then a column to the right
+		// and then to the left
+		int next = (rotation[i] + 1) % NUM_ROTATIONS;
+		const BlockShape& shape = BLOCK_SHAPES[type[i]][next];
+		for (int shift = 0; shift < 3; shift++)
+		{
+			int kick = shift == 0 ? 0 : shift == 1 ? 1 : -1;
+			for (int k = 0; k < 4; k++)
+			{
+				masks[k] = (uint16_t)(shape.rows[k] << (x[i] + kick + ENV_PAD));
+			}
+			if (fits(i, masks, y[i]))
+			{
+				setPiece(i, type[i], next, x[i] + kick, y[i]);
+				break;
+			}
+		}
+		break;
+	}
+
+	case ACTION_DROP:
+		getPiece(i, masks);
+		while (fits(i, masks, y[i] - 1))
+		{
+			y[i]--;
+		}
+		break;
+
+	case ACTION_HOLD:
+		holdLane(i);
+		break;
+	}
+	fallLane(i);
+}
+
+// Checks whether block rows placed at the given height are clear of the
+// board, the walls and the floor
+bool BatchEnvironment::fits(int i, const uint16_t* masks, int blockY) const
+{
+	for (int k = 0; k < 4; k++)
+	{
+		uint16_t mask = masks[k];
+		if (mask == 0)
+		{
+			continue;
+		}
+		int j = blockY + k;
+		uint16_t row = j < 0 ? (uint16_t)ENV_FULL_ROW : j >= GRID_HEIGHT ? ENV_WALLS : rows[j * stride + i];
+		if (row & mask)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+// Copies the rows of a lane's block
+void BatchEnvironment::getPiece(int i, uint16_t* masks) const
+{
+	for (int k = 0; k < 4; k++)
+	{
+		masks[k] = piece[k * stride + i];
+	}
+}
+
+// Puts a lane's block in the given spot and orientation
+void BatchEnvironment::setPiece(int i, int blockType, int blockRotation, int blockX, int blockY)
+{
+	const BlockShape& shape = BLOCK_SHAPES[blockType][blockRotation];
+	type[i] = (int16_t)blockType;
+	rotation[i] = (int16_t)blockRotation;
+	x[i] = (int16_t)blockX;
+	y[i] = (int16_t)blockY;
+	for (int k = 0; k < 4; k++)
+	{
+		piece[k * stride + i] = (uint16_t)(shape.rows[k] << (blockX + ENV_PAD));
+	}
+}
+
+// Swaps a lane's block with the held one, once per merged block
+void BatchEnvironment::holdLane(int i)
+{
+	if (!canSwap[i])
+	{
+		return;
+	}
+	canSwap[i] = 0;
+	int previous = held[i];
+	held[i] = (int8_t)type[i];
+	if (previous == NO_BLOCK)
+	{
+		spawnLane(i);
+	}
+	else
+	{
+		setPiece(i, previous, 0, SPAWN_X, SPAWN_Y);
+	}
+}
+
+// Moves a lane's block down a row, or merges it if it can't fall
+void BatchEnvironment::fallLane(int i)
+{
+	uint16_t masks[4];
+	getPiece(i, masks);
+	if (fits(i, masks, y[i] - 1))
+	{
+		y[i]--;
+	}
+	else
+	{
+		mergeLane(i);
+	}
+}
+
+// Merges a lane's block into its board, clears lines and spawns the
+// next block, or starts the next game if the block is above the board
+void BatchEnvironment::mergeLane(int i)
+{
+	canSwap[i] = 1;
+	int bottom = 4;
+	int top = -1;
+	for (int k = 0; k < 4; k++)
+	{
+		if (piece[k * stride + i] != 0)
+		{
+			bottom = bottom < k ? bottom : k;
+			top = k;
+		}
+	}
+	if (y[i] + top >= GRID_HEIGHT)
+	{
+		done[i] = 1;
+		if (i < lanes)
+		{
+			games++;
+		}
+		resetLane(i);
+		return;
+	}
+
+	bool full = false;
+	for (int k = bottom; k <= top; k++)
+	{
+		uint16_t& row = rows[(y[i] + k) * stride + i];
+		row |= piece[k * stride + i];
+		full = full || row == ENV_FULL_ROW;
+	}
+	pieces[i]++;
+	if (!full)
+	{
+		spawnLane(i);
+		return;
+	}
+
+	// Clear completed lines, moving the rows above them down
+	int cleared = 0;
+	int write = y[i] + bottom;
+	for (int read = write; read < GRID_HEIGHT; read++)
+	{
+		uint16_t row = rows[read * stride + i];
+		if (read <= y[i] + top && row == ENV_FULL_ROW)
+		{
+			cleared++;
+		}
+		else
+		{
+			rows[write++ * stride + i] = row;
+		}
+	}
+	for (; write < GRID_HEIGHT; write++)
+	{
+		rows[write * stride + i] = ENV_WALLS;
+	}
+	if (cleared > 0)
+	{
+		rewards[i] = LINE_SCORES[cleared - 1];
+		score[i] += LINE_SCORES[cleared - 1];
+		lines[i] += cleared;
+	}
+	spawnLane(i);
+}
+
+// Spawns the next block in a lane's order at the top of its board
+void BatchEnvironment::spawnLane(int i)
+{
+	int index = (bagIndex[i] + 1) % NUM_BLOCK_TYPES;
+	if (index == 0)
+	{
+		Random generator = { random[i] };
+		bag[i] = shuffleBag(generator);
+		random[i] = generator.state;
+	}
+	bagIndex[i] = (uint8_t)index;
+	setPiece(i, (bag[i] >> (index * 3)) & 7, 0, SPAWN_X, SPAWN_Y);
+}
+
+#ifdef AVX2_KERNELS
+
+// Byte tables for the vector kernel, looked up with a shuffle
+struct EnvTables
+{
+	// Row k of each orientation, indexed by type * 4 + rotation in two
+	// halves of 16
+	uint8_t shapeRows[4][2][16];
+
+	// Low and high byte of 1 << s for a shift s of 0-15
+	uint8_t shiftLow[16];
+	uint8_t shiftHigh[16];
+
+	EnvTables()
+	{
+		for (int k = 0; k < 4; k++)
+		{
+			for (int index = 0; index < 32; index++)
+			{
+				int blockType = index / NUM_ROTATIONS;
+				shapeRows[k][index / 16][index % 16] = blockType < NUM_BLOCK_TYPES
+					? (uint8_t)BLOCK_SHAPES[blockType][index % NUM_ROTATIONS].rows[k] : 0;
+			}
+		}
+		for (int s = 0; s < 16; s++)
+		{
+			shiftLow[s] = (uint8_t)(s < 8 ? 1 << s : 0);
+			shiftHigh[s] = (uint8_t)(s < 8 ? 0 : 1 << (s - 8));
+		}
+	}
+};
+
+static const EnvTables envTables;
+
+// Four rows of ENV_BATCH blocks or boards, bottom first. Kept as named
+// vectors rather than an array so they stay in registers.
+struct BatchRows
+{
+	__m256i row0;
+	__m256i row1;
+	__m256i row2;
+	__m256i row3;
+};
+
+// Looks up a byte table for the low byte of each 16-bit lane
+AVX2_FUNCTION static inline __m256i lookup16(const uint8_t* table, __m256i index)
+{
+	__m256i bytes = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)table));
+	return _mm256_and_si256(_mm256_shuffle_epi8(bytes, index), _mm256_set1_epi16(0xFF));
+}
+
+// Moves every row of the blocks a column left or right
+AVX2_FUNCTION static inline BatchRows shiftLeft(const BatchRows& rows)
+{
+	BatchRows result = { _mm256_srli_epi16(rows.row0, 1), _mm256_srli_epi16(rows.row1, 1),
+		_mm256_srli_epi16(rows.row2, 1), _mm256_srli_epi16(rows.row3, 1) };
+	return result;
+}
+AVX2_FUNCTION static inline BatchRows shiftRight(const BatchRows& rows)
+{
+	BatchRows result = { _mm256_slli_epi16(rows.row0, 1), _mm256_slli_epi16(rows.row1, 1),
+		_mm256_slli_epi16(rows.row2, 1), _mm256_slli_epi16(rows.row3, 1) };
+	return result;
+}
+
+// Picks the rows of b in the lanes set in mask and of a elsewhere
+AVX2_FUNCTION static inline BatchRows blendRows(const BatchRows& a, const BatchRows& b, __m256i mask)
+{
+	BatchRows result = { _mm256_blendv_epi8(a.row0, b.row0, mask), _mm256_blendv_epi8(a.row1, b.row1, mask),
+		_mm256_blendv_epi8(a.row2, b.row2, mask), _mm256_blendv_epi8(a.row3, b.row3, mask) };
+	return result;
+}
+
+// Checks which lanes' blocks are clear of the board rows they're on
+AVX2_FUNCTION static inline __m256i fitsRows(const BatchRows& board, const BatchRows& block)
+{
+	__m256i overlap = _mm256_or_si256(
+		_mm256_or_si256(_mm256_and_si256(board.row0, block.row0), _mm256_and_si256(board.row1, block.row1)),
+		_mm256_or_si256(_mm256_and_si256(board.row2, block.row2), _mm256_and_si256(board.row3, block.row3)));
+	return _mm256_cmpeq_epi16(overlap, _mm256_setzero_si256());
+}
+
+// Finds the rows of the next orientation of the blocks, shifted to their
+// columns with a multiply by a power of 2
+AVX2_FUNCTION static inline BatchRows turnRows(__m256i index, __m256i column)
+{
+	__m256i upper = _mm256_cmpgt_epi16(index, _mm256_set1_epi16(15));
+	__m256i scale = _mm256_or_si256(lookup16(envTables.shiftLow, column),
+		_mm256_slli_epi16(lookup16(envTables.shiftHigh, column), 8));
+	__m256i shape[4];
+	for (int k = 0; k < 4; k++)
+	{
+		shape[k] = _mm256_mullo_epi16(_mm256_blendv_epi8(lookup16(envTables.shapeRows[k][0], index),
+			lookup16(envTables.shapeRows[k][1], index), upper), scale);
+	}
+	BatchRows result = { shape[0], shape[1], shape[2], shape[3] };
+	return result;
+}
+
+// Adds a board row to whichever lanes have their block's row k on it,
+// given how far the row is above each block
+AVX2_FUNCTION static inline __m256i gatherRow(__m256i window, __m256i row, __m256i offset, int k)
+{
+	return _mm256_or_si256(window, _mm256_and_si256(_mm256_cmpeq_epi16(offset, _mm256_set1_epi16((short)k)), row));
+}
+
+// Raises the landing spot of lanes where block row k hits a board row
+// below where the block is now. Spots are kept GRID_HEIGHT up so none is
+// below 0.
+AVX2_FUNCTION static inline __m256i landOn(__m256i landing, __m256i row, __m256i mask, __m256i offset, __m256i spot, int k)
+{
+	__m256i below = _mm256_cmpgt_epi16(offset, _mm256_set1_epi16((short)-k));
+	__m256i blocked = _mm256_andnot_si256(_mm256_cmpeq_epi16(_mm256_and_si256(row, mask), _mm256_setzero_si256()), below);
+	return _mm256_max_epi16(landing, _mm256_and_si256(blocked, _mm256_sub_epi16(spot, _mm256_set1_epi16((short)k))));
+}
+
+// Steps ENV_BATCH games at once, one in each 16-bit lane. Reads the
+// board rows around each block into a window with one pass over the
+// rows, so every move is tested against the window alone. Lanes that
+// hold or merge are finished a lane at a time afterwards.
+AVX2_FUNCTION void BatchEnvironment::stepBatch(int first)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i one = _mm256_set1_epi16(1);
+	const __m256i walls = _mm256_set1_epi16((short)ENV_WALLS);
+
+	__m256i blockX = _mm256_loadu_si256((const __m256i*)&x[first]);
+	__m256i blockY = _mm256_loadu_si256((const __m256i*)&y[first]);
+	__m256i blockType = _mm256_loadu_si256((const __m256i*)&type[first]);
+	__m256i blockRotation = _mm256_loadu_si256((const __m256i*)&rotation[first]);
+	__m256i swappable = _mm256_loadu_si256((const __m256i*)&canSwap[first]);
+	__m256i action = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)&actions[first]));
+	BatchRows block =
+	{
+		_mm256_loadu_si256((const __m256i*)&piece[first]),
+		_mm256_loadu_si256((const __m256i*)&piece[stride + first]),
+		_mm256_loadu_si256((const __m256i*)&piece[2 * stride + first]),
+		_mm256_loadu_si256((const __m256i*)&piece[3 * stride + first])
+	};
+
+	// Only the rows some block in the batch is near need reading
+	int lowest = y[first];
+	int highest = y[first];
+	for (int i = first + 1; i < first + ENV_BATCH; i++)
+	{
+		lowest = y[i] < lowest ? y[i] : lowest;
+		highest = y[i] > highest ? y[i] : highest;
+	}
+
+	// The rows from one below the block to its top, with the floor full
+	// and the space above the board empty but for the walls
+	__m256i under = _mm256_or_si256(walls, _mm256_cmpgt_epi16(one, blockY));
+	BatchRows around =
+	{
+		_mm256_or_si256(walls, _mm256_cmpgt_epi16(zero, blockY)),
+		_mm256_or_si256(walls, _mm256_cmpgt_epi16(_mm256_set1_epi16(-1), blockY)),
+		_mm256_or_si256(walls, _mm256_cmpgt_epi16(_mm256_set1_epi16(-2), blockY)),
+		_mm256_or_si256(walls, _mm256_cmpgt_epi16(_mm256_set1_epi16(-3), blockY))
+	};
+	int end = highest + 4 < GRID_HEIGHT ? highest + 4 : GRID_HEIGHT;
+	for (int j = lowest > 1 ? lowest - 1 : 0; j < end; j++)
+	{
+		__m256i row = _mm256_loadu_si256((const __m256i*)&rows[j * stride + first]);
+		__m256i offset = _mm256_sub_epi16(_mm256_set1_epi16((short)j), blockY);
+		under = gatherRow(under, row, offset, -1);
+		around.row0 = gatherRow(around.row0, row, offset, 0);
+		around.row1 = gatherRow(around.row1, row, offset, 1);
+		around.row2 = gatherRow(around.row2, row, offset, 2);
+		around.row3 = gatherRow(around.row3, row, offset, 3);
+	}
+
+	// Sideways moves
+	BatchRows left = shiftLeft(block);
+	BatchRows right = shiftRight(block);
+	__m256i movedLeft = _mm256_and_si256(_mm256_cmpeq_epi16(action, _mm256_set1_epi16(ACTION_LEFT)), fitsRows(around, left));
+	__m256i movedRight = _mm256_and_si256(_mm256_cmpeq_epi16(action, _mm256_set1_epi16(ACTION_RIGHT)), fitsRows(around, right));
+
+	// Rotation, kicking right and then left if the block doesn't fit
+	__m256i next = _mm256_and_si256(_mm256_add_epi16(blockRotation, one), _mm256_set1_epi16(NUM_ROTATIONS - 1));
+	BatchRows turned = turnRows(_mm256_add_epi16(_mm256_slli_epi16(blockType, 2), next),
+		_mm256_add_epi16(blockX, _mm256_set1_epi16(ENV_PAD)));
+	BatchRows turnedRight = shiftRight(turned);
+	BatchRows turnedLeft = shiftLeft(turned);
+	__m256i inPlace = fitsRows(around, turned);
+	__m256i kickedRight = _mm256_andnot_si256(inPlace, fitsRows(around, turnedRight));
+	__m256i kickedLeft = _mm256_andnot_si256(_mm256_or_si256(inPlace, kickedRight), fitsRows(around, turnedLeft));
+	__m256i rotated = _mm256_and_si256(_mm256_cmpeq_epi16(action, _mm256_set1_epi16(ACTION_ROTATE)),
+		_mm256_or_si256(inPlace, _mm256_or_si256(kickedRight, kickedLeft)));
+	kickedRight = _mm256_and_si256(rotated, kickedRight);
+	kickedLeft = _mm256_and_si256(rotated, kickedLeft);
+
+	block = blendRows(block, left, movedLeft);
+	block = blendRows(block, right, movedRight);
+	block = blendRows(block, blendRows(blendRows(turnedLeft, turnedRight, kickedRight), turned, inPlace), rotated);
+	blockX = _mm256_add_epi16(blockX, _mm256_or_si256(movedLeft, kickedLeft));
+	blockX = _mm256_sub_epi16(blockX, _mm256_or_si256(movedRight, kickedRight));
+	blockRotation = _mm256_blendv_epi8(blockRotation, next, rotated);
+
+	// Drops find the highest spot below the block that something is in
+	// the way of, counting the floor as four full rows
+	__m256i isDrop = _mm256_cmpeq_epi16(action, _mm256_set1_epi16(ACTION_DROP));
+	if (!_mm256_testz_si256(isDrop, isDrop))
+	{
+		__m256i landing = zero;
+		end = highest + 3 < GRID_HEIGHT ? highest + 3 : GRID_HEIGHT;
+		for (int j = -4; j < end; j++)
+		{
+			__m256i row = j < 0 ? _mm256_set1_epi16((short)ENV_FULL_ROW)
+				: _mm256_loadu_si256((const __m256i*)&rows[j * stride + first]);
+			__m256i offset = _mm256_sub_epi16(blockY, _mm256_set1_epi16((short)j));
+			__m256i spot = _mm256_set1_epi16((short)(j + 1 + GRID_HEIGHT));
+			landing = landOn(landing, row, block.row0, offset, spot, 0);
+			landing = landOn(landing, row, block.row1, offset, spot, 1);
+			landing = landOn(landing, row, block.row2, offset, spot, 2);
+			landing = landOn(landing, row, block.row3, offset, spot, 3);
+		}
+		landing = _mm256_sub_epi16(landing, _mm256_set1_epi16(GRID_HEIGHT));
+		blockY = _mm256_blendv_epi8(blockY, landing, isDrop);
+	}
+
+	// Gravity, leaving lanes that hold to finish a lane at a time
+	BatchRows below = { under, around.row0, around.row1, around.row2 };
+	__m256i holding = _mm256_andnot_si256(_mm256_cmpeq_epi16(swappable, zero),
+		_mm256_cmpeq_epi16(action, _mm256_set1_epi16(ACTION_HOLD)));
+	__m256i falls = _mm256_andnot_si256(_mm256_or_si256(isDrop, holding), fitsRows(below, block));
+	__m256i merges = _mm256_andnot_si256(_mm256_or_si256(falls, holding), _mm256_cmpeq_epi16(zero, zero));
+	blockY = _mm256_add_epi16(blockY, falls);
+
+	_mm256_storeu_si256((__m256i*)&x[first], blockX);
+	_mm256_storeu_si256((__m256i*)&y[first], blockY);
+	_mm256_storeu_si256((__m256i*)&rotation[first], blockRotation);
+	_mm256_storeu_si256((__m256i*)&piece[first], block.row0);
+	_mm256_storeu_si256((__m256i*)&piece[stride + first], block.row1);
+	_mm256_storeu_si256((__m256i*)&piece[2 * stride + first], block.row2);
+	_mm256_storeu_si256((__m256i*)&piece[3 * stride + first], block.row3);
+
+	// Two bits per 16-bit lane
+	uint32_t slow = (uint32_t)_mm256_movemask_epi8(_mm256_or_si256(holding, merges));
+	uint32_t holds = (uint32_t)_mm256_movemask_epi8(holding);
+	while (slow != 0)
+	{
+		int bit = lowestBit(slow);
+		int i = first + bit / 2;
+		if (holds & (1u << bit))
+		{
+			holdLane(i);
+			fallLane(i);
+		}
+		else
+		{
+			mergeLane(i);
+		}
+		slow &= slow - 1;
+		slow &= slow - 1;
+	}
+}
+
+#else
+
+// Steps a batch of games a lane at a time where there's no AVX2
+void BatchEnvironment::stepBatch(int first)
+{
+	for (int i = first; i < first + ENV_BATCH; i++)
+	{
+		stepLane(i, actions[i]);
+	}
+}
+
+#endif
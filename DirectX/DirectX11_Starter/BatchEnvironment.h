@@ -0,0 +1,106 @@
+#ifndef BATCHENVIRONMENT_H
+#define BATCHENVIRONMENT_H
+
+#include "GameState.h"
+
+#include <stdint.h>
+#include <vector>
+
+// Number of games stepped together by one pass of the vector kernel.
+// Lanes are allocated in whole batches.
+#define ENV_BATCH 16
+
+// Empty columns kept on each side of a board row, so a block can move
+// or rotate off the edge and be caught by the walls without losing
+// cells off the end of the mask
+#define ENV_PAD 3
+
+// A board row with only its walls filled, in the padded layout
+#define ENV_WALLS ((uint16_t)~(FULL_ROW << ENV_PAD))
+
+// What a game does in one step, before gravity moves its block down
+enum EnvAction
+{
+	ACTION_NONE,
+	ACTION_LEFT,
+	ACTION_RIGHT,
+	ACTION_ROTATE,
+	ACTION_DROP,
+	ACTION_HOLD,
+	NUM_ACTIONS
+};
+
+// Many independent games for reinforcement learning, kept as structures
+// of arrays with one lane per game and stepped together. A step applies
+// one action to each game the way GameSimulation's move(), rotate(),
+// drop() and holdBlock() do, then moves its block down a row, merging it
+// with mergeBlock()'s rules when it can't fall any further. There is no
+// smooth movement, so a step is a whole cell.
+//
+// Board rows are padded with wall cells and the block is kept as row
+// masks already shifted to its column, so moving, rotating, dropping and
+// checking for collisions are all mask operations on ENV_BATCH lanes at
+// once with AVX2. Merging, holding and spawning touch the generator and
+// the bag, and happen on a fraction of the steps, so are done a lane at
+// a time. Games that top out start again from the next seed.
+class BatchEnvironment
+{
+public:
+	BatchEnvironment(int lanes, uint64_t seed = 0);
+
+	void reset(uint64_t seed);
+	void resetLane(int lane);
+	void step(const uint8_t* actions);
+	void getState(int lane, GameState& state) const;
+
+	int getLanes() const { return lanes; }
+	const int32_t* getRewards() const { return &rewards[0]; }
+	const uint8_t* getDone() const { return &done[0]; }
+	uint32_t getScore(int lane) const { return score[lane]; }
+	uint32_t getLines(int lane) const { return lines[lane]; }
+	uint32_t getPieces(int lane) const { return pieces[lane]; }
+	uint64_t getGames() const { return games; }
+	bool isVectorized() const { return vectorized; }
+	void setVectorized(bool enable);
+
+private:
+	int lanes;
+	int stride;
+	bool vectorized;
+	uint64_t games;
+
+	// Read and written by the vector kernel, in 16-bit lanes
+	std::vector<uint16_t> rows;		// GRID_HEIGHT rows of stride lanes
+	std::vector<uint16_t> piece;	// The block's 4 rows at its column
+	std::vector<int16_t> x;
+	std::vector<int16_t> y;
+	std::vector<int16_t> type;
+	std::vector<int16_t> rotation;
+	std::vector<int16_t> canSwap;
+	std::vector<uint8_t> actions;
+
+	// Only used a lane at a time
+	std::vector<int8_t> held;
+	std::vector<uint64_t> random;
+	std::vector<uint32_t> bag;
+	std::vector<uint8_t> bagIndex;
+	std::vector<uint64_t> seeds;
+	std::vector<uint32_t> score;
+	std::vector<uint32_t> lines;
+	std::vector<uint32_t> pieces;
+	std::vector<int32_t> rewards;
+	std::vector<uint8_t> done;
+
+	void startGame(int i);
+	void stepLane(int i, int action);
+	bool fits(int i, const uint16_t* masks, int blockY) const;
+	void getPiece(int i, uint16_t* masks) const;
+	void setPiece(int i, int blockType, int blockRotation, int blockX, int blockY);
+	void holdLane(int i);
+	void fallLane(int i);
+	void mergeLane(int i);
+	void spawnLane(int i);
+	void stepBatch(int first);
+};
+
+#endif
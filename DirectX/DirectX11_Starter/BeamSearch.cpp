@@ -0,0 +1,262 @@
+#include "BeamSearch.h"
+#include "Zobrist.h"
+
+#include <algorithm>
+
+// Orders ways of reaching the same position, best first
+static bool isBetter(int32_t valueA, const GameMove& rootA, int32_t valueB, const GameMove& rootB)
+{
+	if (valueA != valueB)
+	{
+		return valueA > valueB;
+	}
+	if (rootA.hold != rootB.hold)
+	{
+		return !rootA.hold;
+	}
+	if (rootA.rotation != rootB.rotation)
+	{
+		return rootA.rotation < rootB.rotation;
+	}
+	return rootA.x != rootB.x ? rootA.x < rootB.x : rootA.y < rootB.y;
+}
+
+// Orders positions by hash, best first among equal positions
+static bool byHash(const BeamNode& a, const BeamNode& b)
+{
+	if (a.hash != b.hash)
+	{
+		return a.hash < b.hash;
+	}
+	return isBetter(a.value, a.root, b.value, b.root);
+}
+
+// Orders distinct positions best first
+static bool byValue(const BeamNode& a, const BeamNode& b)
+{
+	return a.value != b.value ? a.value > b.value : a.hash < b.hash;
+}
+
+// Starts the helper threads. With threads 0, uses one thread per core,
+// counting the thread that calls search().
+BeamSearch::BeamSearch(int width, int depth, int threads)
+	: table(AGENT_TABLE_ENTRIES)
+{
+	setWidth(width);
+	setDepth(depth);
+	setWeights(DEFAULT_WEIGHTS);
+	scoreWeight = SCORE_WEIGHT;
+	if (threads <= 0)
+	{
+		threads = (int)std::thread::hardware_concurrency();
+		threads = threads > 0 ? threads : 1;
+	}
+	for (int i = 0; i < threads; i++)
+	{
+		workers.push_back(new Worker());
+	}
+
+	nextNode = 0;
+	round = 0;
+	running = 0;
+	level = 0;
+	stopping = false;
+	for (int i = 1; i < threads; i++)
+	{
+		helpers.push_back(std::thread(&BeamSearch::runHelper, this, i));
+	}
+}
+
+// Stops the helper threads
+BeamSearch::~BeamSearch()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	wake.notify_all();
+	for (size_t i = 0; i < helpers.size(); i++)
+	{
+		helpers[i].join();
+	}
+	for (size_t i = 0; i < workers.size(); i++)
+	{
+		delete workers[i];
+	}
+}
+
+// Sets the weights of the board features, NUM_FEATURES of them
+void BeamSearch::setWeights(const int32_t* pWeights)
+{
+	for (int i = 0; i < NUM_FEATURES; i++)
+	{
+		weights[i] = pWeights[i];
+	}
+}
+
+// Finds the best move from a position, returning false if there is
+// none. Blocks until the search is done.
+bool BeamSearch::search(const GameState& state, GameMove& move)
+{
+	if (state.isGameOver())
+	{
+		return false;
+	}
+
+	BeamNode root;
+	root.state = state;
+	root.hash = zobristHash(state);
+	root.reward = 0;
+	root.value = 0;
+	root.root = GameMove();
+	beam.assign(1, root);
+	table.newSearch();
+
+	for (level = 0; level < depth; level++)
+	{
+		expandLevel();
+
+		// Keep the last level if every line has ended
+		if (candidates.empty())
+		{
+			if (level == 0)
+			{
+				return false;
+			}
+			break;
+		}
+		selectBeam();
+	}
+	move = beam[0].root;
+	return true;
+}
+
+// Expands every position in the beam, sharing them out between the
+// workers, and gathers the results into the candidates
+void BeamSearch::expandLevel()
+{
+	nextNode = 0;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		round++;
+		running = (int)helpers.size();
+	}
+	wake.notify_all();
+	expand(*workers[0]);
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		done.wait(lock, [this] { return running == 0; });
+	}
+
+	candidates.clear();
+	for (size_t i = 0; i < workers.size(); i++)
+	{
+		candidates.insert(candidates.end(), workers[i]->children.begin(), workers[i]->children.end());
+	}
+}
+
+// Takes positions from the beam until there are none left, trying
+// every placement from each one. A child no better than one already
+// kept for its position is dropped, as selectBeam() would drop it
+// anyway. Every child dropped has a better one in the candidates, so
+// which thread gets to a position first doesn't change the result.
+void BeamSearch::expand(Worker& worker)
+{
+	worker.children.clear();
+	int count = (int)beam.size();
+	for (int i = nextNode++; i < count; i = nextNode++)
+	{
+		const BeamNode& node = beam[i];
+		size_t first = worker.children.size();
+		worker.states.clear();
+		for (int hold = 0; hold < 2; hold++)
+		{
+			int placements = worker.finder.find(node.state, hold != 0);
+			for (int p = 0; p < placements; p++)
+			{
+				BeamNode child;
+				child.root = worker.finder.getPlacement(p).move;
+				child.state = node.state;
+				if (child.state.apply(child.root) < 0)
+				{
+					continue;
+				}
+				child.hash = zobristUpdate(node.hash, node.state, child.state);
+				child.reward = node.reward + (int32_t)(child.state.score - node.state.score) * scoreWeight;
+				if (level > 0)
+				{
+					child.root = node.root;
+				}
+
+				// The same position has the same evaluation, so the reward decides
+				TableEntry entry;
+				if (table.probe(child.hash, entry) && entry.generation == table.getGeneration()
+					&& entry.depth == level + 1 && !isBetter(child.reward, child.root, entry.value, entry.move))
+				{
+					continue;
+				}
+				entry.value = child.reward;
+				entry.depth = (uint8_t)(level + 1);
+				entry.move = child.root;
+				table.store(child.hash, entry);
+
+				worker.children.push_back(child);
+				worker.states.push_back(child.state);
+			}
+		}
+
+		// Score the new boards together so the vector kernel gets whole batches
+		worker.scores.resize(worker.states.size());
+		evaluateBoards(worker.states.data(), (int)worker.states.size(), weights, worker.scores.data());
+		for (size_t c = 0; c < worker.states.size(); c++)
+		{
+			BeamNode& child = worker.children[first + c];
+			child.value = child.reward + (child.state.isGameOver() ? LOSS_VALUE : worker.scores[c]);
+		}
+	}
+}
+
+// Keeps the best of each distinct position, then the best width of them
+void BeamSearch::selectBeam()
+{
+	std::sort(candidates.begin(), candidates.end(), byHash);
+	size_t distinct = 0;
+	for (size_t i = 0; i < candidates.size(); i++)
+	{
+		if (distinct == 0 || candidates[i].hash != candidates[distinct - 1].hash)
+		{
+			candidates[distinct++] = candidates[i];
+		}
+	}
+	candidates.resize(distinct);
+
+	size_t kept = std::min(distinct, (size_t)width);
+	std::partial_sort(candidates.begin(), candidates.begin() + kept, candidates.end(), byValue);
+	beam.assign(candidates.begin(), candidates.begin() + kept);
+}
+
+// Helper thread loop, expands positions each time a level starts
+void BeamSearch::runHelper(int index)
+{
+	int seen = 0;
+	while (true)
+	{
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			wake.wait(lock, [this, seen] { return round != seen || stopping; });
+			if (stopping)
+			{
+				return;
+			}
+			seen = round;
+		}
+
+		expand(*workers[index]);
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			running--;
+		}
+		done.notify_one();
+	}
+}
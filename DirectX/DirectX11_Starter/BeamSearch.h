@@ -0,0 +1,108 @@
+#ifndef BEAMSEARCH_H
+#define BEAMSEARCH_H
+
+#include "Agent.h"
+#include "Evaluator.h"
+#include "GameState.h"
+#include "PlacementFinder.h"
+#include "TranspositionTable.h"
+
+#include <stdint.h>
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+// Default number of positions kept after each placement, and number
+// of placements looked ahead
+#define BEAM_WIDTH 64
+#define BEAM_DEPTH 3
+
+// Default value of a point of game score, weighed against the board
+// evaluation. Line clears are worth their LINE_SCORES entry times this.
+#define SCORE_WEIGHT 10
+
+// Value of a position where the game is over
+#define LOSS_VALUE (INT32_MIN / 2)
+
+// A position in the beam and the first move of the line that led to it
+struct BeamNode
+{
+	GameState state;
+	uint64_t hash;
+	int32_t reward;		// Weighted score gained since the root
+	int32_t value;		// Reward plus the evaluation of the board
+	GameMove root;
+};
+
+// Picks moves by beam search: every placement of the active and the
+// held block is tried from each position in the beam, and only the
+// best few results by board evaluation and score gained are kept for
+// the next placement. The spawn order is known ahead from the state's
+// generator, so every level searches the real next block. Positions
+// reached in more than one way are kept once.
+//
+// The positions of a level are expanded in parallel by a pool of
+// worker threads plus the thread calling search(). Ties are broken
+// by position, so the result doesn't depend on the number of threads.
+// The threads share a table of the positions each level has reached,
+// so a position reached again with no more reward, from the same
+// parent or another, on this thread or another, is dropped before
+// its board is evaluated.
+class BeamSearch : public Agent
+{
+public:
+	BeamSearch(int width = BEAM_WIDTH, int depth = BEAM_DEPTH, int threads = 0);
+	~BeamSearch();
+
+	bool search(const GameState& state, GameMove& move);
+	void setWidth(int pWidth) { width = pWidth > 0 ? pWidth : 1; }
+	void setDepth(int pDepth) { depth = pDepth > 0 ? pDepth : 1; }
+	void setWeights(const int32_t* pWeights);
+	void setScoreWeight(int32_t pScoreWeight) { scoreWeight = pScoreWeight; }
+	int getWidth() const { return width; }
+	int getDepth() const { return depth; }
+	int32_t getScoreWeight() const { return scoreWeight; }
+	int getThreads() const { return (int)workers.size(); }
+
+private:
+	// What each thread expands into, kept between searches to avoid allocating
+	struct Worker
+	{
+		PlacementFinder finder;
+		std::vector<BeamNode> children;
+		std::vector<GameState> states;
+		std::vector<int32_t> scores;
+	};
+
+	int width;
+	int depth;
+	int32_t weights[NUM_FEATURES];
+	int32_t scoreWeight;
+	std::vector<Worker*> workers;
+	std::vector<BeamNode> beam;
+	std::vector<BeamNode> candidates;
+	TranspositionTable table;
+
+	// Hands the positions of a level out to the helper threads
+	std::vector<std::thread> helpers;
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::condition_variable done;
+	std::atomic<int> nextNode;
+	int round;
+	int running;
+	int level;
+	bool stopping;
+
+	void expandLevel();
+	void expand(Worker& worker);
+	void selectBeam();
+	void runHelper(int index);
+
+	BeamSearch(const BeamSearch& rhs);
+	BeamSearch& operator=(const BeamSearch& rhs);
+};
+
+#endif
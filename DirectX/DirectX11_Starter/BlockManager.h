@@ -2,95 +2,86 @@
 #define BLOCKMANAGER_H
 #endif
 
+#include "Autoplayer.h"
 #include "GameObject.h"
+#include "GameSimulation.h"
 #include "ParticleSystem.h"
+#include "Replay.h"
+#include "RewindBuffer.h"
 
 #include <stdlib.h>
 #include <math.h>
 #include <vector>
+#include <string>
 
 using namespace std;
 
-// Values for the game
-#define GRID_WIDTH 10
-#define GRID_HEIGHT 20
-#define SLOW_FALL_SPEED 2.0f
-#define FAST_FALL_SPEED 8.0f
-#define SIDE_SPEED 5.0f
-#define SPEED_INCREASE 0.01f
-#define ROTATION_SPEED 12.0f
 #define PI 3.1415926535f
 
+// Longest stretch of time simulated in a single frame
+#define MAX_FRAME_TIME 0.25f
+
 // A block object in the game
 struct Block
 {
 	GameObject* gameObject;
 	bool threeByThree;
-	bool* localGrid;
-	bool* tempGrid;
-	bool* grid;
-};
-
-// A direction to move a block
-enum MoveDirection
-{
-	LEFT,
-	RIGHT,
-	DOWN
 };
 
-// Manages interactions with the blocks in the game
+// Runs a GameSimulation at its fixed tick rate and draws its blocks.
+// Every game is recorded to a replay file that can be played back,
+// and the last few seconds of play can be rewound. Games can also be
+// played by an Autoplayer in place of the player's inputs.
 class BlockManager
 {
 public:
-	BlockManager(Block* blocks, int numBlocks, vector<GameObject*> cubes, XMFLOAT3 min, XMFLOAT3 holdPos, float blockWidth, ParticleSystem* particleSystem);
+	BlockManager(Block* blocks, vector<GameObject*> cubes, XMFLOAT3 min, XMFLOAT3 holdPos, float blockWidth, ParticleSystem* particleSystem);
 	~BlockManager();
 	
 	void reset();
+	bool playReplay(const char* path);
+	bool replayLastGame() { return playReplay(replayPath.c_str()); }
 	void update(float dt);
 	void draw(ID3D11DeviceContext* deviceContext, ID3D11Buffer* cBuffer, VertexShaderConstantBufferLayout* cBufferData);
 
-	bool canMove(MoveDirection direction);
-	bool canOccupy(int x, int y);
-
-	void spawnFallingBlock();
-	void resetActiveBlock();
 	void move(MoveDirection direction);
 	void drop();
 	void rotate();
 	void holdBlock();
-	void mergeBlock();
-	void checkLines(int min, int max);
+	void setFastFall(bool fastFall);
+	void setRewinding(bool pRewinding) { rewinding = pRewinding; }
+	void setAutoplaying(bool pAutoplaying, Agent* agent = NULL);
+	bool isAutoplaying() { return autoplaying; }
+	void setPerfectClearing(bool perfectClearing);
+	bool isPerfectClearing() { return autoplayer && autoplayer->isPerfectClearing(); }
 	XMFLOAT2 getGhostPos();
-	bool isGameOver() { return gameOver; }
-	int getScore() { return score; }
-
-	float fallSpeed = SLOW_FALL_SPEED;
+	bool isGameOver() { return simulation.isGameOver(); }
+	int getScore() { return simulation.getScore(); }
+	const GameSimulation& getSimulation() const { return simulation; }
 
 private:
+	GameSimulation simulation;
+	ReplayRecorder recorder;
+	ReplayPlayer player;
+	RewindBuffer history;
+	Autoplayer* autoplayer = NULL;
+	std::string replayPath;
+	bool replaying = false;
+	bool rewinding = false;
+	bool autoplaying = false;
 	Block* blocks;
-	bool* gameGrid;
 	vector<GameObject*> cubes;
-	int* typeOrder;
-	int* scores;
-	int score = 0;
-	bool hacked = false;
 	
 	XMFLOAT3 min;
 	XMFLOAT3 holdPos;
 	float blockWidth;
-	float rotation = 0;
-	bool canSwap = true;
-	bool gameOver = false;
-	int numBlocks;
-	int targetX;
-	int targetY;
-	int activeId = -1;
-	int heldId = -1;
+	float elapsed = 0;
+	int input = 0;
 
-	void copy(bool* src, bool* dest, int num);
-	void shuffle();
+	void placeActiveBlock();
 
 	ParticleSystem* particleSystem;
-};
 
+	BlockManager(const BlockManager& rhs);
+	BlockManager& operator=(const BlockManager& rhs);
+};
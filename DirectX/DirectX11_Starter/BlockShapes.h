@@ -0,0 +1,160 @@
+#ifndef BLOCKSHAPES_H
+#define BLOCKSHAPES_H
+
+#include "GameBoard.h"
+
+// Number of different block types
+#define NUM_BLOCK_TYPES 7
+
+// Number of orientations of each block type
+#define NUM_ROTATIONS 4
+
+// Width of the grid of each block type
+constexpr int BLOCK_SIZES[NUM_BLOCK_TYPES] = { 3, 3, 3, 4, 3, 4, 3 };
+
+// Spawn grids of each block type, bottom row first
+constexpr bool BLOCK_GRIDS[NUM_BLOCK_TYPES][16] =
+{
+	// J block
+	{
+		true, true, true,
+		true, false, false,
+		false, false, false
+	},
+
+	// L block
+	{
+		true, true, true,
+		false, false, true,
+		false, false, false
+	},
+
+	// Left stairs block
+	{
+		false, true, true,
+		true, true, false,
+		false, false, false
+	},
+
+	// Long block
+	{
+		false, false, false, false,
+		true, true, true, true,
+		false, false, false, false,
+		false, false, false, false
+	},
+
+	// Right stairs block
+	{
+		true, true, false,
+		false, true, true,
+		false, false, false
+	},
+
+	// Square block
+	{
+		false, false, false, false,
+		false, true, true, false,
+		false, true, true, false,
+		false, false, false, false
+	},
+
+	// Stairs block
+	{
+		true, true, true,
+		false, true, false,
+		false, false, false
+	}
+};
+
+// Checks whether or not a block grid has a cell at the given position
+// after being rotated the given number of quarter turns. Each turn moves
+// the cell at (size - 1 - j, i) to (i, j).
+constexpr bool blockCell(int type, int rotation, int i, int j)
+{
+	return i >= BLOCK_SIZES[type] || j >= BLOCK_SIZES[type] ? false
+		: rotation == 0 ? BLOCK_GRIDS[type][i + j * BLOCK_SIZES[type]]
+		: blockCell(type, rotation - 1, BLOCK_SIZES[type] - 1 - j, i);
+}
+
+// Mask of the cells in row j of a rotated block
+constexpr uint16_t blockRow(int type, int rotation, int j)
+{
+	return (uint16_t)(blockCell(type, rotation, 0, j) | blockCell(type, rotation, 1, j) << 1
+		| blockCell(type, rotation, 2, j) << 2 | blockCell(type, rotation, 3, j) << 3);
+}
+
+// Mask of the cells in column i of a rotated block
+constexpr int blockColumn(int type, int rotation, int i)
+{
+	return blockCell(type, rotation, i, 0) | blockCell(type, rotation, i, 1) << 1
+		| blockCell(type, rotation, i, 2) << 2 | blockCell(type, rotation, i, 3) << 3;
+}
+
+// Mask of the non-empty rows of a rotated block
+constexpr int blockRowsUsed(int type, int rotation)
+{
+	return (blockRow(type, rotation, 0) != 0) | (blockRow(type, rotation, 1) != 0) << 1
+		| (blockRow(type, rotation, 2) != 0) << 2 | (blockRow(type, rotation, 3) != 0) << 3;
+}
+
+// Mask of the non-empty columns of a rotated block
+constexpr int blockColumnsUsed(int type, int rotation)
+{
+	return blockRow(type, rotation, 0) | blockRow(type, rotation, 1)
+		| blockRow(type, rotation, 2) | blockRow(type, rotation, 3);
+}
+
+// Index of the lowest and highest set bit of a 4-bit mask, -1 if empty
+constexpr int8_t lowBit(int mask)
+{
+	return mask & 1 ? 0 : mask & 2 ? 1 : mask & 4 ? 2 : mask & 8 ? 3 : -1;
+}
+constexpr int8_t highBit(int mask)
+{
+	return mask & 8 ? 3 : mask & 4 ? 2 : mask & 2 ? 1 : mask & 1 ? 0 : -1;
+}
+
+// Number of set bits in a mask
+constexpr int bitCount(int mask)
+{
+	return mask == 0 ? 0 : (mask & 1) + bitCount(mask >> 1);
+}
+
+#define BLOCK_SHAPE(type, rotation) \
+	{ \
+		{ blockRow(type, rotation, 0), blockRow(type, rotation, 1), blockRow(type, rotation, 2), blockRow(type, rotation, 3) }, \
+		lowBit(blockColumnsUsed(type, rotation)), highBit(blockColumnsUsed(type, rotation)), \
+		lowBit(blockRowsUsed(type, rotation)), highBit(blockRowsUsed(type, rotation)), \
+		{ lowBit(blockColumn(type, rotation, 0)), lowBit(blockColumn(type, rotation, 1)), \
+		  lowBit(blockColumn(type, rotation, 2)), lowBit(blockColumn(type, rotation, 3)) } \
+	}
+#define BLOCK_ROTATIONS(type) \
+	{ BLOCK_SHAPE(type, 0), BLOCK_SHAPE(type, 1), BLOCK_SHAPE(type, 2), BLOCK_SHAPE(type, 3) }
+
+// Every orientation of every block type, built at compile time.
+// Rotating a block is a step to the next entry of its row.
+constexpr BlockShape BLOCK_SHAPES[NUM_BLOCK_TYPES][NUM_ROTATIONS] =
+{
+	BLOCK_ROTATIONS(0),
+	BLOCK_ROTATIONS(1),
+	BLOCK_ROTATIONS(2),
+	BLOCK_ROTATIONS(3),
+	BLOCK_ROTATIONS(4),
+	BLOCK_ROTATIONS(5),
+	BLOCK_ROTATIONS(6)
+};
+
+#undef BLOCK_ROTATIONS
+#undef BLOCK_SHAPE
+
+// Number of cells in a block orientation
+constexpr int shapeCells(const BlockShape& shape)
+{
+	return bitCount(shape.rows[0]) + bitCount(shape.rows[1]) + bitCount(shape.rows[2]) + bitCount(shape.rows[3]);
+}
+
+static_assert(shapeCells(BLOCK_SHAPES[0][1]) == 4 && shapeCells(BLOCK_SHAPES[3][1]) == 4 && shapeCells(BLOCK_SHAPES[5][3]) == 4,
+	"Block shapes must have four cells in every orientation");
+
+#endif
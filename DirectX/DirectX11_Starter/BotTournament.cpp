@@ -0,0 +1,223 @@
+#include "BotTournament.h"
+#include "BeamSearch.h"
+#include "MctsAgent.h"
+
+#include <algorithm>
+#include <string.h>
+#include <string>
+
+// A bot tournaments can pick by name
+struct RegisteredBot
+{
+	std::string name;
+	BotFactory create;
+};
+
+// Built-in bots: beam searches of growing size, and a quick tree search
+// that depends on timing, so its games change from run to run
+static Agent* createGreedy() { return new BeamSearch(1, 1, 1); }
+static Agent* createBeam4x2() { return new BeamSearch(4, 2, 1); }
+static Agent* createBeam8x2() { return new BeamSearch(8, 2, 1); }
+static Agent* createBeam16x2() { return new BeamSearch(16, 2, 1); }
+static Agent* createBeam32x3() { return new BeamSearch(32, 3, 1); }
+static Agent* createMcts10() { return new MctsAgent(10, 1); }
+
+// Retrieves the list of bots, registering the built-in ones the first time
+static std::vector<RegisteredBot>& getBots()
+{
+	static std::vector<RegisteredBot> bots;
+	if (bots.empty())
+	{
+		const RegisteredBot builtIn[] = {
+			{ "greedy", createGreedy },
+			{ "beam-4x2", createBeam4x2 },
+			{ "beam-8x2", createBeam8x2 },
+			{ "beam-16x2", createBeam16x2 },
+			{ "beam-32x3", createBeam32x3 },
+			{ "mcts-10ms", createMcts10 }
+		};
+		bots.assign(builtIn, builtIn + sizeof(builtIn) / sizeof(builtIn[0]));
+	}
+	return bots;
+}
+
+// Adds a bot, replacing any registered under the same name
+void registerBot(const char* name, BotFactory create)
+{
+	std::vector<RegisteredBot>& bots = getBots();
+	int found = findBot(name);
+	if (found >= 0)
+	{
+		bots[found].create = create;
+		return;
+	}
+	RegisteredBot bot = { name, create };
+	bots.push_back(bot);
+}
+
+// Finds a registered bot by name, returning -1 if there is none
+int findBot(const char* name)
+{
+	std::vector<RegisteredBot>& bots = getBots();
+	for (size_t i = 0; i < bots.size(); i++)
+	{
+		if (bots[i].name == name)
+		{
+			return (int)i;
+		}
+	}
+	return -1;
+}
+
+// Retrieves the number of registered bots
+int getBotCount()
+{
+	return (int)getBots().size();
+}
+
+// Retrieves the name of a registered bot
+const char* getBotName(int bot)
+{
+	return getBots()[bot].name.c_str();
+}
+
+// Makes a new instance of a registered bot
+Agent* createBot(int bot)
+{
+	return getBots()[bot].create();
+}
+
+BotTournament::BotTournament(const std::vector<int>& pBots, const TournamentSettings& pSettings, int threads)
+	: bots(pBots), elo((int)pBots.size()), glicko((int)pBots.size())
+{
+	settings = pSettings;
+	agents.resize(threads, std::vector<Agent*>(bots.size(), (Agent*)NULL));
+
+	// Round by round, every pair once a round
+	for (int r = 0; r < settings.rounds; r++)
+	{
+		for (int a = 0; a < (int)bots.size(); a++)
+		{
+			for (int b = a + 1; b < (int)bots.size(); b++)
+			{
+				MatchRecord match;
+				match.a = a;
+				match.b = b;
+				matches.push_back(match);
+			}
+		}
+	}
+	Standing empty = { 0, 0, 0, 0, 0 };
+	standings.assign(bots.size(), empty);
+}
+
+BotTournament::~BotTournament()
+{
+	for (size_t t = 0; t < agents.size(); t++)
+	{
+		for (size_t b = 0; b < agents[t].size(); b++)
+		{
+			delete agents[t][b];
+		}
+	}
+}
+
+// Plays every match and rates the bots from the results
+void BotTournament::run(WorkStealingPool& pool)
+{
+	pool.run((int64_t)matches.size(), *this);
+	rate();
+}
+
+// Plays both games of one match
+void BotTournament::runItem(int thread, int64_t index)
+{
+	MatchRecord& match = matches[(size_t)index];
+	std::vector<Agent*>& threadAgents = agents[thread];
+	int players[2] = { match.a, match.b };
+	for (int p = 0; p < 2; p++)
+	{
+		if (threadAgents[players[p]] == NULL)
+		{
+			threadAgents[players[p]] = createBot(bots[players[p]]);
+		}
+	}
+
+	int pairs = (int)(bots.size() * (bots.size() - 1) / 2);
+	VersusMatch game(settings.firstSeed + (uint64_t)(index / pairs), settings.attack);
+	match.games[0] = game.play(*threadAgents[match.a], *threadAgents[match.b], settings.pieces);
+	match.games[1] = game.play(*threadAgents[match.b], *threadAgents[match.a], settings.pieces);
+}
+
+// Totals the standings and rates every game in schedule order
+void BotTournament::rate()
+{
+	int pairs = (int)(bots.size() * (bots.size() - 1) / 2);
+	for (size_t m = 0; m < matches.size(); m++)
+	{
+		const MatchRecord& match = matches[m];
+		for (int g = 0; g < 2; g++)
+		{
+			// In the second game b moved first, so player 0 was b
+			const VersusResult& result = match.games[g];
+			int first = g == 0 ? match.a : match.b;
+			int second = g == 0 ? match.b : match.a;
+			double scoreA = result.winner < 0 ? 0.5 : ((result.winner == 0) == (first == match.a) ? 1 : 0);
+
+			Standing& a = standings[match.a];
+			Standing& b = standings[match.b];
+			a.wins += scoreA == 1;
+			a.draws += scoreA == 0.5;
+			a.losses += scoreA == 0;
+			b.wins += scoreA == 0;
+			b.draws += scoreA == 0.5;
+			b.losses += scoreA == 1;
+			standings[first].sent += result.sent[0];
+			standings[first].lines += result.lines[0];
+			standings[second].sent += result.sent[1];
+			standings[second].lines += result.lines[1];
+
+			elo.addGame(match.a, match.b, scoreA);
+			glicko.addGame(match.a, match.b, scoreA);
+		}
+		if ((m + 1) % pairs == 0)
+		{
+			glicko.endPeriod();
+		}
+	}
+}
+
+// Retrieves the blocks placed over every game
+uint64_t BotTournament::getPieces() const
+{
+	uint64_t pieces = 0;
+	for (size_t m = 0; m < matches.size(); m++)
+	{
+		pieces += 2 * ((uint64_t)matches[m].games[0].pieces + matches[m].games[1].pieces);
+	}
+	return pieces;
+}
+
+// Writes the standings, best Glicko rating first
+void BotTournament::print(FILE* out) const
+{
+	std::vector<int> order(bots.size());
+	for (size_t i = 0; i < order.size(); i++)
+	{
+		order[i] = (int)i;
+	}
+	std::stable_sort(order.begin(), order.end(), [this](int a, int b) { return glicko.getRating(a) > glicko.getRating(b); });
+
+	fprintf(out, "%-12s %7s %7s %7s %7s %7s %8s %7s %14s\n", "bot", "games", "wins", "draws", "losses", "score",
+		"sent/game", "elo", "glicko");
+	for (size_t i = 0; i < order.size(); i++)
+	{
+		int bot = order[i];
+		const Standing& standing = standings[bot];
+		int games = standing.wins + standing.draws + standing.losses;
+		double score = games > 0 ? (standing.wins + 0.5 * standing.draws) / games : 0;
+		fprintf(out, "%-12s %7d %7d %7d %7d %6.1f%% %8.1f %7.0f %7.0f +-%4.0f\n", getBotName(bots[bot]), games,
+			standing.wins, standing.draws, standing.losses, 100 * score, games > 0 ? (double)standing.sent / games : 0,
+			elo.getRating(bot), glicko.getRating(bot), 2 * glicko.getDeviation(bot));
+	}
+}
@@ -0,0 +1,93 @@
+#ifndef BOTTOURNAMENT_H
+#define BOTTOURNAMENT_H
+
+#include "Agent.h"
+#include "Ratings.h"
+#include "VersusMatch.h"
+#include "WorkStealingPool.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <vector>
+
+// Makes a new instance of a bot, searching on the calling thread only
+typedef Agent* (*BotFactory)();
+
+// Adds a bot that tournaments can pick by name. The built-in bots are
+// registered from the start.
+void registerBot(const char* name, BotFactory create);
+
+// Finds a registered bot by name, returning -1 if there is none
+int findBot(const char* name);
+
+int getBotCount();
+const char* getBotName(int bot);
+Agent* createBot(int bot);
+
+// How a tournament is played
+struct TournamentSettings
+{
+	int rounds;			// Matches every pair of bots plays
+	uint64_t firstSeed;	// Round r uses seed firstSeed + r
+	uint32_t pieces;	// Most blocks per player, see VersusMatch
+	AttackTable attack;	// Garbage sent for clears
+};
+
+// Plays a round robin of versus matches between registered bots across
+// a WorkStealingPool and rates them. Every pair plays one match a round,
+// a match being two games on the same seed with the bots swapping who
+// moves first, so neither is dealt better blocks or gets the first move
+// more often.
+//
+// Each thread makes its own instance of each bot the first time it needs
+// one. Results are kept by match and rated in schedule order once the
+// run is over, so the ratings come out the same whatever the threads.
+// Elo is updated game by game; Glicko-2 takes each round as a rating
+// period.
+class BotTournament : public PoolJob
+{
+public:
+	BotTournament(const std::vector<int>& bots, const TournamentSettings& settings, int threads);
+	~BotTournament();
+
+	void run(WorkStealingPool& pool);
+	void runItem(int thread, int64_t index);
+	void print(FILE* out) const;
+
+	int64_t getMatches() const { return (int64_t)matches.size(); }
+	uint64_t getPieces() const;
+
+private:
+	// Who played in a match and how both games went
+	struct MatchRecord
+	{
+		int a;
+		int b;
+		VersusResult games[2];	// a moving first, then b moving first
+	};
+
+	// Standing of a bot in the tournament
+	struct Standing
+	{
+		int wins;
+		int draws;
+		int losses;
+		uint64_t sent;
+		uint64_t lines;
+	};
+
+	std::vector<int> bots;
+	TournamentSettings settings;
+	std::vector<std::vector<Agent*> > agents;	// Per thread, per bot
+	std::vector<MatchRecord> matches;
+	std::vector<Standing> standings;
+	EloRatings elo;
+	GlickoRatings glicko;
+
+	void rate();
+
+	BotTournament(const BotTournament& rhs);
+	BotTournament& operator=(const BotTournament& rhs);
+};
+
+#endif
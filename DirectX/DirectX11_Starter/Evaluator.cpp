@@ -0,0 +1,200 @@
+#include "Evaluator.h"
+#include "BitOps.h"
+
+const int32_t DEFAULT_WEIGHTS[NUM_FEATURES] = { -510, -20, -357, -40, -30, -90, -20, -184 };
+
+// Mask of the transitions between the GRID_WIDTH + 2 cells of a row
+// including both walls
+#define WALLED_ROW ((1 << (GRID_WIDTH + 1)) - 1)
+
+// Columns with a filled cell to their left, or against the left wall
+#define LEFT_FILLED(row) (((row) << 1) | 1)
+
+// Columns with a filled cell to their right, or against the right wall
+#define RIGHT_FILLED(row) (((row) >> 1) | (1 << (GRID_WIDTH - 1)))
+
+// Counts the features of the board rows of a state. Works down from the
+// top one row at a time with whole-row masks, so no feature needs the
+// column heights themselves: a column is taller than a row exactly when
+// it has a filled cell in or above that row.
+void getBoardFeatures(const GameState& state, int32_t* features)
+{
+	uint32_t holes[GRID_HEIGHT];
+	uint32_t covered = 0;
+	uint32_t above = 0;
+	for (int i = 0; i < NUM_FEATURES; i++)
+	{
+		features[i] = 0;
+	}
+	for (int j = GRID_HEIGHT - 1; j >= 0; j--)
+	{
+		uint32_t row = state.rows[j];
+		uint32_t under = row | covered;
+		uint32_t walled = (row << 1) | 1 | (1 << (GRID_WIDTH + 1));
+		holes[j] = covered & ~row;
+		features[FEATURE_HEIGHT] += popCount(under);
+		features[FEATURE_MAX_HEIGHT] += under != 0;
+		features[FEATURE_HOLES] += popCount(holes[j]);
+		features[FEATURE_ROW_TRANSITIONS] += popCount((walled ^ (walled >> 1)) & WALLED_ROW);
+		features[FEATURE_COLUMN_TRANSITIONS] += popCount(row ^ above);
+		features[FEATURE_WELLS] += popCount(~under & LEFT_FILLED(row) & RIGHT_FILLED(row) & FULL_ROW);
+		features[FEATURE_BUMPINESS] += popCount((under ^ (under >> 1)) & (FULL_ROW >> 1));
+		covered = under;
+		above = row;
+	}
+	features[FEATURE_COLUMN_TRANSITIONS] += popCount(~above & FULL_ROW);
+
+	uint32_t holesBelow = 0;
+	for (int j = 0; j < GRID_HEIGHT; j++)
+	{
+		features[FEATURE_COVERED] += popCount(state.rows[j] & holesBelow);
+		holesBelow |= holes[j];
+	}
+}
+
+// Scores one board as the weighted sum of its features
+int32_t evaluateBoard(const GameState& state, const int32_t* weights)
+{
+	int32_t features[NUM_FEATURES];
+	getBoardFeatures(state, features);
+	int32_t score = 0;
+	for (int i = 0; i < NUM_FEATURES; i++)
+	{
+		score += weights[i] * features[i];
+	}
+	return score;
+}
+
+#ifdef AVX2_KERNELS
+
+static const bool vectorEvaluator = hasAvx2();
+
+// Counts the bits of each 16-bit lane, looking up a nibble at a time
+AVX2_FUNCTION static inline __m256i popCount16(__m256i v)
+{
+	const __m256i table = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+		0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+	const __m256i nibble = _mm256_set1_epi8(0x0F);
+	__m256i low = _mm256_shuffle_epi8(table, _mm256_and_si256(v, nibble));
+	__m256i high = _mm256_shuffle_epi8(table, _mm256_and_si256(_mm256_srli_epi16(v, 4), nibble));
+	return _mm256_maddubs_epi16(_mm256_add_epi8(low, high), _mm256_set1_epi8(1));
+}
+
+// Adds the weighted features of 16 boards to two vectors of 8 scores
+AVX2_FUNCTION static inline void addWeighted(__m256i feature, int32_t weight, __m256i& low, __m256i& high)
+{
+	__m256i scale = _mm256_set1_epi32(weight);
+	low = _mm256_add_epi32(low, _mm256_mullo_epi32(_mm256_cvtepi16_epi32(_mm256_castsi256_si128(feature)), scale));
+	high = _mm256_add_epi32(high, _mm256_mullo_epi32(_mm256_cvtepi16_epi32(_mm256_extracti128_si256(feature, 1)), scale));
+}
+
+// Scores EVAL_BATCH boards at once, with one board in each 16-bit lane.
+// Follows getBoardFeatures() step for step. Boards past count are empty
+// and their scores are dropped.
+AVX2_FUNCTION static void evaluateBatch(const GameState* states, int count, const int32_t* weights, int32_t* scores)
+{
+	alignas(32) uint16_t rows[GRID_HEIGHT][EVAL_BATCH];
+	for (int b = 0; b < EVAL_BATCH; b++)
+	{
+		for (int j = 0; j < GRID_HEIGHT; j++)
+		{
+			rows[j][b] = b < count ? states[b].rows[j] : 0;
+		}
+	}
+
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i one = _mm256_set1_epi16(1);
+	const __m256i fullRow = _mm256_set1_epi16(FULL_ROW);
+	const __m256i walledRow = _mm256_set1_epi16(WALLED_ROW);
+	const __m256i walls = _mm256_set1_epi16(1 | (1 << (GRID_WIDTH + 1)));
+	const __m256i rightWall = _mm256_set1_epi16(1 << (GRID_WIDTH - 1));
+	const __m256i pairs = _mm256_set1_epi16(FULL_ROW >> 1);
+
+	__m256i holes[GRID_HEIGHT];
+	__m256i features[NUM_FEATURES];
+	for (int i = 0; i < NUM_FEATURES; i++)
+	{
+		features[i] = zero;
+	}
+	__m256i covered = zero;
+	__m256i above = zero;
+	for (int j = GRID_HEIGHT - 1; j >= 0; j--)
+	{
+		__m256i row = _mm256_load_si256((const __m256i*)rows[j]);
+		__m256i under = _mm256_or_si256(row, covered);
+		__m256i walled = _mm256_or_si256(_mm256_slli_epi16(row, 1), walls);
+		holes[j] = _mm256_andnot_si256(row, covered);
+		features[FEATURE_HEIGHT] = _mm256_add_epi16(features[FEATURE_HEIGHT], popCount16(under));
+		features[FEATURE_MAX_HEIGHT] = _mm256_add_epi16(features[FEATURE_MAX_HEIGHT],
+			_mm256_add_epi16(one, _mm256_cmpeq_epi16(under, zero)));
+		features[FEATURE_HOLES] = _mm256_add_epi16(features[FEATURE_HOLES], popCount16(holes[j]));
+		features[FEATURE_ROW_TRANSITIONS] = _mm256_add_epi16(features[FEATURE_ROW_TRANSITIONS],
+			popCount16(_mm256_and_si256(_mm256_xor_si256(walled, _mm256_srli_epi16(walled, 1)), walledRow)));
+		features[FEATURE_COLUMN_TRANSITIONS] = _mm256_add_epi16(features[FEATURE_COLUMN_TRANSITIONS],
+			popCount16(_mm256_xor_si256(row, above)));
+		__m256i sides = _mm256_and_si256(_mm256_or_si256(_mm256_slli_epi16(row, 1), one),
+			_mm256_or_si256(_mm256_srli_epi16(row, 1), rightWall));
+		features[FEATURE_WELLS] = _mm256_add_epi16(features[FEATURE_WELLS],
+			popCount16(_mm256_andnot_si256(under, _mm256_and_si256(sides, fullRow))));
+		features[FEATURE_BUMPINESS] = _mm256_add_epi16(features[FEATURE_BUMPINESS],
+			popCount16(_mm256_and_si256(_mm256_xor_si256(under, _mm256_srli_epi16(under, 1)), pairs)));
+		covered = under;
+		above = row;
+	}
+	features[FEATURE_COLUMN_TRANSITIONS] = _mm256_add_epi16(features[FEATURE_COLUMN_TRANSITIONS],
+		popCount16(_mm256_andnot_si256(above, fullRow)));
+
+	__m256i holesBelow = zero;
+	for (int j = 0; j < GRID_HEIGHT; j++)
+	{
+		__m256i row = _mm256_load_si256((const __m256i*)rows[j]);
+		features[FEATURE_COVERED] = _mm256_add_epi16(features[FEATURE_COVERED],
+			popCount16(_mm256_and_si256(row, holesBelow)));
+		holesBelow = _mm256_or_si256(holesBelow, holes[j]);
+	}
+
+	__m256i low = zero;
+	__m256i high = zero;
+	for (int i = 0; i < NUM_FEATURES; i++)
+	{
+		addWeighted(features[i], weights[i], low, high);
+	}
+	alignas(32) int32_t results[EVAL_BATCH];
+	_mm256_store_si256((__m256i*)results, low);
+	_mm256_store_si256((__m256i*)(results + 8), high);
+	for (int b = 0; b < count && b < EVAL_BATCH; b++)
+	{
+		scores[b] = results[b];
+	}
+}
+
+#endif
+
+// Scores a list of boards, a batch at a time when AVX2 is available
+void evaluateBoards(const GameState* states, int count, const int32_t* weights, int32_t* scores)
+{
+#ifdef AVX2_KERNELS
+	if (vectorEvaluator)
+	{
+		for (int b = 0; b < count; b += EVAL_BATCH)
+		{
+			evaluateBatch(states + b, count - b, weights, scores + b);
+		}
+		return;
+	}
+#endif
+	for (int b = 0; b < count; b++)
+	{
+		scores[b] = evaluateBoard(states[b], weights);
+	}
+}
+
+// Returns whether evaluateBoards() is using the AVX2 kernel
+bool hasVectorEvaluator()
+{
+#ifdef AVX2_KERNELS
+	return vectorEvaluator;
+#else
+	return false;
+#endif
+}
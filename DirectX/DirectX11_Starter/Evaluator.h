@@ -0,0 +1,43 @@
+#ifndef EVALUATOR_H
+#define EVALUATOR_H
+
+#include "GameState.h"
+
+#include <stdint.h>
+
+// Number of boards scored together by one pass of the vector kernel
+#define EVAL_BATCH 16
+
+// Shape features of a board used by the bot heuristics. Every feature is
+// a count, so a score is the sum of the features times integer weights and
+// is the same on every machine.
+enum BoardFeature
+{
+	FEATURE_HEIGHT,				// Sum of the column heights
+	FEATURE_MAX_HEIGHT,			// Height of the tallest column
+	FEATURE_HOLES,				// Empty cells with a filled cell above them
+	FEATURE_COVERED,			// Filled cells above a hole
+	FEATURE_ROW_TRANSITIONS,	// Changes between filled and empty along rows, counting the walls as filled
+	FEATURE_COLUMN_TRANSITIONS,	// Changes between filled and empty up columns, counting the floor as filled
+	FEATURE_WELLS,				// Open empty cells with both sides filled or against a wall
+	FEATURE_BUMPINESS,			// Sum of the height differences of neighbouring columns
+	NUM_FEATURES
+};
+
+// Weights that play a reasonable game before any tuning
+extern const int32_t DEFAULT_WEIGHTS[NUM_FEATURES];
+
+// Counts the features of the board rows of a state
+void getBoardFeatures(const GameState& state, int32_t* features);
+
+// Scores one board as the weighted sum of its features
+int32_t evaluateBoard(const GameState& state, const int32_t* weights);
+
+// Scores a list of boards, a batch of EVAL_BATCH at a time with AVX2 when
+// the processor supports it. The scores match evaluateBoard() exactly.
+void evaluateBoards(const GameState* states, int count, const int32_t* weights, int32_t* scores);
+
+// Returns whether evaluateBoards() is using the AVX2 kernel
+bool hasVectorEvaluator();
+
+#endif
@@ -0,0 +1,265 @@
+#include "GameBoard.h"
+#include "Serialize.h"
+
+#include <string.h>
+
+// Initializes an empty board
+GameBoard::GameBoard()
+{
+	clear();
+}
+
+// Removes every block from the board
+void GameBoard::clear()
+{
+	memset(rows, 0, sizeof(rows));
+	memset(types, EMPTY_CELL, sizeof(types));
+	memset(heights, 0, sizeof(heights));
+	for (int i = 0; i < GRID_HEIGHT; i++)
+	{
+		order[i] = (uint8_t)i;
+	}
+}
+
+// Checks whether or not a block shape fits into the board at the given
+// position. Cells above the board are always free.
+bool GameBoard::canOccupy(const BlockShape& shape, int x, int y) const
+{
+	// Limit it to the game board
+	if (x + shape.left < 0 || x + shape.right >= GRID_WIDTH || y + shape.bottom < 0)
+	{
+		return false;
+	}
+
+	// Check for collision with other blocks a row at a time
+	for (int j = shape.bottom; j <= shape.top && y + j < GRID_HEIGHT; j++)
+	{
+		if (rows[order[y + j]] & shiftRow(shape.rows[j], x))
+		{
+			return false;
+		}
+	}
+
+	// No collisions
+	return true;
+}
+
+// Writes a block shape into the board, marking its cells with the block type.
+// Returns false without changing the board if any cell is above the board
+// or already taken.
+bool GameBoard::place(const BlockShape& shape, int type, int x, int y)
+{
+	if (y + shape.top >= GRID_HEIGHT || !canOccupy(shape, x, y))
+	{
+		return false;
+	}
+
+	// Merge the cells
+	for (int j = shape.bottom; j <= shape.top; j++)
+	{
+		int index = order[y + j];
+		uint16_t mask = shiftRow(shape.rows[j], x);
+		rows[index] |= mask;
+		for (int i = 0; i < GRID_WIDTH; i++)
+		{
+			if (mask & (1 << i))
+			{
+				types[index][i] = (int8_t)type;
+				if (heights[i] < y + j + 1)
+				{
+					heights[i] = (int8_t)(y + j + 1);
+				}
+			}
+		}
+	}
+	return true;
+}
+
+// Clears completed lines between the min and max rows, moving the
+// rows above them down. Returns the number of lines cleared.
+int GameBoard::checkLines(int min, int max)
+{
+	// Find the completed lines
+	uint8_t cleared[GRID_HEIGHT];
+	int count = 0;
+	for (int i = min; i <= max; i++)
+	{
+		if (rows[order[i]] == FULL_ROW)
+		{
+			cleared[count++] = order[i];
+		}
+	}
+	if (count == 0)
+	{
+		return 0;
+	}
+
+	// Compact the remaining rows down over the cleared ones
+	int write = min;
+	for (int read = min; read < GRID_HEIGHT; read++)
+	{
+		if (read > max || rows[order[read]] != FULL_ROW)
+		{
+			order[write++] = order[read];
+		}
+	}
+
+	// Reuse the cleared rows as empty rows at the top
+	for (int i = 0; i < count; i++)
+	{
+		rows[cleared[i]] = 0;
+		memset(types[cleared[i]], EMPTY_CELL, sizeof(types[0]));
+		order[write++] = cleared[i];
+	}
+
+	lowerColumns(count);
+	return count;
+}
+
+// Pushes the board up and fills the bottom rows with garbage that
+// has a gap in the given column. Returns false if any blocks were
+// pushed off the top of the board.
+bool GameBoard::insertGarbage(int count, int holeColumn, int type)
+{
+	if (count <= 0)
+	{
+		return true;
+	}
+	if (count > GRID_HEIGHT)
+	{
+		count = GRID_HEIGHT;
+	}
+
+	// The top rows are reused for the garbage
+	bool fits = true;
+	uint8_t garbage[GRID_HEIGHT];
+	for (int i = 0; i < count; i++)
+	{
+		garbage[i] = order[GRID_HEIGHT - count + i];
+		fits &= rows[garbage[i]] == 0;
+	}
+	memmove(&order[count], &order[0], GRID_HEIGHT - count);
+
+	uint16_t mask = (uint16_t)(FULL_ROW & ~(1 << holeColumn));
+	for (int i = 0; i < count; i++)
+	{
+		order[i] = garbage[i];
+		rows[garbage[i]] = mask;
+		memset(types[garbage[i]], type, sizeof(types[0]));
+	}
+
+	// Raise the columns
+	for (int i = 0; i < GRID_WIDTH; i++)
+	{
+		if (heights[i] > 0)
+		{
+			heights[i] = (int8_t)(heights[i] + count < GRID_HEIGHT ? heights[i] + count : GRID_HEIGHT);
+		}
+		else if (i != holeColumn)
+		{
+			heights[i] = (int8_t)count;
+		}
+	}
+	return fits;
+}
+
+// Writes the board to BOARD_STATE_SIZE bytes, bottom row first
+void GameBoard::save(uint8_t* out) const
+{
+	for (int j = 0; j < GRID_HEIGHT; j++)
+	{
+		writeU16(out + j * 2, rows[order[j]]);
+	}
+
+	// Cell types are stored one above their value so empty cells are 0
+	uint8_t* cells = out + GRID_HEIGHT * 2;
+	for (int j = 0; j < GRID_HEIGHT; j++)
+	{
+		for (int i = 0; i < GRID_WIDTH; i += 2)
+		{
+			*cells++ = (uint8_t)((getCell(i, j) + 1) | (getCell(i + 1, j) + 1) << 4);
+		}
+	}
+}
+
+// Reads a board written by save()
+void GameBoard::load(const uint8_t* in)
+{
+	clear();
+	const uint8_t* cells = in + GRID_HEIGHT * 2;
+	for (int j = 0; j < GRID_HEIGHT; j++)
+	{
+		rows[j] = readU16(in + j * 2) & FULL_ROW;
+		for (int i = 0; i < GRID_WIDTH; i += 2)
+		{
+			types[j][i] = (int8_t)((*cells & 0xF) - 1);
+			types[j][i + 1] = (int8_t)((*cells >> 4) - 1);
+			cells++;
+		}
+		for (int i = 0; i < GRID_WIDTH; i++)
+		{
+			if (rows[j] & (1 << i))
+			{
+				heights[i] = (int8_t)(j + 1);
+			}
+		}
+	}
+}
+
+// Lowers the column heights after clearing lines. A column can drop
+// further than the number of cleared lines if there were holes below it.
+void GameBoard::lowerColumns(int cleared)
+{
+	for (int i = 0; i < GRID_WIDTH; i++)
+	{
+		int height = heights[i] - cleared;
+		while (height > 0 && !(rows[order[height - 1]] & (1 << i)))
+		{
+			height--;
+		}
+		heights[i] = (int8_t)(height > 0 ? height : 0);
+	}
+}
+
+// Retrieves the row a block shape would land on if dropped from the
+// given position. Uses the column heights unless the block is already
+// below the top of a column, e.g. after sliding under an overhang.
+int GameBoard::dropPosition(const BlockShape& shape, int x, int y) const
+{
+	int landing = -shape.bottom;
+	for (int i = shape.left; i <= shape.right; i++)
+	{
+		if (shape.bottoms[i] >= 0 && heights[x + i] - shape.bottoms[i] > landing)
+		{
+			landing = heights[x + i] - shape.bottoms[i];
+		}
+	}
+	if (landing <= y)
+	{
+		return landing;
+	}
+
+	// Fall back to moving down a row at a time
+	while (canOccupy(shape, x, y - 1))
+	{
+		y--;
+	}
+	return y;
+}
+
+// Checks whether or not the cell at the given position has a block in it.
+// Cells above the board are always empty.
+bool GameBoard::isFilled(int x, int y) const
+{
+	if (x < 0 || x >= GRID_WIDTH || y < 0 || y >= GRID_HEIGHT)
+	{
+		return false;
+	}
+	return (rows[order[y]] & (1 << x)) != 0;
+}
+
+// Retrieves the type of the block in the given cell or EMPTY_CELL
+int GameBoard::getCell(int x, int y) const
+{
+	return isFilled(x, y) ? types[order[y]][x] : EMPTY_CELL;
+}
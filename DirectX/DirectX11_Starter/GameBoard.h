@@ -0,0 +1,68 @@
+#ifndef GAMEBOARD_H
+#define GAMEBOARD_H
+
+#include <stdint.h>
+
+// Size of the game grid
+#define GRID_WIDTH 10
+#define GRID_HEIGHT 20
+
+// Mask of a row with every cell filled
+#define FULL_ROW ((1 << GRID_WIDTH) - 1)
+
+// Value of a grid cell without a block in it
+#define EMPTY_CELL -1
+
+// Bytes used by a saved board: a mask per row and half a byte per cell
+#define BOARD_STATE_SIZE (GRID_HEIGHT * 2 + GRID_HEIGHT * GRID_WIDTH / 2)
+
+// The cells of a block orientation as one bit mask per row, bottom
+// row first, along with the bounds of the filled cells in its grid
+// and the lowest filled row of each of its columns (-1 if empty)
+struct BlockShape
+{
+	uint16_t rows[4];
+	int8_t left;
+	int8_t right;
+	int8_t bottom;
+	int8_t top;
+	int8_t bottoms[4];
+};
+
+// The grid of settled blocks in a game, stored as one bit mask per
+// row along with the height of each column. Rows are reached through
+// an index table so clearing lines and adding garbage reorder indices
+// rather than moving cells. Contains no rendering code so the rules
+// can run without a device.
+class GameBoard
+{
+public:
+	GameBoard();
+
+	void clear();
+	bool canOccupy(const BlockShape& shape, int x, int y) const;
+	bool place(const BlockShape& shape, int type, int x, int y);
+	int checkLines(int min, int max);
+	int dropPosition(const BlockShape& shape, int x, int y) const;
+	bool insertGarbage(int count, int holeColumn, int type);
+	void save(uint8_t* out) const;
+	void load(const uint8_t* in);
+
+	bool isFilled(int x, int y) const;
+	int getCell(int x, int y) const;
+	uint16_t getRow(int y) const { return rows[order[y]]; }
+	int getHeight(int x) const { return heights[x]; }
+
+	// Shifts a row mask of a block to the given column
+	static uint16_t shiftRow(uint16_t row, int x) { return x >= 0 ? (uint16_t)(row << x) : (uint16_t)(row >> -x); }
+
+private:
+	uint16_t rows[GRID_HEIGHT];
+	int8_t types[GRID_HEIGHT][GRID_WIDTH];
+	uint8_t order[GRID_HEIGHT];
+	int8_t heights[GRID_WIDTH];
+
+	void lowerColumns(int cleared);
+};
+
+#endif
@@ -24,6 +24,8 @@
 #include <Windows.h>
 #include <d3dcompiler.h>
 #include "GameManager.h"
+#include "BeamSearch.h"
+#include "MctsAgent.h"
 #include <vector>
 
 // Background color
@@ -97,9 +99,6 @@ GameManager::~GameManager()
 	for (UINT i = 0; i < 7; i++)
 	{
 		delete blocks[i].gameObject;
-		delete[] blocks[i].localGrid;
-		delete[] blocks[i].tempGrid;
-		delete[] blocks[i].grid;
 	}
 	delete[] blocks;
 	delete blockManager;
@@ -218,8 +217,7 @@ bool GameManager::Init()
 			cubes.push_back(new GameObject(cubeMesh, shapeMaterial, &XMFLOAT3((float)i - 4.5f, (float)j - 5.0f, 0), &XMFLOAT3(0, 0, 0)));
 		}
 	}
-	blockManager = new BlockManager(blocks, 7, cubes, XMFLOAT3(-4.5, -5, 0), XMFLOAT3(-8.5, 12.5, 0), 1, particleSystem);
-	blockManager->spawnFallingBlock();
+	blockManager = new BlockManager(blocks, cubes, XMFLOAT3(-4.5, -5, 0), XMFLOAT3(-8.5, 12.5, 0), 1, particleSystem);
 
 	// Create 2D meshes
 	//triangleMesh = new Mesh(device, deviceContext, TRIANGLE);
@@ -443,75 +441,24 @@ void GameManager::BuildBlockTypes()
 
 	blocks[0].threeByThree = true;
 	blocks[0].gameObject = new GameObject(jBlockMesh, jBlockMaterial, &XMFLOAT3(0, 0, 0), &XMFLOAT3(0, 0, 0), &XMFLOAT3(1.0f, 1.5f, 0.0f));
-	blocks[0].localGrid = new bool[9];
-	blocks[0].tempGrid = new bool[9];
-	blocks[0].grid = new bool[9] {
-		true, true, true,
-			true, false, false,
-			false, false, false
-	};
 
 	blocks[1].threeByThree = true;
 	blocks[1].gameObject = new GameObject(lBlockMesh, lBlockMaterial, &XMFLOAT3(0, 0, 0), &XMFLOAT3(0, 0, 0), &XMFLOAT3(1.0f, 1.5f, 0.0f));
-	blocks[1].localGrid = new bool[9];
-	blocks[1].tempGrid = new bool[9];
-	blocks[1].grid = new bool[9] {
-		true, true, true,
-			false, false, true,
-			false, false, false
-	};
 
 	blocks[2].threeByThree = true;
 	blocks[2].gameObject = new GameObject(leftBlockMesh, leftBlockMaterial, &XMFLOAT3(0, 0, 0), &XMFLOAT3(0, 0, 0), &XMFLOAT3(1.0f, 1.5f, 0.0f));
-	blocks[2].localGrid = new bool[9];
-	blocks[2].tempGrid = new bool[9];
-	blocks[2].grid = new bool[9] {
-		false, true, true,
-			true, true, false,
-			false, false, false
-	};
 
 	blocks[3].threeByThree = false;
 	blocks[3].gameObject = new GameObject(longBlockMesh, longBlockMaterial, &XMFLOAT3(0, 0, 0), &XMFLOAT3(0, 0, 0), &XMFLOAT3(1.5f, 2.0f, 0.0f));
-	blocks[3].localGrid = new bool[16];
-	blocks[3].tempGrid = new bool[16];
-	blocks[3].grid = new bool[16] {
-		false, false, false, false,
-			true, true, true, true,
-			false, false, false, false,
-			false, false, false, false
-	};
 
 	blocks[4].threeByThree = true;
 	blocks[4].gameObject = new GameObject(rightBlockMesh, rightBlockMaterial, &XMFLOAT3(0, 0, 0), &XMFLOAT3(0, 0, 0), &XMFLOAT3(1.0f, 1.5f, 0.0f));
-	blocks[4].localGrid = new bool[9];
-	blocks[4].tempGrid = new bool[9];
-	blocks[4].grid = new bool[9] {
-		true, true, false,
-			false, true, true,
-			false, false, false
-	};
 
 	blocks[5].threeByThree = false;
 	blocks[5].gameObject = new GameObject(squareBlockMesh, squareBlockMaterial, &XMFLOAT3(0, 0, 0), &XMFLOAT3(0, 0, 0), &XMFLOAT3(1.5f, 2.0f, 0.0f));
-	blocks[5].localGrid = new bool[16];
-	blocks[5].tempGrid = new bool[16];
-	blocks[5].grid = new bool[16] {
-		false, false, false, false,
-			false, true, true, false,
-			false, true, true, false,
-			false, false, false, false
-	};
 
 	blocks[6].threeByThree = true;
 	blocks[6].gameObject = new GameObject(stairsBlockMesh, stairsBlockMaterial, &XMFLOAT3(0, 0, 0), &XMFLOAT3(0, 0, 0), &XMFLOAT3(1.0f, 1.5f, 0.0f));
-	blocks[6].localGrid = new bool[9];
-	blocks[6].tempGrid = new bool[9];
-	blocks[6].grid = new bool[9] {
-		true, true, true,
-			false, true, false,
-			false, false, false
-	};
 }
 
 void GameManager::CreateShadowMapResources() 
@@ -574,14 +521,24 @@ void GameManager::UpdateScene(float dt)
 		}
 	}
 
+	// Let the bot play, starting over whenever it loses
+	if (gameState == AUTOPLAY)
+	{
+		blockManager->update(dt);
+		if (blockManager->isGameOver())
+		{
+			blockManager->reset();
+		}
+	}
+
 	// Active mesh list
 	std::vector<GameObject*> *meshObjects = 0;
-	if (gameState == GAME || gameState == DEBUG) meshObjects = &gameObjects;
+	if (gameState == GAME || gameState == AUTOPLAY || gameState == DEBUG) meshObjects = &gameObjects;
 	
 	// Active UI list
 	std::vector<UIObject*> *uiObjects = 0;
 	if (gameState == MENU) uiObjects = &menuObjects;
-	if (gameState == GAME || gameState == DEBUG) uiObjects = &gameUIObjects;
+	if (gameState == GAME || gameState == AUTOPLAY || gameState == DEBUG) uiObjects = &gameUIObjects;
 	if (gameState == GAME_OVER) uiObjects = &gameOverObjects;
 
 	// [DRAW] Set up the input assembler for objects
@@ -626,7 +583,7 @@ void GameManager::UpdateScene(float dt)
 		}
 	}
 	// Draw the game if in game mode
-	if (gameState == GAME || gameState == DEBUG)
+	if (gameState == GAME || gameState == AUTOPLAY || gameState == DEBUG)
 	{
 		blockManager->draw(deviceContext, vsConstantBuffer, &dataToSendToVSConstantBuffer);
 	}
@@ -667,13 +624,13 @@ void GameManager::UpdateScene(float dt)
 	}
 
 	// Draw the game if in game mode
-	if (gameState == GAME || gameState == DEBUG)
+	if (gameState == GAME || gameState == AUTOPLAY || gameState == DEBUG)
 	{
 		blockManager->draw(deviceContext, vsConstantBuffer, &dataToSendToVSConstantBuffer);
 	}
 
 	// Draw the particle system
-	if (gameState == GAME || gameState == DEBUG)
+	if (gameState == GAME || gameState == AUTOPLAY || gameState == DEBUG)
 	{
 		// [DRAW] Set up the input assembler for particle system
 		deviceContext->IASetInputLayout(InputLayouts::Particle);
@@ -747,11 +704,11 @@ void GameManager::CheckKeyBoard(float dt)
 		// Move down faster
 		if (GetAsyncKeyState('S') || GetAsyncKeyState(VK_DOWN))
 		{
-			blockManager->fallSpeed = FAST_FALL_SPEED;
+			blockManager->setFastFall(true);
 		}
 		else
 		{
-			blockManager->fallSpeed = SLOW_FALL_SPEED;
+			blockManager->setFastFall(false);
 		}
 
 		// Rotation
@@ -773,6 +730,9 @@ void GameManager::CheckKeyBoard(float dt)
 		{
 			blockManager->holdBlock();
 		}
+
+		// Rewinding time
+		blockManager->setRewinding(GetAsyncKeyState('Q') != 0);
 	}
 	else if (gameState == DEBUG)
 	{
@@ -806,12 +766,49 @@ LRESULT GameManager::MsgProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
 			blockManager->drop();
 		// Switch to debug mode
 		case VK_CAPITAL:
-			gameState = (gameState != DEBUG) ? DEBUG : GAME;
+			if (gameState != DEBUG)
+				gameState = DEBUG;
+			else
+				gameState = blockManager->isAutoplaying() ? AUTOPLAY : GAME;
 			break;
 		// Change the active shader
 		case VK_TAB:
 			activeShader = (activeShader + 1) % shaderCount;
 			break;
+		// Watch the beam search (B) or tree search (M) bot play, or stop it and go back to the menu
+		case 'B':
+		case 'M':
+			if (gameState == MENU || gameState == GAME_OVER)
+			{
+				Agent* agent;
+				if (wParam == 'M')
+					agent = new MctsAgent(MCTS_TIME_BUDGET, Agent::getBackgroundThreads());
+				else
+					agent = new BeamSearch(BEAM_WIDTH, BEAM_DEPTH, Agent::getBackgroundThreads());
+				blockManager->reset();
+				blockManager->setAutoplaying(true, agent);
+				gameState = AUTOPLAY;
+			}
+			else if (gameState == AUTOPLAY)
+			{
+				blockManager->setAutoplaying(false);
+				gameState = MENU;
+			}
+			break;
+		// Have the bot play perfect clears when it finds any, or stop
+		case 'P':
+			if (gameState == AUTOPLAY)
+			{
+				blockManager->setPerfectClearing(!blockManager->isPerfectClearing());
+			}
+			break;
+		// Watch the replay of the last game
+		case 'R':
+			if (gameState == GAME_OVER && blockManager->replayLastGame())
+			{
+				gameState = GAME;
+			}
+			break;
 		}
 	}
 
@@ -835,6 +832,7 @@ void GameManager::OnMouseUp(WPARAM btnState, int x, int y)
 	// Main menu buttons
 	if (gameState == MENU) {
 		if (playButton->IsOver(x, y)) {
+			blockManager->setAutoplaying(false);
 			blockManager->reset();
 			gameState = GAME;
 		}
@@ -30,7 +30,8 @@ enum GAME_STATE
 	MENU,
 	GAME,
 	GAME_OVER,
-	DEBUG
+	DEBUG,
+	AUTOPLAY
 };
 
 struct BLEND_DESC : public D3D11_BLEND_DESC {};
@@ -0,0 +1,481 @@
+#include "GameServer.h"
+#include "Serialize.h"
+
+#include <string.h>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+// Mixed into the server's seed for each loop's games and tokens
+#define LOOP_SEED 0xBB67AE8584CAA73BULL
+
+// Most batches of datagrams taken in one pass, so a flood can't hold up
+// the ticks
+#define MAX_RECEIVE_BATCHES 64
+
+// Fills in the default server
+void setDefaultServer(ServerSettings& settings)
+{
+	settings.port = DEFAULT_SERVER_PORT;
+	settings.address = NULL;
+	settings.loops = 0;
+	settings.sessions = DEFAULT_LOOP_SESSIONS;
+	settings.stateInterval = DEFAULT_STATE_INTERVAL;
+	settings.seed = 1;
+	settings.pin = false;
+}
+
+// Adds one loop's counts to another's
+void addLoopStats(LoopStats& total, const LoopStats& loop)
+{
+	total.sessions += loop.sessions;
+	total.ticks += loop.ticks;
+	total.sessionTicks += loop.sessionTicks;
+	total.received += loop.received;
+	total.sent += loop.sent;
+	total.badPackets += loop.badPackets;
+	total.lateInputs += loop.lateInputs;
+	total.missedInputs += loop.missedInputs;
+	total.joins += loop.joins;
+	total.refused += loop.refused;
+	total.leaves += loop.leaves;
+	total.timeouts += loop.timeouts;
+	total.overruns += loop.overruns;
+	total.busySeconds += loop.busySeconds;
+	total.worstTick = total.worstTick > loop.worstTick ? total.worstTick : loop.worstTick;
+}
+
+// Keeps the calling thread on one core
+static void pinThread(int core)
+{
+	int cores = (int)std::thread::hardware_concurrency();
+	core = cores > 0 ? core % cores : 0;
+#ifdef _WIN32
+	SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1 << core);
+#elif defined(__linux__)
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(core, &set);
+	pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#endif
+}
+
+ServerLoop::ServerLoop(int pIndex, const ServerSettings& pSettings)
+	: sessions(pSettings.sessions < 1 ? 1 : (pSettings.sessions > MAX_LOOP_SESSIONS ? MAX_LOOP_SESSIONS : pSettings.sessions))
+{
+	index = pIndex;
+	settings = pSettings;
+	settings.stateInterval = settings.stateInterval > 0 ? settings.stateInterval : 1;
+	freeSlots.reserve(sessions.size());
+	for (size_t i = sessions.size(); i > 0; i--)
+	{
+		sessions[i - 1].token = 0;
+		freeSlots.push_back((uint16_t)(i - 1));
+	}
+	incoming = new DatagramBatch();
+	outgoing = new DatagramBatch();
+	incoming->count = 0;
+	outgoing->count = 0;
+	random.seed(settings.seed ^ (LOOP_SEED * (uint64_t)(index + 1)));
+	tick = 0;
+	stopping = false;
+	memset(&stats, 0, sizeof(stats));
+	shared = stats;
+}
+
+ServerLoop::~ServerLoop()
+{
+	stop();
+	delete incoming;
+	delete outgoing;
+}
+
+// Opens the loop's socket
+bool ServerLoop::open(uint16_t port, const char* address)
+{
+	return socket.bind(port, address);
+}
+
+// Starts the loop on a thread of its own
+void ServerLoop::start()
+{
+	stopping = false;
+	thread = std::thread(&ServerLoop::run, this);
+}
+
+// Stops the loop, waiting for its thread to finish
+void ServerLoop::stop()
+{
+	stopping = true;
+	if (thread.joinable())
+	{
+		thread.join();
+	}
+}
+
+// Copies the counts as of the loop's last tick
+void ServerLoop::getStats(LoopStats& out)
+{
+	std::lock_guard<std::mutex> lock(statsMutex);
+	out = shared;
+}
+
+// Loop thread: waits for datagrams until the next tick is due, takes
+// them, and plays the tick
+void ServerLoop::run()
+{
+	if (settings.pin)
+	{
+		pinThread(index);
+	}
+	const Clock::duration period = std::chrono::duration_cast<Clock::duration>(std::chrono::nanoseconds(1000000000 / TICKS_PER_SECOND));
+	Clock::time_point next = Clock::now() + period;
+	while (!stopping)
+	{
+		Clock::time_point now = Clock::now();
+		if (now < next)
+		{
+			// Rounded up, so the loop sleeps rather than spins the last
+			// part of a millisecond
+			int milliseconds = (int)((std::chrono::duration_cast<std::chrono::microseconds>(next - now).count() + 999) / 1000);
+			socket.wait(milliseconds);
+		}
+
+		Clock::time_point started = Clock::now();
+		receivePackets();
+		if (started >= next)
+		{
+			if (started - next > period)
+			{
+				stats.overruns++;
+			}
+			Clock::time_point tickStarted = Clock::now();
+			playTick();
+			flush();
+			double seconds = std::chrono::duration<double>(Clock::now() - tickStarted).count();
+			stats.worstTick = seconds > stats.worstTick ? seconds : stats.worstTick;
+
+			// After a long stall, carries on from now rather than racing
+			// through the missed ticks
+			next += period;
+			if (started - next > period * TICKS_PER_SECOND)
+			{
+				next = started + period;
+			}
+		}
+		else
+		{
+			flush();
+		}
+		stats.busySeconds += std::chrono::duration<double>(Clock::now() - started).count();
+
+		std::lock_guard<std::mutex> lock(statsMutex);
+		shared = stats;
+	}
+}
+
+// Takes every datagram waiting, a batch at a time
+void ServerLoop::receivePackets()
+{
+	for (int b = 0; b < MAX_RECEIVE_BATCHES; b++)
+	{
+		int count = socket.receive(*incoming);
+		for (int i = 0; i < count; i++)
+		{
+			handlePacket(incoming->data[i], incoming->sizes[i], incoming->addresses[i]);
+		}
+		stats.received += count > 0 ? count : 0;
+		if (count < DATAGRAM_BATCH)
+		{
+			return;
+		}
+	}
+}
+
+// Passes a datagram to the handler of its type
+void ServerLoop::handlePacket(const uint8_t* data, int size, const NetAddress& from)
+{
+	switch (size > 0 ? data[0] : 0)
+	{
+	case PACKET_JOIN:
+		handleJoin(data, size, from);
+		break;
+	case PACKET_INPUT:
+		handleInput(data, size, from);
+		break;
+	case PACKET_LEAVE:
+		handleLeave(data, size, from);
+		break;
+	default:
+		stats.badPackets++;
+		break;
+	}
+}
+
+// Opens a session with a new game, or refuses if the loop is full. A
+// join resent after a lost welcome opens a second session, and the
+// first is closed once it times out.
+void ServerLoop::handleJoin(const uint8_t* data, int size, const NetAddress& from)
+{
+	if (size != JOIN_SIZE || readU16(data + 1) != SERVER_PROTOCOL)
+	{
+		stats.badPackets++;
+		return;
+	}
+	uint32_t nonce = readU32(data + 3);
+	if (freeSlots.empty())
+	{
+		uint8_t* reply = queuePacket(from, REFUSED_SIZE);
+		reply[0] = PACKET_REFUSED;
+		writeU32(reply + 1, nonce);
+		stats.refused++;
+		return;
+	}
+
+	uint16_t slot = freeSlots.back();
+	freeSlots.pop_back();
+	ServerSession& session = sessions[slot];
+	uint64_t seed = random.next();
+	session.simulation.reset(seed);
+	session.address = from;
+	session.token = 0;
+	while (session.token == 0)
+	{
+		session.token = (uint32_t)random.next();
+	}
+	session.tick = 0;
+	session.ack = 0;
+	session.heard = tick;
+	for (int i = 0; i < INPUT_WINDOW; i++)
+	{
+		session.inputTicks[i] = UINT32_MAX;
+		session.inputs[i] = 0;
+	}
+	stats.sessions++;
+	stats.joins++;
+
+	uint8_t* reply = queuePacket(from, WELCOME_SIZE);
+	reply[0] = PACKET_WELCOME;
+	writeU32(reply + 1, nonce);
+	writeU16(reply + 5, slot);
+	writeU32(reply + 7, session.token);
+	writeU64(reply + 11, seed);
+}
+
+// Stores the inputs of a packet for the ticks they are for. Inputs for
+// ticks already played are too late and dropped, as are ones further
+// ahead than the session holds.
+void ServerLoop::handleInput(const uint8_t* data, int size, const NetAddress& from)
+{
+	int count = size >= INPUT_HEADER_SIZE ? data[11] : 0;
+	ServerSession* session = count > 0 && count <= MAX_PACKET_INPUTS && size == INPUT_HEADER_SIZE + count ? findSession(data, from) : NULL;
+	if (session == NULL)
+	{
+		stats.badPackets++;
+		return;
+	}
+	const uint8_t* inputs = data + INPUT_HEADER_SIZE;
+	for (int i = 0; i < count; i++)
+	{
+		if ((inputs[i] & ~INPUT_MASK) != 0)
+		{
+			stats.badPackets++;
+			return;
+		}
+	}
+
+	uint32_t last = readU32(data + 7);
+	session->heard = tick;
+	if (last < session->tick)
+	{
+		stats.lateInputs++;
+		return;
+	}
+	session->ack = last + 1 > session->ack ? last + 1 : session->ack;
+	for (int i = 0; i < count; i++)
+	{
+		int64_t inputTick = (int64_t)last - (count - 1 - i);
+		if (inputTick >= session->tick && inputTick < (int64_t)session->tick + INPUT_WINDOW)
+		{
+			session->inputs[inputTick % INPUT_WINDOW] = inputs[i];
+			session->inputTicks[inputTick % INPUT_WINDOW] = (uint32_t)inputTick;
+		}
+	}
+}
+
+// Closes a session at its client's request
+void ServerLoop::handleLeave(const uint8_t* data, int size, const NetAddress& from)
+{
+	ServerSession* session = size == LEAVE_SIZE ? findSession(data, from) : NULL;
+	if (session == NULL)
+	{
+		stats.badPackets++;
+		return;
+	}
+	closeSession(*session);
+	stats.leaves++;
+}
+
+// Finds the open session a packet's slot and token are for, which must
+// have come from the address that joined
+ServerLoop::ServerSession* ServerLoop::findSession(const uint8_t* data, const NetAddress& from)
+{
+	uint16_t slot = readU16(data + 1);
+	if (slot >= sessions.size())
+	{
+		return NULL;
+	}
+	ServerSession& session = sessions[slot];
+	uint32_t token = readU32(data + 3);
+	return session.token != 0 && session.token == token && session.address == from ? &session : NULL;
+}
+
+// Frees a session's slot
+void ServerLoop::closeSession(ServerSession& session)
+{
+	session.token = 0;
+	freeSlots.push_back((uint16_t)(&session - &sessions[0]));
+	stats.sessions--;
+}
+
+// Advances every session's game a tick and sends the states due
+void ServerLoop::playTick()
+{
+	tick++;
+	stats.ticks++;
+	for (size_t slot = 0; slot < sessions.size(); slot++)
+	{
+		ServerSession& session = sessions[slot];
+		if (session.token == 0)
+		{
+			continue;
+		}
+		if (tick - session.heard > SESSION_TIMEOUT)
+		{
+			closeSession(session);
+			stats.timeouts++;
+			continue;
+		}
+
+		int input = 0;
+		int ring = session.tick % INPUT_WINDOW;
+		if (session.inputTicks[ring] == session.tick)
+		{
+			input = session.inputs[ring];
+		}
+		else
+		{
+			stats.missedInputs++;
+		}
+		session.simulation.tick(input);
+		session.tick++;
+		stats.sessionTicks++;
+
+		if ((session.tick + slot) % settings.stateInterval == 0)
+		{
+			uint8_t* packet = queuePacket(session.address, STATE_PACKET_SIZE);
+			packet[0] = PACKET_STATE;
+			writeU16(packet + 1, (uint16_t)slot);
+			writeU32(packet + 3, session.tick);
+			writeU32(packet + 7, session.ack);
+			packet[11] = session.simulation.isGameOver() ? SESSION_GAME_OVER : 0;
+			session.simulation.saveState(packet + 12);
+		}
+	}
+}
+
+// Makes room for a datagram in the outgoing batch, sending the batch
+// first if it's full, and returns where to write it
+uint8_t* ServerLoop::queuePacket(const NetAddress& to, int size)
+{
+	if (outgoing->count == DATAGRAM_BATCH)
+	{
+		flush();
+	}
+	int i = outgoing->count++;
+	outgoing->addresses[i] = to;
+	outgoing->sizes[i] = (uint16_t)size;
+	return outgoing->data[i];
+}
+
+// Sends the datagrams queued
+void ServerLoop::flush()
+{
+	if (outgoing->count > 0)
+	{
+		int sent = socket.send(*outgoing);
+		stats.sent += sent > 0 ? sent : 0;
+	}
+}
+
+GameServer::GameServer(const ServerSettings& pSettings)
+{
+	settings = pSettings;
+}
+
+GameServer::~GameServer()
+{
+	stop();
+}
+
+// Opens every loop's socket and starts the loops, returning false if
+// a port couldn't be opened
+bool GameServer::start()
+{
+	stop();
+	int count = settings.loops;
+	if (count <= 0)
+	{
+		count = (int)std::thread::hardware_concurrency();
+		count = count > 0 ? count : 1;
+	}
+	for (int i = 0; i < count; i++)
+	{
+		ServerLoop* loop = new ServerLoop(i, settings);
+		loops.push_back(loop);
+		if (!loop->open(settings.port > 0 ? (uint16_t)(settings.port + i) : 0, settings.address))
+		{
+			stop();
+			return false;
+		}
+	}
+	for (size_t i = 0; i < loops.size(); i++)
+	{
+		loops[i]->start();
+	}
+	return true;
+}
+
+// Stops and closes every loop
+void GameServer::stop()
+{
+	for (size_t i = 0; i < loops.size(); i++)
+	{
+		delete loops[i];
+	}
+	loops.clear();
+}
+
+// Totals the counts of every loop, optionally keeping each loop's
+void GameServer::getStats(LoopStats& total, std::vector<LoopStats>* perLoop)
+{
+	memset(&total, 0, sizeof(total));
+	if (perLoop != NULL)
+	{
+		perLoop->resize(loops.size());
+	}
+	for (size_t i = 0; i < loops.size(); i++)
+	{
+		LoopStats loop;
+		loops[i]->getStats(loop);
+		addLoopStats(total, loop);
+		if (perLoop != NULL)
+		{
+			(*perLoop)[i] = loop;
+		}
+	}
+}
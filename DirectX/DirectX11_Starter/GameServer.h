@@ -0,0 +1,204 @@
+#ifndef GAMESERVER_H
+#define GAMESERVER_H
+
+#include "GameSimulation.h"
+#include "Random.h"
+#include "Socket.h"
+
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Version of the packets below, which a client must match
+#define SERVER_PROTOCOL 1
+
+// Port of the first event loop, the rest following on
+#define DEFAULT_SERVER_PORT 7360
+
+// Sessions each event loop has room for, at most as many as a u16 slot
+// can number
+#define DEFAULT_LOOP_SESSIONS 8192
+#define MAX_LOOP_SESSIONS 65535
+
+// Ticks between the states sent to each session, spread over the ticks
+// so a loop sends about the same every tick
+#define DEFAULT_STATE_INTERVAL 3
+
+// Ticks of input a session holds ahead of its game, and the most inputs
+// in one packet. Clients resend their last few inputs in every packet
+// so one lost on the way is covered by the next.
+#define INPUT_WINDOW 32
+#define MAX_PACKET_INPUTS 16
+
+// Ticks a session may go without a packet before it's closed
+#define SESSION_TIMEOUT (5 * TICKS_PER_SECOND)
+
+// Bits of the flags in a state packet
+#define SESSION_GAME_OVER 1
+
+// Datagrams, each a u8 type and then:
+//   join:     u16 protocol, u32 nonce picked by the client
+//   welcome:  u32 nonce, u16 slot, u32 token, u64 seed
+//   refused:  u32 nonce, the loop is full
+//   input:    u16 slot, u32 token, u32 tick of the last input,
+//             u8 count, that many inputs, oldest first
+//   state:    u16 slot, u32 ticks played, u32 newest input tick
+//             received plus one (0 before any), u8 flags,
+//             GameSimulation::saveState()
+//   leave:    u16 slot, u32 token
+enum ServerPacket
+{
+	PACKET_JOIN = 1,
+	PACKET_WELCOME,
+	PACKET_REFUSED,
+	PACKET_INPUT,
+	PACKET_STATE,
+	PACKET_LEAVE
+};
+
+#define JOIN_SIZE 7
+#define WELCOME_SIZE 19
+#define REFUSED_SIZE 5
+#define INPUT_HEADER_SIZE 12
+#define STATE_PACKET_SIZE (12 + STATE_SIZE)
+#define LEAVE_SIZE 7
+
+// How a server is run
+struct ServerSettings
+{
+	uint16_t port;		// Of the first loop, loop i listens on port + i
+	const char* address;	// To listen on, NULL for every address
+	int loops;			// Event loops, 0 for one per core
+	int sessions;		// Sessions per loop
+	int stateInterval;	// Ticks between states sent to a session
+	uint64_t seed;		// Seeds the games' seeds
+	bool pin;			// Keeps each loop on a core of its own
+};
+
+// Fills in the default server: every address, one loop per core,
+// unpinned
+void setDefaultServer(ServerSettings& settings);
+
+// Counts kept by an event loop since it started
+struct LoopStats
+{
+	uint32_t sessions;		// Open now
+	uint64_t ticks;
+	uint64_t sessionTicks;	// Games advanced a tick
+	uint64_t received;		// Datagrams
+	uint64_t sent;
+	uint64_t badPackets;	// Malformed, unknown sessions or wrong tokens
+	uint64_t lateInputs;	// For ticks already played
+	uint64_t missedInputs;	// Session ticks played with no input
+	uint64_t joins;
+	uint64_t refused;
+	uint64_t leaves;
+	uint64_t timeouts;
+	uint64_t overruns;		// Ticks started more than a tick late
+	double busySeconds;		// Working rather than waiting
+	double worstTick;		// Longest a tick's work took, in seconds
+};
+
+// Adds one loop's counts to another's
+void addLoopStats(LoopStats& total, const LoopStats& loop);
+
+// One event loop of a GameServer: a thread with its own UDP socket and
+// its own sessions, which stay on it for good. Nothing is shared with
+// other loops, so loops never wait on each other and a session's game
+// stays in one core's cache.
+//
+// Each pass takes every datagram waiting in batches, then plays any
+// ticks due: each session's game is advanced with its input for that
+// tick, and states are queued into a batch sent whenever it fills.
+// Sessions, input rings and batches are all made up front, so nothing
+// is allocated once the loop is running.
+class ServerLoop
+{
+public:
+	ServerLoop(int index, const ServerSettings& settings);
+	~ServerLoop();
+
+	bool open(uint16_t port, const char* address);
+	void start();
+	void stop();
+	void getStats(LoopStats& out);
+
+	uint16_t getPort() const { return socket.getPort(); }
+
+private:
+	typedef std::chrono::steady_clock Clock;
+
+	// A client's game and the inputs it has sent ahead
+	struct ServerSession
+	{
+		GameSimulation simulation;
+		NetAddress address;
+		uint32_t token;		// 0 while the slot is free
+		uint32_t tick;		// Ticks played
+		uint32_t ack;		// Newest input tick received, plus one
+		uint32_t heard;		// Loop tick of the last packet
+		uint32_t inputTicks[INPUT_WINDOW];
+		uint8_t inputs[INPUT_WINDOW];
+	};
+
+	int index;
+	ServerSettings settings;
+	DatagramSocket socket;
+	std::vector<ServerSession> sessions;
+	std::vector<uint16_t> freeSlots;
+	DatagramBatch* incoming;
+	DatagramBatch* outgoing;
+	Random random;
+	uint32_t tick;
+
+	std::thread thread;
+	std::atomic<bool> stopping;
+	std::mutex statsMutex;
+	LoopStats stats;
+	LoopStats shared;
+
+	void run();
+	void receivePackets();
+	void handlePacket(const uint8_t* data, int size, const NetAddress& from);
+	void handleJoin(const uint8_t* data, int size, const NetAddress& from);
+	void handleInput(const uint8_t* data, int size, const NetAddress& from);
+	void handleLeave(const uint8_t* data, int size, const NetAddress& from);
+	ServerSession* findSession(const uint8_t* data, const NetAddress& from);
+	void closeSession(ServerSession& session);
+	void playTick();
+	uint8_t* queuePacket(const NetAddress& to, int size);
+	void flush();
+
+	ServerLoop(const ServerLoop& rhs);
+	ServerLoop& operator=(const ServerLoop& rhs);
+};
+
+// The authoritative server: runs every client's game itself at the
+// fixed tick rate from the inputs they send over UDP, and sends each
+// client its game's state. Runs an event loop per core, each listening
+// on a port of its own; a client picks a loop by the port it joins on.
+class GameServer
+{
+public:
+	GameServer(const ServerSettings& settings);
+	~GameServer();
+
+	bool start();
+	void stop();
+	void getStats(LoopStats& total, std::vector<LoopStats>* perLoop = NULL);
+
+	int getLoops() const { return (int)loops.size(); }
+	uint16_t getPort(int loop) const { return loops[loop]->getPort(); }
+
+private:
+	ServerSettings settings;
+	std::vector<ServerLoop*> loops;
+
+	GameServer(const GameServer& rhs);
+	GameServer& operator=(const GameServer& rhs);
+};
+
+#endif
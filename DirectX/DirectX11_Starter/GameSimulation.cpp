@@ -0,0 +1,469 @@
+#include "GameSimulation.h"
+#include "Serialize.h"
+
+// Initializes a new game with the given seed
+GameSimulation::GameSimulation(uint64_t seed)
+{
+	reset(seed);
+}
+
+// Resets the game for a new one. The seed decides the order blocks spawn in.
+void GameSimulation::reset(uint64_t seed)
+{
+	board.clear();
+	random.seed(seed);
+	score = 0;
+	lines = 0;
+	pieces = 0;
+	heldType = NO_BLOCK;
+	canSwap = true;
+	gameOver = false;
+	orderIndex = NUM_BLOCK_TYPES - 1;
+	spawnFallingBlock();
+}
+
+// Advances the game by one tick, applying the given inputs first.
+// Returns the number of lines cleared during the tick.
+int GameSimulation::tick(int input)
+{
+	// Cannot update if the game is not active
+	if (activeType == NO_BLOCK) {
+		return 0;
+	}
+
+	// Sideways moves wait until the block has nearly reached its column
+	if ((input & INPUT_LEFT) && abs(posX - targetX * CELL_SIZE) <= MOVE_THRESHOLD)
+	{
+		move(LEFT);
+	}
+	if ((input & INPUT_RIGHT) && abs(posX - targetX * CELL_SIZE) <= MOVE_THRESHOLD)
+	{
+		move(RIGHT);
+	}
+
+	// Rotations wait until the previous one has finished turning
+	if ((input & INPUT_ROTATE) && turn == 0 && rotate())
+	{
+		turn = QUARTER_TURN;
+	}
+	if (input & INPUT_HOLD)
+	{
+		holdBlock();
+	}
+	if (input & INPUT_DROP)
+	{
+		drop();
+	}
+
+	return advance((input & INPUT_FAST_FALL) ? FAST_FALL_SPEED : SLOW_FALL_SPEED);
+}
+
+// Moves the active block towards its target cell and applies gravity,
+// merging it once it has come to rest. Returns the number of lines cleared.
+int GameSimulation::advance(int fallSpeed)
+{
+	if (activeType == NO_BLOCK) {
+		return 0;
+	}
+	bool settled = posX == targetX * CELL_SIZE;
+
+	// Apply smooth horizontal movement
+	int dx = targetX * CELL_SIZE - posX;
+	posX += dx > 0 ? (dx < SIDE_SPEED ? dx : SIDE_SPEED) : (dx > -SIDE_SPEED ? dx : -SIDE_SPEED);
+
+	// Apply "gravity"
+	int dy = targetY * CELL_SIZE - posY;
+	if (dy >= -fallSpeed && move(DOWN))
+	{
+		dy = targetY * CELL_SIZE - posY;
+	}
+
+	// Merge the block once it has stopped, otherwise keep it falling
+	int yChange = dy > -fallSpeed ? dy : -fallSpeed;
+	if (yChange == 0 && settled && turn == 0)
+	{
+		return mergeBlock();
+	}
+	posY += yChange;
+
+	// Apply smooth rotation
+	turn -= turn < ROTATION_SPEED ? turn : ROTATION_SPEED;
+	return 0;
+}
+
+// Writes the whole game to STATE_SIZE bytes, in a layout that doesn't
+// depend on the compiler so saved games can be stored in files
+void GameSimulation::saveState(uint8_t* out) const
+{
+	board.save(out);
+	out += BOARD_STATE_SIZE;
+
+	out[0] = (uint8_t)activeType;
+	out[1] = (uint8_t)heldType;
+	out[2] = (uint8_t)rotation;
+	out[3] = (uint8_t)(canSwap | gameOver << 1);
+	out[4] = (uint8_t)targetX;
+	out[5] = (uint8_t)targetY;
+	writeU32(out + 6, (uint32_t)posX);
+	writeU32(out + 10, (uint32_t)posY);
+	writeU16(out + 14, (uint16_t)turn);
+	for (int i = 0; i < NUM_BLOCK_TYPES; i++)
+	{
+		out[16 + i] = (uint8_t)typeOrder[i];
+	}
+	out[23] = (uint8_t)orderIndex;
+	writeU64(out + 24, random.state);
+	writeU32(out + 32, (uint32_t)score);
+	writeU32(out + 36, (uint32_t)lines);
+	writeU32(out + 40, (uint32_t)pieces);
+}
+
+// Reads a game written by saveState(). The bytes may come from a file,
+// so every field is checked before the game is replaced; returns false
+// and leaves the game as it was if any is out of range.
+bool GameSimulation::loadState(const uint8_t* in)
+{
+	GameSimulation loaded = *this;
+	loaded.board.load(in);
+	in += BOARD_STATE_SIZE;
+
+	loaded.activeType = (int8_t)in[0];
+	loaded.heldType = (int8_t)in[1];
+	loaded.rotation = in[2];
+	loaded.canSwap = (in[3] & 1) != 0;
+	loaded.gameOver = (in[3] & 2) != 0;
+	loaded.targetX = (int8_t)in[4];
+	loaded.targetY = (int8_t)in[5];
+	loaded.posX = (int32_t)readU32(in + 6);
+	loaded.posY = (int32_t)readU32(in + 10);
+	loaded.turn = readU16(in + 14);
+	for (int i = 0; i < NUM_BLOCK_TYPES; i++)
+	{
+		loaded.typeOrder[i] = in[16 + i];
+	}
+	loaded.orderIndex = in[23];
+	loaded.random.state = readU64(in + 24);
+	loaded.score = (int)readU32(in + 32);
+	loaded.lines = (int)readU32(in + 36);
+	loaded.pieces = (int)readU32(in + 40);
+
+	if (!loaded.isValid() || (in[3] & ~3) != 0)
+	{
+		return false;
+	}
+	*this = loaded;
+	return true;
+}
+
+// Checks that every field is one the rules could have left it in, so
+// none of them can index past the shape tables or the board
+bool GameSimulation::isValid() const
+{
+	// Cells can only hold a block type or garbage
+	for (int j = 0; j < GRID_HEIGHT; j++)
+	{
+		for (int i = 0; i < GRID_WIDTH; i++)
+		{
+			int type = board.getCell(i, j);
+			if (type < EMPTY_CELL || type > GARBAGE_TYPE)
+			{
+				return false;
+			}
+		}
+	}
+
+	// The spawn order is a shuffle of every type
+	int seen = 0;
+	for (int i = 0; i < NUM_BLOCK_TYPES; i++)
+	{
+		if (typeOrder[i] < 0 || typeOrder[i] >= NUM_BLOCK_TYPES || (seen & (1 << typeOrder[i])))
+		{
+			return false;
+		}
+		seen |= 1 << typeOrder[i];
+	}
+	if (orderIndex < 0 || orderIndex >= NUM_BLOCK_TYPES || heldType < NO_BLOCK || heldType >= NUM_BLOCK_TYPES ||
+		score < 0 || lines < 0 || pieces < 0)
+	{
+		return false;
+	}
+
+	// There's a falling block in a spot it fits until the game is over
+	if (activeType == NO_BLOCK)
+	{
+		return gameOver;
+	}
+	return !gameOver && activeType >= 0 && activeType < NUM_BLOCK_TYPES &&
+		rotation >= 0 && rotation < NUM_ROTATIONS && turn >= 0 && turn <= QUARTER_TURN &&
+		targetY <= SPAWN_Y && canOccupy(targetX, targetY) &&
+		posX >= -4 * CELL_SIZE && posX <= GRID_WIDTH * CELL_SIZE &&
+		posY >= -4 * CELL_SIZE && posY <= (SPAWN_Y + GRID_HEIGHT) * CELL_SIZE;
+}
+
+// Copies the rules' part of the game into a compact state for search.
+// The block's smooth movement and the board's cell types are left out.
+void GameSimulation::getState(GameState& state) const
+{
+	for (int j = 0; j < GRID_HEIGHT; j++)
+	{
+		state.rows[j] = board.getRow(j);
+	}
+	state.random = random.state;
+	state.score = (uint32_t)score;
+	state.bag = 0;
+	for (int i = 0; i < NUM_BLOCK_TYPES; i++)
+	{
+		state.bag |= (uint32_t)typeOrder[i] << (i * 3);
+	}
+	state.lines = (uint16_t)lines;
+	state.type = (int8_t)activeType;
+	state.rotation = (int8_t)rotation;
+	state.x = (int8_t)targetX;
+	state.y = (int8_t)targetY;
+	state.held = (int8_t)heldType;
+	state.flags = (uint8_t)(orderIndex | (canSwap ? STATE_CAN_SWAP : 0) | (gameOver ? STATE_GAME_OVER : 0));
+}
+
+// Checks whether or not a move in the given direction can be made
+bool GameSimulation::canMove(MoveDirection direction) const
+{
+	// If the game is not active, no moves can be made
+	if (activeType == NO_BLOCK) {
+		return false;
+	}
+
+	// Check for collisions when active
+	switch (direction)
+	{
+	case LEFT:
+		return canOccupy(targetX - 1, targetY);
+	case RIGHT:
+		return canOccupy(targetX + 1, targetY);
+	case DOWN:
+		return canOccupy(targetX, targetY - 1);
+	default:
+		return false;
+	}
+}
+
+// Checks whether or not the active block can fit into the given spot
+// with it's current orientation
+bool GameSimulation::canOccupy(int x, int y) const
+{
+	// Cannot check if the game is not active
+	if (activeType == NO_BLOCK) {
+		return false;
+	}
+
+	return board.canOccupy(BLOCK_SHAPES[activeType][rotation], x, y);
+}
+
+// Tries to move the active block in the given direction
+bool GameSimulation::move(MoveDirection direction)
+{
+	if (!canMove(direction)) {
+		return false;
+	}
+
+	// Apply the move
+	switch (direction)
+	{
+	case LEFT:
+		targetX--;
+		break;
+	case RIGHT:
+		targetX++;
+		break;
+	case DOWN:
+		targetY--;
+		break;
+	}
+	return true;
+}
+
+// Rotates the active block if able to, shifting it a column
+// to either side if it doesn't fit in place
+bool GameSimulation::rotate()
+{
+	// Cannot rotate if the game is not active
+	if (activeType == NO_BLOCK) {
+		return false;
+	}
+
+	// See if the next orientation is valid
+	int next = (rotation + 1) % NUM_ROTATIONS;
+	const BlockShape& shape = BLOCK_SHAPES[activeType][next];
+	bool canRotateNormal = board.canOccupy(shape, targetX, targetY);
+	bool canRotateRight = !canRotateNormal && board.canOccupy(shape, targetX + 1, targetY);
+	bool canRotateLeft = !canRotateNormal && board.canOccupy(shape, targetX - 1, targetY);
+	if (canRotateNormal || canRotateLeft || canRotateRight)
+	{
+		// Move if necessary
+		if (canRotateRight)
+		{
+			targetX++;
+		}
+		else if (canRotateLeft)
+		{
+			targetX--;
+		}
+
+		rotation = next;
+		return true;
+	}
+	return false;
+}
+
+// Instantly drops the active block to the lowest spot it fits in
+void GameSimulation::drop()
+{
+	if (activeType != NO_BLOCK)
+	{
+		targetY = getGhostY();
+		posX = targetX * CELL_SIZE;
+		posY = targetY * CELL_SIZE;
+	}
+}
+
+// Moves the active block to the held spot and replaces it with a new block
+// or the previously held block. Only allowed once per merged block.
+bool GameSimulation::holdBlock()
+{
+	// Cannot hold a block if the game is not active
+	if (activeType == NO_BLOCK || !canSwap) {
+		return false;
+	}
+
+	canSwap = false;
+	int held = heldType;
+	heldType = activeType;
+
+	// If there is no held block, spawn a new one
+	if (held == NO_BLOCK)
+	{
+		spawnFallingBlock();
+	}
+
+	// Otherwise grab the held block
+	else
+	{
+		activeType = held;
+		resetActiveBlock();
+	}
+	return true;
+}
+
+// Merges the active block into the game grid, clears completed lines
+// and spawns the next block. Returns the number of lines cleared.
+int GameSimulation::mergeBlock()
+{
+	// Cannot merge a block if the game is not active
+	if (activeType == NO_BLOCK) {
+		return 0;
+	}
+
+	canSwap = true;
+	const BlockShape& shape = BLOCK_SHAPES[activeType][rotation];
+
+	// Game over if the block doesn't fit on the board
+	if (!board.place(shape, activeType, targetX, targetY))
+	{
+		gameOver = true;
+		activeType = NO_BLOCK;
+		return 0;
+	}
+
+	// Reward points for cleared lines
+	int cleared = board.checkLines(targetY + shape.bottom, targetY + shape.top);
+	if (cleared > 0)
+	{
+		score += LINE_SCORES[cleared - 1];
+		lines += cleared;
+	}
+
+	// Spawn a new block
+	pieces++;
+	spawnFallingBlock();
+	return cleared;
+}
+
+// Pushes garbage rows in under the stack with a gap in the given column,
+// lifting the falling block if they reach it. Tops the game out,
+// returning false, if that pushes any blocks off the board.
+bool GameSimulation::addGarbage(int count, int holeColumn)
+{
+	if (gameOver || count <= 0)
+	{
+		return !gameOver;
+	}
+	if (!board.insertGarbage(count, holeColumn, GARBAGE_TYPE))
+	{
+		gameOver = true;
+		activeType = NO_BLOCK;
+		return false;
+	}
+	while (activeType != NO_BLOCK && !canOccupy(targetX, targetY))
+	{
+		targetY++;
+		posY += CELL_SIZE;
+	}
+	return true;
+}
+
+// Retrieves the row the active block would land on if dropped
+int GameSimulation::getGhostY() const
+{
+	if (activeType == NO_BLOCK) {
+		return targetY;
+	}
+	return board.dropPosition(BLOCK_SHAPES[activeType][rotation], targetX, targetY);
+}
+
+// Checks whether or not the active block has a cell at the
+// given position of its grid
+bool GameSimulation::isActiveCell(int i, int j) const
+{
+	if (activeType == NO_BLOCK) {
+		return false;
+	}
+	return i >= 0 && i < 4 && j >= 0 && j < 4 && (BLOCK_SHAPES[activeType][rotation].rows[j] & (1 << i)) != 0;
+}
+
+// Spawns the next block in the order at the top of the game
+void GameSimulation::spawnFallingBlock()
+{
+	orderIndex = (orderIndex + 1) % NUM_BLOCK_TYPES;
+	if (orderIndex == 0)
+	{
+		shuffle();
+	}
+	activeType = typeOrder[orderIndex];
+	resetActiveBlock();
+}
+
+// Resets the active block to the top of the game
+void GameSimulation::resetActiveBlock()
+{
+	// Reset target position
+	targetY = SPAWN_Y;
+	targetX = SPAWN_X;
+
+	// Reset the orientation
+	rotation = 0;
+	turn = 0;
+	posX = targetX * CELL_SIZE;
+	posY = targetY * CELL_SIZE;
+}
+
+// Shuffles the order of block types to spawn
+void GameSimulation::shuffle() {
+	for (int i = 0; i < NUM_BLOCK_TYPES; i++) {
+		typeOrder[i] = i;
+	}
+	for (int i = NUM_BLOCK_TYPES - 1; i > 0; i--) {
+		int index = random.nextInt(i + 1);
+		int type = typeOrder[index];
+		typeOrder[index] = typeOrder[i];
+		typeOrder[i] = type;
+	}
+}
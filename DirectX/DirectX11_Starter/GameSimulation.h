@@ -0,0 +1,128 @@
+#ifndef GAMESIMULATION_H
+#define GAMESIMULATION_H
+
+#include "GameState.h"
+#include "Random.h"
+
+#include <stdlib.h>
+
+// Fixed rate the game advances at
+#define TICKS_PER_SECOND 60
+
+// Blocks move smoothly between cells in steps of 1/CELL_SIZE of a cell,
+// and rotate in steps of 1/QUARTER_TURN of a quarter turn
+#define CELL_SIZE 480
+#define QUARTER_TURN 480
+
+// Speeds in steps per tick
+#define SLOW_FALL_SPEED 16	// 2 cells per second
+#define FAST_FALL_SPEED 64	// 8 cells per second
+#define SIDE_SPEED 40		// 5 cells per second
+#define ROTATION_SPEED 61	// About 12 radians per second
+
+// Sideways moves are ignored until the block is this close to its column
+#define MOVE_THRESHOLD (CELL_SIZE / 10)
+
+// Cell type of garbage rows, after the block types
+#define GARBAGE_TYPE NUM_BLOCK_TYPES
+
+// Bytes used by a saved game
+#define STATE_SIZE (BOARD_STATE_SIZE + 44)
+
+// A direction to move a block
+enum MoveDirection
+{
+	LEFT,
+	RIGHT,
+	DOWN
+};
+
+// Player inputs for a single tick, combined as bit flags
+enum InputFlags
+{
+	INPUT_LEFT = 1,
+	INPUT_RIGHT = 2,
+	INPUT_FAST_FALL = 4,
+	INPUT_ROTATE = 8,
+	INPUT_HOLD = 16,
+	INPUT_DROP = 32
+};
+
+// Bits used by the input flags, and a mask of all of them
+#define INPUT_BITS 6
+#define INPUT_MASK ((1 << INPUT_BITS) - 1)
+
+// The rules of the game: the board, the falling block, the held
+// block, the spawn order and the score. Has no Windows or D3D
+// dependencies so it can be run headless.
+//
+// tick() advances the game by one fixed step using only integer math
+// and the game's own random numbers, so the same seed and inputs always
+// play out the same game. The move/rotate/drop/hold/merge methods apply
+// a single action immediately for callers that don't need the timing.
+class GameSimulation
+{
+public:
+	GameSimulation(uint64_t seed = 0);
+
+	void reset(uint64_t seed);
+	int tick(int input);
+	void saveState(uint8_t* out) const;
+	bool loadState(const uint8_t* in);
+	void getState(GameState& state) const;
+
+	bool canMove(MoveDirection direction) const;
+	bool canOccupy(int x, int y) const;
+
+	bool move(MoveDirection direction);
+	bool rotate();
+	void drop();
+	bool holdBlock();
+	int mergeBlock();
+	bool addGarbage(int count, int holeColumn);
+	int getGhostY() const;
+
+	const GameBoard& getBoard() const { return board; }
+	bool isGameOver() const { return gameOver; }
+	int getScore() const { return score; }
+	int getLines() const { return lines; }
+	int getActiveType() const { return activeType; }
+	int getHeldType() const { return heldType; }
+	int getX() const { return targetX; }
+	int getY() const { return targetY; }
+	int getRotation() const { return rotation; }
+	int getPosX() const { return posX; }
+	int getPosY() const { return posY; }
+	int getTurn() const { return turn; }
+	int getPieces() const { return pieces; }
+	bool isActiveCell(int i, int j) const;
+
+	static int getBlockSize(int type) { return BLOCK_SIZES[type]; }
+
+private:
+	GameBoard board;
+	Random random;
+	int typeOrder[NUM_BLOCK_TYPES];
+	int orderIndex;
+	int activeType;
+	int heldType;
+	int targetX;
+	int targetY;
+	int rotation;
+	int posX;
+	int posY;
+	int turn;
+	int score;
+	int lines;
+	int pieces;
+	bool canSwap;
+	bool gameOver;
+
+	void spawnFallingBlock();
+	void resetActiveBlock();
+	int advance(int fallSpeed);
+	void shuffle();
+	bool isValid() const;
+};
+
+#endif
@@ -0,0 +1,273 @@
+#include "GameState.h"
+#include "Random.h"
+
+#include <string.h>
+
+// Fills a bag with one of each block type in a random order,
+// the same way GameSimulation does
+static uint32_t shuffleBag(Random& random)
+{
+	int order[NUM_BLOCK_TYPES];
+	for (int i = 0; i < NUM_BLOCK_TYPES; i++)
+	{
+		order[i] = i;
+	}
+	for (int i = NUM_BLOCK_TYPES - 1; i > 0; i--)
+	{
+		int index = random.nextInt(i + 1);
+		int type = order[index];
+		order[index] = order[i];
+		order[i] = type;
+	}
+
+	uint32_t bag = 0;
+	for (int i = 0; i < NUM_BLOCK_TYPES; i++)
+	{
+		bag |= (uint32_t)order[i] << (i * 3);
+	}
+	return bag;
+}
+
+// Starts a new game with the given seed
+void GameState::reset(uint64_t seed)
+{
+	memset(rows, 0, sizeof(rows));
+	Random generator;
+	generator.seed(seed);
+	random = generator.state;
+	score = 0;
+	bag = 0;
+	lines = 0;
+	held = NO_BLOCK;
+	flags = STATE_CAN_SWAP | (NUM_BLOCK_TYPES - 1);
+	spawn();
+}
+
+// Checks whether or not a block fits at the given position.
+// Cells above the board are always free.
+bool GameState::canOccupy(int blockType, int blockRotation, int blockX, int blockY) const
+{
+	const BlockShape& shape = BLOCK_SHAPES[blockType][blockRotation];
+	if (blockX + shape.left < 0 || blockX + shape.right >= GRID_WIDTH || blockY + shape.bottom < 0)
+	{
+		return false;
+	}
+	for (int j = shape.bottom; j <= shape.top && blockY + j < GRID_HEIGHT; j++)
+	{
+		if (rows[blockY + j] & GameBoard::shiftRow(shape.rows[j], blockX))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+// Retrieves the row a block would land on if dropped from the given position
+int GameState::dropY(int blockType, int blockRotation, int blockX, int blockY) const
+{
+	while (canOccupy(blockType, blockRotation, blockX, blockY - 1))
+	{
+		blockY--;
+	}
+	return blockY;
+}
+
+// Retrieves the type of the block that spawns i + 1 blocks after the active one
+int GameState::getQueued(int i) const
+{
+	Random generator = { random };
+	uint32_t order = bag;
+	int index = getBagIndex();
+	for (int k = 0; k <= i; k++)
+	{
+		index = (index + 1) % NUM_BLOCK_TYPES;
+		if (index == 0)
+		{
+			order = shuffleBag(generator);
+		}
+	}
+	return (order >> (index * 3)) & 7;
+}
+
+// Places the active block, holding it first if asked to, then clears lines
+// and spawns the next block. The spot must fit the block and rest on the
+// stack or floor. Returns the number of lines cleared, or -1 without changing
+// anything if the move isn't allowed. Fills in the undo record if given one.
+int GameState::apply(const GameMove& move, GameUndo* undo)
+{
+	if (type == NO_BLOCK || move.rotation < 0 || move.rotation >= NUM_ROTATIONS || (move.hold && !canSwap()))
+	{
+		return -1;
+	}
+
+	GameUndo record;
+	memcpy(record.status, &random, sizeof(record.status));
+	record.clearedRows = 0;
+	record.type = NO_BLOCK;
+
+	if (move.hold)
+	{
+		int previous = held;
+		held = type;
+		flags &= ~STATE_CAN_SWAP;
+		if (previous == NO_BLOCK)
+		{
+			spawn();
+		}
+		else
+		{
+			type = (int8_t)previous;
+		}
+	}
+
+	if (!canOccupy(type, move.rotation, move.x, move.y) || canOccupy(type, move.rotation, move.x, move.y - 1))
+	{
+		memcpy(&random, record.status, sizeof(record.status));
+		return -1;
+	}
+
+	// Game over if the block doesn't fit on the board
+	const BlockShape& shape = BLOCK_SHAPES[type][move.rotation];
+	rotation = move.rotation;
+	x = move.x;
+	y = move.y;
+	flags |= STATE_CAN_SWAP;
+	if (move.y + shape.top >= GRID_HEIGHT)
+	{
+		type = NO_BLOCK;
+		flags |= STATE_GAME_OVER;
+		if (undo)
+		{
+			*undo = record;
+		}
+		return 0;
+	}
+
+	// Merge the cells
+	for (int j = shape.bottom; j <= shape.top; j++)
+	{
+		rows[move.y + j] |= GameBoard::shiftRow(shape.rows[j], move.x);
+	}
+	record.x = move.x;
+	record.y = move.y;
+	record.type = type;
+	record.rotation = move.rotation;
+
+	// Clear completed lines, moving the rows above them down
+	int cleared = 0;
+	int write = move.y + shape.bottom;
+	for (int read = write; read < GRID_HEIGHT; read++)
+	{
+		if (read <= move.y + shape.top && rows[read] == FULL_ROW)
+		{
+			record.clearedRows |= 1u << read;
+			cleared++;
+		}
+		else
+		{
+			rows[write++] = rows[read];
+		}
+	}
+	for (; write < GRID_HEIGHT; write++)
+	{
+		rows[write] = 0;
+	}
+	if (cleared > 0)
+	{
+		score += LINE_SCORES[cleared - 1];
+		lines = (uint16_t)(lines + cleared);
+	}
+
+	spawn();
+	if (undo)
+	{
+		*undo = record;
+	}
+	return cleared;
+}
+
+// Takes back the move apply() filled in the undo record for.
+// Must be called on the state apply() left behind.
+void GameState::undo(const GameUndo& record)
+{
+	if (record.type != NO_BLOCK)
+	{
+		// Put the cleared lines back under the rows that fell onto them
+		if (record.clearedRows != 0)
+		{
+			uint16_t restored[GRID_HEIGHT];
+			int read = 0;
+			for (int j = 0; j < GRID_HEIGHT; j++)
+			{
+				restored[j] = (record.clearedRows & (1u << j)) ? (uint16_t)FULL_ROW : rows[read++];
+			}
+			memcpy(rows, restored, sizeof(rows));
+		}
+
+		// Take the block's cells back out
+		const BlockShape& shape = BLOCK_SHAPES[record.type][record.rotation];
+		for (int j = shape.bottom; j <= shape.top; j++)
+		{
+			rows[record.y + j] &= ~GameBoard::shiftRow(shape.rows[j], record.x);
+		}
+	}
+	memcpy(&random, record.status, sizeof(record.status));
+}
+
+// Pushes the stack up and fills the bottom rows with garbage that has a
+// gap in the given column. Tops the game out, returning false, if that
+// pushes any cells off the board.
+bool GameState::addGarbage(int count, int holeColumn)
+{
+	if (count <= 0 || isGameOver())
+	{
+		return !isGameOver();
+	}
+	if (count > GRID_HEIGHT)
+	{
+		count = GRID_HEIGHT;
+	}
+
+	uint16_t pushedOut = 0;
+	for (int j = GRID_HEIGHT - count; j < GRID_HEIGHT; j++)
+	{
+		pushedOut |= rows[j];
+	}
+	memmove(&rows[count], &rows[0], (GRID_HEIGHT - count) * sizeof(rows[0]));
+	uint16_t garbage = (uint16_t)(FULL_ROW & ~(1 << holeColumn));
+	for (int j = 0; j < count; j++)
+	{
+		rows[j] = garbage;
+	}
+
+	if (pushedOut != 0)
+	{
+		type = NO_BLOCK;
+		flags |= STATE_GAME_OVER;
+		return false;
+	}
+	return true;
+}
+
+// Spawns the next block in the order at the top of the board
+void GameState::spawn()
+{
+	int index = (getBagIndex() + 1) % NUM_BLOCK_TYPES;
+	if (index == 0)
+	{
+		shuffle();
+	}
+	flags = (uint8_t)((flags & ~STATE_BAG_INDEX) | index);
+	type = (int8_t)getBagType(index);
+	rotation = 0;
+	x = SPAWN_X;
+	y = SPAWN_Y;
+}
+
+// Shuffles the order of block types to spawn
+void GameState::shuffle()
+{
+	Random generator = { random };
+	bag = shuffleBag(generator);
+	random = generator.state;
+}
@@ -0,0 +1,90 @@
+#ifndef GAMESTATE_H
+#define GAMESTATE_H
+
+#include "BlockShapes.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <type_traits>
+
+// No block type (e.g. nothing held)
+#define NO_BLOCK -1
+
+// Where new blocks appear
+#define SPAWN_X (GRID_WIDTH / 2 - 2)
+#define SPAWN_Y GRID_HEIGHT
+
+// Points rewarded for clearing 1-4 lines at once
+constexpr int LINE_SCORES[4] = { 40, 100, 300, 1200 };
+
+// Bits of GameState::flags
+#define STATE_BAG_INDEX 0x07
+#define STATE_CAN_SWAP 0x08
+#define STATE_GAME_OVER 0x10
+
+// Placing the active block at a resting spot, optionally after
+// swapping it with the held block
+struct GameMove
+{
+	int8_t x;
+	int8_t y;
+	int8_t rotation;
+	bool hold;
+};
+
+// What GameState::apply() changed, so it can be taken back. Everything
+// after the rows is copied, the rows are restored from the placed
+// block and the lines it cleared.
+struct GameUndo
+{
+	uint8_t status[24];
+	uint32_t clearedRows;
+	int8_t x;
+	int8_t y;
+	int8_t type;
+	int8_t rotation;
+};
+
+// A whole game in 64 bytes with no pointers, for search and anything
+// else that copies positions in bulk. Works a placement at a time
+// rather than tick by tick, and keeps only the rules: the board has
+// no cell types and the block has no smooth movement. Follows the
+// same spawn order as a GameSimulation with the same seed.
+struct GameState
+{
+	uint16_t rows[GRID_HEIGHT];
+	uint64_t random;
+	uint32_t score;
+	uint32_t bag;		// Spawn order of the current bag, 3 bits per type
+	uint16_t lines;
+	int8_t type;		// Active block or NO_BLOCK once the game is over
+	int8_t rotation;
+	int8_t x;
+	int8_t y;
+	int8_t held;
+	uint8_t flags;
+
+	void reset(uint64_t seed);
+	bool canOccupy(int blockType, int blockRotation, int blockX, int blockY) const;
+	int dropY(int blockType, int blockRotation, int blockX, int blockY) const;
+	int getQueued(int i) const;
+
+	int apply(const GameMove& move, GameUndo* undo = NULL);
+	void undo(const GameUndo& undo);
+	bool addGarbage(int count, int holeColumn);
+
+	bool isGameOver() const { return (flags & STATE_GAME_OVER) != 0; }
+	bool canSwap() const { return (flags & STATE_CAN_SWAP) != 0; }
+	int getBagIndex() const { return flags & STATE_BAG_INDEX; }
+	int getBagType(int i) const { return (bag >> (i * 3)) & 7; }
+
+private:
+	void spawn();
+	void shuffle();
+};
+
+static_assert(sizeof(GameState) == 64, "GameState should fill one cache line");
+static_assert(std::is_trivially_copyable<GameState>::value, "GameState must copy with memcpy");
+static_assert(sizeof(GameState) - offsetof(GameState, random) == sizeof(GameUndo().status), "GameUndo must hold everything after the rows");
+
+#endif
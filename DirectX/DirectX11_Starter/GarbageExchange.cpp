@@ -0,0 +1,258 @@
+#include "GarbageExchange.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// Mixed into the game's seed for the gap columns, so they don't follow
+// the blocks
+#define GARBAGE_SEED 0x6A09E667F3BCC908ULL
+
+const AttackTable CLASSIC_ATTACK =
+{
+	{ 0, 1, 2, 4 },
+	{ 0 },
+	0,
+	GRID_HEIGHT
+};
+
+const AttackTable MODERN_ATTACK =
+{
+	{ 0, 1, 2, 4 },
+	{ 0, 0, 1, 1, 1, 2, 2, 3, 3, 4, 4, 4 },
+	10,
+	8
+};
+
+// Reads an attack table by name or as four row counts
+bool parseAttackTable(const char* text, AttackTable& table)
+{
+	if (strcmp(text, "classic") == 0 || strcmp(text, "modern") == 0)
+	{
+		table = strcmp(text, "classic") == 0 ? CLASSIC_ATTACK : MODERN_ATTACK;
+		return true;
+	}
+
+	AttackTable parsed = CLASSIC_ATTACK;
+	for (int i = 0; i < 4; i++)
+	{
+		char* end;
+		long rows = strtol(text, &end, 10);
+		if (end == text || rows < 0 || rows > GRID_HEIGHT || *end != (i < 3 ? ',' : '\0'))
+		{
+			return false;
+		}
+		parsed.clears[i] = (int)rows;
+		text = end + 1;
+	}
+	table = parsed;
+	return true;
+}
+
+GarbageExchange::GarbageExchange(int pPlayers, const AttackTable& pTable)
+{
+	table = pTable;
+	players = pPlayers < 2 ? 2 : (pPlayers > MAX_VERSUS_PLAYERS ? MAX_VERSUS_PLAYERS : pPlayers);
+	memset(queues, 0, sizeof(queues));
+	reset(0);
+}
+
+// Starts a new game, with nothing waiting and every player in
+void GarbageExchange::reset(uint64_t seed)
+{
+	for (int p = 0; p < players; p++)
+	{
+		GarbageQueue& queue = queues[p];
+		queue.first = 0;
+		queue.count = 0;
+		queue.pending = 0;
+		queue.combo = 0;
+		queue.target = p;
+		queue.alive = true;
+		queue.holes.seed(seed ^ GARBAGE_SEED);
+		queue.sent = 0;
+		queue.cancelled = 0;
+		queue.received = 0;
+	}
+}
+
+// Works out the rows a player's placement is worth, cancels them against
+// the garbage waiting for them and sends the rest on. Must be called
+// after every placement, clearing or not, to keep the combo count.
+// Returns the rows sent.
+int GarbageExchange::sendAttack(int player, int cleared, bool perfectClear)
+{
+	GarbageQueue& queue = queues[player];
+	if (cleared <= 0)
+	{
+		queue.combo = 0;
+		return 0;
+	}
+
+	int combo = queue.combo < ATTACK_COMBOS ? queue.combo : ATTACK_COMBOS - 1;
+	int rows = table.clears[(cleared > 4 ? 4 : cleared) - 1] + table.combo[combo] + (perfectClear ? table.perfectClear : 0);
+	queue.combo++;
+	rows -= cancel(queue, rows);
+	if (rows <= 0)
+	{
+		return 0;
+	}
+
+	// The next opponent in turn still in the game
+	for (int i = 1; i <= players; i++)
+	{
+		int target = (queue.target + i) % players;
+		if (target != player && queues[target].alive)
+		{
+			queue.target = target;
+			queueGarbage(target, rows);
+			queue.sent += rows;
+			return rows;
+		}
+	}
+	return 0;
+}
+
+// Takes up to the cap's worth of rows off the front of a player's queue
+// into at most GARBAGE_QUEUE batches. Returns the number of batches.
+int GarbageExchange::takeGarbage(int player, GarbageBatch* batches)
+{
+	GarbageQueue& queue = queues[player];
+	int left = table.cap;
+	int taken = 0;
+	while (left > 0 && queue.count > 0)
+	{
+		GarbageBatch& front = queue.batches[queue.first];
+		int rows = front.rows < left ? front.rows : left;
+		batches[taken].rows = (uint8_t)rows;
+		batches[taken].hole = front.hole;
+		taken++;
+		left -= rows;
+		queue.pending -= rows;
+		queue.received += rows;
+		front.rows = (uint8_t)(front.rows - rows);
+		if (front.rows == 0)
+		{
+			queue.first = (queue.first + 1) % GARBAGE_QUEUE;
+			queue.count--;
+		}
+	}
+	return taken;
+}
+
+// Pushes a player's waiting garbage into their board after a placement
+// that cleared nothing. Returns false if it topped them out.
+bool GarbageExchange::receiveGarbage(int player, GameState& state)
+{
+	GarbageBatch batches[GARBAGE_QUEUE];
+	int count = takeGarbage(player, batches);
+	for (int i = 0; i < count; i++)
+	{
+		if (!state.addGarbage(batches[i].rows, batches[i].hole))
+		{
+			return false;
+		}
+	}
+	return !state.isGameOver();
+}
+
+// Pushes a player's waiting garbage into their game after a placement
+// that cleared nothing. Returns false if it topped them out.
+bool GarbageExchange::receiveGarbage(int player, GameSimulation& simulation)
+{
+	GarbageBatch batches[GARBAGE_QUEUE];
+	int count = takeGarbage(player, batches);
+	for (int i = 0; i < count; i++)
+	{
+		if (!simulation.addGarbage(batches[i].rows, batches[i].hole))
+		{
+			return false;
+		}
+	}
+	return !simulation.isGameOver();
+}
+
+// Takes a player out, so nothing more is sent to them
+void GarbageExchange::eliminate(int player)
+{
+	queues[player].alive = false;
+}
+
+// Mixes the bytes of a value into an FNV-1a hash
+static uint64_t mixHash(uint64_t hash, uint64_t value)
+{
+	for (int b = 0; b < 64; b += 8)
+	{
+		hash = (hash ^ ((value >> b) & 0xFF)) * 0x100000001B3ULL;
+	}
+	return hash;
+}
+
+// Mixes everything that decides how the game goes on into a hash,
+// field by field so padding doesn't count. Exchanges with the same
+// checksum behave the same from then on.
+uint64_t GarbageExchange::getChecksum(uint64_t hash) const
+{
+	for (int p = 0; p < players; p++)
+	{
+		const GarbageQueue& queue = queues[p];
+		hash = mixHash(hash, (uint64_t)queue.pending << 32 | (uint32_t)queue.combo);
+		hash = mixHash(hash, (uint64_t)queue.target << 32 | (queue.alive ? 1 : 0));
+		hash = mixHash(hash, queue.holes.state);
+		hash = mixHash(hash, (uint64_t)queue.sent << 32 | queue.cancelled);
+		hash = mixHash(hash, (uint64_t)queue.received << 32 | (uint32_t)queue.count);
+		for (int i = 0; i < queue.count; i++)
+		{
+			const GarbageBatch& batch = queue.batches[(queue.first + i) % GARBAGE_QUEUE];
+			hash = mixHash(hash, batch.rows << 8 | batch.hole);
+		}
+	}
+	return hash;
+}
+
+// Takes rows off the front of a queue, returning how many it had
+int GarbageExchange::cancel(GarbageQueue& queue, int rows)
+{
+	int cancelled = 0;
+	while (rows > cancelled && queue.count > 0)
+	{
+		GarbageBatch& front = queue.batches[queue.first];
+		int taken = front.rows < rows - cancelled ? front.rows : rows - cancelled;
+		front.rows = (uint8_t)(front.rows - taken);
+		cancelled += taken;
+		if (front.rows == 0)
+		{
+			queue.first = (queue.first + 1) % GARBAGE_QUEUE;
+			queue.count--;
+		}
+	}
+	queue.pending -= cancelled;
+	queue.cancelled += cancelled;
+	return cancelled;
+}
+
+// Adds a batch of garbage with a new gap to the back of a player's queue
+void GarbageExchange::queueGarbage(int player, int rows)
+{
+	GarbageQueue& queue = queues[player];
+	if (rows > GRID_HEIGHT)
+	{
+		rows = GRID_HEIGHT;
+	}
+	int hole = queue.holes.nextInt(GRID_WIDTH);
+	if (queue.count == GARBAGE_QUEUE)
+	{
+		// Full, so the rows join the newest batch and its gap
+		GarbageBatch& last = queue.batches[(queue.first + queue.count - 1) % GARBAGE_QUEUE];
+		int total = last.rows + rows;
+		rows = (total > 255 ? 255 : total) - last.rows;
+		last.rows = (uint8_t)(last.rows + rows);
+	}
+	else
+	{
+		GarbageBatch& batch = queue.batches[(queue.first + queue.count) % GARBAGE_QUEUE];
+		batch.rows = (uint8_t)rows;
+		batch.hole = (uint8_t)hole;
+		queue.count++;
+	}
+	queue.pending += rows;
+}
@@ -0,0 +1,106 @@
+#ifndef GARBAGEEXCHANGE_H
+#define GARBAGEEXCHANGE_H
+
+#include "GameSimulation.h"
+#include "GameState.h"
+#include "Random.h"
+
+#include <stdint.h>
+#include <type_traits>
+
+// Most players in one exchange
+#define MAX_VERSUS_PLAYERS 8
+
+// Entries in an attack table's combo list, and batches of garbage a
+// player can have waiting before new ones are merged into the last
+#define ATTACK_COMBOS 12
+#define GARBAGE_QUEUE 16
+
+// Rows of garbage sent for a clear
+struct AttackTable
+{
+	int clears[4];					// For clearing 1-4 lines at once
+	int combo[ATTACK_COMBOS];		// Added for the n-th clearing placement in a row, the last repeating
+	int perfectClear;				// Added for emptying the board
+	int cap;						// Most rows pushed in after one placement
+};
+
+// Rows for doubles, triples and fours only
+extern const AttackTable CLASSIC_ATTACK;
+
+// The classic rows plus combos and perfect clears, as most modern
+// versus games play
+extern const AttackTable MODERN_ATTACK;
+
+// Reads an attack table by name ("classic" or "modern"), or as four
+// comma-separated row counts for 1-4 lines with no combos
+bool parseAttackTable(const char* text, AttackTable& table);
+
+// Rows of garbage waiting to be pushed in, all with the same gap
+struct GarbageBatch
+{
+	uint8_t rows;
+	uint8_t hole;
+};
+
+// The garbage rules of a versus game between two or more boards. A
+// clear's rows first cancel the garbage waiting for the player who made
+// it, oldest first, and the rest is sent to the next opponent still in
+// the game in turn. Garbage waits until its player places a block without
+// clearing, then up to the table's cap of rows is pushed in.
+//
+// Each batch's gap column is drawn from the receiving player's own
+// generator, seeded from the game, so a game plays out the same from
+// the same seed, and players given the same garbage get the same gaps.
+// Holds no pointers and copies with memcpy, so it can be saved and
+// restored with the boards.
+class GarbageExchange
+{
+public:
+	GarbageExchange(int players = 2, const AttackTable& table = CLASSIC_ATTACK);
+
+	void reset(uint64_t seed);
+	int sendAttack(int player, int cleared, bool perfectClear);
+	int takeGarbage(int player, GarbageBatch* batches);
+	bool receiveGarbage(int player, GameState& state);
+	bool receiveGarbage(int player, GameSimulation& simulation);
+	void eliminate(int player);
+	uint64_t getChecksum(uint64_t hash) const;
+
+	int getPlayers() const { return players; }
+	const AttackTable& getTable() const { return table; }
+	bool isAlive(int player) const { return queues[player].alive; }
+	int getPending(int player) const { return queues[player].pending; }
+	int getCombo(int player) const { return queues[player].combo; }
+	uint32_t getSent(int player) const { return queues[player].sent; }
+	uint32_t getCancelled(int player) const { return queues[player].cancelled; }
+	uint32_t getReceived(int player) const { return queues[player].received; }
+
+private:
+	// A player's waiting garbage, a ring of batches, and their totals
+	struct GarbageQueue
+	{
+		GarbageBatch batches[GARBAGE_QUEUE];
+		int first;
+		int count;
+		int pending;	// Rows across the batches
+		int combo;		// Clearing placements in a row
+		int target;		// Last player sent to
+		bool alive;
+		Random holes;
+		uint32_t sent;
+		uint32_t cancelled;
+		uint32_t received;
+	};
+
+	AttackTable table;
+	int players;
+	GarbageQueue queues[MAX_VERSUS_PLAYERS];
+
+	int cancel(GarbageQueue& queue, int rows);
+	void queueGarbage(int player, int rows);
+};
+
+static_assert(std::is_trivially_copyable<GarbageExchange>::value, "GarbageExchange must copy with memcpy");
+
+#endif
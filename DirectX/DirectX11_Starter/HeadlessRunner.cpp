@@ -0,0 +1,378 @@
+#include "HeadlessRunner.h"
+#include "GameSimulation.h"
+#include "Serialize.h"
+
+#include <algorithm>
+#include <math.h>
+
+// Buckets in a printed histogram, and the width of its longest bar
+#define HISTOGRAM_BUCKETS 10
+#define HISTOGRAM_WIDTH 40
+
+// Fills in the default bot
+void setDefaultBot(BotSettings& settings)
+{
+	settings.placements = false;
+	settings.width = BOT_WIDTH;
+	settings.depth = BOT_DEPTH;
+	settings.pieces = DEFAULT_MAX_PIECES;
+	for (int i = 0; i < NUM_FEATURES; i++)
+	{
+		settings.weights[i] = DEFAULT_WEIGHTS[i];
+	}
+	settings.scoreWeight = SCORE_WEIGHT;
+}
+
+// Plays a game tick by tick, the autoplayer pressing the inputs
+GameResult playTickGame(uint64_t seed, Autoplayer& player, uint32_t maxPieces)
+{
+	GameSimulation simulation(seed);
+	player.reset();
+	uint32_t ticks = 0;
+	while (!simulation.isGameOver() && (uint32_t)simulation.getPieces() < maxPieces)
+	{
+		simulation.tick(player.getInput(simulation));
+		ticks++;
+	}
+
+	GameResult result;
+	result.seed = seed;
+	result.score = (uint32_t)simulation.getScore();
+	result.lines = (uint32_t)simulation.getLines();
+	result.pieces = (uint32_t)simulation.getPieces();
+	result.ticks = ticks;
+	result.toppedOut = simulation.isGameOver();
+	return result;
+}
+
+// Plays a game a placement at a time, giving up if the agent finds no move
+GameResult playPlacementGame(uint64_t seed, Agent& agent, uint32_t maxPieces)
+{
+	GameState state;
+	state.reset(seed);
+	uint32_t pieces = 0;
+	GameMove move;
+	while (!state.isGameOver() && pieces < maxPieces && agent.search(state, move) && state.apply(move) >= 0)
+	{
+		// The placement that tops out isn't counted, as in a GameSimulation
+		if (!state.isGameOver())
+		{
+			pieces++;
+		}
+	}
+
+	GameResult result;
+	result.seed = seed;
+	result.score = state.score;
+	result.lines = state.lines;
+	result.pieces = pieces;
+	result.ticks = 0;
+	result.toppedOut = state.isGameOver() || pieces < maxPieces;
+	return result;
+}
+
+// Fills in what a game played from a recording came to at a tick
+static GameResult getReplayResult(uint64_t seed, const GameSimulation& simulation, uint32_t ticks)
+{
+	GameResult result;
+	result.seed = seed;
+	result.score = (uint32_t)simulation.getScore();
+	result.lines = (uint32_t)simulation.getLines();
+	result.pieces = (uint32_t)simulation.getPieces();
+	result.ticks = ticks;
+	result.toppedOut = simulation.isGameOver();
+	return result;
+}
+
+// Plays a recorded game through to its last tick, or to the given one
+GameResult playReplay(ReplayPlayer& replay, uint32_t stopTick)
+{
+	replay.restart();
+	GameSimulation simulation(replay.getSeed());
+	while (!replay.isFinished() && replay.getTick() < stopTick)
+	{
+		simulation.tick(replay.next());
+	}
+	return getReplayResult(replay.getSeed(), simulation, replay.getTick());
+}
+
+// Seeks an archived game to its last tick, or to the given one, which
+// plays at most a keyframe interval of it. Returns false if the archive
+// is damaged.
+bool playArchive(ReplayArchive& archive, GameResult& result, uint32_t stopTick)
+{
+	GameSimulation simulation(archive.getSeed());
+	uint32_t target = stopTick < archive.getLength() ? stopTick : archive.getLength();
+	if (!archive.seek(target, simulation))
+	{
+		return false;
+	}
+	result = getReplayResult(archive.getSeed(), simulation, archive.getTick());
+	return true;
+}
+
+ResultSummary::ResultSummary()
+{
+	clear();
+}
+
+// Counts a game
+void ResultSummary::add(const GameResult& result)
+{
+	scores[result.score]++;
+	lines[result.lines]++;
+	games++;
+	ticks += result.ticks;
+	pieces += result.pieces;
+	toppedOut += result.toppedOut ? 1 : 0;
+}
+
+// Counts every game of another summary
+void ResultSummary::merge(const ResultSummary& other)
+{
+	for (Counts::const_iterator it = other.scores.begin(); it != other.scores.end(); ++it)
+	{
+		scores[it->first] += it->second;
+	}
+	for (Counts::const_iterator it = other.lines.begin(); it != other.lines.end(); ++it)
+	{
+		lines[it->first] += it->second;
+	}
+	games += other.games;
+	ticks += other.ticks;
+	pieces += other.pieces;
+	toppedOut += other.toppedOut;
+}
+
+// Forgets every game
+void ResultSummary::clear()
+{
+	scores.clear();
+	lines.clear();
+	games = 0;
+	ticks = 0;
+	pieces = 0;
+	toppedOut = 0;
+}
+
+// Retrieves the average score of the games
+double ResultSummary::getMeanScore() const
+{
+	return getMean(scores, games);
+}
+
+// Retrieves the average lines cleared in the games
+double ResultSummary::getMeanLines() const
+{
+	return getMean(lines, games);
+}
+
+// Writes the rates over the given time and the score and line
+// distributions
+void ResultSummary::print(FILE* out, double seconds) const
+{
+	double rate = seconds > 0 ? 1.0 / seconds : 0;
+	fprintf(out, "games      %llu (%llu topped out) in %.2f s\n",
+		(unsigned long long)games, (unsigned long long)toppedOut, seconds);
+	fprintf(out, "games/s    %.1f\n", games * rate);
+	fprintf(out, "pieces/s   %.0f\n", pieces * rate);
+	if (ticks > 0)
+	{
+		fprintf(out, "ticks/s    %.0f\n", ticks * rate);
+	}
+	printDistribution(out, "score", scores, games);
+	printDistribution(out, "lines", lines, games);
+}
+
+// Appends the summary as varints: the totals, then each distribution
+void ResultSummary::write(std::vector<uint8_t>& out) const
+{
+	writeVarint(out, games);
+	writeVarint(out, ticks);
+	writeVarint(out, pieces);
+	writeVarint(out, toppedOut);
+	writeCounts(out, scores);
+	writeCounts(out, lines);
+}
+
+// Replaces the summary with one written by write(), returning false if
+// the data doesn't hold one
+bool ResultSummary::read(const uint8_t* data, size_t size)
+{
+	clear();
+	size_t position = 0;
+	if (!readVarint(data, size, &position, &games) || !readVarint(data, size, &position, &ticks) ||
+		!readVarint(data, size, &position, &pieces) || !readVarint(data, size, &position, &toppedOut) ||
+		!readCounts(data, size, &position, scores) || !readCounts(data, size, &position, lines) || position != size)
+	{
+		clear();
+		return false;
+	}
+	return true;
+}
+
+// Finds the average of counted values
+double ResultSummary::getMean(const Counts& counts, uint64_t total)
+{
+	double sum = 0;
+	for (Counts::const_iterator it = counts.begin(); it != counts.end(); ++it)
+	{
+		sum += (double)it->first * it->second;
+	}
+	return total > 0 ? sum / total : 0;
+}
+
+// Writes the mean, percentiles and a histogram of counted values
+void ResultSummary::printDistribution(FILE* out, const char* name, const Counts& counts, uint64_t total)
+{
+	if (total == 0)
+	{
+		return;
+	}
+	double mean = getMean(counts, total);
+	double variance = 0;
+	for (Counts::const_iterator it = counts.begin(); it != counts.end(); ++it)
+	{
+		variance += (it->first - mean) * (it->first - mean) * it->second;
+	}
+	double deviation = sqrt(variance / total);
+
+	// Walks the values in order to find the one at each rank
+	const int percents[] = { 10, 50, 90, 99 };
+	uint32_t percentiles[4];
+	Counts::const_iterator walk = counts.begin();
+	uint64_t seen = walk->second;
+	for (int p = 0; p < 4; p++)
+	{
+		uint64_t rank = total * percents[p] / 100;
+		while (seen <= rank)
+		{
+			++walk;
+			seen += walk->second;
+		}
+		percentiles[p] = walk->first;
+	}
+	uint32_t lowest = counts.begin()->first;
+	uint32_t highest = counts.rbegin()->first;
+	fprintf(out, "\n%s: mean %.1f sd %.1f min %u p10 %u p50 %u p90 %u p99 %u max %u\n", name, mean, deviation,
+		lowest, percentiles[0], percentiles[1], percentiles[2], percentiles[3], highest);
+
+	uint32_t width = (highest - lowest) / HISTOGRAM_BUCKETS + 1;
+	uint64_t buckets[HISTOGRAM_BUCKETS] = { 0 };
+	uint64_t most = 0;
+	for (Counts::const_iterator it = counts.begin(); it != counts.end(); ++it)
+	{
+		uint64_t& bucket = buckets[(it->first - lowest) / width];
+		bucket += it->second;
+		most = std::max(most, bucket);
+	}
+	for (int b = 0; b < HISTOGRAM_BUCKETS; b++)
+	{
+		int bar = (int)(buckets[b] * HISTOGRAM_WIDTH / most);
+		fprintf(out, "  %10u-%-10u %8llu %.*s\n", lowest + b * width, lowest + (b + 1) * width - 1,
+			(unsigned long long)buckets[b], bar, "########################################");
+	}
+}
+
+// Appends counted values as the number of them, then each as the gap
+// from the last value and its count
+void ResultSummary::writeCounts(std::vector<uint8_t>& out, const Counts& counts)
+{
+	writeVarint(out, counts.size());
+	uint32_t last = 0;
+	for (Counts::const_iterator it = counts.begin(); it != counts.end(); ++it)
+	{
+		writeVarint(out, it->first - last);
+		writeVarint(out, it->second);
+		last = it->first;
+	}
+}
+
+// Reads counted values written by writeCounts()
+bool ResultSummary::readCounts(const uint8_t* data, size_t size, size_t* position, Counts& counts)
+{
+	uint64_t entries;
+	if (!readVarint(data, size, position, &entries))
+	{
+		return false;
+	}
+	uint64_t value = 0;
+	for (uint64_t i = 0; i < entries; i++)
+	{
+		uint64_t gap;
+		uint64_t count;
+		if (!readVarint(data, size, position, &gap) || !readVarint(data, size, position, &count))
+		{
+			return false;
+		}
+		value += gap;
+		if (value > UINT32_MAX || (i > 0 && gap == 0))
+		{
+			return false;
+		}
+		counts[(uint32_t)value] = count;
+	}
+	return true;
+}
+
+BotGameJob::BotGameJob(const BotSettings& pSettings, int threads)
+{
+	settings = pSettings;
+	for (int i = 0; i < threads; i++)
+	{
+		BeamSearch* agent = new BeamSearch(settings.width, settings.depth, 1);
+		agent->setWeights(settings.weights);
+		agent->setScoreWeight(settings.scoreWeight);
+		if (settings.placements)
+		{
+			agents.push_back(agent);
+		}
+		else
+		{
+			players.push_back(new Autoplayer(agent, false));
+		}
+	}
+	firstSeed = 0;
+}
+
+BotGameJob::~BotGameJob()
+{
+	for (size_t i = 0; i < agents.size(); i++)
+	{
+		delete agents[i];
+	}
+	for (size_t i = 0; i < players.size(); i++)
+	{
+		delete players[i];
+	}
+}
+
+// Sets the seeds of the games the next run plays, firstSeed onwards
+void BotGameJob::setRange(uint64_t pFirstSeed, uint64_t count)
+{
+	firstSeed = pFirstSeed;
+	results.resize((size_t)count);
+}
+
+// Plays the game of one seed in the range
+void BotGameJob::runItem(int thread, int64_t index)
+{
+	uint64_t seed = firstSeed + (uint64_t)index;
+	if (settings.placements)
+	{
+		results[(size_t)index] = playPlacementGame(seed, *agents[thread], settings.pieces);
+	}
+	else
+	{
+		results[(size_t)index] = playTickGame(seed, *players[thread], settings.pieces);
+	}
+}
+
+// Adds up the results of the last run
+void BotGameJob::summarize(ResultSummary& summary) const
+{
+	for (size_t i = 0; i < results.size(); i++)
+	{
+		summary.add(results[i]);
+	}
+}
@@ -0,0 +1,132 @@
+#ifndef HEADLESSRUNNER_H
+#define HEADLESSRUNNER_H
+
+#include "Agent.h"
+#include "Autoplayer.h"
+#include "BeamSearch.h"
+#include "Replay.h"
+#include "ReplayArchive.h"
+#include "WorkStealingPool.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <map>
+#include <vector>
+
+// Most blocks placed in a bot game before it's stopped, since a good
+// bot may never top out
+#define DEFAULT_MAX_PIECES 1000
+
+// Beam the simulator's bot searches with unless told otherwise
+#define BOT_WIDTH 8
+#define BOT_DEPTH 2
+
+// What a game played without a window came to
+struct GameResult
+{
+	uint64_t seed;
+	uint32_t score;
+	uint32_t lines;
+	uint32_t pieces;
+	uint32_t ticks;		// 0 for games played a placement at a time
+	bool toppedOut;
+};
+
+// How bot games are played
+struct BotSettings
+{
+	bool placements;	// A placement at a time rather than tick by tick
+	int width;
+	int depth;
+	uint32_t pieces;	// Most blocks placed in a game
+	int32_t weights[NUM_FEATURES];
+	int32_t scoreWeight;
+};
+
+// Fills in the default bot: placements off, the default beam, weights
+// and piece limit
+void setDefaultBot(BotSettings& settings);
+
+// Plays a game tick by tick with the full rules, the autoplayer pressing
+// the inputs. The autoplayer should search in the foreground so the game
+// is the same on every run.
+GameResult playTickGame(uint64_t seed, Autoplayer& player, uint32_t maxPieces);
+
+// Plays a game a placement at a time on a GameState, which skips the
+// block's movement and is far faster when only the result matters
+GameResult playPlacementGame(uint64_t seed, Agent& agent, uint32_t maxPieces);
+
+// Plays a recorded game through to its last tick, or to the given one
+GameResult playReplay(ReplayPlayer& replay, uint32_t stopTick = UINT32_MAX);
+
+// Seeks an archived game to its last tick, or to the given one, which
+// plays at most a keyframe interval of it. Returns false if the archive
+// is damaged.
+bool playArchive(ReplayArchive& archive, GameResult& result, uint32_t stopTick = UINT32_MAX);
+
+// Totals and distributions of many results. Values are counted rather
+// than kept, so a summary stays small however many games it covers.
+// Summaries from different threads or processes can be merged, and
+// written out to be sent elsewhere.
+class ResultSummary
+{
+public:
+	ResultSummary();
+
+	void add(const GameResult& result);
+	void merge(const ResultSummary& other);
+	void clear();
+	void print(FILE* out, double seconds) const;
+	void write(std::vector<uint8_t>& out) const;
+	bool read(const uint8_t* data, size_t size);
+
+	uint64_t getGames() const { return games; }
+	uint64_t getTicks() const { return ticks; }
+	uint64_t getPieces() const { return pieces; }
+	uint64_t getToppedOut() const { return toppedOut; }
+	double getMeanScore() const;
+	double getMeanLines() const;
+
+private:
+	typedef std::map<uint32_t, uint64_t> Counts;
+
+	Counts scores;
+	Counts lines;
+	uint64_t games;
+	uint64_t ticks;
+	uint64_t pieces;
+	uint64_t toppedOut;
+
+	static double getMean(const Counts& counts, uint64_t total);
+	static void printDistribution(FILE* out, const char* name, const Counts& counts, uint64_t total);
+	static void writeCounts(std::vector<uint8_t>& out, const Counts& counts);
+	static bool readCounts(const uint8_t* data, size_t size, size_t* position, Counts& counts);
+};
+
+// Plays the bot games of a range of seeds on a WorkStealingPool, with a
+// bot per thread. Results are kept by index so the summary doesn't
+// depend on which thread ran what.
+class BotGameJob : public PoolJob
+{
+public:
+	BotGameJob(const BotSettings& settings, int threads);
+	~BotGameJob();
+
+	void setRange(uint64_t firstSeed, uint64_t count);
+	void runItem(int thread, int64_t index);
+	void summarize(ResultSummary& summary) const;
+
+	uint64_t getCount() const { return results.size(); }
+
+private:
+	BotSettings settings;
+	std::vector<BeamSearch*> agents;
+	std::vector<Autoplayer*> players;
+	std::vector<GameResult> results;
+	uint64_t firstSeed;
+
+	BotGameJob(const BotGameJob& rhs);
+	BotGameJob& operator=(const BotGameJob& rhs);
+};
+
+#endif
@@ -0,0 +1,462 @@
+#include "LoadTester.h"
+#include "Serialize.h"
+
+#include <string.h>
+
+// Mixed into the load test's seed for each session's inputs
+#define INPUT_SEED 0x3C6EF372FE94F82BULL
+
+// Fills in the default load test
+void setDefaultLoad(LoadSettings& settings)
+{
+	settings.host = "127.0.0.1";
+	settings.port = DEFAULT_SERVER_PORT;
+	settings.loops = 1;
+	settings.sessions = 1000;
+	settings.threads = 0;
+	settings.inputDelay = DEFAULT_INPUT_DELAY;
+	settings.redundancy = DEFAULT_INPUT_REDUNDANCY;
+	settings.seed = 1;
+}
+
+// Retrieves how many round trips were timed
+uint64_t LoadStats::getLatencyCount() const
+{
+	uint64_t count = 0;
+	for (int i = 0; i < LATENCY_BUCKETS; i++)
+	{
+		count += latencies[i];
+	}
+	return count;
+}
+
+// Retrieves the round trip, in milliseconds, that the given fraction of
+// those timed were quicker than, to the nearest bucket
+double LoadStats::getLatency(double fraction) const
+{
+	uint64_t count = getLatencyCount();
+	uint64_t rank = (uint64_t)(count * fraction);
+	uint64_t seen = 0;
+	for (int i = 0; i < LATENCY_BUCKETS; i++)
+	{
+		seen += latencies[i];
+		if (seen > rank)
+		{
+			return (i + 1) * LATENCY_BUCKET / 1000.0;
+		}
+	}
+	return LATENCY_BUCKETS * LATENCY_BUCKET / 1000.0;
+}
+
+// Adds one client thread's counts to another's
+void addLoadStats(LoadStats& total, const LoadStats& client)
+{
+	total.playing += client.playing;
+	total.sent += client.sent;
+	total.received += client.received;
+	total.states += client.states;
+	total.welcomes += client.welcomes;
+	total.refused += client.refused;
+	total.games += client.games;
+	total.rejoins += client.rejoins;
+	for (int i = 0; i < LATENCY_BUCKETS; i++)
+	{
+		total.latencies[i] += client.latencies[i];
+	}
+}
+
+// Takes the sessions whose number is index, index + threads and so on
+LoadClient::LoadClient(int pIndex, const LoadSettings& pSettings, const NetAddress& server)
+	: slots(pSettings.loops > 0 ? pSettings.loops : 1, std::vector<int32_t>(MAX_LOOP_SESSIONS, -1))
+{
+	index = pIndex;
+	settings = pSettings;
+	settings.loops = (int)slots.size();
+	settings.inputDelay = settings.inputDelay < 0 ? 0 : (settings.inputDelay >= INPUT_WINDOW ? INPUT_WINDOW - 1 : settings.inputDelay);
+	settings.redundancy = settings.redundancy < 1 ? 1 : (settings.redundancy > MAX_PACKET_INPUTS ? MAX_PACKET_INPUTS : settings.redundancy);
+	for (int number = index; number < settings.sessions; number += settings.threads)
+	{
+		ClientSession session;
+		session.loop = number % settings.loops;
+		session.server = server;
+		session.server.port = (uint16_t)(server.port + session.loop);
+		session.state = CLIENT_IDLE;
+		session.generation = 0;
+		session.joinTick = 0;
+		session.slot = 0;
+		session.token = 0;
+		session.tick = 0;
+		session.acked = 0;
+		session.random.seed(settings.seed ^ (INPUT_SEED * (uint64_t)(number + 1)));
+		sessions.push_back(session);
+	}
+	incoming = new DatagramBatch();
+	outgoing = new DatagramBatch();
+	incoming->count = 0;
+	outgoing->count = 0;
+	tick = 0;
+	stopping = false;
+	memset(&stats, 0, sizeof(stats));
+	shared = stats;
+}
+
+LoadClient::~LoadClient()
+{
+	stop();
+	delete incoming;
+	delete outgoing;
+}
+
+// Opens the thread's socket on a free port
+bool LoadClient::open()
+{
+	return socket.bind(0);
+}
+
+// Starts playing on a thread of its own
+void LoadClient::start()
+{
+	stopping = false;
+	thread = std::thread(&LoadClient::run, this);
+}
+
+// Stops playing, leaving every session so the server can free them
+// straight away
+void LoadClient::stop()
+{
+	stopping = true;
+	if (thread.joinable())
+	{
+		thread.join();
+		for (size_t i = 0; i < sessions.size(); i++)
+		{
+			if (sessions[i].state == CLIENT_PLAYING)
+			{
+				sendLeave(sessions[i]);
+			}
+		}
+		flush();
+	}
+}
+
+// Copies the counts as of the thread's last tick
+void LoadClient::getStats(LoadStats& out)
+{
+	std::lock_guard<std::mutex> lock(statsMutex);
+	out = shared;
+}
+
+// Client thread: the same fixed tick as the server, taking what arrives
+// in between
+void LoadClient::run()
+{
+	const Clock::duration period = std::chrono::duration_cast<Clock::duration>(std::chrono::nanoseconds(1000000000 / TICKS_PER_SECOND));
+	Clock::time_point next = Clock::now();
+	while (!stopping)
+	{
+		Clock::time_point now = Clock::now();
+		if (now < next)
+		{
+			int milliseconds = (int)((std::chrono::duration_cast<std::chrono::microseconds>(next - now).count() + 999) / 1000);
+			socket.wait(milliseconds);
+		}
+		receivePackets();
+		now = Clock::now();
+		if (now >= next)
+		{
+			playTick();
+			next += period;
+			if (now - next > period * TICKS_PER_SECOND)
+			{
+				next = now + period;
+			}
+		}
+		flush();
+
+		std::lock_guard<std::mutex> lock(statsMutex);
+		shared = stats;
+	}
+}
+
+// Takes every datagram waiting, a batch at a time
+void LoadClient::receivePackets()
+{
+	while (true)
+	{
+		int count = socket.receive(*incoming);
+		for (int i = 0; i < count; i++)
+		{
+			const uint8_t* data = incoming->data[i];
+			int size = incoming->sizes[i];
+			if (size == WELCOME_SIZE && data[0] == PACKET_WELCOME)
+			{
+				handleWelcome(data, size);
+			}
+			else if (size == STATE_PACKET_SIZE && data[0] == PACKET_STATE)
+			{
+				handleState(data, size, incoming->addresses[i]);
+			}
+			else if (size == REFUSED_SIZE && data[0] == PACKET_REFUSED)
+			{
+				uint32_t nonce = readU32(data + 1);
+				uint32_t local = nonce & 0xFFFF;
+				if (local < sessions.size() && sessions[local].state == CLIENT_JOINING &&
+					(sessions[local].generation & 0xFFFF) == nonce >> 16)
+				{
+					sessions[local].state = CLIENT_IDLE;
+					stats.refused++;
+				}
+			}
+		}
+		stats.received += count > 0 ? count : 0;
+		if (count < DATAGRAM_BATCH)
+		{
+			return;
+		}
+	}
+}
+
+// Starts a session's game once the server has opened it
+void LoadClient::handleWelcome(const uint8_t* data, int size)
+{
+	(void)size;
+	uint32_t nonce = readU32(data + 1);
+	uint32_t local = nonce & 0xFFFF;
+	if (local >= sessions.size())
+	{
+		return;
+	}
+	ClientSession& session = sessions[local];
+	if (session.state != CLIENT_JOINING || (session.generation & 0xFFFF) != nonce >> 16)
+	{
+		return;
+	}
+	session.slot = readU16(data + 5);
+	session.token = readU32(data + 7);
+	session.state = CLIENT_PLAYING;
+	session.joinTick = tick;
+	session.tick = 0;
+	session.acked = 0;
+	slots[session.loop][session.slot] = (int32_t)local;
+	stats.welcomes++;
+	stats.playing++;
+}
+
+// Times the round trip of the newest input the state acknowledges, and
+// leaves the session once its game is over. If the server has played
+// past the inputs made, as when this thread was held up, the session's
+// clock is moved on so its inputs aren't all too late from then on.
+void LoadClient::handleState(const uint8_t* data, int size, const NetAddress& from)
+{
+	(void)size;
+	int loop = (int)from.port - (int)settings.port;
+	uint16_t slot = readU16(data + 1);
+	if (loop < 0 || loop >= settings.loops || slots[loop][slot] < 0)
+	{
+		return;
+	}
+	ClientSession& session = sessions[slots[loop][slot]];
+	stats.states++;
+
+	uint32_t played = readU32(data + 3);
+	if (tick - session.joinTick < played)
+	{
+		session.joinTick = tick - played;
+	}
+
+	uint32_t ack = readU32(data + 7);
+	if (ack > session.acked && ack <= session.tick)
+	{
+		uint32_t newest = ack - 1;
+		if (session.tick - newest <= INPUT_WINDOW)
+		{
+			int64_t micros = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - session.sentAt[newest % INPUT_WINDOW]).count();
+			int64_t bucket = micros / LATENCY_BUCKET;
+			stats.latencies[bucket < LATENCY_BUCKETS ? bucket : LATENCY_BUCKETS - 1]++;
+		}
+		session.acked = ack;
+	}
+
+	if ((data[11] & SESSION_GAME_OVER) != 0)
+	{
+		sendLeave(session);
+		stats.games++;
+	}
+}
+
+// Joins idle sessions, a few at a time, and sends every playing
+// session's inputs
+void LoadClient::playTick()
+{
+	tick++;
+	int joins = 0;
+	for (size_t i = 0; i < sessions.size(); i++)
+	{
+		ClientSession& session = sessions[i];
+		if (session.state == CLIENT_IDLE && joins < JOINS_PER_TICK)
+		{
+			sendJoin(session, (int)i);
+			joins++;
+		}
+		else if (session.state == CLIENT_JOINING && tick - session.joinTick > TICKS_PER_SECOND && joins < JOINS_PER_TICK)
+		{
+			sendJoin(session, (int)i);
+			joins++;
+			stats.rejoins++;
+		}
+		else if (session.state == CLIENT_PLAYING)
+		{
+			sendInputs(session);
+		}
+	}
+}
+
+// Asks the session's loop for a new game
+void LoadClient::sendJoin(ClientSession& session, int number)
+{
+	session.generation++;
+	session.joinTick = tick;
+	session.state = CLIENT_JOINING;
+	uint8_t* packet = queuePacket(session.server, JOIN_SIZE);
+	packet[0] = PACKET_JOIN;
+	writeU16(packet + 1, SERVER_PROTOCOL);
+	writeU32(packet + 3, (session.generation & 0xFFFF) << 16 | (uint32_t)number);
+}
+
+// Makes the inputs due, keeping the delay ahead of the client's clock,
+// and sends the newest few
+void LoadClient::sendInputs(ClientSession& session)
+{
+	Clock::time_point now = Clock::now();
+	uint32_t due = tick - session.joinTick + settings.inputDelay;
+	if (due >= session.tick + INPUT_WINDOW)
+	{
+		// Too far behind for the ones skipped to matter
+		session.tick = due - settings.inputDelay;
+	}
+	int made = 0;
+	while (session.tick <= due)
+	{
+		int roll = session.random.nextInt(100);
+		int input = roll < 2 ? INPUT_DROP : roll < 10 ? INPUT_LEFT : roll < 18 ? INPUT_RIGHT :
+			roll < 24 ? INPUT_ROTATE : roll < 40 ? INPUT_FAST_FALL : 0;
+		session.inputs[session.tick % INPUT_WINDOW] = (uint8_t)input;
+		session.sentAt[session.tick % INPUT_WINDOW] = now;
+		session.tick++;
+		made++;
+	}
+
+	int count = made > settings.redundancy ? made : settings.redundancy;
+	count = count > MAX_PACKET_INPUTS ? MAX_PACKET_INPUTS : count;
+	count = (uint32_t)count > session.tick ? (int)session.tick : count;
+	uint8_t* packet = queuePacket(session.server, INPUT_HEADER_SIZE + count);
+	packet[0] = PACKET_INPUT;
+	writeU16(packet + 1, session.slot);
+	writeU32(packet + 3, session.token);
+	writeU32(packet + 7, session.tick - 1);
+	packet[11] = (uint8_t)count;
+	for (int i = 0; i < count; i++)
+	{
+		packet[INPUT_HEADER_SIZE + i] = session.inputs[(session.tick - count + i) % INPUT_WINDOW];
+	}
+}
+
+// Leaves a session's game, so it joins again next tick
+void LoadClient::sendLeave(ClientSession& session)
+{
+	uint8_t* packet = queuePacket(session.server, LEAVE_SIZE);
+	packet[0] = PACKET_LEAVE;
+	writeU16(packet + 1, session.slot);
+	writeU32(packet + 3, session.token);
+	slots[session.loop][session.slot] = -1;
+	session.state = CLIENT_IDLE;
+	stats.playing--;
+}
+
+// Makes room for a datagram in the outgoing batch, sending the batch
+// first if it's full, and returns where to write it
+uint8_t* LoadClient::queuePacket(const NetAddress& to, int size)
+{
+	if (outgoing->count == DATAGRAM_BATCH)
+	{
+		flush();
+	}
+	int i = outgoing->count++;
+	outgoing->addresses[i] = to;
+	outgoing->sizes[i] = (uint16_t)size;
+	return outgoing->data[i];
+}
+
+// Sends the datagrams queued
+void LoadClient::flush()
+{
+	if (outgoing->count > 0)
+	{
+		int sent = socket.send(*outgoing);
+		stats.sent += sent > 0 ? sent : 0;
+	}
+}
+
+LoadTester::LoadTester(const LoadSettings& pSettings)
+{
+	settings = pSettings;
+	if (settings.threads <= 0)
+	{
+		settings.threads = (int)std::thread::hardware_concurrency();
+		settings.threads = settings.threads > 0 ? settings.threads : 1;
+	}
+}
+
+LoadTester::~LoadTester()
+{
+	stop();
+}
+
+// Finds the server and starts every client thread, returning false if
+// the host can't be found or a socket opened
+bool LoadTester::start()
+{
+	stop();
+	NetAddress server;
+	if (!resolveAddress(settings.host, settings.port, server))
+	{
+		return false;
+	}
+	for (int i = 0; i < settings.threads; i++)
+	{
+		LoadClient* client = new LoadClient(i, settings, server);
+		clients.push_back(client);
+		if (!client->open())
+		{
+			stop();
+			return false;
+		}
+	}
+	for (size_t i = 0; i < clients.size(); i++)
+	{
+		clients[i]->start();
+	}
+	return true;
+}
+
+// Stops every client thread, leaving their sessions
+void LoadTester::stop()
+{
+	for (size_t i = 0; i < clients.size(); i++)
+	{
+		delete clients[i];
+	}
+	clients.clear();
+}
+
+// Totals the counts of every client thread
+void LoadTester::getStats(LoadStats& total)
+{
+	memset(&total, 0, sizeof(total));
+	for (size_t i = 0; i < clients.size(); i++)
+	{
+		LoadStats client;
+		clients[i]->getStats(client);
+		addLoadStats(total, client);
+	}
+}
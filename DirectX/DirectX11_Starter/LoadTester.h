@@ -0,0 +1,163 @@
+#ifndef LOADTESTER_H
+#define LOADTESTER_H
+
+#include "GameServer.h"
+#include "Random.h"
+#include "Socket.h"
+
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Ticks ahead of a client's own clock its inputs are sent for, so they
+// reach the server before it plays those ticks, and inputs resent in
+// each packet
+#define DEFAULT_INPUT_DELAY 4
+#define DEFAULT_INPUT_REDUNDANCY 4
+
+// Joins each client thread sends a tick at most, so thousands of
+// sessions start over a second or two rather than all at once
+#define JOINS_PER_TICK 50
+
+// Round trips are counted in buckets this many microseconds wide, the
+// last taking everything longer
+#define LATENCY_BUCKET 250
+#define LATENCY_BUCKETS 1000
+
+// How a load test is run
+struct LoadSettings
+{
+	const char* host;
+	uint16_t port;		// Of the server's first loop
+	int loops;			// Server loops, sessions are spread over their ports
+	int sessions;
+	int threads;		// Client threads, 0 for one per core
+	int inputDelay;
+	int redundancy;		// Inputs per packet
+	uint64_t seed;		// Of the random inputs
+};
+
+// Fills in the default load test: loopback, one server loop, 1000
+// sessions
+void setDefaultLoad(LoadSettings& settings);
+
+// Counts kept by the client threads since they started
+struct LoadStats
+{
+	uint32_t playing;		// Sessions in a game now
+	uint64_t sent;			// Datagrams
+	uint64_t received;
+	uint64_t states;
+	uint64_t welcomes;
+	uint64_t refused;
+	uint64_t games;			// Finished by topping out
+	uint64_t rejoins;		// Joins sent again after no answer
+	uint64_t latencies[LATENCY_BUCKETS];	// From sending an input to a state acknowledging it
+
+	uint64_t getLatencyCount() const;
+	double getLatency(double fraction) const;
+};
+
+// Adds one client thread's counts to another's
+void addLoadStats(LoadStats& total, const LoadStats& client);
+
+// One thread of a LoadTester, playing its share of the sessions over
+// its own socket with random inputs
+class LoadClient
+{
+public:
+	LoadClient(int index, const LoadSettings& settings, const NetAddress& server);
+	~LoadClient();
+
+	bool open();
+	void start();
+	void stop();
+	void getStats(LoadStats& out);
+
+private:
+	typedef std::chrono::steady_clock Clock;
+
+	enum ClientState
+	{
+		CLIENT_IDLE,
+		CLIENT_JOINING,
+		CLIENT_PLAYING
+	};
+
+	// A session as the client sees it: its slot on a loop, and the
+	// inputs sent along with when, to time the round trips
+	struct ClientSession
+	{
+		NetAddress server;
+		int loop;
+		ClientState state;
+		uint32_t generation;	// Joins sent, so old welcomes are ignored
+		uint32_t joinTick;		// Client tick the last join was sent
+		uint16_t slot;
+		uint32_t token;
+		uint32_t tick;			// Inputs made
+		uint32_t acked;			// Newest input acknowledged, plus one
+		Random random;
+		uint8_t inputs[INPUT_WINDOW];
+		Clock::time_point sentAt[INPUT_WINDOW];
+	};
+
+	int index;
+	LoadSettings settings;
+	DatagramSocket socket;
+	std::vector<ClientSession> sessions;
+	std::vector<std::vector<int32_t> > slots;	// Session of each slot of each loop, or -1
+	DatagramBatch* incoming;
+	DatagramBatch* outgoing;
+	uint32_t tick;
+
+	std::thread thread;
+	std::atomic<bool> stopping;
+	std::mutex statsMutex;
+	LoadStats stats;
+	LoadStats shared;
+
+	void run();
+	void receivePackets();
+	void handleWelcome(const uint8_t* data, int size);
+	void handleState(const uint8_t* data, int size, const NetAddress& from);
+	void playTick();
+	void sendJoin(ClientSession& session, int number);
+	void sendInputs(ClientSession& session);
+	void sendLeave(ClientSession& session);
+	uint8_t* queuePacket(const NetAddress& to, int size);
+	void flush();
+
+	LoadClient(const LoadClient& rhs);
+	LoadClient& operator=(const LoadClient& rhs);
+};
+
+// Plays many sessions against a GameServer from a few threads, each
+// session joining, pressing random inputs every tick and joining again
+// once its game is over, to measure how many the server keeps up with.
+// Allocates nothing once the sessions are set up, so it adds as little
+// load of its own as it can when run on the same machine.
+class LoadTester
+{
+public:
+	LoadTester(const LoadSettings& settings);
+	~LoadTester();
+
+	bool start();
+	void stop();
+	void getStats(LoadStats& total);
+
+	int getThreads() const { return (int)clients.size(); }
+
+private:
+	LoadSettings settings;
+	std::vector<LoadClient*> clients;
+
+	LoadTester(const LoadTester& rhs);
+	LoadTester& operator=(const LoadTester& rhs);
+};
+
+#endif
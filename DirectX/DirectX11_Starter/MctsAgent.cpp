@@ -0,0 +1,506 @@
+#include "MctsAgent.h"
+#include "BeamSearch.h"
+#include "Zobrist.h"
+
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <chrono>
+#include <utility>
+
+// Nanoseconds on a clock that only goes forward
+static int64_t getTime()
+{
+	return (int64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Value of a position: its score and the shape of its board
+static double getValue(const GameState& state, int32_t evaluation)
+{
+	double value = (double)state.score * SCORE_WEIGHT + evaluation;
+	return state.isGameOver() ? value - MCTS_LOSS_PENALTY : value;
+}
+
+// Spreads the next block type over a hash
+#define NEXT_TYPE_KEY 0x9E3779B97F4A7C15ULL
+
+// Starts the helper threads. With threads 0, uses one thread per core,
+// counting the thread that calls search().
+MctsAgent::MctsAgent(int pBudget, int threads)
+	: rolloutMoves(AGENT_TABLE_ENTRIES)
+{
+	setBudget(pBudget);
+	setWeights(DEFAULT_WEIGHTS);
+	if (threads <= 0)
+	{
+		threads = (int)std::thread::hardware_concurrency();
+		threads = threads > 0 ? threads : 1;
+	}
+	for (int i = 0; i < threads; i++)
+	{
+		Worker* worker = new Worker();
+		worker->random.seed(i);
+		worker->rollouts = 0;
+		workers.push_back(worker);
+	}
+
+	reusable = false;
+	rollouts = 0;
+	rolloutsPerSecond = 0;
+	deadline = 0;
+	round = 0;
+	running = 0;
+	stopping = false;
+	for (int i = 1; i < threads; i++)
+	{
+		helpers.push_back(std::thread(&MctsAgent::runHelper, this, i));
+	}
+}
+
+// Stops the helper threads
+MctsAgent::~MctsAgent()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	wake.notify_all();
+	for (size_t i = 0; i < helpers.size(); i++)
+	{
+		helpers[i].join();
+	}
+	for (size_t i = 0; i < workers.size(); i++)
+	{
+		delete workers[i];
+	}
+}
+
+// Sets the weights of the board features, NUM_FEATURES of them. The
+// placements the rollouts picked with the old weights are dropped.
+void MctsAgent::setWeights(const int32_t* pWeights)
+{
+	for (int i = 0; i < NUM_FEATURES; i++)
+	{
+		weights[i] = pWeights[i];
+	}
+	rolloutMoves.clear();
+}
+
+// Searches for the time budget and picks the root move the threads
+// visited most between them, returning false if there is no move
+bool MctsAgent::search(const GameState& state, GameMove& move)
+{
+	if (state.isGameOver())
+	{
+		return false;
+	}
+
+	// The trees carry on if the game reached the position they expected
+	bool reuse = false;
+	uint32_t lastSituation = 0;
+	if (reusable)
+	{
+		GameState expected = lastRoot;
+		reuse = expected.apply(lastMove) >= 0 && memcmp(&expected, &state, sizeof(GameState)) == 0;
+		lastSituation = getSituation(lastRoot);
+	}
+	root = state;
+	for (size_t i = 0; i < workers.size(); i++)
+	{
+		Worker& worker = *workers[i];
+		int32_t child = -1;
+		if (reuse)
+		{
+			int32_t e = findExpansion(worker, 0, lastSituation);
+			for (int32_t c = 0; e >= 0 && c < worker.expansions[e].count; c++)
+			{
+				const GameMove& childMove = worker.nodes[worker.expansions[e].first + c].move;
+				if (memcmp(&childMove, &lastMove, sizeof(GameMove)) == 0)
+				{
+					child = worker.expansions[e].first + c;
+					break;
+				}
+			}
+		}
+		if (child >= 0)
+		{
+			reroot(worker, child);
+		}
+		else
+		{
+			MctsNode node;
+			node.move = GameMove();
+			node.expansion = -1;
+			node.visits = 0;
+			node.total = 0;
+			worker.nodes.assign(1, node);
+			worker.expansions.clear();
+			worker.minValue = HUGE_VAL;
+			worker.maxValue = -HUGE_VAL;
+		}
+		worker.rollouts = 0;
+	}
+
+	// Grow the trees until the time is up
+	int64_t start = getTime();
+	deadline = start + (int64_t)budget * 1000000;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		round++;
+		running = (int)helpers.size();
+	}
+	wake.notify_all();
+	grow(*workers[0]);
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		done.wait(lock, [this] { return running == 0; });
+	}
+	double seconds = (getTime() - start) / 1e9;
+
+	// Add up the root moves of every tree
+	std::vector<MctsNode> moves;
+	uint32_t situation = getSituation(root);
+	rollouts = 0;
+	for (size_t i = 0; i < workers.size(); i++)
+	{
+		const Worker& worker = *workers[i];
+		rollouts += worker.rollouts;
+		int32_t e = findExpansion(worker, 0, situation);
+		for (int32_t c = 0; e >= 0 && c < worker.expansions[e].count; c++)
+		{
+			const MctsNode& node = worker.nodes[worker.expansions[e].first + c];
+			size_t m = 0;
+			while (m < moves.size() && memcmp(&moves[m].move, &node.move, sizeof(GameMove)) != 0)
+			{
+				m++;
+			}
+			if (m == moves.size())
+			{
+				moves.push_back(node);
+			}
+			else
+			{
+				moves[m].visits += node.visits;
+				moves[m].total += node.total;
+			}
+		}
+	}
+	rolloutsPerSecond = seconds > 0 ? rollouts / seconds : 0;
+	if (moves.empty())
+	{
+		reusable = false;
+		return false;
+	}
+
+	size_t best = 0;
+	for (size_t m = 1; m < moves.size(); m++)
+	{
+		if (moves[m].visits > moves[best].visits ||
+			(moves[m].visits == moves[best].visits && moves[m].visits > 0 &&
+			moves[m].total / moves[m].visits > moves[best].total / moves[best].visits))
+		{
+			best = m;
+		}
+	}
+	move = moves[best].move;
+	lastRoot = root;
+	lastMove = move;
+	reusable = true;
+	return true;
+}
+
+// Runs iterations on a thread's tree until the deadline, at least one
+void MctsAgent::grow(Worker& worker)
+{
+	do
+	{
+		iterate(worker);
+	} while (getTime() < deadline);
+}
+
+// Plays down the tree against a new random order for the later bags,
+// adds a position at the end and scores it with a rollout
+void MctsAgent::iterate(Worker& worker)
+{
+	GameState state = root;
+	state.random = worker.random.next() | 1;
+	worker.path.assign(1, 0);
+	worker.pathExpansions.clear();
+
+	int32_t node = 0;
+	while (!state.isGameOver())
+	{
+		uint32_t situation = getSituation(state);
+		int32_t e = findExpansion(worker, node, situation);
+		if (e < 0)
+		{
+			e = expand(worker, node, state, situation);
+		}
+		if (e < 0 || worker.expansions[e].count == 0)
+		{
+			break;
+		}
+
+		node = select(worker, worker.expansions[e]);
+		state.apply(worker.nodes[node].move);
+		worker.path.push_back(node);
+		worker.pathExpansions.push_back(e);
+		if (worker.nodes[node].visits == 0)
+		{
+			break;
+		}
+	}
+
+	double value = rollout(worker, state);
+	worker.minValue = value < worker.minValue ? value : worker.minValue;
+	worker.maxValue = value > worker.maxValue ? value : worker.maxValue;
+	for (size_t i = 0; i < worker.path.size(); i++)
+	{
+		MctsNode& visited = worker.nodes[worker.path[i]];
+		visited.visits++;
+		visited.total += value;
+	}
+	for (size_t i = 0; i < worker.pathExpansions.size(); i++)
+	{
+		worker.expansions[worker.pathExpansions[i]].visits++;
+	}
+	worker.rollouts++;
+}
+
+// Adds the children of a position for a situation, best first by the
+// evaluation of the boards they lead to. Returns the new list, or -1
+// if the tree is full.
+int32_t MctsAgent::expand(Worker& worker, int32_t node, const GameState& state, uint32_t situation)
+{
+	worker.states.clear();
+	worker.moves.clear();
+	for (int hold = 0; hold < 2; hold++)
+	{
+		int count = worker.finder.find(state, hold != 0);
+		for (int p = 0; p < count; p++)
+		{
+			GameState child = state;
+			if (child.apply(worker.finder.getPlacement(p).move) >= 0)
+			{
+				worker.states.push_back(child);
+				worker.moves.push_back(worker.finder.getPlacement(p).move);
+			}
+		}
+	}
+	if (worker.nodes.size() + worker.states.size() > MCTS_MAX_NODES)
+	{
+		return -1;
+	}
+
+	std::vector<MctsNode>& children = worker.children;
+	children.resize(worker.states.size());
+	worker.scores.resize(worker.states.size());
+	evaluateBoards(worker.states.data(), (int)worker.states.size(), weights, worker.scores.data());
+	for (size_t i = 0; i < children.size(); i++)
+	{
+		children[i].move = worker.moves[i];
+		children[i].expansion = -1;
+		children[i].visits = 0;
+		children[i].total = getValue(worker.states[i], worker.scores[i]);
+	}
+	std::stable_sort(children.begin(), children.end(), [](const MctsNode& a, const MctsNode& b) { return a.total > b.total; });
+
+	MctsExpansion expansion;
+	expansion.situation = situation;
+	expansion.next = worker.nodes[node].expansion;
+	expansion.first = (int32_t)worker.nodes.size();
+	expansion.count = (int32_t)children.size();
+	expansion.visits = 0;
+	for (size_t i = 0; i < children.size(); i++)
+	{
+		children[i].total = 0;
+		worker.nodes.push_back(children[i]);
+	}
+	worker.nodes[node].expansion = (int32_t)worker.expansions.size();
+	worker.expansions.push_back(expansion);
+	return worker.nodes[node].expansion;
+}
+
+// Picks the child to visit by UCB1, over the first few children with
+// more let in as the position is visited more
+int32_t MctsAgent::select(Worker& worker, const MctsExpansion& expansion) const
+{
+	int allowed = MCTS_MIN_CHILDREN + (int)sqrt((double)expansion.visits);
+	allowed = allowed < expansion.count ? allowed : expansion.count;
+	double range = worker.maxValue > worker.minValue ? worker.maxValue - worker.minValue : 1;
+	double exploration = log((double)expansion.visits + 1);
+
+	int32_t best = expansion.first;
+	double bestScore = -HUGE_VAL;
+	for (int i = 0; i < allowed; i++)
+	{
+		const MctsNode& child = worker.nodes[expansion.first + i];
+		if (child.visits == 0)
+		{
+			return expansion.first + i;
+		}
+		double mean = (child.total / child.visits - worker.minValue) / range;
+		double score = mean + MCTS_EXPLORATION * sqrt(exploration / child.visits);
+		if (score > bestScore)
+		{
+			bestScore = score;
+			best = expansion.first + i;
+		}
+	}
+	return best;
+}
+
+// Plays a few placements picked greedily by the evaluation and returns
+// the value of where they end up. Placements picked before from the
+// same position are taken from the table.
+double MctsAgent::rollout(Worker& worker, GameState& state)
+{
+	uint64_t hash = zobristHash(state);
+	for (int k = 0; k < ROLLOUT_LENGTH && !state.isGameOver(); k++)
+	{
+		GameState before = state;
+		uint64_t key = getRolloutKey(hash, state);
+		TableEntry entry;
+		if (rolloutMoves.probe(key, entry) && state.apply(entry.move) >= 0)
+		{
+			hash = zobristUpdate(hash, before, state);
+			continue;
+		}
+
+		worker.states.clear();
+		worker.moves.clear();
+		int count = worker.finder.find(state);
+		for (int p = 0; p < count; p++)
+		{
+			GameState child = state;
+			if (child.apply(worker.finder.getPlacement(p).move) >= 0)
+			{
+				worker.states.push_back(child);
+				worker.moves.push_back(worker.finder.getPlacement(p).move);
+			}
+		}
+		if (worker.states.empty())
+		{
+			break;
+		}
+
+		worker.scores.resize(worker.states.size());
+		evaluateBoards(worker.states.data(), (int)worker.states.size(), weights, worker.scores.data());
+		size_t best = 0;
+		double bestValue = -HUGE_VAL;
+		for (size_t i = 0; i < worker.states.size(); i++)
+		{
+			double value = getValue(worker.states[i], worker.scores[i]);
+			if (value > bestValue)
+			{
+				bestValue = value;
+				best = i;
+			}
+		}
+		state = worker.states[best];
+		hash = zobristUpdate(hash, before, state);
+
+		entry.value = 0;
+		entry.depth = 0;
+		entry.move = worker.moves[best];
+		rolloutMoves.store(key, entry);
+	}
+	return getValue(state, evaluateBoard(state, weights));
+}
+
+// Keys the placement a rollout picks from a position. The pick depends
+// on the board, the active block and, through topping out, the block
+// after it, so the next block is added to the position's hash.
+uint64_t MctsAgent::getRolloutKey(uint64_t hash, const GameState& state)
+{
+	return hash ^ (uint64_t)(state.getQueued(0) + 1) * NEXT_TYPE_KEY;
+}
+
+// Makes a child the root of a thread's tree, copying the part of the
+// tree under it so the rest is freed
+void MctsAgent::reroot(Worker& worker, int32_t node)
+{
+	worker.spareNodes.assign(1, worker.nodes[node]);
+	worker.spareExpansions.clear();
+	std::vector<std::pair<int32_t, int32_t> > stack(1, std::make_pair(node, 0));
+	while (!stack.empty())
+	{
+		int32_t from = stack.back().first;
+		int32_t to = stack.back().second;
+		stack.pop_back();
+		worker.spareNodes[to].expansion = -1;
+		for (int32_t e = worker.nodes[from].expansion; e >= 0; e = worker.expansions[e].next)
+		{
+			MctsExpansion expansion = worker.expansions[e];
+			expansion.first = (int32_t)worker.spareNodes.size();
+			expansion.next = worker.spareNodes[to].expansion;
+			worker.spareNodes[to].expansion = (int32_t)worker.spareExpansions.size();
+			worker.spareExpansions.push_back(expansion);
+			for (int32_t c = 0; c < expansion.count; c++)
+			{
+				stack.push_back(std::make_pair(worker.expansions[e].first + c, (int32_t)worker.spareNodes.size()));
+				worker.spareNodes.push_back(worker.nodes[worker.expansions[e].first + c]);
+			}
+		}
+	}
+	worker.nodes.swap(worker.spareNodes);
+	worker.expansions.swap(worker.spareExpansions);
+}
+
+// Helper thread loop, grows its tree each time a search starts
+void MctsAgent::runHelper(int index)
+{
+	int seen = 0;
+	while (true)
+	{
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			wake.wait(lock, [this, seen] { return round != seen || stopping; });
+			if (stopping)
+			{
+				return;
+			}
+			seen = round;
+		}
+
+		grow(*workers[index]);
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			running--;
+		}
+		done.notify_one();
+	}
+}
+
+// Packs what decides the children of a position: the active block, the
+// held block and whether it can be swapped, and the block that holding
+// would bring in when nothing is held
+uint32_t MctsAgent::getSituation(const GameState& state)
+{
+	uint32_t situation = (uint32_t)(state.type + 1) | (uint32_t)(state.held + 1) << 4;
+	if (state.canSwap())
+	{
+		situation |= 1 << 8;
+		if (state.held == NO_BLOCK)
+		{
+			situation |= (uint32_t)(state.getQueued(0) + 1) << 9;
+		}
+	}
+	return situation;
+}
+
+// Finds the children of a position for a situation, or -1 if it
+// hasn't been expanded in that situation yet
+int32_t MctsAgent::findExpansion(const Worker& worker, int32_t node, uint32_t situation)
+{
+	for (int32_t e = worker.nodes[node].expansion; e >= 0; e = worker.expansions[e].next)
+	{
+		if (worker.expansions[e].situation == situation)
+		{
+			return e;
+		}
+	}
+	return -1;
+}
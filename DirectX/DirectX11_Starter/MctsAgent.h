@@ -0,0 +1,143 @@
+#ifndef MCTSAGENT_H
+#define MCTSAGENT_H
+
+#include "Agent.h"
+#include "Evaluator.h"
+#include "GameState.h"
+#include "PlacementFinder.h"
+#include "Random.h"
+#include "TranspositionTable.h"
+
+#include <stdint.h>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+// Default time spent on each move
+#define MCTS_TIME_BUDGET 100
+
+// Placements played by the greedy policy at the end of each rollout
+#define ROLLOUT_LENGTH 3
+
+// Children of a position tried before more are let in, which grows
+// with the square root of the visits
+#define MCTS_MIN_CHILDREN 3
+
+// Weight of exploring less visited moves, against values scaled to 0-1
+#define MCTS_EXPLORATION 0.5
+
+// Value lost for topping out, on top of the evaluation of the board
+#define MCTS_LOSS_PENALTY 200000
+
+// Most positions kept in each thread's tree
+#define MCTS_MAX_NODES (1 << 20)
+
+// A position in a search tree, reached by a move from its parent
+struct MctsNode
+{
+	GameMove move;
+	int32_t expansion;	// First list of children or -1
+	uint32_t visits;
+	double total;		// Sum of the rollout values through this position
+};
+
+// The children of a position for one situation it can be in: the
+// active block, the held block and, with nothing held, the block that
+// holding brings in. Which one comes up depends on the bag.
+struct MctsExpansion
+{
+	uint32_t situation;
+	int32_t next;		// Next list of children of the same position or -1
+	int32_t first;
+	int32_t count;
+	uint32_t visits;
+};
+
+// Picks moves by Monte Carlo tree search. The agent isn't allowed to
+// look past the current bag, so every iteration plays against a new
+// random order for the bags after it, and the tree is open loop: a
+// position's children are kept apart by the situation each order
+// leads to. Leaves are scored by a short greedy rollout and the board
+// evaluation, and children are let in best first by the evaluation.
+//
+// Uses root parallelism: every thread grows its own tree for the whole
+// time budget without sharing anything, and the visits of the root
+// moves are added up at the end. Each tree is kept for the next move
+// if the game went the way it expected. The one thing the threads
+// share is a table of the placements the rollouts picked, so a
+// rollout reaching a position any thread has been through before
+// plays the same placement without looking for it again.
+class MctsAgent : public Agent
+{
+public:
+	MctsAgent(int budget = MCTS_TIME_BUDGET, int threads = 0);
+	~MctsAgent();
+
+	bool search(const GameState& state, GameMove& move);
+	void setBudget(int milliseconds) { budget = milliseconds > 0 ? milliseconds : 1; }
+	void setWeights(const int32_t* pWeights);
+	int getBudget() const { return budget; }
+	int getThreads() const { return (int)workers.size(); }
+	uint64_t getRollouts() const { return rollouts; }
+	double getRolloutsPerSecond() const { return rolloutsPerSecond; }
+
+private:
+	// A thread's tree and what it needs to search it
+	struct Worker
+	{
+		std::vector<MctsNode> nodes;
+		std::vector<MctsExpansion> expansions;
+		std::vector<MctsNode> spareNodes;
+		std::vector<MctsExpansion> spareExpansions;
+		std::vector<int32_t> path;
+		std::vector<int32_t> pathExpansions;
+		std::vector<MctsNode> children;
+		std::vector<GameState> states;
+		std::vector<GameMove> moves;
+		std::vector<int32_t> scores;
+		PlacementFinder finder;
+		Random random;
+		double minValue;
+		double maxValue;
+		uint64_t rollouts;
+	};
+
+	int budget;
+	int32_t weights[NUM_FEATURES];
+	std::vector<Worker*> workers;
+	TranspositionTable rolloutMoves;
+	GameState root;
+	GameState lastRoot;
+	GameMove lastMove;
+	bool reusable;
+	uint64_t rollouts;
+	double rolloutsPerSecond;
+
+	// Runs the helper threads for the length of a search
+	std::vector<std::thread> helpers;
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::condition_variable done;
+	int64_t deadline;
+	int round;
+	int running;
+	bool stopping;
+
+	void grow(Worker& worker);
+	void iterate(Worker& worker);
+	int32_t expand(Worker& worker, int32_t node, const GameState& state, uint32_t situation);
+	int32_t select(Worker& worker, const MctsExpansion& expansion) const;
+	double rollout(Worker& worker, GameState& state);
+	void reroot(Worker& worker, int32_t node);
+	void runHelper(int index);
+
+	static uint32_t getSituation(const GameState& state);
+	static uint64_t getRolloutKey(uint64_t hash, const GameState& state);
+	static int32_t findExpansion(const Worker& worker, int32_t node, uint32_t situation);
+
+	MctsAgent(const MctsAgent& rhs);
+	MctsAgent& operator=(const MctsAgent& rhs);
+};
+
+#endif
@@ -0,0 +1,112 @@
+#include "NetworkEmulator.h"
+
+#include <string.h>
+
+// Fills in a perfect network
+void setPerfectNetwork(NetworkConditions& conditions)
+{
+	conditions.latency = 0;
+	conditions.jitter = 0;
+	conditions.loss = 0;
+	conditions.duplicates = 0;
+}
+
+NetworkEmulator::NetworkEmulator(DatagramSocket& pSocket, const NetworkConditions& pConditions, uint64_t seed)
+	: socket(pSocket), held(EMULATOR_CAPACITY)
+{
+	conditions = pConditions;
+	conditions.latency = conditions.latency > 0 ? conditions.latency : 0;
+	conditions.jitter = conditions.jitter > 0 ? conditions.jitter : 0;
+	random.seed(seed);
+	count = 0;
+	batch = new DatagramBatch();
+	batch->count = 0;
+	sent = 0;
+	lost = 0;
+	duplicated = 0;
+}
+
+NetworkEmulator::~NetworkEmulator()
+{
+	delete batch;
+}
+
+// Loses a datagram, or holds it back to send later, maybe twice
+void NetworkEmulator::send(const NetAddress& to, const uint8_t* data, int size)
+{
+	if (size <= 0 || size > MAX_DATAGRAM_SIZE || nextChance() < conditions.loss)
+	{
+		lost++;
+		return;
+	}
+	hold(to, data, size);
+	if (nextChance() < conditions.duplicates)
+	{
+		hold(to, data, size);
+		duplicated++;
+	}
+}
+
+// Sends every datagram whose time has come
+void NetworkEmulator::flush()
+{
+	Clock::time_point now = Clock::now();
+
+	// Slides the ones still held down over the gaps, so everything stays
+	// in the order it was sent and only jitter reorders
+	int kept = 0;
+	for (int i = 0; i < count; i++)
+	{
+		if (held[i].due > now)
+		{
+			if (kept != i)
+			{
+				held[kept] = held[i];
+			}
+			kept++;
+			continue;
+		}
+		if (batch->count == DATAGRAM_BATCH)
+		{
+			int done = socket.send(*batch);
+			sent += done > 0 ? done : 0;
+		}
+		int slot = batch->count++;
+		batch->addresses[slot] = held[i].to;
+		batch->sizes[slot] = held[i].size;
+		memcpy(batch->data[slot], held[i].data, held[i].size);
+	}
+	count = kept;
+	if (batch->count > 0)
+	{
+		int done = socket.send(*batch);
+		sent += done > 0 ? done : 0;
+	}
+}
+
+// Holds a datagram back for the latency give or take the jitter, or
+// loses it if there's no room
+void NetworkEmulator::hold(const NetAddress& to, const uint8_t* data, int size)
+{
+	if (count == EMULATOR_CAPACITY)
+	{
+		lost++;
+		return;
+	}
+	int delay = conditions.latency;
+	if (conditions.jitter > 0)
+	{
+		delay += random.nextInt(2 * conditions.jitter + 1) - conditions.jitter;
+	}
+	HeldDatagram& datagram = held[count++];
+	datagram.due = Clock::now() + std::chrono::milliseconds(delay > 0 ? delay : 0);
+	datagram.to = to;
+	datagram.size = (uint16_t)size;
+	memcpy(datagram.data, data, size);
+}
+
+// Retrieves a random number from 0 up to 1
+double NetworkEmulator::nextChance()
+{
+	return (random.next() >> 11) * (1.0 / 9007199254740992.0);
+}
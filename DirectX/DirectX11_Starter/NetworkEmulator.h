@@ -0,0 +1,75 @@
+#ifndef NETWORKEMULATOR_H
+#define NETWORKEMULATOR_H
+
+#include "Random.h"
+#include "Socket.h"
+
+#include <stdint.h>
+#include <chrono>
+#include <vector>
+
+// Datagrams an emulator can hold back at once; more are dropped
+#define EMULATOR_CAPACITY 1024
+
+// A network to pretend to be on
+struct NetworkConditions
+{
+	int latency;		// One way, in milliseconds
+	int jitter;			// Most milliseconds added to or taken off the latency
+	double loss;		// Chance of a datagram being lost, 0 to 1
+	double duplicates;	// Chance of a datagram arriving twice
+};
+
+// Fills in a perfect network
+void setPerfectNetwork(NetworkConditions& conditions);
+
+// Sends datagrams over a DatagramSocket as if over a worse network, for
+// testing netcode over loopback. Each datagram is held back for the
+// latency give or take the jitter, so they can arrive out of order, and
+// some are lost or sent twice. Datagrams are only sent from flush(),
+// which should be called often, e.g. once a tick. The chances come from
+// the emulator's own seeded generator.
+class NetworkEmulator
+{
+public:
+	NetworkEmulator(DatagramSocket& socket, const NetworkConditions& conditions, uint64_t seed = 1);
+	~NetworkEmulator();
+
+	void send(const NetAddress& to, const uint8_t* data, int size);
+	void flush();
+
+	const NetworkConditions& getConditions() const { return conditions; }
+	uint64_t getSent() const { return sent; }
+	uint64_t getLost() const { return lost; }
+	uint64_t getDuplicated() const { return duplicated; }
+
+private:
+	typedef std::chrono::steady_clock Clock;
+
+	// A datagram waiting to go out
+	struct HeldDatagram
+	{
+		Clock::time_point due;
+		NetAddress to;
+		uint16_t size;
+		uint8_t data[MAX_DATAGRAM_SIZE];
+	};
+
+	DatagramSocket& socket;
+	NetworkConditions conditions;
+	Random random;
+	std::vector<HeldDatagram> held;
+	int count;
+	DatagramBatch* batch;
+	uint64_t sent;
+	uint64_t lost;
+	uint64_t duplicated;
+
+	void hold(const NetAddress& to, const uint8_t* data, int size);
+	double nextChance();
+
+	NetworkEmulator(const NetworkEmulator& rhs);
+	NetworkEmulator& operator=(const NetworkEmulator& rhs);
+};
+
+#endif
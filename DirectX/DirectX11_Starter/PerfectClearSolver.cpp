@@ -0,0 +1,348 @@
+#include "PerfectClearSolver.h"
+#include "BitOps.h"
+#include "Zobrist.h"
+
+#include <algorithm>
+
+// Creates a search stack for each thread and starts the helper
+// threads. With threads 0, uses one thread per core, counting the
+// thread that calls solve().
+PerfectClearSolver::PerfectClearSolver(int threads)
+	: failures(PC_TABLE_ENTRIES)
+{
+	if (threads <= 0)
+	{
+		threads = (int)std::thread::hardware_concurrency();
+		threads = threads > 0 ? threads : 1;
+	}
+	for (int i = 0; i < threads; i++)
+	{
+		workers.push_back(new Worker());
+	}
+	nodes = 0;
+	nodeLimit = 0;
+	nextMove = 0;
+	solved = false;
+	stopped = false;
+
+	round = 0;
+	running = 0;
+	stopping = false;
+	for (int i = 1; i < threads; i++)
+	{
+		helpers.push_back(std::thread(&PerfectClearSolver::runHelper, this, i));
+	}
+}
+
+// Stops the helper threads
+PerfectClearSolver::~PerfectClearSolver()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	wake.notify_all();
+	for (size_t i = 0; i < helpers.size(); i++)
+	{
+		helpers[i].join();
+	}
+	for (size_t i = 0; i < workers.size(); i++)
+	{
+		delete workers[i];
+	}
+}
+
+// Searches for a perfect clear of the given height, or with height 0
+// for the lowest one up to PC_DEFAULT_HEIGHT (or PC_MAX_HEIGHT for a
+// taller stack) that leaves a multiple of 4 cells to fill. Returns
+// whether one was found.
+bool PerfectClearSolver::solve(const GameState& state, int height)
+{
+	if (height > 0)
+	{
+		return solveHeight(state, height);
+	}
+
+	int stack = 0;
+	for (int j = 0; j < GRID_HEIGHT; j++)
+	{
+		stack = state.rows[j] != 0 ? j + 1 : stack;
+	}
+	uint64_t total = 0;
+	int highest = stack > PC_DEFAULT_HEIGHT ? PC_MAX_HEIGHT : PC_DEFAULT_HEIGHT;
+	for (int h = stack > 0 ? stack : 1; h <= highest; h++)
+	{
+		if (getEmptyCells(state, h) % 4 != 0)
+		{
+			continue;
+		}
+		bool found = solveHeight(state, h);
+		total += nodes;
+		if (found)
+		{
+			nodes = total;
+			return true;
+		}
+	}
+	nodes = total;
+	return false;
+}
+
+// Searches for a perfect clear that keeps the blocks below the given
+// height, returning whether one was found. Also returns false if the
+// node limit ran out first.
+bool PerfectClearSolver::solveHeight(const GameState& state, int height)
+{
+	solution.clear();
+	nodes = 0;
+	if (height < 1 || height > PC_MAX_HEIGHT || state.isGameOver())
+	{
+		return false;
+	}
+	for (int j = height; j < GRID_HEIGHT; j++)
+	{
+		if (state.rows[j] != 0)
+		{
+			return false;
+		}
+	}
+	if (!canFill(state, height))
+	{
+		return false;
+	}
+
+	// Share out the first placements between the threads
+	listSteps(*workers[0], state, height, rootSteps);
+	nextMove = 0;
+	solved = false;
+	stopped = false;
+	failures.newSearch();
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		round++;
+		running = (int)helpers.size();
+	}
+	wake.notify_all();
+	run(workers[0]);
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		done.wait(lock, [this] { return running == 0; });
+	}
+
+	for (size_t i = 0; i < workers.size(); i++)
+	{
+		nodes += workers[i]->nodes;
+	}
+	return solved;
+}
+
+// Thread loop, searches under each first placement it takes until
+// they run out or a solution turns up
+void PerfectClearSolver::run(Worker* worker)
+{
+	worker->nodes = 0;
+	while (!solved && !stopped)
+	{
+		int i = nextMove++;
+		if (i >= (int)rootSteps.size())
+		{
+			return;
+		}
+
+		const ClearStep& step = rootSteps[i];
+		worker->path[0] = step.move;
+		if (search(*worker, step.state, step.height, 1))
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (!solved)
+			{
+				solution.assign(worker->path, worker->path + worker->length);
+				solved = true;
+			}
+		}
+	}
+}
+
+// Depth first search from a position after depth placements, returning
+// true once the board is empty
+bool PerfectClearSolver::search(Worker& worker, const GameState& state, int height, int depth)
+{
+	worker.nodes++;
+	if (getEmptyCells(state, height) == 0)
+	{
+		worker.length = depth;
+		return true;
+	}
+	if (nodeLimit > 0 && worker.nodes >= nodeLimit)
+	{
+		stopped = true;
+	}
+	if (solved || stopped || !canFill(state, height))
+	{
+		return false;
+	}
+
+	uint64_t key = getKey(state, height);
+	TableEntry entry;
+	if (failures.probe(key, entry))
+	{
+		return false;
+	}
+
+	std::vector<ClearStep>& steps = worker.levels[depth];
+	listSteps(worker, state, height, steps);
+	for (size_t i = 0; i < steps.size(); i++)
+	{
+		worker.path[depth] = steps[i].move;
+		if (search(worker, steps[i].state, steps[i].height, depth + 1))
+		{
+			return true;
+		}
+	}
+
+	// A search cut short by a solution or the node limit proves nothing
+	if (!solved && !stopped)
+	{
+		entry.value = 0;
+		entry.depth = (uint8_t)(getEmptyCells(state, height) / 4);
+		entry.move = GameMove();
+		failures.store(key, entry);
+	}
+	return false;
+}
+
+// Lists the placements of the active and held blocks that stay below
+// the height limit and could still lead to a clear. The ones that
+// leave the fewest covered cells, then the lowest, are tried first.
+void PerfectClearSolver::listSteps(Worker& worker, const GameState& state, int height, std::vector<ClearStep>& steps)
+{
+	steps.clear();
+	for (int hold = 0; hold < 2; hold++)
+	{
+		int type = state.type;
+		if (hold)
+		{
+			// Holding a block for another of the same type changes nothing
+			type = state.held != NO_BLOCK ? state.held : state.getQueued(0);
+			if (!state.canSwap() || type == state.type)
+			{
+				continue;
+			}
+		}
+
+		int count = worker.finder.find(state, hold != 0);
+		for (int p = 0; p < count; p++)
+		{
+			ClearStep step;
+			step.move = worker.finder.getPlacement(p).move;
+			const BlockShape& shape = BLOCK_SHAPES[type][step.move.rotation];
+			if (step.move.y + shape.top >= height)
+			{
+				continue;
+			}
+			step.state = state;
+			int cleared = step.state.apply(step.move);
+			step.height = height - cleared;
+			if (cleared < 0 || step.state.isGameOver() || !canFill(step.state, step.height))
+			{
+				continue;
+			}
+
+			uint32_t covered = 0;
+			int holes = 0;
+			for (int j = step.height - 1; j >= 0; j--)
+			{
+				holes += popCount(covered & ~step.state.rows[j]);
+				covered |= step.state.rows[j];
+			}
+			step.cost = holes * GRID_HEIGHT + step.move.y + shape.bottom;
+			steps.push_back(step);
+		}
+	}
+	std::stable_sort(steps.begin(), steps.end(), [](const ClearStep& a, const ClearStep& b) { return a.cost < b.cost; });
+}
+
+// Helper thread loop, searches each time a solve starts
+void PerfectClearSolver::runHelper(int index)
+{
+	int seen = 0;
+	while (true)
+	{
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			wake.wait(lock, [this, seen] { return round != seen || stopping; });
+			if (stopping)
+			{
+				return;
+			}
+			seen = round;
+		}
+
+		run(workers[index]);
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			running--;
+		}
+		done.notify_one();
+	}
+}
+
+// Counts the empty cells below the height limit
+int PerfectClearSolver::getEmptyCells(const GameState& state, int height)
+{
+	int filled = 0;
+	for (int j = 0; j < height; j++)
+	{
+		filled += popCount(state.rows[j]);
+	}
+	return height * GRID_WIDTH - filled;
+}
+
+// Checks the cells left to fill could be filled by whole blocks. A
+// block can only cross between two columns in a row where both cells
+// are empty, and clearing lines never makes such a row, so where there
+// is none the board is split for good and the cells on each side must
+// come to a multiple of 4.
+bool PerfectClearSolver::canFill(const GameState& state, int height)
+{
+	uint32_t crossings = 0;
+	for (int j = 0; j < height; j++)
+	{
+		uint32_t empty = ~state.rows[j] & FULL_ROW;
+		crossings |= empty & (empty >> 1);
+	}
+
+	// Each side ends at the first column with no crossing to its right
+	uint32_t side = 0;
+	for (int i = 0; i < GRID_WIDTH; i++)
+	{
+		side |= 1u << i;
+		if (i == GRID_WIDTH - 1 || !(crossings & (1u << i)))
+		{
+			int empty = 0;
+			for (int j = 0; j < height; j++)
+			{
+				empty += popCount(side & ~state.rows[j]);
+			}
+			if (empty % 4 != 0)
+			{
+				return false;
+			}
+			side = 0;
+		}
+	}
+	return true;
+}
+
+// Key of a position in the table: its Zobrist hash mixed with the
+// height limit and the generator, which together with the bag position
+// decide every block still to come
+uint64_t PerfectClearSolver::getKey(const GameState& state, int height)
+{
+	uint64_t z = state.random + (uint64_t)height * 0x9E3779B97F4A7C15ULL;
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+	return zobristHash(state) ^ z ^ (z >> 31);
+}
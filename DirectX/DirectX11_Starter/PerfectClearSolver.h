@@ -0,0 +1,110 @@
+#ifndef PERFECTCLEARSOLVER_H
+#define PERFECTCLEARSOLVER_H
+
+#include "GameState.h"
+#include "PlacementFinder.h"
+#include "TranspositionTable.h"
+
+#include <stdint.h>
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+// Highest perfect clear searched for, in rows
+#define PC_MAX_HEIGHT 6
+
+// Highest perfect clear tried when no height is asked for, unless the
+// stack is already taller
+#define PC_DEFAULT_HEIGHT 4
+
+// Most placements in a solution: enough to fill PC_MAX_HEIGHT rows
+#define PC_MAX_PIECES (PC_MAX_HEIGHT * GRID_WIDTH / 4)
+
+// Entries in the table of positions known not to clear (16 bytes each)
+#define PC_TABLE_ENTRIES (1 << 18)
+
+// A placement tried by the solver and where it leads
+struct ClearStep
+{
+	GameState state;
+	GameMove move;
+	int height;		// Limit left after the lines it clears
+	int cost;		// Order to try it in, lowest first
+};
+
+// Searches for placements of the coming blocks, holding as needed,
+// that leave the board empty. Blocks must stay below a height limit,
+// which drops as lines are cleared, so the cells still to fill are
+// known and must be a multiple of 4 on each side of any column that's
+// full to the limit. Positions that can't be cleared are remembered in
+// a TranspositionTable keyed by their Zobrist hash, the limit and the
+// state of the generator, which fixes every block still to come. The
+// table is kept between solves, so asking again later in the same game
+// reuses what was learned.
+//
+// Threads take the first placements of the search between them, and
+// all of them stop as soon as one finds a solution, or once any of
+// them has searched as many positions as the node limit allows. The
+// helper threads are started with the solver and wait between solves.
+class PerfectClearSolver
+{
+public:
+	PerfectClearSolver(int threads = 0);
+	~PerfectClearSolver();
+
+	bool solve(const GameState& state, int height = 0);
+	bool solveHeight(const GameState& state, int height);
+	void setNodeLimit(uint64_t limit) { nodeLimit = limit; }
+	int getSolutionLength() const { return (int)solution.size(); }
+	const GameMove& getSolutionMove(int i) const { return solution[i]; }
+	uint64_t getNodes() const { return nodes; }
+	uint64_t getNodeLimit() const { return nodeLimit; }
+
+private:
+	// A thread's stack of placements, one list per placement deep
+	struct Worker
+	{
+		PlacementFinder finder;
+		std::vector<ClearStep> levels[PC_MAX_PIECES + 1];
+		GameMove path[PC_MAX_PIECES];
+		int length;
+		uint64_t nodes;
+	};
+
+	std::vector<Worker*> workers;
+	TranspositionTable failures;
+	std::vector<GameMove> solution;
+	uint64_t nodes;
+	uint64_t nodeLimit;	// Positions each thread may search, 0 for no limit
+
+	// Shared between the threads of a solve
+	std::vector<ClearStep> rootSteps;
+	std::atomic<int> nextMove;
+	std::atomic<bool> solved;
+	std::atomic<bool> stopped;
+
+	// Runs the helper threads for the length of a solve
+	std::vector<std::thread> helpers;
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::condition_variable done;
+	int round;
+	int running;
+	bool stopping;
+
+	void run(Worker* worker);
+	void runHelper(int index);
+	bool search(Worker& worker, const GameState& state, int height, int depth);
+	void listSteps(Worker& worker, const GameState& state, int height, std::vector<ClearStep>& steps);
+
+	static int getEmptyCells(const GameState& state, int height);
+	static bool canFill(const GameState& state, int height);
+	static uint64_t getKey(const GameState& state, int height);
+
+	PerfectClearSolver(const PerfectClearSolver& rhs);
+	PerfectClearSolver& operator=(const PerfectClearSolver& rhs);
+};
+
+#endif
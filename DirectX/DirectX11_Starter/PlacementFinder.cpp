@@ -0,0 +1,339 @@
+#include "PlacementFinder.h"
+
+#include "BitOps.h"
+
+#include <string.h>
+
+// Rows searched, one bit each starting from SEARCH_MIN_Y
+#define SEARCH_ROWS ((1u << SEARCH_HEIGHT) - 1)
+
+PlacementFinder::PlacementFinder()
+{
+	memset(fitting, 0, sizeof(fitting));
+	memset(next, 0, sizeof(next));
+	memset(keyStamps, 0, sizeof(keyStamps));
+	skyRows = 0;
+	skyY = SPAWN_Y;
+	stamp = 0;
+}
+
+// Searches for the placements of the active block, or of the block
+// that holding would bring in. Returns the number of placements found.
+int PlacementFinder::find(const GameState& state, bool hold)
+{
+	placements.clear();
+	if (state.type == NO_BLOCK || (hold && !state.canSwap()))
+	{
+		return 0;
+	}
+	int type = state.type;
+	if (hold)
+	{
+		type = state.held != NO_BLOCK ? state.held : state.getQueued(0);
+	}
+
+	// Stamps mark the cells this search has seen without clearing the table
+	if (++stamp == 0)
+	{
+		memset(keyStamps, 0, sizeof(keyStamps));
+		stamp = 1;
+	}
+
+	findFree(state, type);
+	memset(reached, 0, sizeof(reached));
+	memset(steps[0], 0, sizeof(steps[0]));
+	memset(active, 0, sizeof(active));
+	int spawn = SPAWN_X - SEARCH_MIN_X + 1;
+	reached[0][spawn] = steps[0][0][spawn] = 1u << (SPAWN_Y - SEARCH_MIN_Y);
+	active[0] = 1u << spawn;
+
+	// Each pass lists the resting positions reached in that many steps, then takes another step
+	bool searching = true;
+	for (int distance = 0; searching && distance <= SEARCH_MAX_STEPS; distance++)
+	{
+		searching = false;
+		for (int rotation = 0; rotation < NUM_ROTATIONS; rotation++)
+		{
+			const BlockShape& shape = BLOCK_SHAPES[type][rotation];
+			for (uint32_t columns = active[rotation]; columns != 0; columns &= columns - 1)
+			{
+				int i = lowestBit(columns);
+				int x = i - 1 + SEARCH_MIN_X;
+				searching = true;
+				for (uint32_t resting = steps[distance][rotation][i] & ~(fitting[rotation][i] << 1); resting != 0; resting &= resting - 1)
+				{
+					// Orientations that fill the same cells are the same placement
+					int y = lowestBit(resting) + SEARCH_MIN_Y;
+					uint64_t key = (uint64_t)(y + shape.bottom - SEARCH_MIN_Y);
+					for (int j = shape.bottom; j < shape.bottom + 4; j++)
+					{
+						key = key << GRID_WIDTH | (j < 4 ? GameBoard::shiftRow(shape.rows[j], x) : 0);
+					}
+					if (addCells(key))
+					{
+						Placement placement;
+						placement.move.x = (int8_t)x;
+						placement.move.y = (int8_t)y;
+						placement.move.rotation = (int8_t)rotation;
+						placement.move.hold = hold;
+						placement.pathLength = distance + (hold ? 1 : 0);
+						placements.push_back(placement);
+					}
+				}
+			}
+		}
+		if (searching && distance < SEARCH_MAX_STEPS)
+		{
+			step(distance + 1);
+		}
+	}
+	return (int)placements.size();
+}
+
+// Marks the rows each orientation and column of the block fits in. Works
+// from the filled rows of each board column, shifted down by the row of
+// each cell of the block. The columns either side of the search stay empty.
+void PlacementFinder::findFree(const GameState& state, int type)
+{
+	uint32_t columns[GRID_WIDTH] = { 0 };
+	for (int k = 0; k < GRID_HEIGHT; k++)
+	{
+		for (unsigned row = state.rows[k]; row != 0; row &= row - 1)
+		{
+			columns[lowestBit(row)] |= 1u << k;
+		}
+	}
+
+	uint32_t blockedRows = 0;
+	for (int rotation = 0; rotation < NUM_ROTATIONS; rotation++)
+	{
+		const BlockShape& shape = BLOCK_SHAPES[type][rotation];
+		uint32_t floor = (1u << (-shape.bottom - SEARCH_MIN_Y)) - 1;
+		for (int i = 1; i <= SEARCH_WIDTH; i++)
+		{
+			int x = i - 1 + SEARCH_MIN_X;
+			if (x + shape.left < 0 || x + shape.right >= GRID_WIDTH)
+			{
+				fitting[rotation][i] = 0;
+				continue;
+			}
+
+			uint32_t blocked = floor;
+			for (int j = shape.bottom; j <= shape.top; j++)
+			{
+				for (unsigned row = shape.rows[j]; row != 0; row &= row - 1)
+				{
+					blocked |= columns[x + lowestBit(row)] << -SEARCH_MIN_Y >> j;
+				}
+			}
+			fitting[rotation][i] = ~blocked & SEARCH_ROWS;
+			blockedRows |= blocked;
+		}
+	}
+
+	// Every position from the sky row up fits, so nothing happens in the
+	// rows between it and the spawn row that couldn't happen at the top
+	skyY = highestBit(blockedRows) + 1 + SEARCH_MIN_Y;
+	skyRows = 0;
+	if (SPAWN_Y - skyY > 1)
+	{
+		skyRows = (1u << (SPAWN_Y - SEARCH_MIN_Y)) - (2u << (skyY - SEARCH_MIN_Y));
+	}
+}
+
+// Moves the search one step on from the positions it reached last,
+// which are the given distance from the spawn position
+void PlacementFinder::step(int distance)
+{
+	uint32_t touched[NUM_ROTATIONS] = { 0 };
+	for (int rotation = 0; rotation < NUM_ROTATIONS; rotation++)
+	{
+		int turned = (rotation + 1) % NUM_ROTATIONS;
+		for (uint32_t columns = active[rotation]; columns != 0; columns &= columns - 1)
+		{
+			int i = lowestBit(columns);
+			uint32_t positions = steps[distance - 1][rotation][i];
+			uint32_t open = fitting[rotation][i];
+			touched[rotation] |= 7u << (i - 1);
+			touched[turned] |= 7u << (i - 1);
+
+			next[rotation][i - 1] |= positions & fitting[rotation][i - 1];
+			next[rotation][i + 1] |= positions & fitting[rotation][i + 1];
+
+			// Rotate in place, or shifted a column right or left
+			uint32_t blocked = positions & ~fitting[turned][i];
+			next[turned][i] |= positions & fitting[turned][i];
+			next[turned][i + 1] |= blocked & fitting[turned][i + 1];
+			next[turned][i - 1] |= blocked & ~fitting[turned][i + 1] & fitting[turned][i - 1];
+
+			// Step down a row, or drop to the bottom of the open rows below
+			uint32_t below = positions >> 1 & open;
+			next[rotation][i] |= below & ~skyRows;
+			uint32_t fall = open;
+			below |= fall & below >> 1;
+			fall &= fall >> 1;
+			below |= fall & below >> 2;
+			fall &= fall >> 2;
+			below |= fall & below >> 4;
+			fall &= fall >> 4;
+			below |= fall & below >> 8;
+			fall &= fall >> 8;
+			below |= fall & below >> 16;
+			next[rotation][i] |= below & ~(open << 1);
+		}
+	}
+
+	// Blocks at the top come down to the sky row a step per row later
+	int descent = SPAWN_Y - skyY;
+	if (skyRows != 0 && distance >= descent)
+	{
+		for (int rotation = 0; rotation < NUM_ROTATIONS; rotation++)
+		{
+			for (int i = 1; i <= SEARCH_WIDTH; i++)
+			{
+				if (steps[distance - descent][rotation][i] >> (SPAWN_Y - SEARCH_MIN_Y))
+				{
+					next[rotation][i] |= 1u << (skyY - SEARCH_MIN_Y);
+					touched[rotation] |= 1u << i;
+				}
+			}
+		}
+	}
+
+	// Keep the positions reached for the first time
+	memset(steps[distance], 0, sizeof(steps[distance]));
+	for (int rotation = 0; rotation < NUM_ROTATIONS; rotation++)
+	{
+		active[rotation] = 0;
+		for (uint32_t columns = touched[rotation]; columns != 0; columns &= columns - 1)
+		{
+			int i = lowestBit(columns);
+			uint32_t positions = next[rotation][i] & ~reached[rotation][i];
+			next[rotation][i] = 0;
+			reached[rotation][i] |= positions;
+			steps[distance][rotation][i] = positions;
+			if (positions != 0)
+			{
+				active[rotation] |= 1u << i;
+			}
+		}
+	}
+}
+
+// Checks whether or not the search reached a position in the given number of steps
+bool PlacementFinder::isReached(int x, int y, int rotation, int distance) const
+{
+	if (x < SEARCH_MIN_X || x >= SEARCH_MIN_X + SEARCH_WIDTH || y < SEARCH_MIN_Y || y > SPAWN_Y)
+	{
+		return false;
+	}
+	return (steps[distance][rotation][x - SEARCH_MIN_X + 1] >> (y - SEARCH_MIN_Y) & 1) != 0;
+}
+
+// Checks whether or not the block fits at the given position
+bool PlacementFinder::fits(int x, int y, int rotation) const
+{
+	if (x < SEARCH_MIN_X || x >= SEARCH_MIN_X + SEARCH_WIDTH || y < SEARCH_MIN_Y || y > SPAWN_Y)
+	{
+		return false;
+	}
+	return (fitting[rotation][x - SEARCH_MIN_X + 1] >> (y - SEARCH_MIN_Y) & 1) != 0;
+}
+
+// Finds a position nearer the spawn that leads to the given one, moving
+// to it and returning the step taken from it. The distance goes down by
+// the number of times the step is taken.
+PathAction PlacementFinder::findStep(int& x, int& y, int& rotation, int& distance) const
+{
+	int descent = SPAWN_Y - skyY;
+	if (skyRows != 0 && y == skyY && distance >= descent && isReached(x, SPAWN_Y, rotation, distance - descent))
+	{
+		y = SPAWN_Y;
+		distance -= descent;
+		return PATH_DOWN;
+	}
+	distance--;
+	if (isReached(x, y + 1, rotation, distance))
+	{
+		y++;
+		return PATH_DOWN;
+	}
+	if (isReached(x + 1, y, rotation, distance))
+	{
+		x++;
+		return PATH_LEFT;
+	}
+	if (isReached(x - 1, y, rotation, distance))
+	{
+		x--;
+		return PATH_RIGHT;
+	}
+
+	// A rotation from the previous orientation that kicked into this column
+	int previous = (rotation + NUM_ROTATIONS - 1) % NUM_ROTATIONS;
+	for (int from = x - 1; from <= x + 1; from++)
+	{
+		int kicked = fits(from, y, rotation) ? from : fits(from + 1, y, rotation) ? from + 1 : from - 1;
+		if (kicked == x && isReached(from, y, previous, distance))
+		{
+			x = from;
+			rotation = previous;
+			return PATH_ROTATE;
+		}
+	}
+
+	// Otherwise a drop from somewhere above in the same open rows
+	int from = y + 1;
+	while (!isReached(x, from, rotation, distance))
+	{
+		from++;
+	}
+	y = from;
+	return PATH_DROP;
+}
+
+// Remembers the cells of a placement, returning false if another
+// placement already filled the same cells
+bool PlacementFinder::addCells(uint64_t key)
+{
+	uint32_t slot = (uint32_t)((key * 0x9E3779B97F4A7C15ULL) >> (64 - CELL_KEY_BITS));
+	while (keyStamps[slot] == stamp)
+	{
+		if (cellKeys[slot] == key)
+		{
+			return false;
+		}
+		slot = (slot + 1) & ((1 << CELL_KEY_BITS) - 1);
+	}
+	keyStamps[slot] = stamp;
+	cellKeys[slot] = key;
+	return true;
+}
+
+// Writes the shortest inputs that lead to a placement from the last
+// search, returning how many there are
+int PlacementFinder::getPath(int i, uint8_t* path) const
+{
+	const Placement& placement = placements[i];
+	int x = placement.move.x;
+	int y = placement.move.y;
+	int rotation = placement.move.rotation;
+	int offset = placement.move.hold ? 1 : 0;
+
+	// Walk back to the spawn position
+	int distance = placement.pathLength - offset;
+	while (distance > 0)
+	{
+		int end = distance;
+		PathAction action = findStep(x, y, rotation, distance);
+		for (int k = distance; k < end; k++)
+		{
+			path[k + offset] = (uint8_t)action;
+		}
+	}
+	if (placement.move.hold)
+	{
+		path[0] = PATH_HOLD;
+	}
+	return placement.pathLength;
+}
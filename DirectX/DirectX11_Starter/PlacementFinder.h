@@ -0,0 +1,88 @@
+#ifndef PLACEMENTFINDER_H
+#define PLACEMENTFINDER_H
+
+#include "GameState.h"
+
+#include <stdint.h>
+#include <vector>
+
+// Steps of the inputs that lead a block to its placement
+enum PathAction
+{
+	PATH_LEFT,
+	PATH_RIGHT,
+	PATH_DOWN,
+	PATH_ROTATE,
+	PATH_DROP,
+	PATH_HOLD
+};
+
+// Range of block positions searched. Blocks can hang up to 3 cells
+// past the left and bottom edges of the board when their grid has
+// empty columns or rows.
+#define SEARCH_MIN_X -3
+#define SEARCH_MIN_Y -3
+#define SEARCH_WIDTH 16
+#define SEARCH_HEIGHT (SPAWN_Y - SEARCH_MIN_Y + 1)
+
+// Longest path searched
+#define SEARCH_MAX_STEPS 64
+
+// Size of the table of filled cells used to drop duplicate placements
+#define CELL_KEY_BITS 12
+
+// A spot a block can come to rest in and the number of steps to get there
+struct Placement
+{
+	GameMove move;
+	int pathLength;
+};
+
+// Finds every spot the active (or held) block can reach and rest in,
+// searching breadth first from the spawn position over moves, single
+// row steps, drops and rotations with the same kicks as
+// GameSimulation::rotate(). Placements that fill the same cells are
+// only listed once, with the shortest path to them. Ignores timing, so
+// a spot may need quicker inputs than a player can manage, and paths
+// longer than SEARCH_MAX_STEPS aren't followed.
+//
+// Positions are kept as a bit per row for each orientation and column,
+// so each step of the search moves whole columns of positions with a
+// few bit operations. Open rows above the stack are passed over in one
+// go, counting a step per row. Only the positions reached at each step
+// are kept, and the path to a placement is worked out from them when
+// asked for, until the next search. Doesn't allocate once its list of
+// placements has grown.
+class PlacementFinder
+{
+public:
+	PlacementFinder();
+
+	int find(const GameState& state, bool hold = false);
+
+	int getCount() const { return (int)placements.size(); }
+	const Placement& getPlacement(int i) const { return placements[i]; }
+	int getPath(int i, uint8_t* path) const;
+
+private:
+	std::vector<Placement> placements;
+	uint32_t fitting[NUM_ROTATIONS][SEARCH_WIDTH + 2];
+	uint32_t reached[NUM_ROTATIONS][SEARCH_WIDTH + 2];
+	uint32_t next[NUM_ROTATIONS][SEARCH_WIDTH + 2];
+	uint32_t steps[SEARCH_MAX_STEPS + 1][NUM_ROTATIONS][SEARCH_WIDTH + 2];
+	uint32_t active[NUM_ROTATIONS];
+	uint32_t skyRows;
+	int skyY;
+	uint64_t cellKeys[1 << CELL_KEY_BITS];
+	uint32_t keyStamps[1 << CELL_KEY_BITS];
+	uint32_t stamp;
+
+	void findFree(const GameState& state, int type);
+	void step(int distance);
+	bool isReached(int x, int y, int rotation, int distance) const;
+	bool fits(int x, int y, int rotation) const;
+	PathAction findStep(int& x, int& y, int& rotation, int& distance) const;
+	bool addCells(uint64_t key);
+};
+
+#endif
@@ -0,0 +1,38 @@
+#ifndef RANDOM_H
+#define RANDOM_H
+
+#include <stdint.h>
+
+// A small seedable random number generator (xorshift64*), so each
+// game has its own sequence that plays out the same for the same seed
+struct Random
+{
+	uint64_t state;
+
+	// Starts a new sequence. The seed is mixed first (splitmix64) so
+	// nearby seeds don't give similar sequences.
+	void seed(uint64_t value)
+	{
+		uint64_t z = value + 0x9E3779B97F4A7C15ULL;
+		z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+		z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+		state = (z ^ (z >> 31)) | 1;
+	}
+
+	// Retrieves the next 64 random bits
+	uint64_t next()
+	{
+		state ^= state >> 12;
+		state ^= state << 25;
+		state ^= state >> 27;
+		return state * 0x2545F4914F6CDD1DULL;
+	}
+
+	// Retrieves a random number from 0 to bound - 1
+	int nextInt(int bound)
+	{
+		return (int)(((next() >> 32) * (uint64_t)bound) >> 32);
+	}
+};
+
+#endif
@@ -0,0 +1,164 @@
+#include "Ratings.h"
+
+#include <math.h>
+
+// Conversion between the Glicko and Glicko-2 scales
+#define GLICKO_SCALE 173.7178
+
+// Accuracy of the volatility found each period
+#define VOLATILITY_EPSILON 0.000001
+
+#define PI 3.14159265358979323846
+
+EloRatings::EloRatings(int players)
+	: ratings(players, START_RATING)
+{
+}
+
+// Moves both ratings by how far the score was from the expected one.
+// The score is 1 for a win by a, 0.5 for a draw and 0 for a loss.
+void EloRatings::addGame(int a, int b, double scoreA)
+{
+	double expected = 1 / (1 + pow(10.0, (ratings[b] - ratings[a]) / 400));
+	double change = ELO_K * (scoreA - expected);
+	ratings[a] += change;
+	ratings[b] -= change;
+}
+
+GlickoRatings::GlickoRatings(int count)
+{
+	Player player;
+	player.rating = 0;
+	player.deviation = GLICKO_DEVIATION / GLICKO_SCALE;
+	player.volatility = GLICKO_VOLATILITY;
+	player.variance = 0;
+	player.delta = 0;
+	player.games = 0;
+	players.assign(count, player);
+}
+
+// Counts a game towards the current period
+void GlickoRatings::addGame(int a, int b, double scoreA)
+{
+	gamesA.push_back(a);
+	gamesB.push_back(b);
+	scores.push_back(scoreA);
+}
+
+// Weighs a game by how unsure the opponent's rating is
+static double getImpact(double deviation)
+{
+	return 1 / sqrt(1 + 3 * deviation * deviation / (PI * PI));
+}
+
+// Updates every player from the games of the period, all against the
+// ratings from before it
+void GlickoRatings::endPeriod()
+{
+	for (size_t g = 0; g < scores.size(); g++)
+	{
+		Player& a = players[gamesA[g]];
+		Player& b = players[gamesB[g]];
+		double impactA = getImpact(b.deviation);
+		double impactB = getImpact(a.deviation);
+		double expectedA = 1 / (1 + exp(-impactA * (a.rating - b.rating)));
+		double expectedB = 1 / (1 + exp(-impactB * (b.rating - a.rating)));
+		a.variance += impactA * impactA * expectedA * (1 - expectedA);
+		a.delta += impactA * (scores[g] - expectedA);
+		b.variance += impactB * impactB * expectedB * (1 - expectedB);
+		b.delta += impactB * ((1 - scores[g]) - expectedB);
+		a.games++;
+		b.games++;
+	}
+
+	for (size_t i = 0; i < players.size(); i++)
+	{
+		Player& player = players[i];
+		if (player.games == 0)
+		{
+			// Unplayed ratings only grow less certain
+			player.deviation = sqrt(player.deviation * player.deviation + player.volatility * player.volatility);
+			continue;
+		}
+		double variance = 1 / player.variance;
+		double delta = variance * player.delta;
+		player.volatility = updateVolatility(player, variance, delta);
+		double grown = sqrt(player.deviation * player.deviation + player.volatility * player.volatility);
+		player.deviation = 1 / sqrt(1 / (grown * grown) + 1 / variance);
+		player.rating += player.deviation * player.deviation * player.delta;
+		player.variance = 0;
+		player.delta = 0;
+		player.games = 0;
+	}
+
+	gamesA.clear();
+	gamesB.clear();
+	scores.clear();
+}
+
+// Finds a player's new volatility by the Illinois method, as in
+// Glickman's description of Glicko-2
+double GlickoRatings::updateVolatility(const Player& player, double variance, double delta) const
+{
+	double phi2 = player.deviation * player.deviation;
+	double a = log(player.volatility * player.volatility);
+	double tau2 = GLICKO_TAU * GLICKO_TAU;
+	struct Curve
+	{
+		double delta2, phi2, variance, a, tau2;
+		double at(double x) const
+		{
+			double ex = exp(x);
+			double d = phi2 + variance + ex;
+			return ex * (delta2 - d) / (2 * d * d) - (x - a) / tau2;
+		}
+	} f = { delta * delta, phi2, variance, a, tau2 };
+
+	double low = a;
+	double high;
+	if (delta * delta > phi2 + variance)
+	{
+		high = log(delta * delta - phi2 - variance);
+	}
+	else
+	{
+		int k = 1;
+		while (f.at(a - k * GLICKO_TAU) < 0)
+		{
+			k++;
+		}
+		high = a - k * GLICKO_TAU;
+	}
+
+	double fLow = f.at(low);
+	double fHigh = f.at(high);
+	while (fabs(high - low) > VOLATILITY_EPSILON)
+	{
+		double c = low + (low - high) * fLow / (fHigh - fLow);
+		double fC = f.at(c);
+		if (fC * fHigh <= 0)
+		{
+			low = high;
+			fLow = fHigh;
+		}
+		else
+		{
+			fLow /= 2;
+		}
+		high = c;
+		fHigh = fC;
+	}
+	return exp(low / 2);
+}
+
+// Retrieves a rating on the usual Elo-like scale
+double GlickoRatings::getRating(int player) const
+{
+	return START_RATING + players[player].rating * GLICKO_SCALE;
+}
+
+// Retrieves the deviation of a rating on the usual scale
+double GlickoRatings::getDeviation(int player) const
+{
+	return players[player].deviation * GLICKO_SCALE;
+}
@@ -0,0 +1,68 @@
+#ifndef RATINGS_H
+#define RATINGS_H
+
+#include <vector>
+
+// Rating every player starts from, on the usual Elo scale
+#define START_RATING 1500.0
+
+// Most rating points an Elo game can move
+#define ELO_K 16.0
+
+// Glicko-2 starting deviation and volatility, and how fast the
+// volatility may change
+#define GLICKO_DEVIATION 350.0
+#define GLICKO_VOLATILITY 0.06
+#define GLICKO_TAU 0.5
+
+// Elo ratings, updated one game at a time in the order given
+class EloRatings
+{
+public:
+	EloRatings(int players);
+
+	void addGame(int a, int b, double scoreA);
+
+	double getRating(int player) const { return ratings[player]; }
+
+private:
+	std::vector<double> ratings;
+};
+
+// Glicko-2 ratings. Games are collected into rating periods and every
+// player is updated at once at the end of each, so the order of the games
+// within a period doesn't matter. Each rating has a deviation, how sure
+// it is, and a volatility, how much the player's strength seems to move.
+class GlickoRatings
+{
+public:
+	GlickoRatings(int players);
+
+	void addGame(int a, int b, double scoreA);
+	void endPeriod();
+
+	double getRating(int player) const;
+	double getDeviation(int player) const;
+	double getVolatility(int player) const { return players[player].volatility; }
+
+private:
+	// A player on the Glicko-2 scale, and the sums of their games this period
+	struct Player
+	{
+		double rating;
+		double deviation;
+		double volatility;
+		double variance;	// Sum of g^2 E (1 - E), to be inverted
+		double delta;		// Sum of g (score - E)
+		int games;
+	};
+
+	std::vector<Player> players;
+	std::vector<int> gamesA;
+	std::vector<int> gamesB;
+	std::vector<double> scores;
+
+	double updateVolatility(const Player& player, double variance, double delta) const;
+};
+
+#endif
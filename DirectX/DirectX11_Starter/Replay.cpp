@@ -0,0 +1,231 @@
+#include "Replay.h"
+
+#include <string.h>
+#include <fstream>
+#include <iterator>
+
+// Bytes kept in memory before handing them to the writer
+#define FLUSH_SIZE 4096
+
+// Marks the start of a replay stream
+static const uint8_t REPLAY_MAGIC[4] = { '3', 'D', 'T', 'R' };
+
+// Creates a recorder that holds back the changes of the given number of
+// latest ticks so they can be taken back
+ReplayRecorder::ReplayRecorder(uint32_t pHoldBack)
+{
+	holdBack = pHoldBack;
+	recording = false;
+	tick = 0;
+	written = 0;
+	lastChange = 0;
+	lastInput = 0;
+}
+
+// Writes out the end of the replay if still recording
+ReplayRecorder::~ReplayRecorder()
+{
+	finish();
+}
+
+// Starts recording a game that uses the given seed. Without a path
+// the whole replay is kept in memory and can be read with getData().
+bool ReplayRecorder::begin(uint64_t seed, const char* path)
+{
+	finish();
+	buffer.clear();
+	held.clear();
+	if (path && !writer.open(path))
+	{
+		return false;
+	}
+
+	buffer.insert(buffer.end(), REPLAY_MAGIC, REPLAY_MAGIC + 4);
+	buffer.push_back(REPLAY_VERSION);
+	writeVarint(buffer, seed);
+
+	recording = true;
+	tick = 0;
+	written = 0;
+	lastChange = 0;
+	lastInput = 0;
+	return true;
+}
+
+// Records the input used for the next tick
+void ReplayRecorder::record(int input)
+{
+	if (!recording)
+	{
+		return;
+	}
+
+	input &= INPUT_MASK;
+	if (input != (held.empty() ? lastInput : held.back().input))
+	{
+		HeldChange change = { tick, input };
+		held.push_back(change);
+	}
+	tick++;
+	writeHeld(tick > holdBack ? tick - holdBack : 0);
+}
+
+// Cuts the recording back to its first given number of ticks, dropping
+// the changes after them, so recording carries on from there. Returns
+// false if they have already been written.
+bool ReplayRecorder::truncate(uint32_t ticks)
+{
+	if (!recording || ticks < written)
+	{
+		return false;
+	}
+	while (!held.empty() && held.back().tick >= ticks)
+	{
+		held.pop_back();
+	}
+	tick = ticks < tick ? ticks : tick;
+	return true;
+}
+
+// Ends the replay, writing out the number of ticks played
+void ReplayRecorder::finish()
+{
+	if (!recording)
+	{
+		return;
+	}
+
+	writeHeld(tick);
+	writeVarint(buffer, 0);
+	writeVarint(buffer, tick);
+	flush();
+	writer.close();
+	recording = false;
+}
+
+// Writes the held changes made before the given tick
+void ReplayRecorder::writeHeld(uint32_t before)
+{
+	size_t count = 0;
+	while (count < held.size() && held[count].tick < before)
+	{
+		const HeldChange& change = held[count++];
+		writeVarint(buffer, (uint64_t)(change.tick - lastChange) << INPUT_BITS | change.input);
+		lastChange = change.tick;
+		lastInput = change.input;
+	}
+	if (count > 0)
+	{
+		held.erase(held.begin(), held.begin() + count);
+		if (buffer.size() >= FLUSH_SIZE)
+		{
+			flush();
+		}
+	}
+	written = before > written ? before : written;
+}
+
+// Hands the buffered bytes to the writer when writing to a file
+void ReplayRecorder::flush()
+{
+	if (writer.isOpen())
+	{
+		writer.write(buffer.data(), buffer.size());
+		buffer.clear();
+	}
+}
+
+ReplayPlayer::ReplayPlayer()
+{
+	start = 0;
+	position = 0;
+	seed = 0;
+	length = 0;
+	tick = 0;
+	nextChange = 0;
+	nextInput = 0;
+	input = 0;
+}
+
+// Loads a replay from a file
+bool ReplayPlayer::load(const char* path)
+{
+	std::ifstream file(path, std::ios::in | std::ios::binary);
+	if (!file.is_open())
+	{
+		return false;
+	}
+	std::vector<uint8_t> bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+	return load(bytes.data(), bytes.size());
+}
+
+// Loads a replay from memory
+bool ReplayPlayer::load(const uint8_t* pData, size_t size)
+{
+	data.assign(pData, pData + size);
+	length = 0;
+	tick = 0;
+
+	// Check the header
+	if (size < 5 || memcmp(pData, REPLAY_MAGIC, 4) != 0 || pData[4] != REPLAY_VERSION)
+	{
+		return false;
+	}
+	position = 5;
+	if (!readVarint(data.data(), data.size(), &position, &seed))
+	{
+		return false;
+	}
+	start = position;
+	restart();
+	return true;
+}
+
+// Goes back to the first tick of the replay
+void ReplayPlayer::restart()
+{
+	position = start;
+	tick = 0;
+	input = 0;
+	length = UINT32_MAX;
+	nextChange = 0;
+	readChange();
+}
+
+// Retrieves the input for the next tick
+int ReplayPlayer::next()
+{
+	if (isFinished())
+	{
+		return 0;
+	}
+	if (tick == nextChange)
+	{
+		input = nextInput;
+		readChange();
+	}
+	tick++;
+	return input;
+}
+
+// Reads the next input change, or the length of the replay at the end.
+// A replay cut off without its end ends after its last change.
+void ReplayPlayer::readChange()
+{
+	uint64_t value;
+	if (!readVarint(data.data(), data.size(), &position, &value))
+	{
+		length = nextChange + 1;
+		nextChange = UINT32_MAX;
+		return;
+	}
+	if (value == 0)
+	{
+		uint64_t ticks;
+		length = readVarint(data.data(), data.size(), &position, &ticks) ? (uint32_t)ticks : nextChange + 1;
+		nextChange = UINT32_MAX;
+		return;
+	}
+	nextChange += (uint32_t)(value >> INPUT_BITS);
+	nextInput = (int)(value & INPUT_MASK);
+}
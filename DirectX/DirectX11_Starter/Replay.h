@@ -0,0 +1,92 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include "BackgroundWriter.h"
+#include "GameSimulation.h"
+#include "Serialize.h"
+
+#include <stdint.h>
+#include <vector>
+
+// Replay stream layout:
+//   "3DTR", version byte, varint seed
+//   one varint per input change: ticks since the last change << INPUT_BITS | input
+//   varint 0, varint number of ticks played
+// Every tick's input is the input of the last change, starting from 0.
+#define REPLAY_VERSION 1
+
+// Records the seed and per-tick inputs of a game. Only changes in the
+// input are stored, so a game takes a few bytes per key press. When
+// given a file the data is written out from a background thread.
+//
+// Changes from the last holdBack ticks are kept back in memory rather
+// than written, so a game that is rewound can be cut back to an earlier
+// tick with truncate() and go on being recorded from there.
+class ReplayRecorder
+{
+public:
+	ReplayRecorder(uint32_t holdBack = 0);
+	~ReplayRecorder();
+
+	bool begin(uint64_t seed, const char* path = NULL);
+	void record(int input);
+	bool truncate(uint32_t ticks);
+	void finish();
+
+	bool isRecording() const { return recording; }
+	uint32_t getTicks() const { return tick; }
+	const std::vector<uint8_t>& getData() const { return buffer; }	// Without the changes held back
+
+private:
+	// An input change not yet written
+	struct HeldChange
+	{
+		uint32_t tick;
+		int input;
+	};
+
+	BackgroundWriter writer;
+	std::vector<uint8_t> buffer;
+	std::vector<HeldChange> held;
+	uint32_t holdBack;
+	bool recording;
+	uint32_t tick;
+	uint32_t written;		// Ticks whose changes are all written
+	uint32_t lastChange;	// Last change written
+	int lastInput;
+
+	void writeHeld(uint32_t before);
+	void flush();
+};
+
+// Feeds the inputs of a recorded game back one tick at a time
+class ReplayPlayer
+{
+public:
+	ReplayPlayer();
+
+	bool load(const char* path);
+	bool load(const uint8_t* data, size_t size);
+	void restart();
+	int next();
+
+	uint64_t getSeed() const { return seed; }
+	uint32_t getTick() const { return tick; }
+	uint32_t getLength() const { return length; }
+	bool isFinished() const { return tick >= length; }
+
+private:
+	std::vector<uint8_t> data;
+	size_t start;
+	size_t position;
+	uint64_t seed;
+	uint32_t length;
+	uint32_t tick;
+	uint32_t nextChange;
+	int nextInput;
+	int input;
+
+	void readChange();
+};
+
+#endif
@@ -0,0 +1,354 @@
+#include "ReplayArchive.h"
+#include "Replay.h"
+#include "Serialize.h"
+
+#include <string.h>
+
+// Bytes kept in memory before handing them to the writer
+#define FLUSH_SIZE 4096
+
+// Sizes of the fixed parts of the file
+#define ARCHIVE_HEADER_SIZE 20
+#define ARCHIVE_FOOTER_SIZE 20
+#define INDEX_ENTRY_SIZE 12
+
+// Marks the start and the end of an archive
+static const uint8_t ARCHIVE_MAGIC[4] = { '3', 'D', 'T', 'K' };
+static const uint8_t INDEX_MAGIC[4] = { '3', 'D', 'T', 'I' };
+
+ReplayArchiveWriter::ReplayArchiveWriter()
+{
+	written = 0;
+	interval = KEYFRAME_INTERVAL;
+	tick = 0;
+	lastChange = 0;
+	lastInput = 0;
+	recording = false;
+}
+
+// Writes out the index if still recording
+ReplayArchiveWriter::~ReplayArchiveWriter()
+{
+	finish();
+}
+
+// Starts recording a game that uses the given seed, saving a
+// keyframe every interval ticks
+bool ReplayArchiveWriter::begin(uint64_t seed, const char* path, uint32_t pInterval)
+{
+	finish();
+	if (pInterval == 0 || !writer.open(path))
+	{
+		return false;
+	}
+	buffer.clear();
+	index.clear();
+
+	uint8_t header[ARCHIVE_HEADER_SIZE];
+	memcpy(header, ARCHIVE_MAGIC, 4);
+	writeU32(header + 4, ARCHIVE_VERSION);
+	writeU32(header + 8, pInterval);
+	writeU64(header + 12, seed);
+	buffer.insert(buffer.end(), header, header + ARCHIVE_HEADER_SIZE);
+
+	written = 0;
+	interval = pInterval;
+	tick = 0;
+	lastChange = 0;
+	lastInput = 0;
+	recording = true;
+	return true;
+}
+
+// Records the input used for the next tick, starting a new
+// segment with a saved game when a keyframe is due
+void ReplayArchiveWriter::record(const GameSimulation& simulation, int input)
+{
+	if (!recording)
+	{
+		return;
+	}
+
+	if (tick % interval == 0)
+	{
+		IndexEntry entry = { tick, written + buffer.size() };
+		index.push_back(entry);
+
+		size_t start = buffer.size();
+		buffer.resize(start + SEGMENT_HEADER_SIZE);
+		writeU32(&buffer[start], tick);
+		buffer[start + 4] = (uint8_t)lastInput;
+		simulation.saveState(&buffer[start + 5]);
+		lastChange = tick;
+	}
+
+	input &= INPUT_MASK;
+	if (input != lastInput)
+	{
+		writeVarint(buffer, (uint64_t)(tick - lastChange) << INPUT_BITS | input);
+		lastChange = tick;
+		lastInput = input;
+	}
+	if (buffer.size() >= FLUSH_SIZE)
+	{
+		flush();
+	}
+	tick++;
+}
+
+// Ends the archive, writing out the index of keyframes
+void ReplayArchiveWriter::finish()
+{
+	if (!recording)
+	{
+		return;
+	}
+
+	uint64_t indexOffset = written + buffer.size();
+	uint8_t entry[INDEX_ENTRY_SIZE];
+	for (size_t i = 0; i < index.size(); i++)
+	{
+		writeU32(entry, index[i].tick);
+		writeU64(entry + 4, index[i].offset);
+		buffer.insert(buffer.end(), entry, entry + INDEX_ENTRY_SIZE);
+	}
+
+	uint8_t footer[ARCHIVE_FOOTER_SIZE];
+	writeU32(footer, (uint32_t)index.size());
+	writeU32(footer + 4, tick);
+	writeU64(footer + 8, indexOffset);
+	memcpy(footer + 16, INDEX_MAGIC, 4);
+	buffer.insert(buffer.end(), footer, footer + ARCHIVE_FOOTER_SIZE);
+
+	flush();
+	writer.close();
+	recording = false;
+}
+
+// Hands the buffered bytes to the writer
+void ReplayArchiveWriter::flush()
+{
+	writer.write(buffer.data(), buffer.size());
+	written += buffer.size();
+	buffer.clear();
+}
+
+// Builds an archive from an input-only replay by playing it through once
+bool ReplayArchiveWriter::convert(const char* replayPath, const char* archivePath, uint32_t interval)
+{
+	ReplayPlayer player;
+	if (!player.load(replayPath))
+	{
+		return false;
+	}
+
+	GameSimulation simulation(player.getSeed());
+	ReplayArchiveWriter archive;
+	if (!archive.begin(player.getSeed(), archivePath, interval))
+	{
+		return false;
+	}
+	while (!player.isFinished())
+	{
+		int input = player.next();
+		archive.record(simulation, input);
+		simulation.tick(input);
+	}
+	archive.finish();
+	return true;
+}
+
+ReplayArchive::ReplayArchive()
+{
+	close();
+}
+
+// Maps an archive into memory and checks its header and index
+bool ReplayArchive::open(const char* path)
+{
+	close();
+	if (!file.open(path))
+	{
+		return false;
+	}
+	const uint8_t* bytes = file.getData();
+	size_t size = file.getSize();
+
+	if (size < ARCHIVE_HEADER_SIZE + ARCHIVE_FOOTER_SIZE
+		|| memcmp(bytes, ARCHIVE_MAGIC, 4) != 0
+		|| readU32(bytes + 4) != ARCHIVE_VERSION
+		|| memcmp(bytes + size - 4, INDEX_MAGIC, 4) != 0)
+	{
+		close();
+		return false;
+	}
+
+	// The index has to end at the footer. Bounds are checked by
+	// subtracting, as adding untrusted offsets could wrap around.
+	const uint8_t* footer = bytes + size - ARCHIVE_FOOTER_SIZE;
+	uint32_t segments = readU32(footer);
+	uint64_t offset = readU64(footer + 8);
+	uint64_t end = size - ARCHIVE_FOOTER_SIZE;
+	if (segments == 0 || offset < ARCHIVE_HEADER_SIZE || offset > end
+		|| (end - offset) % INDEX_ENTRY_SIZE != 0 || (end - offset) / INDEX_ENTRY_SIZE != segments)
+	{
+		close();
+		return false;
+	}
+
+	data = bytes;
+	indexOffset = (size_t)offset;
+	count = segments;
+	length = readU32(footer + 4);
+	interval = readU32(bytes + 8);
+	seed = readU64(bytes + 12);
+
+	// Every segment has to fit before the next one or the index, and
+	// the ticks have to start at 0 and never go back, as seek() searches them
+	for (uint32_t i = 0; i < count; i++)
+	{
+		const uint8_t* entry = data + indexOffset + i * INDEX_ENTRY_SIZE;
+		uint64_t start = readU64(entry + 4);
+		uint64_t next = i + 1 < count ? readU64(entry + INDEX_ENTRY_SIZE + 4) : offset;
+		uint32_t first = readU32(entry);
+		if (start < ARCHIVE_HEADER_SIZE || start > next || next - start < SEGMENT_HEADER_SIZE
+			|| (i == 0 ? first != 0 : first < getSegmentTick(i - 1)))
+		{
+			close();
+			return false;
+		}
+	}
+	return true;
+}
+
+// Unmaps the archive
+void ReplayArchive::close()
+{
+	file.close();
+	data = NULL;
+	indexOffset = 0;
+	seed = 0;
+	interval = 0;
+	length = 0;
+	count = 0;
+	segment = 0;
+	position = 0;
+	segmentEnd = 0;
+	tick = 0;
+	nextChange = UINT32_MAX;
+	nextInput = 0;
+	input = 0;
+}
+
+// Moves the simulation to the given tick, playing at most one
+// keyframe interval of ticks past the keyframe before it. Returns false
+// if the keyframe is damaged, leaving the simulation as it was.
+bool ReplayArchive::seek(uint32_t target, GameSimulation& simulation)
+{
+	if (data == NULL || target > length)
+	{
+		return false;
+	}
+
+	// Find the last keyframe at or before the target
+	uint32_t low = 0;
+	uint32_t high = count;
+	while (high - low > 1)
+	{
+		uint32_t middle = (low + high) / 2;
+		if (getSegmentTick(middle) <= target)
+		{
+			low = middle;
+		}
+		else
+		{
+			high = middle;
+		}
+	}
+
+	const uint8_t* keyframe = data + getSegmentOffset(low);
+	if (readU32(keyframe) != getSegmentTick(low) || readU32(keyframe) > target ||
+		(keyframe[4] & ~INPUT_MASK) != 0 || !simulation.loadState(keyframe + 5))
+	{
+		return false;
+	}
+	tick = readU32(keyframe);
+	input = keyframe[4];
+	enterSegment(low);
+
+	while (tick < target)
+	{
+		step(simulation);
+	}
+	return true;
+}
+
+// Plays the next recorded tick, returning false at the end of the game
+bool ReplayArchive::step(GameSimulation& simulation)
+{
+	if (data == NULL || isFinished())
+	{
+		return false;
+	}
+	if (tick == nextChange)
+	{
+		input = nextInput;
+		readChange();
+	}
+	simulation.tick(input);
+	tick++;
+	return true;
+}
+
+// Retrieves the first tick of a segment
+uint32_t ReplayArchive::getSegmentTick(uint32_t i) const
+{
+	return readU32(data + indexOffset + i * INDEX_ENTRY_SIZE);
+}
+
+// Retrieves where a segment starts, or where the index starts past the last one
+size_t ReplayArchive::getSegmentOffset(uint32_t i) const
+{
+	if (i >= count)
+	{
+		return indexOffset;
+	}
+	return (size_t)readU64(data + indexOffset + i * INDEX_ENTRY_SIZE + 4);
+}
+
+// Starts reading the input changes of a segment
+void ReplayArchive::enterSegment(uint32_t i)
+{
+	segment = i;
+	position = getSegmentOffset(i) + SEGMENT_HEADER_SIZE;
+	segmentEnd = getSegmentOffset(i + 1);
+	nextChange = getSegmentTick(i);
+	readChange();
+}
+
+// Reads the next input change, moving on to the following segment
+// when this one runs out. The input carries over between segments.
+void ReplayArchive::readChange()
+{
+	while (position >= segmentEnd)
+	{
+		if (segment + 1 >= count)
+		{
+			nextChange = UINT32_MAX;
+			return;
+		}
+		segment++;
+		position = getSegmentOffset(segment) + SEGMENT_HEADER_SIZE;
+		segmentEnd = getSegmentOffset(segment + 1);
+		nextChange = getSegmentTick(segment);
+	}
+
+	uint64_t value;
+	if (!readVarint(data, segmentEnd, &position, &value))
+	{
+		nextChange = UINT32_MAX;
+		return;
+	}
+	nextChange += (uint32_t)(value >> INPUT_BITS);
+	nextInput = (int)(value & INPUT_MASK);
+}
@@ -0,0 +1,104 @@
+#ifndef REPLAYARCHIVE_H
+#define REPLAYARCHIVE_H
+
+#include "BackgroundWriter.h"
+#include "GameSimulation.h"
+#include "MappedFile.h"
+
+#include <stdint.h>
+#include <vector>
+
+// Replay archive layout, all fixed-width values little-endian:
+//   "3DTK", u32 version, u32 keyframe interval, u64 seed
+//   one segment per keyframe interval:
+//     u32 first tick, u8 input held at that tick, STATE_SIZE bytes of saved game,
+//     one varint per input change in the segment: ticks since the
+//     previous change (or the segment start) << INPUT_BITS | input
+//   index: u32 tick, u64 file offset for every segment
+//   u32 segment count, u32 number of ticks played, u64 index offset, "3DTI"
+// A game can be picked up at any segment without reading what comes before it.
+#define ARCHIVE_VERSION 1
+#define KEYFRAME_INTERVAL 600
+#define SEGMENT_HEADER_SIZE (5 + STATE_SIZE)
+
+// Records a game as keyframes plus inputs. Must be given the simulation
+// before each tick, along with the input the tick is about to use.
+class ReplayArchiveWriter
+{
+public:
+	ReplayArchiveWriter();
+	~ReplayArchiveWriter();
+
+	bool begin(uint64_t seed, const char* path, uint32_t interval = KEYFRAME_INTERVAL);
+	void record(const GameSimulation& simulation, int input);
+	void finish();
+
+	bool isRecording() const { return recording; }
+	uint32_t getTicks() const { return tick; }
+
+	static bool convert(const char* replayPath, const char* archivePath, uint32_t interval = KEYFRAME_INTERVAL);
+
+private:
+	struct IndexEntry
+	{
+		uint32_t tick;
+		uint64_t offset;
+	};
+
+	BackgroundWriter writer;
+	std::vector<uint8_t> buffer;
+	std::vector<IndexEntry> index;
+	uint64_t written;
+	uint32_t interval;
+	uint32_t tick;
+	uint32_t lastChange;
+	int lastInput;
+	bool recording;
+
+	void flush();
+};
+
+// Reads a replay archive through a memory mapping and moves a simulation
+// to any tick by loading the keyframe before it and playing forward
+class ReplayArchive
+{
+public:
+	ReplayArchive();
+
+	bool open(const char* path);
+	void close();
+
+	bool seek(uint32_t target, GameSimulation& simulation);
+	bool step(GameSimulation& simulation);
+
+	uint64_t getSeed() const { return seed; }
+	uint32_t getInterval() const { return interval; }
+	uint32_t getLength() const { return length; }
+	uint32_t getTick() const { return tick; }
+	uint32_t getKeyframeCount() const { return count; }
+	bool isFinished() const { return tick >= length; }
+
+private:
+	MappedFile file;
+	const uint8_t* data;
+	size_t indexOffset;
+	uint64_t seed;
+	uint32_t interval;
+	uint32_t length;
+	uint32_t count;
+
+	uint32_t segment;
+	size_t position;
+	size_t segmentEnd;
+	uint32_t tick;
+	uint32_t nextChange;
+	int nextInput;
+	int input;
+
+	uint32_t getSegmentTick(uint32_t i) const;
+	size_t getSegmentOffset(uint32_t i) const;
+	void enterSegment(uint32_t i);
+	void readChange();
+};
+
+#endif
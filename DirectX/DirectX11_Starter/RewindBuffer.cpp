@@ -0,0 +1,133 @@
+#include "RewindBuffer.h"
+
+#include <string.h>
+
+// Runs are stored as a start offset and length byte, each followed by the changed bytes
+static_assert(STATE_SIZE < 256, "run offsets must fit in a byte");
+
+// Sets aside room for the history
+RewindBuffer::RewindBuffer(uint32_t maxTicks, size_t maxBytes)
+	: bytes(maxBytes < sizeof(delta) ? sizeof(delta) : maxBytes), starts(maxTicks > 0 ? maxTicks : 1)
+{
+	clear();
+}
+
+// Forgets the whole history
+void RewindBuffer::clear()
+{
+	byteHead = 0;
+	byteTail = 0;
+	first = 0;
+	count = 0;
+	hasState = false;
+}
+
+// Records the state of the game after a tick
+void RewindBuffer::push(const GameSimulation& simulation)
+{
+	uint8_t state[STATE_SIZE];
+	simulation.saveState(state);
+	if (!hasState)
+	{
+		memcpy(current, state, STATE_SIZE);
+		hasState = true;
+		return;
+	}
+
+	size_t size = encode(state);
+	memcpy(current, state, STATE_SIZE);
+
+	// Make room for the new delta
+	while (count == starts.size() || byteHead + size - byteTail > bytes.size())
+	{
+		dropOldest();
+	}
+
+	starts[(first + count) % starts.size()] = byteHead;
+	count++;
+	for (size_t i = 0; i < size; i++)
+	{
+		bytes[(byteHead + i) % bytes.size()] = delta[i];
+	}
+	byteHead += size;
+}
+
+// Steps the game back by up to the given number of ticks, dropping the
+// ticks undone from the history. Returns the number of ticks rewound.
+uint32_t RewindBuffer::rewind(uint32_t ticks, GameSimulation& simulation)
+{
+	if (ticks > count)
+	{
+		ticks = count;
+	}
+
+	for (uint32_t t = 0; t < ticks; t++)
+	{
+		count--;
+		uint64_t position = starts[(first + count) % starts.size()];
+		uint64_t end = byteHead;
+		while (position < end)
+		{
+			int offset = bytes[position % bytes.size()];
+			int length = bytes[(position + 1) % bytes.size()];
+			position += 2;
+			for (int i = 0; i < length; i++)
+			{
+				current[offset + i] ^= bytes[(position + i) % bytes.size()];
+			}
+			position += length;
+		}
+		byteHead = starts[(first + count) % starts.size()];
+	}
+
+	if (ticks > 0)
+	{
+		simulation.loadState(current);
+	}
+	return ticks;
+}
+
+// Writes the difference between the given state and the current
+// one into the delta buffer, returning its size in bytes
+size_t RewindBuffer::encode(const uint8_t* state)
+{
+	size_t size = 0;
+	int i = 0;
+	while (i < STATE_SIZE)
+	{
+		if (state[i] == current[i])
+		{
+			i++;
+			continue;
+		}
+
+		// Extend the run over short gaps, which is cheaper than starting a new one
+		int start = i;
+		int end = i;
+		while (i < STATE_SIZE && i - end < 2)
+		{
+			if (state[i] != current[i])
+			{
+				end = i;
+			}
+			i++;
+		}
+		i = end + 1;
+
+		delta[size++] = (uint8_t)start;
+		delta[size++] = (uint8_t)(end + 1 - start);
+		for (int j = start; j <= end; j++)
+		{
+			delta[size++] = state[j] ^ current[j];
+		}
+	}
+	return size;
+}
+
+// Forgets the oldest tick in the history
+void RewindBuffer::dropOldest()
+{
+	first = (first + 1) % starts.size();
+	count--;
+	byteTail = count > 0 ? starts[first] : byteHead;
+}
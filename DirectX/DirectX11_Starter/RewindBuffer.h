@@ -0,0 +1,47 @@
+#ifndef REWINDBUFFER_H
+#define REWINDBUFFER_H
+
+#include "GameSimulation.h"
+
+#include <stdint.h>
+#include <vector>
+
+// Default history kept: 30 seconds of ticks in at most 256 KB of deltas
+#define REWIND_TICKS (30 * TICKS_PER_SECOND)
+#define REWIND_BYTES (256 * 1024)
+
+// Keeps the recent history of a game so it can be stepped back in time.
+// Each tick is stored as the XOR of its saved state with the one before,
+// written as runs of changed bytes, so a falling block costs a few bytes
+// per tick. XOR deltas undo themselves, so rewinding walks back from the
+// newest state without needing any full snapshots. The oldest ticks are
+// dropped once either limit is reached. Nothing is allocated after the
+// buffer is constructed.
+class RewindBuffer
+{
+public:
+	RewindBuffer(uint32_t maxTicks = REWIND_TICKS, size_t maxBytes = REWIND_BYTES);
+
+	void clear();
+	void push(const GameSimulation& simulation);
+	uint32_t rewind(uint32_t ticks, GameSimulation& simulation);
+
+	uint32_t getAvailable() const { return count; }
+	size_t getBytesUsed() const { return (size_t)(byteHead - byteTail); }
+
+private:
+	std::vector<uint8_t> bytes;
+	std::vector<uint64_t> starts;
+	uint64_t byteHead;
+	uint64_t byteTail;
+	uint32_t first;
+	uint32_t count;
+	bool hasState;
+	uint8_t current[STATE_SIZE];
+	uint8_t delta[STATE_SIZE * 2];
+
+	size_t encode(const uint8_t* state);
+	void dropOldest();
+};
+
+#endif
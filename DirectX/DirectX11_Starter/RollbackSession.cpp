@@ -0,0 +1,232 @@
+#include "RollbackSession.h"
+#include "Serialize.h"
+
+#include <string.h>
+
+// rollbackTo when every tick played was played on real inputs
+#define NO_ROLLBACK UINT32_MAX
+
+// Inputs that only act on the tick they're pressed, which a guess
+// doesn't repeat
+#define ONE_SHOT_INPUTS (INPUT_DROP | INPUT_HOLD)
+
+// Fills in the default session
+void setDefaultRollback(RollbackSettings& settings)
+{
+	settings.localPlayer = 0;
+	settings.inputDelay = DEFAULT_INPUT_DELAY_TICKS;
+	settings.maxRollback = DEFAULT_MAX_ROLLBACK;
+	settings.seed = 1;
+	settings.attack = CLASSIC_ATTACK;
+}
+
+RollbackSession::RollbackSession(const RollbackSettings& pSettings)
+	: current(pSettings.seed, pSettings.attack)
+{
+	settings = pSettings;
+	settings.localPlayer = settings.localPlayer != 0 ? 1 : 0;
+	settings.inputDelay = settings.inputDelay < 0 ? 0 : (settings.inputDelay > MAX_ROLLBACK_LIMIT ? MAX_ROLLBACK_LIMIT : settings.inputDelay);
+	settings.maxRollback = settings.maxRollback < 1 ? 1 : (settings.maxRollback > MAX_ROLLBACK_LIMIT ? MAX_ROLLBACK_LIMIT : settings.maxRollback);
+	remotePlayer = 1 - settings.localPlayer;
+	reset();
+}
+
+// Starts the game again from the first tick. The inputs of the ticks
+// before the delay are known to be nothing for both players.
+void RollbackSession::reset()
+{
+	current = VersusSimulation(settings.seed, settings.attack);
+	memset(inputs, 0, sizeof(inputs));
+	memset(guesses, 0, sizeof(guesses));
+	tick = 0;
+	localKnown = (uint32_t)settings.inputDelay;
+	remoteKnown = (uint32_t)settings.inputDelay;
+	localAcked = 0;
+	remoteTick = 0;
+	remoteLead = 0;
+	rollbackTo = NO_ROLLBACK;
+	memset(&stats, 0, sizeof(stats));
+}
+
+// Checks whether the next tick can be played: it mustn't be further
+// ahead of the remote inputs than a rollback can reach, and the local
+// inputs the peer hasn't received must still be kept to resend
+bool RollbackSession::canAdvance() const
+{
+	return tick < remoteKnown + settings.maxRollback && localKnown - localAcked < ROLLBACK_HISTORY - 1;
+}
+
+// Adds the local player's input, which plays after the input delay
+void RollbackSession::addLocalInput(int input)
+{
+	inputs[settings.localPlayer][localKnown % ROLLBACK_HISTORY] = (uint8_t)(input & INPUT_MASK);
+	localKnown++;
+}
+
+// Plays the next tick, first rolling back and playing again any ticks
+// played on wrong guesses. Counts a stall and does nothing if the
+// session can't advance, or the local input for the tick is missing.
+void RollbackSession::advance()
+{
+	if (!canAdvance() || localKnown <= tick)
+	{
+		stats.stalls++;
+		return;
+	}
+
+	if (rollbackTo < tick)
+	{
+		uint32_t target = tick;
+		uint32_t depth = tick - rollbackTo;
+		current = saved[rollbackTo % ROLLBACK_HISTORY];
+		tick = rollbackTo;
+		while (tick < target)
+		{
+			playTick();
+		}
+		stats.rollbacks++;
+		stats.resimulated += depth;
+		stats.deepestRollback = depth > stats.deepestRollback ? depth : stats.deepestRollback;
+	}
+	rollbackTo = NO_ROLLBACK;
+	playTick();
+}
+
+// Writes a packet of the local inputs the peer hasn't acknowledged,
+// oldest first, and returns its size
+int RollbackSession::writePacket(uint8_t* out) const
+{
+	uint32_t count = localKnown - localAcked;
+	count = count > MAX_PACKET_RUN ? MAX_PACKET_RUN : count;
+	out[0] = NETPLAY_INPUT;
+	writeU32(out + 1, tick);
+	writeU32(out + 5, remoteKnown);
+	writeU32(out + 9, localAcked);
+	out[13] = (uint8_t)(int8_t)getLead();
+	out[14] = (uint8_t)count;
+	for (uint32_t i = 0; i < count; i++)
+	{
+		out[NETPLAY_HEADER_SIZE + i] = inputs[settings.localPlayer][(localAcked + i) % ROLLBACK_HISTORY];
+	}
+	return NETPLAY_HEADER_SIZE + (int)count;
+}
+
+// Takes the remote inputs and acknowledgement of a packet from the
+// peer, noting the first tick played on a wrong guess. Packets may
+// arrive late, twice or out of order. Returns false if it isn't one.
+bool RollbackSession::readPacket(const uint8_t* data, int size)
+{
+	int count = size >= NETPLAY_HEADER_SIZE ? data[14] : -1;
+	if (count < 0 || data[0] != NETPLAY_INPUT || count > MAX_PACKET_RUN || size != NETPLAY_HEADER_SIZE + count)
+	{
+		stats.badPackets++;
+		return false;
+	}
+	const uint8_t* packetInputs = data + NETPLAY_HEADER_SIZE;
+	for (int i = 0; i < count; i++)
+	{
+		if ((packetInputs[i] & ~INPUT_MASK) != 0)
+		{
+			stats.badPackets++;
+			return false;
+		}
+	}
+	stats.packetsRead++;
+
+	uint32_t senderTick = readU32(data + 1);
+	uint32_t acked = readU32(data + 5);
+	uint32_t first = readU32(data + 9);
+	if (senderTick >= remoteTick)
+	{
+		remoteTick = senderTick;
+		remoteLead = (int8_t)data[13];
+	}
+	acked = acked < localKnown ? acked : localKnown;
+	localAcked = acked > localAcked ? acked : localAcked;
+
+	// Takes the inputs that carry on from those already known, as long
+	// as they don't run so far ahead they'd overwrite ones not yet played
+	for (int i = 0; i < count; i++)
+	{
+		uint32_t inputTick = first + (uint32_t)i;
+		if (inputTick != remoteKnown || inputTick >= tick + ROLLBACK_HISTORY - MAX_ROLLBACK_LIMIT)
+		{
+			continue;
+		}
+		int slot = inputTick % ROLLBACK_HISTORY;
+		inputs[remotePlayer][slot] = packetInputs[i];
+		if (inputTick < tick && guesses[slot] != packetInputs[i])
+		{
+			stats.mispredicted++;
+			rollbackTo = inputTick < rollbackTo ? inputTick : rollbackTo;
+		}
+		remoteKnown++;
+	}
+	return true;
+}
+
+// Copies the game as it was at the start of a tick, as played so far.
+// It's final once the tick is no later than getConfirmedTick(). Returns
+// false if the tick is too old to be kept, or not played yet.
+bool RollbackSession::getState(uint32_t stateTick, VersusSimulation& out) const
+{
+	if (stateTick == tick)
+	{
+		out = current;
+		return true;
+	}
+	if (stateTick > tick || tick - stateTick > ROLLBACK_HISTORY)
+	{
+		return false;
+	}
+	out = saved[stateTick % ROLLBACK_HISTORY];
+	return true;
+}
+
+// Retrieves the first tick not yet played on every real input; the game
+// up to the start of it won't change
+uint32_t RollbackSession::getConfirmedTick() const
+{
+	uint32_t confirmed = localKnown < remoteKnown ? localKnown : remoteKnown;
+	confirmed = confirmed < tick ? confirmed : tick;
+	return confirmed < rollbackTo ? confirmed : rollbackTo;
+}
+
+// Retrieves how many ticks this end is ahead of the peer, going by the
+// last packet each got from the other. Both see the other's tick late
+// by the same latency, so half the difference of their leads takes it
+// out. Worth waiting a tick now and then while it's more than one, so
+// the end that's behind doesn't do all the rolling back.
+int RollbackSession::getTickAdvantage() const
+{
+	return (getLead() - remoteLead) / 2;
+}
+
+// Retrieves this end's tick less the peer's as of its last packet,
+// clamped to fit a packet
+int RollbackSession::getLead() const
+{
+	int lead = (int)tick - (int)remoteTick;
+	return lead < -127 ? -127 : (lead > 127 ? 127 : lead);
+}
+
+// Saves the game and plays the next tick, guessing the remote input if
+// it hasn't arrived
+void RollbackSession::playTick()
+{
+	int slot = tick % ROLLBACK_HISTORY;
+	saved[slot] = current;
+	int tickInputs[VERSUS_PLAYERS];
+	tickInputs[settings.localPlayer] = inputs[settings.localPlayer][slot];
+	tickInputs[remotePlayer] = tick < remoteKnown ? inputs[remotePlayer][slot] : guessRemote();
+	guesses[slot] = (uint8_t)tickInputs[remotePlayer];
+	current.tick(tickInputs);
+	tick++;
+}
+
+// Guesses a remote input not yet received: the last one known, held
+// down, without the inputs that only act once
+int RollbackSession::guessRemote() const
+{
+	return remoteKnown > 0 ? inputs[remotePlayer][(remoteKnown - 1) % ROLLBACK_HISTORY] & ~ONE_SHOT_INPUTS : 0;
+}
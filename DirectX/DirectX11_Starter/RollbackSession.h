@@ -0,0 +1,112 @@
+#ifndef ROLLBACKSESSION_H
+#define ROLLBACKSESSION_H
+
+#include "VersusSimulation.h"
+
+#include <stdint.h>
+
+// Ticks of saved games and inputs kept, enough for the deepest rollback
+// plus the input delay
+#define ROLLBACK_HISTORY 64
+
+// Default ticks a peer's input is delayed by, and the most ticks a
+// session runs ahead of the remote inputs it has before waiting
+#define DEFAULT_INPUT_DELAY_TICKS 2
+#define DEFAULT_MAX_ROLLBACK 8
+#define MAX_ROLLBACK_LIMIT 16
+
+// Most inputs sent in one packet. Every packet carries all the inputs
+// the peer hasn't acknowledged, so lost packets are covered by the next.
+#define MAX_PACKET_RUN 32
+
+// Packet: u8 type, u32 sender's tick, u32 remote inputs received (every
+// tick before it), u32 tick of the first input, i8 sender's lead over
+// the receiver as it sees it, u8 count, the inputs
+#define NETPLAY_INPUT 1
+#define NETPLAY_HEADER_SIZE 15
+#define MAX_NETPLAY_PACKET (NETPLAY_HEADER_SIZE + MAX_PACKET_RUN)
+
+// How a rollback session is played. Both peers must agree on all of it
+// but the local player.
+struct RollbackSettings
+{
+	int localPlayer;	// 0 or 1
+	int inputDelay;		// Ticks between pressing an input and it playing
+	int maxRollback;	// Ticks played on predictions before waiting
+	uint64_t seed;
+	AttackTable attack;
+};
+
+// Fills in the default session: player 0, the default delay and
+// rollback, classic garbage
+void setDefaultRollback(RollbackSettings& settings);
+
+// Counts kept by a rollback session
+struct RollbackStats
+{
+	uint64_t rollbacks;
+	uint64_t resimulated;		// Ticks played again
+	uint32_t deepestRollback;
+	uint64_t stalls;			// Times it was too far ahead to advance
+	uint64_t mispredicted;		// Remote inputs that weren't as guessed
+	uint64_t packetsRead;
+	uint64_t badPackets;
+};
+
+// GGPO-style rollback for a two player VersusSimulation between peers.
+// Local inputs play after a small delay and are sent to the peer; the
+// remote player's inputs for ticks not yet heard from are guessed to
+// repeat their last known one, so the game never waits on the network.
+// The game is saved at the start of every tick, and when real remote
+// inputs turn out to differ from the guess, it's restored to the first
+// wrong tick and played forward again with them, up to the current
+// tick, before the next tick is played.
+//
+// A save is a plain copy of the game, so a rollback of K ticks costs a
+// copy and K ticks of the rules. Only the VersusSimulation is played
+// again; whatever draws the game reads it once the tick is done.
+//
+// The session only makes and reads packets, so it runs over any
+// transport. Nothing is allocated once it's constructed.
+class RollbackSession
+{
+public:
+	RollbackSession(const RollbackSettings& settings);
+
+	void reset();
+	bool canAdvance() const;
+	void addLocalInput(int input);
+	void advance();
+	int writePacket(uint8_t* out) const;
+	bool readPacket(const uint8_t* data, int size);
+	bool getState(uint32_t tick, VersusSimulation& out) const;
+
+	const VersusSimulation& getSimulation() const { return current; }
+	const RollbackSettings& getSettings() const { return settings; }
+	const RollbackStats& getStats() const { return stats; }
+	uint32_t getTick() const { return tick; }
+	uint32_t getConfirmedTick() const;
+	int getTickAdvantage() const;
+
+private:
+	RollbackSettings settings;
+	int remotePlayer;
+	VersusSimulation current;
+	VersusSimulation saved[ROLLBACK_HISTORY];	// At the start of each tick
+	uint8_t inputs[VERSUS_PLAYERS][ROLLBACK_HISTORY];
+	uint8_t guesses[ROLLBACK_HISTORY];			// Remote inputs played
+	uint32_t tick;				// Next to play
+	uint32_t localKnown;		// Local inputs made, for every tick before
+	uint32_t remoteKnown;		// Remote inputs received, likewise
+	uint32_t localAcked;		// Local inputs the peer has received
+	uint32_t remoteTick;		// The peer's tick as of its last packet
+	int remoteLead;				// Its lead over this end as it saw it
+	uint32_t rollbackTo;		// First tick played on a wrong guess
+	RollbackStats stats;
+
+	int getLead() const;
+	void playTick();
+	int guessRemote() const;
+};
+
+#endif
@@ -0,0 +1,70 @@
+#ifndef SERIALIZE_H
+#define SERIALIZE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+// Little-endian fixed-width values, written to and read from raw buffers
+
+inline void writeU16(uint8_t* out, uint16_t value)
+{
+	out[0] = (uint8_t)value;
+	out[1] = (uint8_t)(value >> 8);
+}
+
+inline void writeU32(uint8_t* out, uint32_t value)
+{
+	writeU16(out, (uint16_t)value);
+	writeU16(out + 2, (uint16_t)(value >> 16));
+}
+
+inline void writeU64(uint8_t* out, uint64_t value)
+{
+	writeU32(out, (uint32_t)value);
+	writeU32(out + 4, (uint32_t)(value >> 32));
+}
+
+inline uint16_t readU16(const uint8_t* in)
+{
+	return (uint16_t)(in[0] | in[1] << 8);
+}
+
+inline uint32_t readU32(const uint8_t* in)
+{
+	return readU16(in) | (uint32_t)readU16(in + 2) << 16;
+}
+
+inline uint64_t readU64(const uint8_t* in)
+{
+	return readU32(in) | (uint64_t)readU32(in + 4) << 32;
+}
+
+// Appends an unsigned variable-length integer, 7 bits per byte
+inline void writeVarint(std::vector<uint8_t>& out, uint64_t value)
+{
+	while (value >= 0x80)
+	{
+		out.push_back((uint8_t)(value | 0x80));
+		value >>= 7;
+	}
+	out.push_back((uint8_t)value);
+}
+
+// Reads an unsigned variable-length integer, returning false if the data runs out
+inline bool readVarint(const uint8_t* data, size_t size, size_t* position, uint64_t* value)
+{
+	*value = 0;
+	for (int shift = 0; shift < 64 && *position < size; shift += 7)
+	{
+		uint8_t byte = data[(*position)++];
+		*value |= (uint64_t)(byte & 0x7F) << shift;
+		if (!(byte & 0x80))
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+#endif
@@ -0,0 +1,366 @@
+#include "SimulationCoordinator.h"
+#include "Serialize.h"
+
+#include <algorithm>
+
+// Payload sizes of the fixed-size messages
+#define HELLO_SIZE 8
+#define SETTINGS_SIZE (17 + 4 * NUM_FEATURES)
+#define RANGE_SIZE 24
+#define PROGRESS_SIZE 16
+
+// Milliseconds to wait on the connections before checking for workers
+// gone quiet, and seconds between progress reports
+#define POLL_INTERVAL 1000
+#define PROGRESS_INTERVAL 5
+
+SimulationCoordinator::SimulationCoordinator(const BotSettings& pSettings, uint64_t pFirstSeed, uint64_t pGames,
+	uint64_t pChunk)
+{
+	settings = pSettings;
+	firstSeed = pFirstSeed;
+	games = pGames;
+	chunk = pChunk > 0 ? pChunk : DEFAULT_CHUNK_GAMES;
+	finished.resize((size_t)((games + chunk - 1) / chunk), false);
+	nextRange = 0;
+	rangesDone = 0;
+	reassigned = 0;
+	workersLost = 0;
+}
+
+SimulationCoordinator::~SimulationCoordinator()
+{
+	for (size_t i = 0; i < workers.size(); i++)
+	{
+		delete workers[i]->socket;
+		delete workers[i];
+	}
+}
+
+// Starts listening for workers on a port, 0 for any free one
+bool SimulationCoordinator::listen(uint16_t port)
+{
+	return server.listen(port);
+}
+
+// Hands out every range and merges the results into the summary as
+// they come in. Returns false if no worker was connected for the
+// timeout in seconds while there was still work left.
+bool SimulationCoordinator::run(ResultSummary& summary, int timeout, FILE* progress)
+{
+	Clock::time_point start = Clock::now();
+	Clock::time_point lastWorker = start;
+	Clock::time_point lastProgress = start;
+	std::vector<Socket*> sockets;
+	std::vector<bool> readable;
+	std::vector<uint8_t> payload;
+	while (rangesDone < finished.size())
+	{
+		// The server first, then every worker
+		sockets.assign(1, &server);
+		for (size_t i = 0; i < workers.size(); i++)
+		{
+			sockets.push_back(workers[i]->socket);
+		}
+		Socket::wait(sockets, readable, POLL_INTERVAL);
+		Clock::time_point now = Clock::now();
+
+		// Backwards, so dropping a worker doesn't move the ones still to check
+		for (size_t i = workers.size(); i-- > 0;)
+		{
+			if (!readable[i + 1])
+			{
+				continue;
+			}
+			WorkerLink& worker = *workers[i];
+			worker.heard = now;
+			bool open = worker.reader.receive(*worker.socket);
+			uint8_t type;
+			while (open && worker.reader.next(type, payload))
+			{
+				open = handleMessage(worker, type, payload, summary);
+			}
+			if (!open)
+			{
+				dropWorker(i);
+			}
+		}
+
+		if (readable[0])
+		{
+			Socket* socket = server.accept();
+			if (socket != NULL)
+			{
+				WorkerLink* worker = new WorkerLink();
+				worker->socket = socket;
+				worker->heard = now;
+				worker->ready = false;
+				workers.push_back(worker);
+			}
+		}
+
+		// Drops workers that have gone quiet on their ranges, then hands
+		// out any ranges that came back
+		for (size_t i = workers.size(); i-- > 0;)
+		{
+			WorkerLink& worker = *workers[i];
+			bool quiet = !worker.ranges.empty() && now - worker.heard > std::chrono::seconds(timeout);
+			if (quiet || (worker.ready && !sendRanges(worker)))
+			{
+				dropWorker(i);
+			}
+		}
+
+		if (!workers.empty())
+		{
+			lastWorker = now;
+		}
+		else if (now - lastWorker > std::chrono::seconds(timeout))
+		{
+			return false;
+		}
+
+		if (progress != NULL && now - lastProgress > std::chrono::seconds(PROGRESS_INTERVAL))
+		{
+			double seconds = std::chrono::duration<double>(now - start).count();
+			fprintf(progress, "%llu/%llu ranges, %d workers, %.1f games/s\n", (unsigned long long)rangesDone,
+				(unsigned long long)finished.size(), (int)workers.size(), summary.getGames() / seconds);
+			lastProgress = now;
+		}
+	}
+
+	for (size_t i = 0; i < workers.size(); i++)
+	{
+		sendMessage(*workers[i]->socket, MESSAGE_FINISH, NULL, 0);
+		delete workers[i]->socket;
+		delete workers[i];
+	}
+	workers.clear();
+	return true;
+}
+
+// Picks the next range to hand out, ranges taken back from lost workers
+// first
+bool SimulationCoordinator::takeRange(uint64_t& range)
+{
+	while (!retries.empty())
+	{
+		range = retries.back();
+		retries.pop_back();
+		if (!finished[(size_t)range])
+		{
+			return true;
+		}
+	}
+	if (nextRange < finished.size())
+	{
+		range = nextRange++;
+		return true;
+	}
+	return false;
+}
+
+// Tops a worker up to its backlog of ranges, returning false if the
+// connection is gone
+bool SimulationCoordinator::sendRanges(WorkerLink& worker)
+{
+	uint64_t range;
+	while (worker.ranges.size() < WORKER_BACKLOG && takeRange(range))
+	{
+		uint8_t payload[RANGE_SIZE];
+		writeU64(payload, range);
+		writeU64(payload + 8, firstSeed + range * chunk);
+		writeU64(payload + 16, std::min(chunk, games - range * chunk));
+		worker.ranges.push_back(range);
+		if (!sendMessage(*worker.socket, MESSAGE_RANGE, payload, RANGE_SIZE))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+// Handles a message from a worker, returning false if it makes no sense
+// and the worker should be dropped
+bool SimulationCoordinator::handleMessage(WorkerLink& worker, uint8_t type, const std::vector<uint8_t>& payload,
+	ResultSummary& summary)
+{
+	if (type == MESSAGE_HELLO && !worker.ready)
+	{
+		if (payload.size() != HELLO_SIZE || readU32(&payload[0]) != COORDINATOR_PROTOCOL)
+		{
+			return false;
+		}
+		uint8_t message[SETTINGS_SIZE];
+		message[0] = settings.placements ? 1 : 0;
+		writeU32(message + 1, (uint32_t)settings.width);
+		writeU32(message + 5, (uint32_t)settings.depth);
+		writeU32(message + 9, settings.pieces);
+		writeU32(message + 13, (uint32_t)settings.scoreWeight);
+		for (int i = 0; i < NUM_FEATURES; i++)
+		{
+			writeU32(message + 17 + 4 * i, (uint32_t)settings.weights[i]);
+		}
+		worker.ready = true;
+		return sendMessage(*worker.socket, MESSAGE_SETTINGS, message, SETTINGS_SIZE) && sendRanges(worker);
+	}
+
+	if (type == MESSAGE_RESULT && worker.ready && payload.size() >= 8)
+	{
+		uint64_t range = readU64(&payload[0]);
+		std::vector<uint64_t>::iterator sent = std::find(worker.ranges.begin(), worker.ranges.end(), range);
+		ResultSummary part;
+		if (sent == worker.ranges.end() || !part.read(&payload[8], payload.size() - 8))
+		{
+			return false;
+		}
+		worker.ranges.erase(sent);
+		if (!finished[(size_t)range])
+		{
+			finished[(size_t)range] = true;
+			rangesDone++;
+			summary.merge(part);
+		}
+		return sendRanges(worker);
+	}
+
+	// Only says the worker is still playing, which arriving was enough to note
+	if (type == MESSAGE_PROGRESS && worker.ready && payload.size() == PROGRESS_SIZE)
+	{
+		return std::find(worker.ranges.begin(), worker.ranges.end(), readU64(&payload[0])) != worker.ranges.end();
+	}
+	return false;
+}
+
+// Closes a worker's connection and puts its unfinished ranges back
+void SimulationCoordinator::dropWorker(size_t index)
+{
+	WorkerLink* worker = workers[index];
+	for (size_t i = 0; i < worker->ranges.size(); i++)
+	{
+		if (!finished[(size_t)worker->ranges[i]])
+		{
+			retries.push_back(worker->ranges[i]);
+			reassigned++;
+		}
+	}
+	workersLost++;
+	delete worker->socket;
+	delete worker;
+	workers.erase(workers.begin() + index);
+}
+
+SimulationWorker::SimulationWorker(int threads)
+	: pool(threads)
+{
+	job = NULL;
+	rangesPlayed = 0;
+	range = 0;
+	gamesPlayed = 0;
+}
+
+SimulationWorker::~SimulationWorker()
+{
+	delete job;
+}
+
+// Plays whatever the coordinator sends until it says to finish,
+// returning false if the connection fails first
+bool SimulationWorker::run(const char* host, uint16_t port)
+{
+	reader.clear();
+	if (!socket.connect(host, port))
+	{
+		return false;
+	}
+	uint8_t hello[HELLO_SIZE];
+	writeU32(hello, COORDINATOR_PROTOCOL);
+	writeU32(hello + 4, (uint32_t)pool.getThreads());
+	if (!sendMessage(socket, MESSAGE_HELLO, hello, HELLO_SIZE))
+	{
+		return false;
+	}
+
+	uint8_t type;
+	std::vector<uint8_t> payload;
+	while (true)
+	{
+		while (!reader.next(type, payload))
+		{
+			if (!reader.receive(socket))
+			{
+				socket.close();
+				return false;
+			}
+		}
+
+		if (type == MESSAGE_SETTINGS && payload.size() == SETTINGS_SIZE)
+		{
+			BotSettings settings;
+			settings.placements = payload[0] != 0;
+			settings.width = (int)readU32(&payload[1]);
+			settings.depth = (int)readU32(&payload[5]);
+			settings.pieces = readU32(&payload[9]);
+			settings.scoreWeight = (int32_t)readU32(&payload[13]);
+			for (int i = 0; i < NUM_FEATURES; i++)
+			{
+				settings.weights[i] = (int32_t)readU32(&payload[17 + 4 * i]);
+			}
+			delete job;
+			job = new BotGameJob(settings, pool.getThreads());
+		}
+		else if (type == MESSAGE_RANGE && payload.size() == RANGE_SIZE && job != NULL)
+		{
+			if (!playRange(payload))
+			{
+				socket.close();
+				return false;
+			}
+		}
+		else
+		{
+			socket.close();
+			return type == MESSAGE_FINISH;
+		}
+	}
+}
+
+// Plays the games of a range and sends back their summary
+bool SimulationWorker::playRange(const std::vector<uint8_t>& payload)
+{
+	range = readU64(&payload[0]);
+	uint64_t first = readU64(&payload[8]);
+	uint64_t count = readU64(&payload[16]);
+	job->setRange(first, count);
+	gamesPlayed = 0;
+	lastSent = Clock::now();
+	pool.run((int64_t)count, *this);
+
+	ResultSummary summary;
+	job->summarize(summary);
+	std::vector<uint8_t> result(8);
+	writeU64(&result[0], range);
+	summary.write(result);
+	rangesPlayed++;
+	return sendMessage(socket, MESSAGE_RESULT, &result[0], result.size());
+}
+
+// Plays a game of the range on one of the pool's threads, then tells
+// the coordinator how far the range has got if it hasn't heard for a
+// while. A failed send shows up when the result is sent.
+void SimulationWorker::runItem(int thread, int64_t index)
+{
+	job->runItem(thread, index);
+
+	std::lock_guard<std::mutex> lock(mutex);
+	gamesPlayed++;
+	Clock::time_point now = Clock::now();
+	if (now - lastSent >= std::chrono::seconds(WORKER_HEARTBEAT))
+	{
+		uint8_t message[PROGRESS_SIZE];
+		writeU64(message, range);
+		writeU64(message + 8, gamesPlayed);
+		sendMessage(socket, MESSAGE_PROGRESS, message, PROGRESS_SIZE);
+		lastSent = now;
+	}
+}
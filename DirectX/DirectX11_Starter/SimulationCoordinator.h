@@ -0,0 +1,143 @@
+#ifndef SIMULATIONCOORDINATOR_H
+#define SIMULATIONCOORDINATOR_H
+
+#include "HeadlessRunner.h"
+#include "Socket.h"
+#include "WorkStealingPool.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <chrono>
+#include <vector>
+#include <mutex>
+
+// Version of the messages below, which a worker must match
+#define COORDINATOR_PROTOCOL 3
+
+// Default games per range handed out, and ranges a worker is given ahead
+// so it never waits between them
+#define DEFAULT_CHUNK_GAMES 1000
+#define WORKER_BACKLOG 2
+
+// Seconds a worker with ranges to play may go quiet before it is dropped
+// and its ranges handed to others. Also how long to wait for any worker
+// at all before giving up.
+#define DEFAULT_WORKER_TIMEOUT 300
+
+// Seconds between the progress messages a worker sends while it plays a
+// range, so a range that outlasts the timeout doesn't get it dropped
+#define WORKER_HEARTBEAT 1
+
+// Messages, each a u32 payload size, a u8 type and the payload:
+//   worker hello:  u32 protocol, u32 threads
+//   settings:      u8 placements, u32 width, u32 depth, u32 pieces,
+//                  i32 score weight, NUM_FEATURES i32 feature weights
+//   range:         u64 range number, u64 first seed, u64 games
+//   result:        u64 range number, ResultSummary::write() of its games
+//   finish:        no payload, the worker should exit
+//   progress:      u64 range number, u64 games played so far
+enum CoordinatorMessage
+{
+	MESSAGE_HELLO = 1,
+	MESSAGE_SETTINGS,
+	MESSAGE_RANGE,
+	MESSAGE_RESULT,
+	MESSAGE_FINISH,
+	MESSAGE_PROGRESS
+};
+
+// Splits a run of bot games into ranges of seeds and hands them to
+// worker processes that connect over TCP, on this machine or others.
+// Each worker is kept a couple of ranges ahead. A range only counts
+// once its whole result is back, so when a worker disconnects or goes
+// quiet its unfinished ranges are simply handed to someone else, and
+// the merged summary is the same as a single process playing every seed.
+//
+// Runs on the calling thread, waiting on every connection at once.
+class SimulationCoordinator
+{
+public:
+	SimulationCoordinator(const BotSettings& settings, uint64_t firstSeed, uint64_t games,
+		uint64_t chunk = DEFAULT_CHUNK_GAMES);
+	~SimulationCoordinator();
+
+	bool listen(uint16_t port);
+	bool run(ResultSummary& summary, int timeout = DEFAULT_WORKER_TIMEOUT, FILE* progress = NULL);
+
+	uint16_t getPort() const { return server.getPort(); }
+	uint64_t getRanges() const { return finished.size(); }
+	uint64_t getReassigned() const { return reassigned; }
+	int getWorkersLost() const { return workersLost; }
+
+private:
+	typedef std::chrono::steady_clock Clock;
+
+	// A connected worker and the ranges it has been sent
+	struct WorkerLink
+	{
+		Socket* socket;
+		MessageReader reader;
+		std::vector<uint64_t> ranges;
+		Clock::time_point heard;
+		bool ready;
+	};
+
+	BotSettings settings;
+	uint64_t firstSeed;
+	uint64_t games;
+	uint64_t chunk;
+	Socket server;
+	std::vector<WorkerLink*> workers;
+	std::vector<bool> finished;
+	std::vector<uint64_t> retries;
+	uint64_t nextRange;
+	uint64_t rangesDone;
+	uint64_t reassigned;
+	int workersLost;
+
+	bool takeRange(uint64_t& range);
+	bool sendRanges(WorkerLink& worker);
+	bool handleMessage(WorkerLink& worker, uint8_t type, const std::vector<uint8_t>& payload, ResultSummary& summary);
+	void dropWorker(size_t index);
+
+	SimulationCoordinator(const SimulationCoordinator& rhs);
+	SimulationCoordinator& operator=(const SimulationCoordinator& rhs);
+};
+
+// The other end: connects to a coordinator, plays the ranges it's sent
+// on a WorkStealingPool and streams back a summary of each. While a
+// range plays, the pool's threads report how far it has got every
+// WORKER_HEARTBEAT seconds, between games.
+class SimulationWorker : public PoolJob
+{
+public:
+	SimulationWorker(int threads = 0);
+	~SimulationWorker();
+
+	bool run(const char* host, uint16_t port);
+	void runItem(int thread, int64_t index);
+
+	uint64_t getRangesPlayed() const { return rangesPlayed; }
+
+private:
+	typedef std::chrono::steady_clock Clock;
+
+	WorkStealingPool pool;
+	BotGameJob* job;
+	Socket socket;
+	MessageReader reader;
+	uint64_t rangesPlayed;
+
+	// The range being played, shared with the pool's threads
+	std::mutex mutex;
+	uint64_t range;
+	uint64_t gamesPlayed;
+	Clock::time_point lastSent;
+
+	bool playRange(const std::vector<uint8_t>& payload);
+
+	SimulationWorker(const SimulationWorker& rhs);
+	SimulationWorker& operator=(const SimulationWorker& rhs);
+};
+
+#endif
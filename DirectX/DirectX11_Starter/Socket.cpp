@@ -0,0 +1,579 @@
+#include "Socket.h"
+#include "Serialize.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <WinSock2.h>
+#include <WS2tcpip.h>
+#pragma comment(lib, "Ws2_32.lib")
+#define INVALID_HANDLE ((uintptr_t)INVALID_SOCKET)
+#define closeHandle closesocket
+#define pollHandles WSAPoll
+#define SEND_FLAGS 0
+#define WOULD_BLOCK (WSAGetLastError() == WSAEWOULDBLOCK)
+typedef int SocketLength;
+#else
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#define INVALID_HANDLE -1
+#define closeHandle ::close
+#define pollHandles ::poll
+#ifdef MSG_NOSIGNAL
+#define SEND_FLAGS MSG_NOSIGNAL
+#else
+#define SEND_FLAGS 0
+#endif
+#define WOULD_BLOCK (errno == EAGAIN || errno == EWOULDBLOCK)
+typedef socklen_t SocketLength;
+#endif
+
+// Bytes read from a socket at a time
+#define RECEIVE_SIZE 65536
+
+// System buffer asked for on each side of a datagram socket, so a burst
+// of a few thousand datagrams between loop passes isn't dropped
+#define DATAGRAM_BUFFER_SIZE (4 << 20)
+
+Socket::Socket()
+{
+	handle = INVALID_HANDLE;
+}
+
+Socket::~Socket()
+{
+	close();
+}
+
+// Sets up the socket library once, which only Windows needs
+bool Socket::startup()
+{
+#ifdef _WIN32
+	static bool started = false;
+	if (!started)
+	{
+		WSADATA data;
+		started = WSAStartup(MAKEWORD(2, 2), &data) == 0;
+	}
+	return started;
+#else
+	return true;
+#endif
+}
+
+// Starts listening for connections on a port of the given address, or
+// of every address. Port 0 picks a free one, see getPort().
+bool Socket::listen(uint16_t port, const char* address)
+{
+	close();
+	if (!startup())
+	{
+		return false;
+	}
+	handle = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	if (handle == INVALID_HANDLE)
+	{
+		return false;
+	}
+	int reuse = 1;
+	setsockopt(handle, SOL_SOCKET, SO_REUSEADDR, (const char*)&reuse, sizeof(reuse));
+
+	sockaddr_in local;
+	memset(&local, 0, sizeof(local));
+	local.sin_family = AF_INET;
+	local.sin_port = htons(port);
+	local.sin_addr.s_addr = htonl(INADDR_ANY);
+	if ((address != NULL && inet_pton(AF_INET, address, &local.sin_addr) != 1) ||
+		bind(handle, (const sockaddr*)&local, sizeof(local)) != 0 || ::listen(handle, SOMAXCONN) != 0)
+	{
+		close();
+		return false;
+	}
+	return true;
+}
+
+// Takes the next incoming connection, or returns NULL if there is none
+Socket* Socket::accept()
+{
+	if (handle == INVALID_HANDLE)
+	{
+		return NULL;
+	}
+	Socket* connection = new Socket();
+	connection->handle = ::accept(handle, NULL, NULL);
+	if (connection->handle == INVALID_HANDLE)
+	{
+		delete connection;
+		return NULL;
+	}
+	connection->configure();
+	return connection;
+}
+
+// Connects to a host by name or address
+bool Socket::connect(const char* host, uint16_t port)
+{
+	close();
+	if (!startup())
+	{
+		return false;
+	}
+	char service[8];
+	snprintf(service, sizeof(service), "%u", port);
+	addrinfo hints;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_INET;
+	hints.ai_socktype = SOCK_STREAM;
+	addrinfo* found = NULL;
+	if (getaddrinfo(host, service, &hints, &found) != 0)
+	{
+		return false;
+	}
+
+	for (addrinfo* address = found; address != NULL; address = address->ai_next)
+	{
+		handle = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+		if (handle != INVALID_HANDLE && ::connect(handle, address->ai_addr, (SocketLength)address->ai_addrlen) == 0)
+		{
+			break;
+		}
+		close();
+	}
+	freeaddrinfo(found);
+	if (handle == INVALID_HANDLE)
+	{
+		return false;
+	}
+	configure();
+	return true;
+}
+
+// Closes the socket, which the peer sees as the end of the stream
+void Socket::close()
+{
+	if (handle != INVALID_HANDLE)
+	{
+		closeHandle(handle);
+		handle = INVALID_HANDLE;
+	}
+}
+
+// Turns off send batching, and on systems without a send flag for it,
+// the signal raised when writing to a closed connection
+void Socket::configure()
+{
+	int on = 1;
+	setsockopt(handle, IPPROTO_TCP, TCP_NODELAY, (const char*)&on, sizeof(on));
+#ifdef SO_NOSIGPIPE
+	setsockopt(handle, SOL_SOCKET, SO_NOSIGPIPE, (const char*)&on, sizeof(on));
+#endif
+}
+
+// Sends all the data, returning false if the connection is gone
+bool Socket::send(const uint8_t* data, size_t size)
+{
+	while (size > 0 && handle != INVALID_HANDLE)
+	{
+		int chunk = size > RECEIVE_SIZE ? RECEIVE_SIZE : (int)size;
+		int sent = (int)::send(handle, (const char*)data, chunk, SEND_FLAGS);
+		if (sent <= 0)
+		{
+			return false;
+		}
+		data += sent;
+		size -= sent;
+	}
+	return size == 0;
+}
+
+// Reads what has arrived, waiting for something if nothing has. Returns
+// the number of bytes read, 0 once the peer has closed the connection
+// or -1 if it broke.
+int Socket::receive(uint8_t* data, size_t size)
+{
+	if (handle == INVALID_HANDLE)
+	{
+		return -1;
+	}
+	int chunk = size > RECEIVE_SIZE ? RECEIVE_SIZE : (int)size;
+	int received = (int)recv(handle, (char*)data, chunk, 0);
+	return received >= 0 ? received : -1;
+}
+
+// Checks whether the socket is listening or connected
+bool Socket::isOpen() const
+{
+	return handle != INVALID_HANDLE;
+}
+
+// Retrieves the local port the socket is bound to
+uint16_t Socket::getPort() const
+{
+	sockaddr_in local;
+	SocketLength length = sizeof(local);
+	if (handle == INVALID_HANDLE || getsockname(handle, (sockaddr*)&local, &length) != 0)
+	{
+		return 0;
+	}
+	return ntohs(local.sin_port);
+}
+
+// Waits up to the given time, or forever if negative, for any of the
+// sockets to have data or a connection waiting, or to be closed. Marks
+// which are ready and returns how many, or -1 on failure.
+int Socket::wait(const std::vector<Socket*>& sockets, std::vector<bool>& readable, int milliseconds)
+{
+	int count = (int)sockets.size();
+	std::vector<pollfd> polled(count);
+	for (int i = 0; i < count; i++)
+	{
+		polled[i].fd = sockets[i]->handle;
+		polled[i].events = POLLIN;
+		polled[i].revents = 0;
+	}
+	readable.resize(count);
+	int ready = count > 0 ? pollHandles(&polled[0], count, milliseconds) : 0;
+	for (int i = 0; i < count; i++)
+	{
+		readable[i] = ready > 0 && polled[i].revents != 0;
+	}
+	return ready;
+}
+
+// Sends a message as its header and then its payload
+bool sendMessage(Socket& socket, uint8_t type, const uint8_t* payload, size_t size)
+{
+	std::vector<uint8_t> message(MESSAGE_HEADER_SIZE + size);
+	writeU32(&message[0], (uint32_t)size);
+	message[4] = type;
+	if (size > 0)
+	{
+		memcpy(&message[MESSAGE_HEADER_SIZE], payload, size);
+	}
+	return socket.send(&message[0], message.size());
+}
+
+MessageReader::MessageReader()
+{
+	clear();
+}
+
+// Reads what has arrived on the socket, returning false once it's
+// closed or has sent something that isn't a message
+bool MessageReader::receive(Socket& socket)
+{
+	if (closed || broken)
+	{
+		return false;
+	}
+	if (start > 0 && start * 2 >= buffer.size())
+	{
+		buffer.erase(buffer.begin(), buffer.begin() + start);
+		start = 0;
+	}
+	size_t used = buffer.size();
+	buffer.resize(used + RECEIVE_SIZE);
+	int received = socket.receive(&buffer[used], RECEIVE_SIZE);
+	buffer.resize(used + (received > 0 ? received : 0));
+	closed = received <= 0;
+	return !closed;
+}
+
+// Takes the next whole message received, if there is one. Messages
+// that came in before the socket closed can still be taken.
+bool MessageReader::next(uint8_t& type, std::vector<uint8_t>& payload)
+{
+	size_t left = buffer.size() - start;
+	if (broken || left < MESSAGE_HEADER_SIZE)
+	{
+		return false;
+	}
+	uint32_t size = readU32(&buffer[start]);
+	if (size > MAX_MESSAGE_SIZE)
+	{
+		broken = true;
+		return false;
+	}
+	if (left < MESSAGE_HEADER_SIZE + size)
+	{
+		return false;
+	}
+	type = buffer[start + 4];
+	payload.assign(buffer.begin() + start + MESSAGE_HEADER_SIZE, buffer.begin() + start + MESSAGE_HEADER_SIZE + size);
+	start += MESSAGE_HEADER_SIZE + size;
+	return true;
+}
+
+// Forgets anything received
+void MessageReader::clear()
+{
+	buffer.clear();
+	start = 0;
+	closed = false;
+	broken = false;
+}
+
+// Looks up a host by name or address
+bool resolveAddress(const char* host, uint16_t port, NetAddress& address)
+{
+	if (!Socket::startup())
+	{
+		return false;
+	}
+	addrinfo hints;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_INET;
+	hints.ai_socktype = SOCK_DGRAM;
+	addrinfo* found = NULL;
+	if (getaddrinfo(host, NULL, &hints, &found) != 0 || found == NULL)
+	{
+		return false;
+	}
+	address.host = ntohl(((const sockaddr_in*)found->ai_addr)->sin_addr.s_addr);
+	address.port = port;
+	freeaddrinfo(found);
+	return true;
+}
+
+// Fills in a system address from a NetAddress
+static void toSystemAddress(const NetAddress& address, sockaddr_in& out)
+{
+	memset(&out, 0, sizeof(out));
+	out.sin_family = AF_INET;
+	out.sin_port = htons(address.port);
+	out.sin_addr.s_addr = htonl(address.host);
+}
+
+// Reads a NetAddress from a system address
+static void fromSystemAddress(const sockaddr_in& address, NetAddress& out)
+{
+	out.host = ntohl(address.sin_addr.s_addr);
+	out.port = ntohs(address.sin_port);
+}
+
+DatagramSocket::DatagramSocket()
+{
+	handle = INVALID_HANDLE;
+}
+
+DatagramSocket::~DatagramSocket()
+{
+	close();
+}
+
+// Opens the socket on a port of the given address, or of every address.
+// Port 0 picks a free one, see getPort().
+bool DatagramSocket::bind(uint16_t port, const char* address)
+{
+	close();
+	if (!Socket::startup())
+	{
+		return false;
+	}
+	handle = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	if (handle == INVALID_HANDLE)
+	{
+		return false;
+	}
+	int size = DATAGRAM_BUFFER_SIZE;
+	setsockopt(handle, SOL_SOCKET, SO_RCVBUF, (const char*)&size, sizeof(size));
+	setsockopt(handle, SOL_SOCKET, SO_SNDBUF, (const char*)&size, sizeof(size));
+#ifdef _WIN32
+	u_long nonBlocking = 1;
+	bool configured = ioctlsocket(handle, FIONBIO, &nonBlocking) == 0;
+#else
+	bool configured = fcntl(handle, F_SETFL, fcntl(handle, F_GETFL, 0) | O_NONBLOCK) == 0;
+#endif
+
+	sockaddr_in local;
+	memset(&local, 0, sizeof(local));
+	local.sin_family = AF_INET;
+	local.sin_port = htons(port);
+	local.sin_addr.s_addr = htonl(INADDR_ANY);
+	if (!configured || (address != NULL && inet_pton(AF_INET, address, &local.sin_addr) != 1) ||
+		::bind(handle, (const sockaddr*)&local, sizeof(local)) != 0)
+	{
+		close();
+		return false;
+	}
+	return true;
+}
+
+// Closes the socket
+void DatagramSocket::close()
+{
+	if (handle != INVALID_HANDLE)
+	{
+		closeHandle(handle);
+		handle = INVALID_HANDLE;
+	}
+}
+
+// Takes as many waiting datagrams as fit in the batch without waiting
+// for more. Returns how many, or -1 if the socket failed.
+int DatagramSocket::receive(DatagramBatch& batch)
+{
+	batch.count = 0;
+	if (handle == INVALID_HANDLE)
+	{
+		return -1;
+	}
+#ifdef __linux__
+	mmsghdr messages[DATAGRAM_BATCH];
+	iovec buffers[DATAGRAM_BATCH];
+	sockaddr_in senders[DATAGRAM_BATCH];
+	for (int i = 0; i < DATAGRAM_BATCH; i++)
+	{
+		buffers[i].iov_base = batch.data[i];
+		buffers[i].iov_len = MAX_DATAGRAM_SIZE;
+		memset(&messages[i].msg_hdr, 0, sizeof(messages[i].msg_hdr));
+		messages[i].msg_hdr.msg_name = &senders[i];
+		messages[i].msg_hdr.msg_namelen = sizeof(senders[i]);
+		messages[i].msg_hdr.msg_iov = &buffers[i];
+		messages[i].msg_hdr.msg_iovlen = 1;
+	}
+	int received = recvmmsg(handle, messages, DATAGRAM_BATCH, MSG_DONTWAIT, NULL);
+	if (received < 0)
+	{
+		return WOULD_BLOCK ? 0 : -1;
+	}
+	for (int i = 0; i < received; i++)
+	{
+		// Datagrams too big for the buffer are cut short, so are dropped
+		bool truncated = (messages[i].msg_hdr.msg_flags & MSG_TRUNC) != 0;
+		batch.sizes[batch.count] = (uint16_t)(truncated ? 0 : messages[i].msg_len);
+		fromSystemAddress(senders[i], batch.addresses[batch.count]);
+		if (batch.count != i)
+		{
+			memcpy(batch.data[batch.count], batch.data[i], batch.sizes[batch.count]);
+		}
+		batch.count += truncated ? 0 : 1;
+	}
+#else
+	while (batch.count < DATAGRAM_BATCH)
+	{
+		sockaddr_in sender;
+		SocketLength length = sizeof(sender);
+		int received = (int)recvfrom(handle, (char*)batch.data[batch.count], MAX_DATAGRAM_SIZE, 0, (sockaddr*)&sender, &length);
+		if (received < 0)
+		{
+#ifdef _WIN32
+			// A datagram too big for the buffer, or an earlier one that
+			// couldn't be delivered, rather than a broken socket
+			int error = WSAGetLastError();
+			if (error == WSAEMSGSIZE || error == WSAECONNRESET)
+			{
+				continue;
+			}
+#endif
+			if (WOULD_BLOCK)
+			{
+				break;
+			}
+			return batch.count > 0 ? batch.count : -1;
+		}
+		batch.sizes[batch.count] = (uint16_t)received;
+		fromSystemAddress(sender, batch.addresses[batch.count]);
+		batch.count++;
+	}
+#endif
+	return batch.count;
+}
+
+// Sends the datagrams of a batch and empties it. Returns how many were
+// handed to the system, or -1 if the socket failed.
+int DatagramSocket::send(DatagramBatch& batch)
+{
+	int count = batch.count;
+	batch.count = 0;
+	if (handle == INVALID_HANDLE)
+	{
+		return -1;
+	}
+	int sent = 0;
+#ifdef __linux__
+	mmsghdr messages[DATAGRAM_BATCH];
+	iovec buffers[DATAGRAM_BATCH];
+	sockaddr_in receivers[DATAGRAM_BATCH];
+	for (int i = 0; i < count; i++)
+	{
+		buffers[i].iov_base = batch.data[i];
+		buffers[i].iov_len = batch.sizes[i];
+		toSystemAddress(batch.addresses[i], receivers[i]);
+		memset(&messages[i].msg_hdr, 0, sizeof(messages[i].msg_hdr));
+		messages[i].msg_hdr.msg_name = &receivers[i];
+		messages[i].msg_hdr.msg_namelen = sizeof(receivers[i]);
+		messages[i].msg_hdr.msg_iov = &buffers[i];
+		messages[i].msg_hdr.msg_iovlen = 1;
+	}
+	int next = 0;
+	while (next < count)
+	{
+		int done = sendmmsg(handle, messages + next, count - next, MSG_DONTWAIT);
+		if (done < 0)
+		{
+			if (!WOULD_BLOCK && errno != ECONNREFUSED)
+			{
+				return -1;
+			}
+			// Skips the datagram the system couldn't take
+			next++;
+			continue;
+		}
+		next += done;
+		sent += done;
+	}
+#else
+	for (int i = 0; i < count; i++)
+	{
+		sockaddr_in receiver;
+		toSystemAddress(batch.addresses[i], receiver);
+		if (sendto(handle, (const char*)batch.data[i], batch.sizes[i], 0, (const sockaddr*)&receiver, sizeof(receiver)) >= 0)
+		{
+			sent++;
+		}
+	}
+#endif
+	return sent;
+}
+
+// Waits up to the given time for a datagram to arrive, returning true
+// if one has
+bool DatagramSocket::wait(int milliseconds)
+{
+	if (handle == INVALID_HANDLE)
+	{
+		return false;
+	}
+	pollfd polled;
+	polled.fd = handle;
+	polled.events = POLLIN;
+	polled.revents = 0;
+	return pollHandles(&polled, 1, milliseconds) > 0;
+}
+
+// Checks whether the socket is open
+bool DatagramSocket::isOpen() const
+{
+	return handle != INVALID_HANDLE;
+}
+
+// Retrieves the local port the socket is bound to
+uint16_t DatagramSocket::getPort() const
+{
+	sockaddr_in local;
+	SocketLength length = sizeof(local);
+	if (handle == INVALID_HANDLE || getsockname(handle, (sockaddr*)&local, &length) != 0)
+	{
+		return 0;
+	}
+	return ntohs(local.sin_port);
+}
@@ -0,0 +1,130 @@
+#ifndef SOCKET_H
+#define SOCKET_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+// Largest message a MessageReader accepts, so a bad length can't make
+// it wait on gigabytes
+#define MAX_MESSAGE_SIZE (16 << 20)
+
+// Bytes before each message: u32 payload size, u8 type
+#define MESSAGE_HEADER_SIZE 5
+
+// Largest datagram a DatagramSocket sends or receives, and the most
+// handed to the system at once
+#define MAX_DATAGRAM_SIZE 512
+#define DATAGRAM_BATCH 64
+
+// A TCP socket, either listening for connections or connected to a peer.
+// Sends block until everything is handed to the system; receives take
+// whatever has arrived. Sockets are set to send small messages at once
+// rather than batching them up.
+class Socket
+{
+public:
+	Socket();
+	~Socket();
+
+	bool listen(uint16_t port, const char* address = NULL);
+	Socket* accept();
+	bool connect(const char* host, uint16_t port);
+	void close();
+
+	bool send(const uint8_t* data, size_t size);
+	int receive(uint8_t* data, size_t size);
+
+	bool isOpen() const;
+	uint16_t getPort() const;
+
+	static int wait(const std::vector<Socket*>& sockets, std::vector<bool>& readable, int milliseconds);
+	static bool startup();
+
+private:
+#ifdef _WIN32
+	uintptr_t handle;
+#else
+	int handle;
+#endif
+
+	void configure();
+
+	Socket(const Socket& rhs);
+	Socket& operator=(const Socket& rhs);
+};
+
+// An IPv4 address and port, in host order
+struct NetAddress
+{
+	uint32_t host;
+	uint16_t port;
+
+	bool operator==(const NetAddress& other) const { return host == other.host && port == other.port; }
+};
+
+// Looks up a host by name or address
+bool resolveAddress(const char* host, uint16_t port, NetAddress& address);
+
+// Datagrams sent or received together, in buffers of their own so a
+// batch can be reused with no allocation
+struct DatagramBatch
+{
+	uint8_t data[DATAGRAM_BATCH][MAX_DATAGRAM_SIZE];
+	uint16_t sizes[DATAGRAM_BATCH];
+	NetAddress addresses[DATAGRAM_BATCH];
+	int count;
+};
+
+// A UDP socket that never blocks. Receives and sends go through batches,
+// a single system call each where the system has one for it (Linux),
+// and datagrams the system has no room for are dropped like any other
+// lost on the way.
+class DatagramSocket
+{
+public:
+	DatagramSocket();
+	~DatagramSocket();
+
+	bool bind(uint16_t port, const char* address = NULL);
+	void close();
+
+	int receive(DatagramBatch& batch);
+	int send(DatagramBatch& batch);
+	bool wait(int milliseconds);
+
+	bool isOpen() const;
+	uint16_t getPort() const;
+
+private:
+#ifdef _WIN32
+	uintptr_t handle;
+#else
+	int handle;
+#endif
+
+	DatagramSocket(const DatagramSocket& rhs);
+	DatagramSocket& operator=(const DatagramSocket& rhs);
+};
+
+// Sends a message as its header and then its payload
+bool sendMessage(Socket& socket, uint8_t type, const uint8_t* payload, size_t size);
+
+// Splits what arrives on a socket back into the messages sent
+class MessageReader
+{
+public:
+	MessageReader();
+
+	bool receive(Socket& socket);
+	bool next(uint8_t& type, std::vector<uint8_t>& payload);
+	void clear();
+
+private:
+	std::vector<uint8_t> buffer;
+	size_t start;
+	bool closed;
+	bool broken;
+};
+
+#endif
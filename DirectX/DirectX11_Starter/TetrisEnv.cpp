@@ -0,0 +1,184 @@
+#include "TetrisEnv.h"
+#include "BatchEnvironment.h"
+
+#include <new>
+#include <string.h>
+
+static_assert(TETRIS_WIDTH == GRID_WIDTH && TETRIS_HEIGHT == GRID_HEIGHT, "TetrisEnv must describe the real board");
+static_assert(TETRIS_NO_BLOCK == NO_BLOCK, "TetrisEnv must use the same empty block");
+static_assert(TETRIS_ACTION_NONE == ACTION_NONE && TETRIS_ACTION_LEFT == ACTION_LEFT && TETRIS_ACTION_RIGHT == ACTION_RIGHT
+	&& TETRIS_ACTION_ROTATE == ACTION_ROTATE && TETRIS_ACTION_DROP == ACTION_DROP && TETRIS_ACTION_HOLD == ACTION_HOLD
+	&& TETRIS_NUM_ACTIONS == NUM_ACTIONS, "TetrisEnv actions must match EnvAction");
+static_assert(sizeof(TetrisObservation) == 64, "TetrisObservation must keep its layout");
+
+// The handle given out to callers
+struct TetrisEnv
+{
+	BatchEnvironment batch;
+
+	TetrisEnv(int count, uint64_t seed)
+		: batch(count, seed)
+	{
+	}
+};
+
+// Clamps a range of games to the ones that exist, returning its length
+static int clampRange(const TetrisEnv* env, int first, int count)
+{
+	if (!env || first < 0 || count <= 0 || first >= env->batch.getLanes())
+	{
+		return 0;
+	}
+	int left = env->batch.getLanes() - first;
+	return count < left ? count : left;
+}
+
+int tetrisEnvVersion(void)
+{
+	return TETRIS_ENV_VERSION;
+}
+
+TetrisEnv* tetrisEnvCreate(int count, uint64_t seed)
+{
+	if (count <= 0)
+	{
+		return NULL;
+	}
+	try
+	{
+		return new TetrisEnv(count, seed);
+	}
+	catch (const std::bad_alloc&)
+	{
+		return NULL;
+	}
+}
+
+void tetrisEnvDestroy(TetrisEnv* env)
+{
+	delete env;
+}
+
+int tetrisEnvCount(const TetrisEnv* env)
+{
+	return env ? env->batch.getLanes() : 0;
+}
+
+int tetrisEnvVectorized(const TetrisEnv* env)
+{
+	return env && env->batch.isVectorized() ? 1 : 0;
+}
+
+void tetrisEnvReset(TetrisEnv* env, uint64_t seed)
+{
+	if (env)
+	{
+		env->batch.reset(seed);
+	}
+}
+
+void tetrisEnvResetOne(TetrisEnv* env, int index)
+{
+	if (clampRange(env, index, 1) == 1)
+	{
+		env->batch.resetLane(index);
+	}
+}
+
+int tetrisEnvStep(TetrisEnv* env, const uint8_t* actions, int32_t* rewards, uint8_t* done)
+{
+	if (!env || !actions)
+	{
+		return 0;
+	}
+	env->batch.step(actions);
+
+	int count = env->batch.getLanes();
+	if (rewards)
+	{
+		memcpy(rewards, env->batch.getRewards(), count * sizeof(int32_t));
+	}
+	const uint8_t* finished = env->batch.getDone();
+	if (done)
+	{
+		memcpy(done, finished, count);
+	}
+	int ended = 0;
+	for (int i = 0; i < count; i++)
+	{
+		ended += finished[i];
+	}
+	return ended;
+}
+
+int tetrisEnvObserve(const TetrisEnv* env, int first, int count, TetrisObservation* observations)
+{
+	count = observations ? clampRange(env, first, count) : 0;
+	for (int n = 0; n < count; n++)
+	{
+		int lane = first + n;
+		GameState state;
+		env->batch.getState(lane, state);
+
+		TetrisObservation& out = observations[n];
+		memcpy(out.rows, state.rows, sizeof(out.rows));
+		out.type = state.type;
+		out.rotation = state.rotation;
+		out.x = state.x;
+		out.y = state.y;
+		out.held = state.held;
+		out.canHold = state.canSwap() ? 1 : 0;
+		for (int i = 0; i < TETRIS_QUEUE; i++)
+		{
+			out.queue[i] = (int8_t)state.getQueued(i);
+		}
+		out.reserved = 0;
+		out.score = env->batch.getScore(lane);
+		out.lines = env->batch.getLines(lane);
+		out.pieces = env->batch.getPieces(lane);
+	}
+	return count;
+}
+
+int tetrisEnvRender(const TetrisEnv* env, int first, int count, uint8_t* cells)
+{
+	count = cells ? clampRange(env, first, count) : 0;
+	for (int n = 0; n < count; n++)
+	{
+		GameState state;
+		env->batch.getState(first + n, state);
+
+		uint8_t* grid = cells + n * GRID_HEIGHT * GRID_WIDTH;
+		for (int j = 0; j < GRID_HEIGHT; j++)
+		{
+			for (int i = 0; i < GRID_WIDTH; i++)
+			{
+				grid[j * GRID_WIDTH + i] = (state.rows[j] >> i) & 1 ? TETRIS_CELL_FILLED : TETRIS_CELL_EMPTY;
+			}
+		}
+
+		// The ghost first so the block is drawn over it where they meet
+		const BlockShape& shape = BLOCK_SHAPES[state.type][state.rotation];
+		int ghostY = state.dropY(state.type, state.rotation, state.x, state.y);
+		for (int pass = 0; pass < 2; pass++)
+		{
+			int blockY = pass == 0 ? ghostY : state.y;
+			for (int j = shape.bottom; j <= shape.top; j++)
+			{
+				int row = blockY + j;
+				if (row < 0 || row >= GRID_HEIGHT)
+				{
+					continue;
+				}
+				for (int i = shape.left; i <= shape.right; i++)
+				{
+					if (shape.rows[j] & (1 << i))
+					{
+						grid[row * GRID_WIDTH + state.x + i] = pass == 0 ? TETRIS_CELL_GHOST : TETRIS_CELL_ACTIVE;
+					}
+				}
+			}
+		}
+	}
+	return count;
+}
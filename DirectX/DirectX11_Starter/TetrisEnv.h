@@ -0,0 +1,119 @@
+#ifndef TETRISENV_H
+#define TETRISENV_H
+
+// A C interface to the game rules for reinforcement learning trainers,
+// which can load it from C, Python (ctypes/cffi) or anything else with
+// a C FFI. Wraps a BatchEnvironment, so one handle drives any number of
+// games and a step moves them all. Every buffer is the caller's, so
+// stepping and observing never allocate or copy more than asked for.
+//
+// The layout of everything here is fixed for a given TETRIS_ENV_VERSION.
+// The TetrisEnv project builds it as TetrisEnv.dll with TETRIS_ENV_EXPORTS
+// defined; programs linking to the DLL define TETRIS_ENV_IMPORTS.
+
+#include <stdint.h>
+
+#if defined(_WIN32) && defined(TETRIS_ENV_EXPORTS)
+#define TETRIS_API __declspec(dllexport)
+#elif defined(_WIN32) && defined(TETRIS_ENV_IMPORTS)
+#define TETRIS_API __declspec(dllimport)
+#elif defined(__GNUC__)
+#define TETRIS_API __attribute__((visibility("default")))
+#else
+#define TETRIS_API
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Changes whenever a function or layout below changes
+#define TETRIS_ENV_VERSION 1
+
+// Size of the board
+#define TETRIS_WIDTH 10
+#define TETRIS_HEIGHT 20
+
+// Coming blocks included in an observation
+#define TETRIS_QUEUE 5
+
+// No block, e.g. nothing held
+#define TETRIS_NO_BLOCK -1
+
+// Actions, applied before gravity moves the block down a row. Each is
+// the same as a key press in the game.
+#define TETRIS_ACTION_NONE 0
+#define TETRIS_ACTION_LEFT 1
+#define TETRIS_ACTION_RIGHT 2
+#define TETRIS_ACTION_ROTATE 3
+#define TETRIS_ACTION_DROP 4
+#define TETRIS_ACTION_HOLD 5
+#define TETRIS_NUM_ACTIONS 6
+
+// Cells written by tetrisEnvRender()
+#define TETRIS_CELL_EMPTY 0
+#define TETRIS_CELL_FILLED 1
+#define TETRIS_CELL_ACTIVE 2
+#define TETRIS_CELL_GHOST 3
+
+// Everything an agent can see of a game. Row 0 is the bottom row and
+// bit i of a row is column i. The active block's cells are at x + i,
+// y + j for the set bits of its shape, which depends only on the type
+// and rotation.
+typedef struct TetrisObservation
+{
+	uint16_t rows[TETRIS_HEIGHT];
+	int8_t type;
+	int8_t rotation;
+	int8_t x;
+	int8_t y;
+	int8_t held;
+	uint8_t canHold;
+	int8_t queue[TETRIS_QUEUE];
+	uint8_t reserved;
+	uint32_t score;
+	uint32_t lines;
+	uint32_t pieces;
+} TetrisObservation;
+
+typedef struct TetrisEnv TetrisEnv;
+
+// Returns the TETRIS_ENV_VERSION the library was built with
+TETRIS_API int tetrisEnvVersion(void);
+
+// Creates count games, game i starting from seed + i. Returns NULL if
+// count isn't positive or there isn't enough memory.
+TETRIS_API TetrisEnv* tetrisEnvCreate(int count, uint64_t seed);
+TETRIS_API void tetrisEnvDestroy(TetrisEnv* env);
+
+// Retrieves the number of games
+TETRIS_API int tetrisEnvCount(const TetrisEnv* env);
+
+// Reports whether steps run on the AVX2 kernel
+TETRIS_API int tetrisEnvVectorized(const TetrisEnv* env);
+
+// Starts every game again as if just created with the given seed
+TETRIS_API void tetrisEnvReset(TetrisEnv* env, uint64_t seed);
+
+// Abandons one game and starts that game's next seed
+TETRIS_API void tetrisEnvResetOne(TetrisEnv* env, int index);
+
+// Steps every game with one action each. Fills in the points each game
+// scored and whether it topped out, if given the arrays; games that top
+// out start their next seed straight away. Returns the number that did.
+TETRIS_API int tetrisEnvStep(TetrisEnv* env, const uint8_t* actions, int32_t* rewards, uint8_t* done);
+
+// Copies count games starting at first into the observations. Returns
+// the number copied, which is fewer if the range runs past the end.
+TETRIS_API int tetrisEnvObserve(const TetrisEnv* env, int first, int count, TetrisObservation* observations);
+
+// Draws count games starting at first as TETRIS_CELL_ values, one byte
+// per cell, TETRIS_HEIGHT rows of TETRIS_WIDTH from the bottom for each
+// game. Returns the number drawn.
+TETRIS_API int tetrisEnvRender(const TetrisEnv* env, int first, int count, uint8_t* cells);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,105 @@
+#include "TranspositionTable.h"
+
+// Placements are stored offset so they are never negative
+#define MOVE_OFFSET 4
+
+// Allocates the table, rounding its size down to a power of two
+TranspositionTable::TranspositionTable(size_t entries)
+{
+	size_t size = 1;
+	while (size * 2 <= entries)
+	{
+		size *= 2;
+	}
+	slots = new Slot[size];
+	mask = size - 1;
+	clear();
+}
+
+TranspositionTable::~TranspositionTable()
+{
+	delete[] slots;
+}
+
+// Empties the table. Must not be called while other threads are using it.
+void TranspositionTable::clear()
+{
+	for (size_t i = 0; i <= mask; i++)
+	{
+		slots[i].check.store(0, std::memory_order_relaxed);
+		slots[i].data.store(0, std::memory_order_relaxed);
+	}
+	generation = 1;
+}
+
+// Marks the entries stored so far as old, so a new search replaces
+// them. Empties the table when the generations wrap around, so an
+// entry of the current generation is always from this search. Must
+// not be called while other threads are using the table.
+void TranspositionTable::newSearch()
+{
+	if (generation == UINT8_MAX)
+	{
+		clear();
+		return;
+	}
+	generation++;
+}
+
+// Looks up a position, returning false if the table doesn't have it
+bool TranspositionTable::probe(uint64_t key, TableEntry& entry) const
+{
+	const Slot& slot = slots[key & mask];
+	uint64_t data = slot.data.load(std::memory_order_relaxed);
+	uint64_t check = slot.check.load(std::memory_order_relaxed);
+	if (data == 0 || (check ^ data) != key)
+	{
+		return false;
+	}
+	unpack(data, entry);
+	return true;
+}
+
+// Stores what was found about a position
+void TranspositionTable::store(uint64_t key, const TableEntry& entry)
+{
+	Slot& slot = slots[key & mask];
+	uint64_t old = slot.data.load(std::memory_order_relaxed);
+	uint8_t oldGeneration = (uint8_t)(old >> 56);
+	uint8_t oldDepth = (uint8_t)(old >> 48);
+	if (old != 0 && oldGeneration == generation && oldDepth > entry.depth
+		&& (slot.check.load(std::memory_order_relaxed) ^ old) != key)
+	{
+		return;
+	}
+
+	uint64_t data = pack(entry, generation);
+	slot.check.store(key ^ data, std::memory_order_relaxed);
+	slot.data.store(data, std::memory_order_relaxed);
+}
+
+// Packs an entry into 64 bits:
+// value (32), move x (4), y (5), rotation (2), hold (1), unused (4), depth (8), generation (8)
+uint64_t TranspositionTable::pack(const TableEntry& entry, uint8_t generation)
+{
+	uint64_t move = (uint64_t)((entry.move.x + MOVE_OFFSET) & 0xF)
+		| (uint64_t)((entry.move.y + MOVE_OFFSET) & 0x1F) << 4
+		| (uint64_t)(entry.move.rotation & 3) << 9
+		| (uint64_t)(entry.move.hold ? 1 : 0) << 11;
+	return (uint64_t)(uint32_t)entry.value
+		| move << 32
+		| (uint64_t)entry.depth << 48
+		| (uint64_t)generation << 56;
+}
+
+// Reads an entry packed by pack()
+void TranspositionTable::unpack(uint64_t data, TableEntry& entry)
+{
+	entry.value = (int32_t)(uint32_t)data;
+	entry.move.x = (int8_t)(((data >> 32) & 0xF) - MOVE_OFFSET);
+	entry.move.y = (int8_t)(((data >> 36) & 0x1F) - MOVE_OFFSET);
+	entry.move.rotation = (int8_t)((data >> 41) & 3);
+	entry.move.hold = ((data >> 43) & 1) != 0;
+	entry.depth = (uint8_t)(data >> 48);
+	entry.generation = (uint8_t)(data >> 56);
+}
@@ -0,0 +1,63 @@
+#ifndef TRANSPOSITIONTABLE_H
+#define TRANSPOSITIONTABLE_H
+
+#include "GameState.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+
+// Default number of entries (16 bytes each)
+#define TABLE_ENTRIES (1 << 20)
+
+// Entries of the smaller tables a bot keeps for itself, small enough
+// to stay in cache
+#define AGENT_TABLE_ENTRIES (1 << 16)
+
+// What a search found out about a position
+struct TableEntry
+{
+	int32_t value;
+	uint8_t depth;
+	GameMove move;
+	uint8_t generation;	// Search that stored it, set by probe()
+};
+
+// A fixed-size table of search results keyed by Zobrist hash, shared
+// between search threads without locks. Each slot keeps its key XORed
+// with its data, so a slot torn by two threads writing at once fails
+// the key check on the next probe instead of returning mixed data.
+// A newer search or a deeper result replaces what is in a slot.
+class TranspositionTable
+{
+public:
+	TranspositionTable(size_t entries = TABLE_ENTRIES);
+	~TranspositionTable();
+
+	void clear();
+	void newSearch();
+	bool probe(uint64_t key, TableEntry& entry) const;
+	void store(uint64_t key, const TableEntry& entry);
+
+	size_t getSize() const { return mask + 1; }
+	uint8_t getGeneration() const { return generation; }
+
+private:
+	struct Slot
+	{
+		std::atomic<uint64_t> check;
+		std::atomic<uint64_t> data;
+	};
+
+	Slot* slots;
+	size_t mask;
+	uint8_t generation;
+
+	static uint64_t pack(const TableEntry& entry, uint8_t generation);
+	static void unpack(uint64_t data, TableEntry& entry);
+
+	TranspositionTable(const TranspositionTable& rhs);
+	TranspositionTable& operator=(const TranspositionTable& rhs);
+};
+
+#endif
@@ -0,0 +1,73 @@
+#include "VersusMatch.h"
+
+VersusMatch::VersusMatch(uint64_t pSeed, const AttackTable& table)
+	: exchange(2, table)
+{
+	seed = pSeed;
+}
+
+// Plays a game from the start, returning who won
+VersusResult VersusMatch::play(Agent& first, Agent& second, uint32_t maxPieces)
+{
+	Agent* agents[2] = { &first, &second };
+	states[0].reset(seed);
+	states[1].reset(seed);
+	exchange.reset(seed);
+
+	VersusResult result;
+	result.winner = -1;
+	result.pieces = 0;
+	result.lines[0] = 0;
+	result.lines[1] = 0;
+
+	while (result.pieces < maxPieces)
+	{
+		for (int p = 0; p < 2; p++)
+		{
+			if (!placeBlock(p, *agents[p], result))
+			{
+				exchange.eliminate(p);
+				result.winner = 1 - p;
+				result.sent[0] = exchange.getSent(0);
+				result.sent[1] = exchange.getSent(1);
+				return result;
+			}
+		}
+		result.pieces++;
+	}
+	result.sent[0] = exchange.getSent(0);
+	result.sent[1] = exchange.getSent(1);
+	if (result.sent[0] != result.sent[1])
+	{
+		result.winner = result.sent[0] > result.sent[1] ? 0 : 1;
+	}
+	return result;
+}
+
+// Has a player place their active block, then sends the garbage it
+// earns or takes the garbage waiting for them, returning false if they
+// topped out
+bool VersusMatch::placeBlock(int player, Agent& agent, VersusResult& result)
+{
+	GameState& state = states[player];
+	GameMove move;
+	int cleared = !state.isGameOver() && agent.search(state, move) ? state.apply(move) : -1;
+	if (cleared < 0 || state.isGameOver())
+	{
+		return false;
+	}
+	if (cleared == 0)
+	{
+		exchange.sendAttack(player, 0, false);
+		return exchange.receiveGarbage(player, state);
+	}
+
+	bool empty = true;
+	for (int y = 0; y < GRID_HEIGHT && empty; y++)
+	{
+		empty = state.rows[y] == 0;
+	}
+	result.lines[player] += cleared;
+	exchange.sendAttack(player, cleared, empty);
+	return true;
+}
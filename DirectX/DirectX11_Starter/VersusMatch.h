@@ -0,0 +1,49 @@
+#ifndef VERSUSMATCH_H
+#define VERSUSMATCH_H
+
+#include "Agent.h"
+#include "GameState.h"
+#include "GarbageExchange.h"
+
+#include <stdint.h>
+
+// Most blocks each player places before a versus game is decided on
+// the garbage sent
+#define VERSUS_MAX_PIECES 500
+
+// How a versus game between two bots went
+struct VersusResult
+{
+	int winner;				// 0 or 1, or -1 for a draw
+	uint32_t pieces;		// Blocks placed by each player
+	uint32_t lines[2];
+	uint32_t sent[2];		// Garbage rows sent, after cancelling
+};
+
+// Plays a versus game between two bots a placement at a time, taking
+// turns with the first player starting. Lines cleared send garbage
+// through a GarbageExchange with the given attack table, and the first
+// to top out loses. If neither has after the most blocks, whoever sent
+// more garbage wins, and it's a draw if that's even. Both players get
+// the same seed, so they are dealt the same blocks, and their garbage
+// gaps come from the same sequence, so equal attacks are answered by
+// equal garbage.
+class VersusMatch
+{
+public:
+	VersusMatch(uint64_t seed, const AttackTable& table = CLASSIC_ATTACK);
+
+	VersusResult play(Agent& first, Agent& second, uint32_t maxPieces = VERSUS_MAX_PIECES);
+
+	const GameState& getState(int player) const { return states[player]; }
+	const GarbageExchange& getExchange() const { return exchange; }
+
+private:
+	GameState states[2];
+	GarbageExchange exchange;
+	uint64_t seed;
+
+	bool placeBlock(int player, Agent& agent, VersusResult& result);
+};
+
+#endif
@@ -0,0 +1,107 @@
+#include "VersusSimulation.h"
+
+VersusSimulation::VersusSimulation(uint64_t pSeed, const AttackTable& table)
+	: exchange(VERSUS_PLAYERS, table)
+{
+	reset(pSeed);
+	ticks = 0;
+	games = 0;
+	for (int p = 0; p < VERSUS_PLAYERS; p++)
+	{
+		wins[p] = 0;
+	}
+}
+
+// Starts a game on the given seed, keeping the tally of earlier ones
+void VersusSimulation::reset(uint64_t pSeed)
+{
+	seed = pSeed;
+	for (int p = 0; p < VERSUS_PLAYERS; p++)
+	{
+		players[p].reset(seed);
+	}
+	exchange.reset(seed);
+	overTicks = 0;
+	winner = NO_WINNER;
+}
+
+// Advances both players a tick, in player order, then trades the
+// garbage of any blocks they placed
+void VersusSimulation::tick(const int inputs[VERSUS_PLAYERS])
+{
+	ticks++;
+	if (isOver())
+	{
+		if (++overTicks >= REMATCH_TICKS)
+		{
+			reset(seed + 1);
+		}
+		return;
+	}
+
+	bool toppedOut[VERSUS_PLAYERS];
+	for (int p = 0; p < VERSUS_PLAYERS; p++)
+	{
+		GameSimulation& player = players[p];
+		int pieces = player.getPieces();
+		int cleared = player.tick(inputs[p]);
+		if (player.getPieces() != pieces && !player.isGameOver())
+		{
+			if (cleared > 0)
+			{
+				bool empty = true;
+				for (int x = 0; x < GRID_WIDTH && empty; x++)
+				{
+					empty = player.getBoard().getHeight(x) == 0;
+				}
+				exchange.sendAttack(p, cleared, empty);
+			}
+			else
+			{
+				exchange.sendAttack(p, 0, false);
+				exchange.receiveGarbage(p, player);
+			}
+		}
+		toppedOut[p] = player.isGameOver();
+	}
+
+	if (toppedOut[0] || toppedOut[1])
+	{
+		winner = toppedOut[0] && toppedOut[1] ? DRAW : (toppedOut[0] ? 1 : 0);
+		games++;
+		if (winner >= 0)
+		{
+			wins[winner]++;
+		}
+		for (int p = 0; p < VERSUS_PLAYERS; p++)
+		{
+			if (toppedOut[p])
+			{
+				exchange.eliminate(p);
+			}
+		}
+	}
+}
+
+// Hashes everything that decides how the game goes on, so peers can
+// check they are in step
+uint64_t VersusSimulation::getChecksum() const
+{
+	uint8_t state[STATE_SIZE];
+	uint64_t hash = 0xCBF29CE484222325ULL;
+	for (int p = 0; p < VERSUS_PLAYERS; p++)
+	{
+		players[p].saveState(state);
+		for (int i = 0; i < STATE_SIZE; i++)
+		{
+			hash = (hash ^ state[i]) * 0x100000001B3ULL;
+		}
+	}
+	hash = exchange.getChecksum(hash);
+	uint32_t counters[4] = { ticks, overTicks, (uint32_t)winner, games };
+	for (int i = 0; i < 4; i++)
+	{
+		hash = (hash ^ counters[i]) * 0x100000001B3ULL;
+	}
+	return hash ^ seed;
+}
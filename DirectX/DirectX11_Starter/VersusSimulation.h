@@ -0,0 +1,62 @@
+#ifndef VERSUSSIMULATION_H
+#define VERSUSSIMULATION_H
+
+#include "GameSimulation.h"
+#include "GarbageExchange.h"
+
+#include <stdint.h>
+#include <type_traits>
+
+// Players in a tick by tick versus game
+#define VERSUS_PLAYERS 2
+
+// Ticks between a versus game ending and the rematch starting
+#define REMATCH_TICKS (2 * TICKS_PER_SECOND)
+
+// A versus game with the full rules, tick by tick: a GameSimulation per
+// player on the same seed, with the garbage from their clears going
+// through a GarbageExchange. Garbage is taken when a player places a
+// block without clearing, as in VersusMatch. Once one player tops out
+// the other wins, and a rematch on the next seed starts a little later,
+// so a session can go on for any number of games.
+//
+// Everything is held by value with no pointers, so the whole game
+// saves and restores with a plain copy, which is what rollback does
+// every tick. tick() depends only on the game and the inputs, so peers
+// given the same inputs stay in step.
+class VersusSimulation
+{
+public:
+	VersusSimulation(uint64_t seed = 0, const AttackTable& table = CLASSIC_ATTACK);
+
+	void reset(uint64_t seed);
+	void tick(const int inputs[VERSUS_PLAYERS]);
+	uint64_t getChecksum() const;
+
+	const GameSimulation& getPlayer(int player) const { return players[player]; }
+	const GarbageExchange& getExchange() const { return exchange; }
+	uint32_t getTick() const { return ticks; }
+	uint64_t getSeed() const { return seed; }
+	bool isOver() const { return winner != NO_WINNER; }
+	int getWinner() const { return winner; }
+	uint32_t getGames() const { return games; }
+	uint32_t getWins(int player) const { return wins[player]; }
+
+	// No winner yet, or both topped out on the same tick
+	static const int NO_WINNER = -2;
+	static const int DRAW = -1;
+
+private:
+	GameSimulation players[VERSUS_PLAYERS];
+	GarbageExchange exchange;
+	uint64_t seed;
+	uint32_t ticks;		// Since the first game started
+	uint32_t overTicks;	// Since this game ended
+	int winner;
+	uint32_t games;		// Finished
+	uint32_t wins[VERSUS_PLAYERS];
+};
+
+static_assert(std::is_trivially_copyable<VersusSimulation>::value, "VersusSimulation must copy with memcpy");
+
+#endif
@@ -0,0 +1,489 @@
+#include "WeightTuner.h"
+
+#include <algorithm>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+// Sweeps of the Jacobi eigenvalue method, far more than it ever needs
+#define JACOBI_SWEEPS 50
+
+// Smallest variance kept along any direction, so the distribution never
+// collapses into fewer dimensions
+#define MIN_EIGENVALUE 1e-20
+
+#define PI 3.14159265358979323846
+
+// Fills in the default run
+void setDefaultTuner(TunerSettings& settings)
+{
+	settings.population = 0;
+	settings.games = TUNER_GAMES;
+	settings.firstSeed = 1;
+	settings.width = BOT_WIDTH;
+	settings.depth = BOT_DEPTH;
+	settings.pieces = TUNER_PIECES;
+	settings.sigma = TUNER_SIGMA;
+}
+
+// Splits a symmetric matrix into its eigenvectors, as columns, and
+// eigenvalues by Jacobi rotations
+static void decompose(const double matrix[TUNED_WEIGHTS][TUNED_WEIGHTS], double vectors[TUNED_WEIGHTS][TUNED_WEIGHTS],
+	double* values)
+{
+	const int n = TUNED_WEIGHTS;
+	double a[TUNED_WEIGHTS][TUNED_WEIGHTS];
+	for (int i = 0; i < n; i++)
+	{
+		for (int j = 0; j < n; j++)
+		{
+			a[i][j] = matrix[i][j];
+			vectors[i][j] = i == j ? 1 : 0;
+		}
+	}
+
+	for (int sweep = 0; sweep < JACOBI_SWEEPS; sweep++)
+	{
+		double off = 0;
+		for (int i = 0; i < n; i++)
+		{
+			for (int j = i + 1; j < n; j++)
+			{
+				off += a[i][j] * a[i][j];
+			}
+		}
+		if (off == 0)
+		{
+			break;
+		}
+
+		for (int p = 0; p < n; p++)
+		{
+			for (int q = p + 1; q < n; q++)
+			{
+				if (a[p][q] == 0)
+				{
+					continue;
+				}
+				// Rotates rows and columns p and q to zero a[p][q]
+				double theta = (a[q][q] - a[p][p]) / (2 * a[p][q]);
+				double t = (theta >= 0 ? 1 : -1) / (fabs(theta) + sqrt(theta * theta + 1));
+				double c = 1 / sqrt(t * t + 1);
+				double s = t * c;
+				for (int k = 0; k < n; k++)
+				{
+					double kp = a[k][p];
+					double kq = a[k][q];
+					a[k][p] = c * kp - s * kq;
+					a[k][q] = s * kp + c * kq;
+				}
+				for (int k = 0; k < n; k++)
+				{
+					double pk = a[p][k];
+					double qk = a[q][k];
+					a[p][k] = c * pk - s * qk;
+					a[q][k] = s * pk + c * qk;
+				}
+				for (int k = 0; k < n; k++)
+				{
+					double kp = vectors[k][p];
+					double kq = vectors[k][q];
+					vectors[k][p] = c * kp - s * kq;
+					vectors[k][q] = s * kp + c * kq;
+				}
+			}
+		}
+	}
+
+	for (int i = 0; i < n; i++)
+	{
+		values[i] = std::max(a[i][i], MIN_EIGENVALUE);
+	}
+}
+
+WeightTuner::CandidateJob::CandidateJob(const TunerSettings& settings, int threads)
+	: settings(settings)
+{
+	for (int i = 0; i < threads; i++)
+	{
+		agents.push_back(new BeamSearch(settings.width, settings.depth, 1));
+	}
+}
+
+WeightTuner::CandidateJob::~CandidateJob()
+{
+	for (size_t i = 0; i < agents.size(); i++)
+	{
+		delete agents[i];
+	}
+}
+
+// Plays one game of one candidate, candidates one after another
+void WeightTuner::CandidateJob::runItem(int thread, int64_t index)
+{
+	size_t candidate = (size_t)(index / (int64_t)settings.games);
+	uint64_t game = (uint64_t)index % settings.games;
+	BeamSearch& agent = *agents[thread];
+	agent.setWeights(&weights[candidate * TUNED_WEIGHTS]);
+	agent.setScoreWeight(weights[candidate * TUNED_WEIGHTS + NUM_FEATURES]);
+	results[(size_t)index] = playPlacementGame(settings.firstSeed + game, agent, settings.pieces);
+}
+
+WeightTuner::WeightTuner(const TunerSettings& pSettings, uint64_t seed, int threads)
+	: pool(threads)
+{
+	settings = pSettings;
+	job = new CandidateJob(settings, pool.getThreads());
+	random.seed(seed);
+
+	int32_t weights[TUNED_WEIGHTS];
+	memcpy(weights, DEFAULT_WEIGHTS, sizeof(DEFAULT_WEIGHTS));
+	weights[NUM_FEATURES] = SCORE_WEIGHT;
+	start(weights);
+}
+
+WeightTuner::~WeightTuner()
+{
+	delete job;
+}
+
+// Starts the search over from the given weights, TUNED_WEIGHTS of them
+void WeightTuner::start(const int32_t* weights)
+{
+	for (int i = 0; i < TUNED_WEIGHTS; i++)
+	{
+		scale[i] = weights[i] != 0 ? weights[i] : 1;
+		mean[i] = weights[i] != 0 ? 1 : 0;
+		pathSigma[i] = 0;
+		pathCovariance[i] = 0;
+		for (int j = 0; j < TUNED_WEIGHTS; j++)
+		{
+			covariance[i][j] = i == j ? 1 : 0;
+		}
+		bestWeights[i] = weights[i];
+	}
+	sigma = settings.sigma;
+	generation = 0;
+	bestFitness = -1;
+	generationBest = 0;
+	generationMean = 0;
+	gamesPlayed = 0;
+	piecesPlayed = 0;
+	setRates();
+}
+
+// Sets the population and learning rates to the usual CMA-ES defaults
+// for the number of weights
+void WeightTuner::setRates()
+{
+	const double n = TUNED_WEIGHTS;
+	population = settings.population > 0 ? settings.population : 4 + (int)(3 * log(n));
+	population = std::max(population, 2);
+	parents = population / 2;
+
+	// Parents are averaged with weights falling off by rank
+	recombination.resize(parents);
+	double total = 0;
+	for (int i = 0; i < parents; i++)
+	{
+		recombination[i] = log(parents + 0.5) - log(i + 1.0);
+		total += recombination[i];
+	}
+	double squares = 0;
+	for (int i = 0; i < parents; i++)
+	{
+		recombination[i] /= total;
+		squares += recombination[i] * recombination[i];
+	}
+	parentsEffective = 1 / squares;
+
+	double mu = parentsEffective;
+	rateSigma = (mu + 2) / (n + mu + 5);
+	rateCovariance = (4 + mu / n) / (n + 4 + 2 * mu / n);
+	rateRankOne = 2 / ((n + 1.3) * (n + 1.3) + mu);
+	rateRankMu = std::min(1 - rateRankOne, 2 * (mu - 2 + 1 / mu) / ((n + 2) * (n + 2) + mu));
+	damping = 1 + 2 * std::max(0.0, sqrt((mu - 1) / (n + 1)) - 1) + rateSigma;
+	expectedLength = sqrt(n) * (1 - 1 / (4 * n) + 1 / (21 * n * n));
+}
+
+// Rounds a point of the search to the bot's integer weights
+void WeightTuner::toWeights(const double* point, int32_t* weights) const
+{
+	for (int i = 0; i < TUNED_WEIGHTS; i++)
+	{
+		weights[i] = (int32_t)floor(point[i] * scale[i] + 0.5);
+	}
+}
+
+// Draws from the standard normal distribution (Box-Muller)
+double WeightTuner::nextGaussian()
+{
+	double u = ((random.next() >> 11) + 1) * (1.0 / 9007199254740992.0);
+	double v = (random.next() >> 11) * (1.0 / 9007199254740992.0);
+	return sqrt(-2 * log(u)) * cos(2 * PI * v);
+}
+
+// Samples a generation of candidates, plays their games and updates
+// the distribution from the best of them
+void WeightTuner::runGeneration()
+{
+	const int n = TUNED_WEIGHTS;
+	double vectors[TUNED_WEIGHTS][TUNED_WEIGHTS];
+	double roots[TUNED_WEIGHTS];
+	decompose(covariance, vectors, roots);
+	for (int i = 0; i < n; i++)
+	{
+		roots[i] = sqrt(roots[i]);
+	}
+
+	// Each candidate is the mean plus sigma times a step drawn from the
+	// covariance: vectors * roots * a standard normal draw
+	std::vector<double> steps(population * n);
+	std::vector<double> points(population * n);
+	job->weights.resize(population * n);
+	for (int k = 0; k < population; k++)
+	{
+		double draw[TUNED_WEIGHTS];
+		for (int i = 0; i < n; i++)
+		{
+			draw[i] = roots[i] * nextGaussian();
+		}
+		for (int i = 0; i < n; i++)
+		{
+			double step = 0;
+			for (int j = 0; j < n; j++)
+			{
+				step += vectors[i][j] * draw[j];
+			}
+			steps[k * n + i] = step;
+			points[k * n + i] = mean[i] + sigma * step;
+		}
+		toWeights(&points[k * n], &job->weights[k * n]);
+	}
+
+	job->results.resize((size_t)(population * settings.games));
+	pool.run((int64_t)job->results.size(), *job);
+
+	// Fitness is the mean score over the candidate's games
+	std::vector<double> fitness(population, 0.0);
+	for (size_t g = 0; g < job->results.size(); g++)
+	{
+		fitness[g / settings.games] += job->results[g].score;
+		piecesPlayed += job->results[g].pieces;
+	}
+	gamesPlayed += job->results.size();
+	std::vector<int> order(population);
+	generationMean = 0;
+	for (int k = 0; k < population; k++)
+	{
+		fitness[k] /= (double)settings.games;
+		generationMean += fitness[k] / population;
+		order[k] = k;
+	}
+	std::stable_sort(order.begin(), order.end(), [&fitness](int a, int b) { return fitness[a] > fitness[b]; });
+	generationBest = fitness[order[0]];
+	if (generationBest > bestFitness)
+	{
+		bestFitness = generationBest;
+		memcpy(bestWeights, &job->weights[order[0] * n], sizeof(bestWeights));
+	}
+
+	// Moves the mean to the weighted average of the best candidates
+	double meanStep[TUNED_WEIGHTS];
+	for (int i = 0; i < n; i++)
+	{
+		meanStep[i] = 0;
+		for (int r = 0; r < parents; r++)
+		{
+			meanStep[i] += recombination[r] * steps[order[r] * n + i];
+		}
+		mean[i] += sigma * meanStep[i];
+	}
+
+	// The sigma path follows the steps with the covariance undone:
+	// vectors * (vectors' * step / roots)
+	double rotated[TUNED_WEIGHTS];
+	for (int j = 0; j < n; j++)
+	{
+		rotated[j] = 0;
+		for (int i = 0; i < n; i++)
+		{
+			rotated[j] += vectors[i][j] * meanStep[i];
+		}
+		rotated[j] /= roots[j];
+	}
+	double pathLength = 0;
+	double sigmaGain = sqrt(rateSigma * (2 - rateSigma) * parentsEffective);
+	for (int i = 0; i < n; i++)
+	{
+		double whitened = 0;
+		for (int j = 0; j < n; j++)
+		{
+			whitened += vectors[i][j] * rotated[j];
+		}
+		pathSigma[i] = (1 - rateSigma) * pathSigma[i] + sigmaGain * whitened;
+		pathLength += pathSigma[i] * pathSigma[i];
+	}
+	pathLength = sqrt(pathLength);
+
+	// The covariance path stalls while the sigma path is long, so a fast
+	// growing sigma doesn't also stretch the covariance
+	generation++;
+	double bias = sqrt(1 - pow(1 - rateSigma, 2.0 * generation));
+	bool stalled = pathLength / bias / expectedLength >= 1.4 + 2 / (n + 1.0);
+	double covarianceGain = stalled ? 0 : sqrt(rateCovariance * (2 - rateCovariance) * parentsEffective);
+	for (int i = 0; i < n; i++)
+	{
+		pathCovariance[i] = (1 - rateCovariance) * pathCovariance[i] + covarianceGain * meanStep[i];
+	}
+
+	double keep = 1 - rateRankOne - rateRankMu + (stalled ? rateRankOne * rateCovariance * (2 - rateCovariance) : 0);
+	for (int i = 0; i < n; i++)
+	{
+		for (int j = 0; j <= i; j++)
+		{
+			double rankMu = 0;
+			for (int r = 0; r < parents; r++)
+			{
+				rankMu += recombination[r] * steps[order[r] * n + i] * steps[order[r] * n + j];
+			}
+			double value = keep * covariance[i][j] + rateRankOne * pathCovariance[i] * pathCovariance[j] +
+				rateRankMu * rankMu;
+			covariance[i][j] = value;
+			covariance[j][i] = value;
+		}
+	}
+
+	sigma *= exp(rateSigma / damping * (pathLength / expectedLength - 1));
+}
+
+// Retrieves the weights at the centre of the distribution
+void WeightTuner::getMeanWeights(int32_t* weights) const
+{
+	toWeights(mean, weights);
+}
+
+// Writes the whole state of the run as text, to a temporary file that
+// then replaces the checkpoint so a crash never leaves half of one
+bool WeightTuner::save(const char* path) const
+{
+	char temporary[1024];
+	snprintf(temporary, sizeof(temporary), "%s.tmp", path);
+	FILE* file = fopen(temporary, "w");
+	if (file == NULL)
+	{
+		return false;
+	}
+
+	fprintf(file, "3DTT %d %d\n", TUNER_CHECKPOINT_VERSION, TUNED_WEIGHTS);
+	fprintf(file, "settings %d %llu %llu %d %d %u %.17g\n", settings.population, (unsigned long long)settings.games,
+		(unsigned long long)settings.firstSeed, settings.width, settings.depth, settings.pieces, settings.sigma);
+	fprintf(file, "progress %d %llu %llu %llu %.17g %.17g\n", generation, (unsigned long long)random.state,
+		(unsigned long long)gamesPlayed, (unsigned long long)piecesPlayed, sigma, bestFitness);
+	fprintf(file, "best");
+	for (int i = 0; i < TUNED_WEIGHTS; i++)
+	{
+		fprintf(file, " %d", bestWeights[i]);
+	}
+
+	const double* rows[] = { scale, mean, pathSigma, pathCovariance };
+	const char* names[] = { "scale", "mean", "pathSigma", "pathCovariance" };
+	for (int r = 0; r < 4 + TUNED_WEIGHTS; r++)
+	{
+		fprintf(file, "\n%s", r < 4 ? names[r] : "covariance");
+		const double* row = r < 4 ? rows[r] : covariance[r - 4];
+		for (int i = 0; i < TUNED_WEIGHTS; i++)
+		{
+			fprintf(file, " %.17g", row[i]);
+		}
+	}
+	fprintf(file, "\n");
+
+	bool written = !ferror(file);
+	written = fclose(file) == 0 && written;
+#ifdef _WIN32
+	remove(path);
+#endif
+	return written && rename(temporary, path) == 0;
+}
+
+// Reads the name at the start of a checkpoint line, returning false if
+// it isn't the one expected
+static bool readName(FILE* file, const char* expected)
+{
+	char name[32];
+	return fscanf(file, " %31s", name) == 1 && strcmp(name, expected) == 0;
+}
+
+// Picks a run up from a checkpoint, settings included, returning false
+// if the file can't be read or isn't one
+bool WeightTuner::load(const char* path)
+{
+	FILE* file = fopen(path, "r");
+	if (file == NULL)
+	{
+		return false;
+	}
+
+	TunerSettings loaded;
+	int version;
+	int count;
+	unsigned long long games;
+	unsigned long long firstSeed;
+	unsigned long long state;
+	unsigned long long loadedGames;
+	unsigned long long loadedPieces;
+	int loadedGeneration;
+	double loadedSigma;
+	double loadedBest;
+	bool ok = readName(file, "3DTT") && fscanf(file, "%d %d", &version, &count) == 2 &&
+		version == TUNER_CHECKPOINT_VERSION && count == TUNED_WEIGHTS &&
+		readName(file, "settings") && fscanf(file, "%d %llu %llu %d %d %u %lg", &loaded.population, &games,
+			&firstSeed, &loaded.width, &loaded.depth, &loaded.pieces, &loaded.sigma) == 7 &&
+		readName(file, "progress") && fscanf(file, "%d %llu %llu %llu %lg %lg", &loadedGeneration, &state,
+			&loadedGames, &loadedPieces, &loadedSigma, &loadedBest) == 6 &&
+		readName(file, "best");
+	int32_t best[TUNED_WEIGHTS];
+	for (int i = 0; ok && i < TUNED_WEIGHTS; i++)
+	{
+		ok = fscanf(file, "%d", &best[i]) == 1;
+	}
+
+	double values[4 + TUNED_WEIGHTS][TUNED_WEIGHTS];
+	const char* names[] = { "scale", "mean", "pathSigma", "pathCovariance" };
+	for (int r = 0; ok && r < 4 + TUNED_WEIGHTS; r++)
+	{
+		ok = readName(file, r < 4 ? names[r] : "covariance");
+		for (int i = 0; ok && i < TUNED_WEIGHTS; i++)
+		{
+			ok = fscanf(file, "%lg", &values[r][i]) == 1;
+		}
+	}
+	fclose(file);
+	if (!ok || games == 0 || loaded.width <= 0 || loaded.depth <= 0 || loaded.pieces == 0)
+	{
+		return false;
+	}
+
+	loaded.games = games;
+	loaded.firstSeed = firstSeed;
+	settings = loaded;
+	delete job;
+	job = new CandidateJob(settings, pool.getThreads());
+	setRates();
+	generation = loadedGeneration;
+	random.state = state;
+	gamesPlayed = loadedGames;
+	piecesPlayed = loadedPieces;
+	sigma = loadedSigma;
+	bestFitness = loadedBest;
+	memcpy(bestWeights, best, sizeof(bestWeights));
+	memcpy(scale, values[0], sizeof(scale));
+	memcpy(mean, values[1], sizeof(mean));
+	memcpy(pathSigma, values[2], sizeof(pathSigma));
+	memcpy(pathCovariance, values[3], sizeof(pathCovariance));
+	memcpy(covariance, values[4], sizeof(covariance));
+	generationBest = 0;
+	generationMean = 0;
+	return true;
+}
@@ -0,0 +1,134 @@
+#ifndef WEIGHTTUNER_H
+#define WEIGHTTUNER_H
+
+#include "BeamSearch.h"
+#include "Evaluator.h"
+#include "HeadlessRunner.h"
+#include "Random.h"
+#include "WorkStealingPool.h"
+
+#include <stdint.h>
+#include <vector>
+
+// Weights tuned: every board feature, then the score weight that values
+// line clears by their LINE_SCORES entry
+#define TUNED_WEIGHTS (NUM_FEATURES + 1)
+
+// Format of the checkpoint files the tuner saves and resumes from
+#define TUNER_CHECKPOINT_VERSION 1
+
+// Defaults of a tuning run
+#define TUNER_GAMES 1000
+#define TUNER_PIECES 500
+#define TUNER_SIGMA 0.3
+
+// How a tuning run plays and searches
+struct TunerSettings
+{
+	int population;		// Candidates per generation, 0 for 4 + 3 ln n
+	uint64_t games;		// Games each candidate plays, the same seeds for all
+	uint64_t firstSeed;
+	int width;
+	int depth;
+	uint32_t pieces;	// Most blocks placed in a game
+	double sigma;		// First step size, as a fraction of each weight
+};
+
+// Fills in the default run
+void setDefaultTuner(TunerSettings& settings);
+
+// Tunes the bot's weights with CMA-ES. Each generation samples candidate
+// weights from a normal distribution, plays every candidate's games on a
+// WorkStealingPool a placement at a time, and moves the distribution
+// towards the candidates with the best average score, learning which
+// weights are worth changing together as it goes.
+//
+// Weights are searched relative to the ones the run starts from, so a
+// step of 1 doubles a weight whatever its size. Every candidate plays the
+// same seeds, so they're compared on the same games, and a run is the
+// same for the same seed whatever the number of threads. The whole state
+// can be saved between generations and a run picked up from it exactly.
+class WeightTuner
+{
+public:
+	WeightTuner(const TunerSettings& settings, uint64_t seed = 1, int threads = 0);
+	~WeightTuner();
+
+	void start(const int32_t* weights);
+	void runGeneration();
+	bool save(const char* path) const;
+	bool load(const char* path);
+
+	const TunerSettings& getSettings() const { return settings; }
+	int getPopulation() const { return population; }
+	int getThreads() const { return pool.getThreads(); }
+	int getGeneration() const { return generation; }
+	double getSigma() const { return sigma; }
+	double getBestFitness() const { return bestFitness; }
+	const int32_t* getBestWeights() const { return bestWeights; }
+	void getMeanWeights(int32_t* weights) const;
+	double getGenerationBest() const { return generationBest; }
+	double getGenerationMean() const { return generationMean; }
+	uint64_t getGamesPlayed() const { return gamesPlayed; }
+	uint64_t getPiecesPlayed() const { return piecesPlayed; }
+
+private:
+	// Plays every candidate's games, a bot per thread
+	class CandidateJob : public PoolJob
+	{
+	public:
+		CandidateJob(const TunerSettings& settings, int threads);
+		~CandidateJob();
+
+		void runItem(int thread, int64_t index);
+
+		std::vector<int32_t> weights;		// TUNED_WEIGHTS per candidate
+		std::vector<GameResult> results;	// games per candidate
+
+	private:
+		const TunerSettings& settings;
+		std::vector<BeamSearch*> agents;
+	};
+
+	TunerSettings settings;
+	WorkStealingPool pool;
+	CandidateJob* job;
+	Random random;
+	int population;
+	int parents;
+
+	// CMA-ES state, in weights divided by the starting ones
+	double scale[TUNED_WEIGHTS];
+	double mean[TUNED_WEIGHTS];
+	double sigma;
+	double pathSigma[TUNED_WEIGHTS];
+	double pathCovariance[TUNED_WEIGHTS];
+	double covariance[TUNED_WEIGHTS][TUNED_WEIGHTS];
+	int generation;
+
+	// Learning rates, set from the number of weights and the population
+	std::vector<double> recombination;
+	double parentsEffective;
+	double rateSigma;
+	double rateCovariance;
+	double rateRankOne;
+	double rateRankMu;
+	double damping;
+	double expectedLength;
+
+	double bestFitness;
+	int32_t bestWeights[TUNED_WEIGHTS];
+	double generationBest;
+	double generationMean;
+	uint64_t gamesPlayed;
+	uint64_t piecesPlayed;
+
+	void setRates();
+	void toWeights(const double* point, int32_t* weights) const;
+	double nextGaussian();
+
+	WeightTuner(const WeightTuner& rhs);
+	WeightTuner& operator=(const WeightTuner& rhs);
+};
+
+#endif
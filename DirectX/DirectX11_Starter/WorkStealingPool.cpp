@@ -0,0 +1,171 @@
+#include "WorkStealingPool.h"
+
+// Starts the helper threads. With threads 0, uses one thread per core.
+WorkStealingPool::WorkStealingPool(int threads)
+{
+	if (threads <= 0)
+	{
+		threads = (int)std::thread::hardware_concurrency();
+		threads = threads > 0 ? threads : 1;
+	}
+	for (int i = 0; i < threads; i++)
+	{
+		Slice* slice = new Slice();
+		slice->next = 0;
+		slice->end = 0;
+		slices.push_back(slice);
+	}
+
+	job = NULL;
+	steals = 0;
+	round = 0;
+	running = 0;
+	stopping = false;
+	for (int i = 1; i < threads; i++)
+	{
+		helpers.push_back(std::thread(&WorkStealingPool::runHelper, this, i));
+	}
+}
+
+WorkStealingPool::~WorkStealingPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	wake.notify_all();
+	for (size_t i = 0; i < helpers.size(); i++)
+	{
+		helpers[i].join();
+	}
+	for (size_t i = 0; i < slices.size(); i++)
+	{
+		delete slices[i];
+	}
+}
+
+// Calls the job for every index from 0 to count - 1 across the threads,
+// returning once they're all done
+void WorkStealingPool::run(int64_t count, PoolJob& pJob)
+{
+	int threads = (int)slices.size();
+	for (int i = 0; i < threads; i++)
+	{
+		std::lock_guard<std::mutex> lock(slices[i]->mutex);
+		slices[i]->next = count * i / threads;
+		slices[i]->end = count * (i + 1) / threads;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		job = &pJob;
+		steals = 0;
+		round++;
+		running = (int)helpers.size();
+	}
+	wake.notify_all();
+
+	work(0);
+
+	std::unique_lock<std::mutex> lock(mutex);
+	done.wait(lock, [this] { return running == 0; });
+	job = NULL;
+}
+
+// Runs items until there are none left to take or steal
+void WorkStealingPool::work(int thread)
+{
+	int64_t index;
+	while (take(thread, index) || (steal(thread) && take(thread, index)))
+	{
+		job->runItem(thread, index);
+	}
+}
+
+// Takes the next index from a thread's own slice
+bool WorkStealingPool::take(int thread, int64_t& index)
+{
+	Slice& slice = *slices[thread];
+	std::lock_guard<std::mutex> lock(slice.mutex);
+	if (slice.next >= slice.end)
+	{
+		return false;
+	}
+	index = slice.next++;
+	return true;
+}
+
+// Moves the back half of the biggest slice left into a thread's own,
+// returning false once every slice is empty
+bool WorkStealingPool::steal(int thread)
+{
+	while (true)
+	{
+		int victim = -1;
+		int64_t most = 0;
+		for (int i = 0; i < (int)slices.size(); i++)
+		{
+			std::lock_guard<std::mutex> lock(slices[i]->mutex);
+			int64_t left = slices[i]->end - slices[i]->next;
+			if (i != thread && left > most)
+			{
+				victim = i;
+				most = left;
+			}
+		}
+		if (victim < 0)
+		{
+			return false;
+		}
+
+		// The slice may have shrunk since, in which case look again
+		int64_t first;
+		int64_t last;
+		{
+			std::lock_guard<std::mutex> lock(slices[victim]->mutex);
+			Slice& slice = *slices[victim];
+			if (slice.next >= slice.end)
+			{
+				continue;
+			}
+			last = slice.end;
+			first = slice.next + (slice.end - slice.next) / 2;
+			slice.end = first;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(slices[thread]->mutex);
+			slices[thread]->next = first;
+			slices[thread]->end = last;
+		}
+		std::lock_guard<std::mutex> lock(mutex);
+		steals++;
+		return true;
+	}
+}
+
+// Helper thread loop, joins in with each run
+void WorkStealingPool::runHelper(int thread)
+{
+	int seen = 0;
+	while (true)
+	{
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			wake.wait(lock, [this, seen] { return round != seen || stopping; });
+			if (stopping)
+			{
+				return;
+			}
+			seen = round;
+		}
+
+		work(thread);
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			running--;
+		}
+		done.notify_one();
+	}
+}
@@ -0,0 +1,71 @@
+#ifndef WORKSTEALINGPOOL_H
+#define WORKSTEALINGPOOL_H
+
+#include <stdint.h>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+// A loop to run on a WorkStealingPool. runItem() is called once for
+// every index, from whichever thread gets to it.
+class PoolJob
+{
+public:
+	virtual ~PoolJob() { }
+	virtual void runItem(int thread, int64_t index) = 0;
+};
+
+// Runs the iterations of a loop on a fixed set of threads. Every thread
+// starts with an equal slice of the indices and works through it from
+// the front, one at a time; a thread that runs out steals the back half
+// of the biggest slice left, so threads given slow items (long games)
+// are helped out by the rest rather than finishing last. Each slice has
+// its own lock, only ever taken by its owner and the odd thief.
+//
+// The helper threads wait between loops, so a pool is best kept for
+// many runs. The thread calling run() works as thread 0.
+class WorkStealingPool
+{
+public:
+	WorkStealingPool(int threads = 0);
+	~WorkStealingPool();
+
+	void run(int64_t count, PoolJob& job);
+	int getThreads() const { return (int)slices.size(); }
+	uint64_t getSteals() const { return steals; }
+
+private:
+	// Indices from next up to end are left for a thread. Kept on its own
+	// cache line so threads don't slow each other down.
+	struct Slice
+	{
+		std::mutex mutex;
+		int64_t next;
+		int64_t end;
+		char padding[64];
+	};
+
+	std::vector<Slice*> slices;
+	PoolJob* job;
+	uint64_t steals;
+
+	// Starts the helper threads on each loop
+	std::vector<std::thread> helpers;
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::condition_variable done;
+	int round;
+	int running;
+	bool stopping;
+
+	void work(int thread);
+	bool take(int thread, int64_t& index);
+	bool steal(int thread);
+	void runHelper(int thread);
+
+	WorkStealingPool(const WorkStealingPool& rhs);
+	WorkStealingPool& operator=(const WorkStealingPool& rhs);
+};
+
+#endif
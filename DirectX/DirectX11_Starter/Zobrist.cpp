@@ -0,0 +1,86 @@
+#include "Zobrist.h"
+#include "BitOps.h"
+#include "Random.h"
+
+// Seed of the random keys, fixed so hashes are the same in every run
+#define ZOBRIST_SEED 0x3D7E7A15ULL
+
+// A random key for every feature of a position
+struct ZobristKeys
+{
+	uint64_t cells[GRID_HEIGHT][GRID_WIDTH];
+	uint64_t active[NUM_BLOCK_TYPES + 1];	// Indexed by type + 1 so NO_BLOCK has a key
+	uint64_t held[NUM_BLOCK_TYPES + 1];
+	uint64_t bagIndex[NUM_BLOCK_TYPES];
+	uint64_t canSwap;
+
+	ZobristKeys()
+	{
+		Random random;
+		random.seed(ZOBRIST_SEED);
+		for (int j = 0; j < GRID_HEIGHT; j++)
+		{
+			for (int i = 0; i < GRID_WIDTH; i++)
+			{
+				cells[j][i] = random.next();
+			}
+		}
+		for (int i = 0; i <= NUM_BLOCK_TYPES; i++)
+		{
+			active[i] = random.next();
+			held[i] = random.next();
+		}
+		for (int i = 0; i < NUM_BLOCK_TYPES; i++)
+		{
+			bagIndex[i] = random.next();
+		}
+		canSwap = random.next();
+	}
+};
+
+static const ZobristKeys KEYS;
+
+// Hashes everything but the board
+static uint64_t hashStatus(const GameState& state)
+{
+	uint64_t hash = KEYS.active[state.type + 1] ^ KEYS.held[state.held + 1] ^ KEYS.bagIndex[state.getBagIndex()];
+	return state.canSwap() ? hash ^ KEYS.canSwap : hash;
+}
+
+// Hashes the filled cells of a row mask
+static uint64_t hashCells(int y, unsigned mask)
+{
+	uint64_t hash = 0;
+	while (mask != 0)
+	{
+		hash ^= KEYS.cells[y][lowestBit(mask)];
+		mask &= mask - 1;
+	}
+	return hash;
+}
+
+// Hashes a whole position
+uint64_t zobristHash(const GameState& state)
+{
+	uint64_t hash = hashStatus(state);
+	for (int j = 0; j < GRID_HEIGHT; j++)
+	{
+		hash ^= hashCells(j, state.rows[j]);
+	}
+	return hash;
+}
+
+// Updates a hash for the cells that differ between two positions
+uint64_t zobristUpdate(uint64_t hash, const GameState& before, const GameState& after)
+{
+	hash ^= hashStatus(before) ^ hashStatus(after);
+	for (int j = 0; j < GRID_HEIGHT; j++)
+	{
+		unsigned changed = before.rows[j] ^ after.rows[j];
+		if (changed != 0)
+		{
+			hash ^= hashCells(j, changed);
+		}
+	}
+	return hash;
+}
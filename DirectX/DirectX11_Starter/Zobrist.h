@@ -0,0 +1,19 @@
+#ifndef ZOBRIST_H
+#define ZOBRIST_H
+
+#include "GameState.h"
+
+#include <stdint.h>
+
+// 64-bit Zobrist hashes of game positions for finding repeated positions
+// in search. Covers the board cells, the active and held blocks, whether
+// the block can be held and the position in the bag. The rest of the bag
+// and the generator are left out, as they follow from the bag position
+// along any line of play from the same root.
+uint64_t zobristHash(const GameState& state);
+
+// Updates a hash after GameState::apply() turned before into after, in
+// time proportional to the number of cells that changed
+uint64_t zobristUpdate(uint64_t hash, const GameState& before, const GameState& after);
+
+#endif
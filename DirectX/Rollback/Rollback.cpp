@@ -0,0 +1,409 @@
+// ----------------------------------------------------------------------------
+//  Rollback test
+//
+//  Plays a versus game between two rollback peers in this process, over
+//  loopback sockets made to act like a worse network, and checks that
+//  both peers end up with the same game as one played straight through
+//  on the real inputs. Reports how often and how far they rolled back,
+//  and how long a tick took with the rollbacks in it.
+//
+//    Rollback [options]
+//
+//  Options:
+//    --seconds T      Seconds to play (default 10)
+//    --latency L      One way latency in milliseconds (default 40)
+//    --jitter J       Most milliseconds the latency varies by (default 10)
+//    --loss P         Percent of packets lost (default 5)
+//    --duplicates P   Percent of packets sent twice (default 1)
+//    --delay D        Ticks of input delay (default 2)
+//    --rollback R     Most ticks played ahead of the remote inputs (default 8)
+//    --seed S         Seed of the game and the inputs (default 1)
+//    --attack A       Garbage rules: classic, modern, or rows for 1-4
+//    --bench          Time saving and restoring the game instead
+// ----------------------------------------------------------------------------
+
+#include "NetworkEmulator.h"
+#include "RollbackSession.h"
+
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+#include <vector>
+
+// First port tried for the peers' sockets
+#define FIRST_PORT 7480
+
+// Chance out of 100 a peer keeps pressing what it pressed last tick,
+// which is what makes guessing the remote input worth it
+#define INPUT_PERSISTENCE 85
+
+// Saves and restores timed by --bench
+#define BENCH_COPIES 1000000
+
+// Settings of a run, from the command line
+struct RollbackOptions
+{
+	RollbackSettings session;
+	NetworkConditions network;
+	int seconds;
+	bool bench;
+};
+
+// One side of the game: its session, its socket onto the emulated
+// network, and the inputs it made
+struct Peer
+{
+	RollbackSession* session;
+	DatagramSocket socket;
+	NetworkEmulator* emulator;
+	NetAddress remote;
+	Random random;
+	int input;					// Pressed last tick
+	std::vector<uint8_t> made;	// Every input, by the tick it plays
+	double advanceSeconds;
+	double worstAdvance;
+	uint64_t advances;
+};
+
+// Writes how to run the test
+static void printUsage()
+{
+	fprintf(stderr,
+		"Usage: Rollback [options]\n"
+		"  --seconds T      seconds to play (default 10)\n"
+		"  --latency L      one way latency in ms (default 40)\n"
+		"  --jitter J       most ms the latency varies by (default 10)\n"
+		"  --loss P         percent of packets lost (default 5)\n"
+		"  --duplicates P   percent of packets sent twice (default 1)\n"
+		"  --delay D        ticks of input delay (default %d)\n"
+		"  --rollback R     most ticks ahead of the remote inputs (default %d, at most %d)\n"
+		"  --seed S         seed of the game and the inputs (default 1)\n"
+		"  --attack A       classic, modern or rows for 1-4 lines as a,b,c,d (default classic)\n"
+		"  --bench          time saving and restoring the game\n",
+		DEFAULT_INPUT_DELAY_TICKS, DEFAULT_MAX_ROLLBACK, MAX_ROLLBACK_LIMIT);
+}
+
+// Reads the command line, returning false if it doesn't make sense
+static bool parseOptions(int argc, char** argv, RollbackOptions& options)
+{
+	setDefaultRollback(options.session);
+	options.network.latency = 40;
+	options.network.jitter = 10;
+	options.network.loss = 0.05;
+	options.network.duplicates = 0.01;
+	options.seconds = 10;
+	options.bench = false;
+	for (int i = 1; i < argc; i++)
+	{
+		const char* arg = argv[i];
+		if (strcmp(arg, "--bench") == 0)
+		{
+			options.bench = true;
+			continue;
+		}
+		if (i + 1 >= argc)
+		{
+			return false;
+		}
+		const char* value = argv[++i];
+		if (strcmp(arg, "--seconds") == 0)
+		{
+			options.seconds = atoi(value);
+		}
+		else if (strcmp(arg, "--latency") == 0)
+		{
+			options.network.latency = atoi(value);
+		}
+		else if (strcmp(arg, "--jitter") == 0)
+		{
+			options.network.jitter = atoi(value);
+		}
+		else if (strcmp(arg, "--loss") == 0)
+		{
+			options.network.loss = atof(value) / 100;
+		}
+		else if (strcmp(arg, "--duplicates") == 0)
+		{
+			options.network.duplicates = atof(value) / 100;
+		}
+		else if (strcmp(arg, "--delay") == 0)
+		{
+			options.session.inputDelay = atoi(value);
+		}
+		else if (strcmp(arg, "--rollback") == 0)
+		{
+			options.session.maxRollback = atoi(value);
+		}
+		else if (strcmp(arg, "--seed") == 0)
+		{
+			options.session.seed = strtoull(value, NULL, 10);
+		}
+		else if (strcmp(arg, "--attack") == 0)
+		{
+			if (!parseAttackTable(value, options.session.attack))
+			{
+				return false;
+			}
+		}
+		else
+		{
+			return false;
+		}
+	}
+	return options.seconds > 0 && options.network.latency >= 0 && options.network.jitter >= 0 &&
+		options.network.loss >= 0 && options.network.loss < 1 && options.session.inputDelay >= 0 &&
+		options.session.inputDelay <= MAX_ROLLBACK_LIMIT && options.session.maxRollback > 0 &&
+		options.session.maxRollback <= MAX_ROLLBACK_LIMIT;
+}
+
+// Times saving and restoring the game as a rollback does, against
+// playing a tick of it
+static void runBench(const RollbackOptions& options)
+{
+	printf("A saved game is %u bytes\n", (unsigned)sizeof(VersusSimulation));
+
+	VersusSimulation* saved = new VersusSimulation[ROLLBACK_HISTORY];
+	VersusSimulation game(options.session.seed, options.session.attack);
+	Random random;
+	random.seed(options.session.seed);
+	int inputs[VERSUS_PLAYERS] = { 0, 0 };
+	for (int i = 0; i < 600; i++)
+	{
+		inputs[0] = random.nextInt(INPUT_DROP);
+		inputs[1] = random.nextInt(INPUT_DROP);
+		game.tick(inputs);
+	}
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (int i = 0; i < BENCH_COPIES; i++)
+	{
+		saved[i % ROLLBACK_HISTORY] = game;
+	}
+	double saveSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	start = std::chrono::steady_clock::now();
+	for (int i = 0; i < BENCH_COPIES; i++)
+	{
+		game = saved[(i * 7) % ROLLBACK_HISTORY];
+	}
+	double loadSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	start = std::chrono::steady_clock::now();
+	int ticks = BENCH_COPIES / 10;
+	for (int i = 0; i < ticks; i++)
+	{
+		inputs[0] = random.nextInt(INPUT_DROP);
+		inputs[1] = random.nextInt(INPUT_DROP);
+		game.tick(inputs);
+	}
+	double tickSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	printf("save %.1f ns, restore %.1f ns, tick %.1f ns (checksum %016llx)\n", 1e9 * saveSeconds / BENCH_COPIES,
+		1e9 * loadSeconds / BENCH_COPIES, 1e9 * tickSeconds / ticks, (unsigned long long)game.getChecksum());
+	delete[] saved;
+}
+
+// Makes a peer's input for its next tick: mostly what it pressed last,
+// as a player holding a key would, and otherwise a new random one
+static int makeInput(Peer& peer)
+{
+	if (peer.random.nextInt(100) < INPUT_PERSISTENCE)
+	{
+		peer.input &= ~(INPUT_DROP | INPUT_HOLD);
+		return peer.input;
+	}
+	int roll = peer.random.nextInt(100);
+	peer.input = roll < 5 ? INPUT_DROP : roll < 25 ? INPUT_LEFT : roll < 45 ? INPUT_RIGHT :
+		roll < 60 ? INPUT_ROTATE : roll < 75 ? INPUT_FAST_FALL : 0;
+	return peer.input;
+}
+
+// Opens a peer's socket on the first free loopback port from the one given
+static bool openPeer(Peer& peer, uint16_t port)
+{
+	for (int i = 0; i < 100; i++)
+	{
+		if (peer.socket.bind((uint16_t)(port + i), "127.0.0.1"))
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+// Reads what arrived for a peer, plays its next tick if it can, and
+// sends its inputs onto the emulated network
+static void stepPeer(Peer& peer, DatagramBatch& batch)
+{
+	int received;
+	while ((received = peer.socket.receive(batch)) > 0)
+	{
+		for (int i = 0; i < received; i++)
+		{
+			peer.session->readPacket(batch.data[i], batch.sizes[i]);
+		}
+	}
+
+	// Waits a tick now and then if it's running ahead of the peer
+	bool ahead = peer.session->getTickAdvantage() > 1 && peer.session->getTick() % 4 == 0;
+	if (!ahead && peer.session->canAdvance())
+	{
+		int input = makeInput(peer);
+		peer.session->addLocalInput(input);
+		peer.made.push_back((uint8_t)input);
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		peer.session->advance();
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		peer.advanceSeconds += seconds;
+		peer.worstAdvance = seconds > peer.worstAdvance ? seconds : peer.worstAdvance;
+		peer.advances++;
+	}
+	else if (!ahead)
+	{
+		peer.session->advance();
+	}
+
+	uint8_t packet[MAX_NETPLAY_PACKET];
+	int size = peer.session->writePacket(packet);
+	peer.emulator->send(peer.remote, packet, size);
+	peer.emulator->flush();
+}
+
+// Plays the reference game on to the tick both peers have confirmed,
+// checking theirs matched it at the start of every tick on the way.
+// Returns the ticks that didn't match.
+static uint64_t checkPeers(Peer* peers, VersusSimulation& reference, VersusSimulation& state, uint64_t& checked)
+{
+	uint32_t confirmed = peers[0].session->getConfirmedTick();
+	uint32_t other = peers[1].session->getConfirmedTick();
+	confirmed = confirmed < other ? confirmed : other;
+
+	uint64_t desyncs = 0;
+	while (reference.getTick() < confirmed)
+	{
+		uint32_t tick = reference.getTick();
+		uint64_t checksum = reference.getChecksum();
+		for (int p = 0; p < VERSUS_PLAYERS; p++)
+		{
+			if (peers[p].session->getState(tick, state))
+			{
+				desyncs += state.getChecksum() != checksum ? 1 : 0;
+				checked++;
+			}
+		}
+		int inputs[VERSUS_PLAYERS];
+		for (int p = 0; p < VERSUS_PLAYERS; p++)
+		{
+			inputs[p] = peers[p].made[tick];
+		}
+		reference.tick(inputs);
+	}
+	return desyncs;
+}
+
+// Plays the game between two peers for the seconds asked and reports
+// how it went. Returns false if the peers' games ever differed.
+static bool runPeers(const RollbackOptions& options)
+{
+	if (!Socket::startup())
+	{
+		fprintf(stderr, "Couldn't start networking\n");
+		return false;
+	}
+
+	Peer peers[VERSUS_PLAYERS];
+	for (int p = 0; p < VERSUS_PLAYERS; p++)
+	{
+		Peer& peer = peers[p];
+		RollbackSettings settings = options.session;
+		settings.localPlayer = p;
+		peer.session = new RollbackSession(settings);
+		if (!openPeer(peer, (uint16_t)(FIRST_PORT + p * 100)))
+		{
+			fprintf(stderr, "Couldn't open a loopback port\n");
+			return false;
+		}
+		peer.emulator = new NetworkEmulator(peer.socket, options.network, options.session.seed * 2 + p);
+		peer.random.seed(options.session.seed + 1000 + p);
+		peer.input = 0;
+
+		// The ticks before the delay play no inputs
+		peer.made.assign(settings.inputDelay, 0);
+		peer.advanceSeconds = 0;
+		peer.worstAdvance = 0;
+		peer.advances = 0;
+	}
+	for (int p = 0; p < VERSUS_PLAYERS; p++)
+	{
+		resolveAddress("127.0.0.1", peers[1 - p].socket.getPort(), peers[p].remote);
+	}
+	printf("Playing %d s at %d ms +-%d ms with %.1f%% lost, %d ticks of delay, rollback up to %d\n", options.seconds,
+		options.network.latency, options.network.jitter, 100 * options.network.loss, options.session.inputDelay,
+		options.session.maxRollback);
+
+	DatagramBatch* batch = new DatagramBatch();
+	VersusSimulation* state = new VersusSimulation();
+	VersusSimulation reference(options.session.seed, options.session.attack);
+	uint64_t desyncs = 0;
+	uint64_t checked = 0;
+	std::chrono::steady_clock::duration period = std::chrono::nanoseconds(1000000000LL / TICKS_PER_SECOND);
+	std::chrono::steady_clock::time_point next = std::chrono::steady_clock::now();
+	int ticks = options.seconds * TICKS_PER_SECOND;
+	for (int i = 0; i < ticks; i++)
+	{
+		for (int p = 0; p < VERSUS_PLAYERS; p++)
+		{
+			stepPeer(peers[p], *batch);
+		}
+		desyncs += checkPeers(peers, reference, *state, checked);
+		next += period;
+		std::this_thread::sleep_until(next);
+	}
+
+	printf("\n%6s %7s %9s %10s %8s %7s %8s %8s %9s %9s\n", "player", "ticks", "rollbacks", "resimulated", "deepest",
+		"stalls", "wrong", "packets", "mean us", "worst us");
+	for (int p = 0; p < VERSUS_PLAYERS; p++)
+	{
+		const RollbackStats& stats = peers[p].session->getStats();
+		printf("%6d %7u %9llu %10llu %8u %7llu %8llu %8llu %9.1f %9.1f\n", p, peers[p].session->getTick(),
+			(unsigned long long)stats.rollbacks, (unsigned long long)stats.resimulated, stats.deepestRollback,
+			(unsigned long long)stats.stalls, (unsigned long long)stats.mispredicted, (unsigned long long)stats.packetsRead,
+			peers[p].advances > 0 ? 1e6 * peers[p].advanceSeconds / peers[p].advances : 0, 1e6 * peers[p].worstAdvance);
+	}
+	for (int p = 0; p < VERSUS_PLAYERS; p++)
+	{
+		printf("player %d sent %llu packets, lost %llu, duplicated %llu\n", p,
+			(unsigned long long)peers[p].emulator->getSent(), (unsigned long long)peers[p].emulator->getLost(),
+			(unsigned long long)peers[p].emulator->getDuplicated());
+	}
+	printf("%u ticks confirmed, %llu states checked, %llu desyncs, %u games, wins %u-%u\n", reference.getTick(),
+		(unsigned long long)checked, (unsigned long long)desyncs, reference.getGames(), reference.getWins(0),
+		reference.getWins(1));
+
+	delete state;
+	delete batch;
+	for (int p = 0; p < VERSUS_PLAYERS; p++)
+	{
+		delete peers[p].emulator;
+		delete peers[p].session;
+	}
+	return desyncs == 0;
+}
+
+int main(int argc, char** argv)
+{
+	RollbackOptions options;
+	if (!parseOptions(argc, argv, options))
+	{
+		printUsage();
+		return 1;
+	}
+	if (options.bench)
+	{
+		runBench(options);
+		return 0;
+	}
+	return runPeers(options) ? 0 : 1;
+}
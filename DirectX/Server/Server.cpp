@@ -0,0 +1,285 @@
+// ----------------------------------------------------------------------------
+//  Game server
+//
+//  Hosts thousands of games at once: clients send their inputs over UDP,
+//  the server plays every game itself at the fixed tick rate and sends
+//  each client its game's state. Runs an event loop per core, each on
+//  its own port. Also load-tests a server with many simulated clients
+//  from the same machine.
+//
+//    Server [options]
+//
+//  Options:
+//    --port P         Port of the first loop, loop i uses P + i (default 7360)
+//    --loops L        Event loops, 0 for one per core (default 0)
+//    --sessions S     Sessions each loop has room for (default 8192)
+//    --interval I     Ticks between states sent to a client (default 3)
+//    --pin            Keep each loop on a core of its own
+//    --seconds T      Stop after T seconds, 0 to run until killed
+//                     (default 0, or 10 when load testing)
+//
+//  Load testing:
+//    --load N         Play N sessions against a server instead of being one
+//    --host H         Server to test (default 127.0.0.1)
+//    --threads N      Client threads, 0 for one per core (default 0)
+//    --delay D        Ticks ahead inputs are sent (default 4)
+//    --redundancy R   Inputs resent in each packet (default 4)
+//    --local          Also run the server in this process
+// ----------------------------------------------------------------------------
+
+#include "GameServer.h"
+#include "LoadTester.h"
+
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+
+// Settings of a run, from the command line
+struct ServerOptions
+{
+	ServerSettings server;
+	LoadSettings load;
+	int seconds;		// -1 for the default of the mode
+	bool loadTest;
+	bool local;
+};
+
+// Writes how to run the server
+static void printUsage()
+{
+	fprintf(stderr,
+		"Usage: Server [options]\n"
+		"  --port P         port of the first loop (default %d)\n"
+		"  --loops L        event loops, 0 for one per core (default 0)\n"
+		"  --sessions S     sessions per loop (default %d)\n"
+		"  --interval I     ticks between states sent (default %d)\n"
+		"  --pin            keep each loop on its own core\n"
+		"  --seconds T      stop after T seconds, 0 to run until killed\n"
+		"  --load N         load-test a server with N sessions\n"
+		"  --host H         server to test (default 127.0.0.1)\n"
+		"  --threads N      client threads, 0 for one per core (default 0)\n"
+		"  --delay D        ticks ahead inputs are sent (default %d)\n"
+		"  --redundancy R   inputs resent in each packet (default %d)\n"
+		"  --local          also run the server in this process\n",
+		DEFAULT_SERVER_PORT, DEFAULT_LOOP_SESSIONS, DEFAULT_STATE_INTERVAL, DEFAULT_INPUT_DELAY, DEFAULT_INPUT_REDUNDANCY);
+}
+
+// Reads the command line, returning false if it doesn't make sense
+static bool parseOptions(int argc, char** argv, ServerOptions& options)
+{
+	setDefaultServer(options.server);
+	setDefaultLoad(options.load);
+	options.seconds = -1;
+	options.loadTest = false;
+	options.local = false;
+	for (int i = 1; i < argc; i++)
+	{
+		const char* arg = argv[i];
+		if (strcmp(arg, "--pin") == 0)
+		{
+			options.server.pin = true;
+			continue;
+		}
+		if (strcmp(arg, "--local") == 0)
+		{
+			options.local = true;
+			continue;
+		}
+		if (i + 1 >= argc)
+		{
+			return false;
+		}
+		const char* value = argv[++i];
+		if (strcmp(arg, "--port") == 0)
+		{
+			options.server.port = (uint16_t)atoi(value);
+		}
+		else if (strcmp(arg, "--loops") == 0)
+		{
+			options.server.loops = atoi(value);
+		}
+		else if (strcmp(arg, "--sessions") == 0)
+		{
+			options.server.sessions = atoi(value);
+		}
+		else if (strcmp(arg, "--interval") == 0)
+		{
+			options.server.stateInterval = atoi(value);
+		}
+		else if (strcmp(arg, "--seconds") == 0)
+		{
+			options.seconds = atoi(value);
+		}
+		else if (strcmp(arg, "--load") == 0)
+		{
+			options.loadTest = true;
+			options.load.sessions = atoi(value);
+		}
+		else if (strcmp(arg, "--host") == 0)
+		{
+			options.load.host = value;
+		}
+		else if (strcmp(arg, "--threads") == 0)
+		{
+			options.load.threads = atoi(value);
+		}
+		else if (strcmp(arg, "--delay") == 0)
+		{
+			options.load.inputDelay = atoi(value);
+		}
+		else if (strcmp(arg, "--redundancy") == 0)
+		{
+			options.load.redundancy = atoi(value);
+		}
+		else
+		{
+			return false;
+		}
+	}
+	options.load.port = options.server.port;
+	if (options.seconds < 0)
+	{
+		options.seconds = options.loadTest ? 10 : 0;
+	}
+	return options.server.port > 0 && options.server.loops >= 0 && options.server.sessions > 0 &&
+		options.server.stateInterval > 0 && (!options.loadTest || options.load.sessions > 0) &&
+		(!options.local || options.loadTest);
+}
+
+// Writes a line of the server's counts over the last second
+static void printServerLine(int second, const LoopStats& now, const LoopStats& last, int loops)
+{
+	printf("%5d %9u %7llu %11llu %9llu %9llu %6.1f%% %8.2f %7llu %8llu %5llu %6llu\n", second, now.sessions,
+		(unsigned long long)(now.ticks - last.ticks) / loops, (unsigned long long)(now.sessionTicks - last.sessionTicks),
+		(unsigned long long)(now.received - last.received), (unsigned long long)(now.sent - last.sent),
+		100 * (now.busySeconds - last.busySeconds) / loops, 1000 * now.worstTick,
+		(unsigned long long)(now.lateInputs - last.lateInputs), (unsigned long long)(now.missedInputs - last.missedInputs),
+		(unsigned long long)(now.badPackets - last.badPackets), (unsigned long long)now.overruns);
+}
+
+// Writes a line of the load test's counts over the last second
+static void printLoadLine(int second, const LoadStats& now, const LoadStats& last)
+{
+	LoadStats window;
+	memset(&window, 0, sizeof(window));
+	for (int i = 0; i < LATENCY_BUCKETS; i++)
+	{
+		window.latencies[i] = now.latencies[i] - last.latencies[i];
+	}
+	printf("%5d %9u %9llu %9llu %9llu %6llu %8.2f %8.2f\n", second, now.playing,
+		(unsigned long long)(now.sent - last.sent), (unsigned long long)(now.received - last.received),
+		(unsigned long long)(now.states - last.states), (unsigned long long)(now.games - last.games),
+		window.getLatency(0.5), window.getLatency(0.99));
+}
+
+// Writes how many sessions a core could play at 60 Hz, going by how
+// busy the loops were for the sessions they had
+static void printCapacity(const LoopStats& total)
+{
+	if (total.busySeconds <= 0 || total.ticks == 0)
+	{
+		return;
+	}
+	double sessionsPerLoop = (double)total.sessionTicks / total.ticks;
+	double busyPerTick = total.busySeconds / total.ticks;
+	printf("\n%.0f sessions per loop on average, %.3f ms of work per tick, about %.0f sessions per core at %d Hz\n",
+		sessionsPerLoop, 1000 * busyPerTick, sessionsPerLoop / (busyPerTick * TICKS_PER_SECOND), TICKS_PER_SECOND);
+	printf("%llu joins, %llu refused, %llu leaves, %llu timeouts, %llu late inputs, %llu missed, %llu bad packets, %llu overruns\n",
+		(unsigned long long)total.joins, (unsigned long long)total.refused, (unsigned long long)total.leaves,
+		(unsigned long long)total.timeouts, (unsigned long long)total.lateInputs, (unsigned long long)total.missedInputs,
+		(unsigned long long)total.badPackets, (unsigned long long)total.overruns);
+}
+
+int main(int argc, char** argv)
+{
+	ServerOptions options;
+	if (!parseOptions(argc, argv, options))
+	{
+		printUsage();
+		return 1;
+	}
+
+	GameServer server(options.server);
+	if (!options.loadTest || options.local)
+	{
+		if (!server.start())
+		{
+			fprintf(stderr, "Couldn't open ports %d onwards\n", options.server.port);
+			return 1;
+		}
+		printf("Serving on ports %u-%u with %d loops of %d sessions, states every %d ticks\n", server.getPort(0),
+			server.getPort(server.getLoops() - 1), server.getLoops(), options.server.sessions, options.server.stateInterval);
+		options.load.loops = server.getLoops();
+	}
+	else
+	{
+		options.load.loops = options.server.loops > 0 ? options.server.loops : 1;
+	}
+
+	LoadTester tester(options.load);
+	if (options.loadTest)
+	{
+		if (!tester.start())
+		{
+			fprintf(stderr, "Couldn't reach %s\n", options.load.host);
+			return 1;
+		}
+		printf("Playing %d sessions against %s:%d-%d from %d threads\n", options.load.sessions, options.load.host,
+			options.load.port, options.load.port + options.load.loops - 1, tester.getThreads());
+	}
+
+	if (options.loadTest)
+	{
+		printf("\n%5s %9s %9s %9s %9s %6s %8s %8s\n", "s", "playing", "sent", "received", "states", "games", "p50 ms", "p99 ms");
+	}
+	else
+	{
+		printf("\n%5s %9s %7s %11s %9s %9s %7s %8s %7s %8s %5s %6s\n", "s", "sessions", "ticks", "game ticks",
+			"received", "sent", "busy", "worst ms", "late", "missed", "bad", "overrun");
+	}
+
+	LoopStats lastServer;
+	LoadStats* lastLoad = new LoadStats();
+	server.getStats(lastServer);
+	tester.getStats(*lastLoad);
+	LoadStats* load = new LoadStats();
+	std::chrono::steady_clock::time_point next = std::chrono::steady_clock::now();
+	for (int second = 1; options.seconds == 0 || second <= options.seconds; second++)
+	{
+		next += std::chrono::seconds(1);
+		std::this_thread::sleep_until(next);
+		if (options.loadTest)
+		{
+			tester.getStats(*load);
+			printLoadLine(second, *load, *lastLoad);
+			*lastLoad = *load;
+		}
+		else
+		{
+			LoopStats stats;
+			server.getStats(stats);
+			printServerLine(second, stats, lastServer, server.getLoops());
+			lastServer = stats;
+		}
+		fflush(stdout);
+	}
+
+	tester.stop();
+	if (options.loadTest)
+	{
+		printf("\nround trip p50 %.2f ms, p90 %.2f ms, p99 %.2f ms over %llu inputs, %llu games finished, %llu refused\n",
+			load->getLatency(0.5), load->getLatency(0.9), load->getLatency(0.99),
+			(unsigned long long)load->getLatencyCount(), (unsigned long long)load->games, (unsigned long long)load->refused);
+	}
+	if (server.getLoops() > 0)
+	{
+		LoopStats total;
+		server.getStats(total);
+		printCapacity(total);
+	}
+	delete load;
+	delete lastLoad;
+	return 0;
+}
@@ -0,0 +1,514 @@
+// ----------------------------------------------------------------------------
+//  Headless simulator
+//
+//  Plays many games without a window across every core and reports how
+//  fast they ran and how they went, for checking rule changes and catching
+//  throughput regressions. Games are either played by a bot from fixed
+//  seeds, so a run is the same every time, or read back from replays.
+//
+//    Simulator [options] [replay files...]
+//
+//  Options:
+//    --games K        Bot games to play (default 1000)
+//    --seed S         Seed of the first game, game i uses S + i (default 1)
+//    --threads N      Threads to use, 0 for one per core (default 0)
+//    --mode M         tick: full rules tick by tick (default)
+//                     placement: a placement at a time, much faster
+//    --width W        Beam width of the bot (default 8)
+//    --depth D        Placements the bot looks ahead (default 2)
+//    --pieces P       Most blocks placed in a game (default 1000)
+//    --weights W      Bot feature weights in BoardFeature order, comma
+//                     separated, optionally followed by the score weight,
+//                     as printed by the Tuner
+//
+//  With replay files given, plays each of them instead of bot games.
+//  Files ending in .3dra are read as keyframed archives, the others as
+//  input replays.
+//    --at T           Stop each replay at tick T; archives seek straight
+//                     to the keyframe before it
+//    --convert        Write each input replay out as an archive next to
+//                     it, with a keyframe every 600 ticks, then play it
+//
+//  Large runs can be spread over processes and machines:
+//    --coordinate P   Hand the games out to workers connecting on port P
+//                     instead of playing them, and merge their results
+//    --chunk C        Games per range handed to a worker (default 1000)
+//    --spawn N        Also start N local workers, each with --threads
+//    --timeout T      Seconds before a silent worker's ranges are handed
+//                     to others (default 300)
+//    --worker H:P     Play games for the coordinator at host H, port P
+// ----------------------------------------------------------------------------
+
+#include "HeadlessRunner.h"
+#include "SimulationCoordinator.h"
+#include "WorkStealingPool.h"
+
+#include <atomic>
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+// Settings of a run, from the command line
+struct SimulatorOptions
+{
+	int64_t games;
+	uint64_t seed;
+	int threads;
+	BotSettings bot;
+	std::vector<std::string> replays;
+	uint32_t stopTick;		// Tick replays stop at
+	bool convert;
+	int coordinatePort;		// -1 to play the games here
+	uint64_t chunk;
+	int spawn;
+	int timeout;
+	std::string worker;		// Coordinator to work for, if any
+};
+
+// Extension of the files read as replay archives
+#define ARCHIVE_EXTENSION ".3dra"
+
+// Checks whether a path ends in the given extension
+static bool hasExtension(const std::string& path, const char* extension)
+{
+	size_t length = strlen(extension);
+	return path.size() >= length && path.compare(path.size() - length, length, extension) == 0;
+}
+
+// Retrieves the path an input replay is converted to
+static std::string getArchivePath(const std::string& path)
+{
+	size_t dot = path.rfind('.');
+	size_t slash = path.find_last_of("/\\");
+	bool hasDot = dot != std::string::npos && (slash == std::string::npos || dot > slash);
+	return (hasDot ? path.substr(0, dot) : path) + ARCHIVE_EXTENSION;
+}
+
+// Plays one replay per index, with a player and an archive reader per
+// thread, stopping each at the same tick
+class ReplayJob : public PoolJob
+{
+public:
+	ReplayJob(const std::vector<std::string>& paths, int threads, uint32_t stopTick, bool convert)
+		: paths(paths), stopTick(stopTick), convert(convert)
+	{
+		for (int i = 0; i < threads; i++)
+		{
+			players.push_back(new ReplayPlayer());
+			archives.push_back(new ReplayArchive());
+		}
+		results.resize(paths.size());
+		loaded.resize(paths.size());
+		failed = 0;
+	}
+
+	~ReplayJob()
+	{
+		for (size_t i = 0; i < players.size(); i++)
+		{
+			delete players[i];
+			delete archives[i];
+		}
+	}
+
+	void runItem(int thread, int64_t index)
+	{
+		const std::string& path = paths[(size_t)index];
+		bool archived = hasExtension(path, ARCHIVE_EXTENSION);
+		if (!archived && convert)
+		{
+			std::string archivePath = getArchivePath(path);
+			if (!ReplayArchiveWriter::convert(path.c_str(), archivePath.c_str()))
+			{
+				fprintf(stderr, "Couldn't convert replay %s\n", path.c_str());
+				failed++;
+				return;
+			}
+			playItem(thread, index, archivePath, true);
+			return;
+		}
+		playItem(thread, index, path, archived);
+	}
+
+	// Adds up the results, leaving out replays that couldn't be read
+	void summarize(ResultSummary& summary) const
+	{
+		for (size_t i = 0; i < results.size(); i++)
+		{
+			if (loaded[i])
+			{
+				summary.add(results[i]);
+			}
+		}
+	}
+
+	int getFailed() const { return failed; }
+
+private:
+	const std::vector<std::string>& paths;
+	uint32_t stopTick;
+	bool convert;
+	std::vector<ReplayPlayer*> players;
+	std::vector<ReplayArchive*> archives;
+	std::vector<GameResult> results;
+	std::vector<char> loaded;
+	std::atomic<int> failed;
+
+	// Plays a replay or an archive up to the stopping tick
+	void playItem(int thread, int64_t index, const std::string& path, bool archived)
+	{
+		bool read;
+		if (archived)
+		{
+			ReplayArchive& archive = *archives[thread];
+			read = archive.open(path.c_str()) && playArchive(archive, results[(size_t)index], stopTick);
+			archive.close();
+		}
+		else
+		{
+			ReplayPlayer& player = *players[thread];
+			read = player.load(path.c_str());
+			if (read)
+			{
+				results[(size_t)index] = playReplay(player, stopTick);
+			}
+		}
+		loaded[(size_t)index] = read;
+		if (!read)
+		{
+			fprintf(stderr, "Couldn't read replay %s\n", path.c_str());
+			failed++;
+		}
+	}
+};
+
+// Writes how to run the simulator
+static void printUsage()
+{
+	fprintf(stderr,
+		"Usage: Simulator [options] [replay files...]\n"
+		"  --games K        bot games to play (default 1000)\n"
+		"  --seed S         seed of the first game (default 1)\n"
+		"  --threads N      threads, 0 for one per core (default 0)\n"
+		"  --mode M         tick or placement (default tick)\n"
+		"  --width W        bot beam width (default %d)\n"
+		"  --depth D        bot look ahead (default %d)\n"
+		"  --pieces P       most blocks per game (default %d)\n"
+		"  --weights W      bot feature weights, comma separated, then the\n"
+		"                   score weight (default the built-in ones)\n"
+		"  --at T           stop each replay at tick T\n"
+		"  --convert        write input replays out as .3dra archives\n"
+		"  --coordinate P   hand the games to workers connecting on port P\n"
+		"  --chunk C        games per range handed out (default %d)\n"
+		"  --spawn N        also start N local workers\n"
+		"  --timeout T      seconds before a silent worker is dropped (default %d)\n"
+		"  --worker H:P     play games for the coordinator at H:P\n",
+		BOT_WIDTH, BOT_DEPTH, DEFAULT_MAX_PIECES, DEFAULT_CHUNK_GAMES, DEFAULT_WORKER_TIMEOUT);
+}
+
+// Reads comma-separated feature weights in BoardFeature order, then
+// optionally the score weight
+static bool parseWeights(const char* text, BotSettings& bot)
+{
+	int32_t values[NUM_FEATURES + 1];
+	int count = 0;
+	while (true)
+	{
+		char* end;
+		long value = strtol(text, &end, 10);
+		if (end == text || count > NUM_FEATURES || (*end != ',' && *end != '\0'))
+		{
+			return false;
+		}
+		values[count++] = (int32_t)value;
+		if (*end == '\0')
+		{
+			break;
+		}
+		text = end + 1;
+	}
+	if (count < NUM_FEATURES)
+	{
+		return false;
+	}
+	for (int i = 0; i < NUM_FEATURES; i++)
+	{
+		bot.weights[i] = values[i];
+	}
+	if (count > NUM_FEATURES)
+	{
+		bot.scoreWeight = values[NUM_FEATURES];
+	}
+	return true;
+}
+
+// Reads the command line, returning false if it doesn't make sense
+static bool parseOptions(int argc, char** argv, SimulatorOptions& options)
+{
+	options.games = 1000;
+	options.seed = 1;
+	options.threads = 0;
+	setDefaultBot(options.bot);
+	options.coordinatePort = -1;
+	options.chunk = DEFAULT_CHUNK_GAMES;
+	options.spawn = 0;
+	options.timeout = DEFAULT_WORKER_TIMEOUT;
+	options.stopTick = UINT32_MAX;
+	options.convert = false;
+	for (int i = 1; i < argc; i++)
+	{
+		const char* arg = argv[i];
+		if (strncmp(arg, "--", 2) != 0)
+		{
+			options.replays.push_back(arg);
+			continue;
+		}
+		if (strcmp(arg, "--convert") == 0)
+		{
+			options.convert = true;
+			continue;
+		}
+		if (i + 1 >= argc)
+		{
+			return false;
+		}
+		const char* value = argv[++i];
+		if (strcmp(arg, "--games") == 0)
+		{
+			options.games = strtoll(value, NULL, 10);
+		}
+		else if (strcmp(arg, "--seed") == 0)
+		{
+			options.seed = strtoull(value, NULL, 10);
+		}
+		else if (strcmp(arg, "--threads") == 0)
+		{
+			options.threads = atoi(value);
+		}
+		else if (strcmp(arg, "--mode") == 0 && (strcmp(value, "tick") == 0 || strcmp(value, "placement") == 0))
+		{
+			options.bot.placements = strcmp(value, "placement") == 0;
+		}
+		else if (strcmp(arg, "--width") == 0)
+		{
+			options.bot.width = atoi(value);
+		}
+		else if (strcmp(arg, "--depth") == 0)
+		{
+			options.bot.depth = atoi(value);
+		}
+		else if (strcmp(arg, "--pieces") == 0)
+		{
+			options.bot.pieces = (uint32_t)strtoul(value, NULL, 10);
+		}
+		else if (strcmp(arg, "--weights") == 0)
+		{
+			if (!parseWeights(value, options.bot))
+			{
+				return false;
+			}
+		}
+		else if (strcmp(arg, "--coordinate") == 0)
+		{
+			options.coordinatePort = atoi(value);
+		}
+		else if (strcmp(arg, "--chunk") == 0)
+		{
+			options.chunk = strtoull(value, NULL, 10);
+		}
+		else if (strcmp(arg, "--spawn") == 0)
+		{
+			options.spawn = atoi(value);
+		}
+		else if (strcmp(arg, "--timeout") == 0)
+		{
+			options.timeout = atoi(value);
+		}
+		else if (strcmp(arg, "--at") == 0)
+		{
+			options.stopTick = (uint32_t)strtoul(value, NULL, 10);
+		}
+		else if (strcmp(arg, "--worker") == 0 && strchr(value, ':') != NULL)
+		{
+			options.worker = value;
+		}
+		else
+		{
+			return false;
+		}
+	}
+	return options.games > 0 && options.bot.width > 0 && options.bot.depth > 0 && options.bot.pieces > 0 &&
+		options.coordinatePort < 65536 && options.chunk > 0 && options.spawn >= 0 && options.timeout > 0 &&
+		(options.replays.empty() || (options.coordinatePort < 0 && options.worker.empty())) &&
+		(!options.convert || !options.replays.empty());
+}
+
+#ifdef _WIN32
+typedef HANDLE WorkerProcess;
+#else
+typedef pid_t WorkerProcess;
+#endif
+
+// Starts this program again as a worker for a coordinator on this machine
+static bool spawnWorker(const char* program, uint16_t port, int threads, WorkerProcess& process)
+{
+	char address[32];
+	char threadCount[16];
+	snprintf(address, sizeof(address), "127.0.0.1:%u", port);
+	snprintf(threadCount, sizeof(threadCount), "%d", threads);
+#ifdef _WIN32
+	char path[MAX_PATH];
+	GetModuleFileNameA(NULL, path, MAX_PATH);
+	std::string command = std::string("\"") + path + "\" --worker " + address + " --threads " + threadCount;
+	STARTUPINFOA startup;
+	PROCESS_INFORMATION info;
+	ZeroMemory(&startup, sizeof(startup));
+	startup.cb = sizeof(startup);
+	if (!CreateProcessA(path, &command[0], NULL, NULL, FALSE, 0, NULL, NULL, &startup, &info))
+	{
+		return false;
+	}
+	CloseHandle(info.hThread);
+	process = info.hProcess;
+	return true;
+#else
+	process = fork();
+	if (process == 0)
+	{
+		char* args[] = { (char*)program, (char*)"--worker", address, (char*)"--threads", threadCount, NULL };
+		execv(program, args);
+		_exit(127);
+	}
+	return process > 0;
+#endif
+}
+
+// Waits for a spawned worker to exit
+static void waitWorker(WorkerProcess process)
+{
+#ifdef _WIN32
+	WaitForSingleObject(process, INFINITE);
+	CloseHandle(process);
+#else
+	int status;
+	waitpid(process, &status, 0);
+#endif
+}
+
+// Plays games for a coordinator until it has no more
+static int runWorker(const SimulatorOptions& options)
+{
+	size_t colon = options.worker.rfind(':');
+	std::string host = options.worker.substr(0, colon);
+	uint16_t port = (uint16_t)atoi(options.worker.c_str() + colon + 1);
+	SimulationWorker worker(options.threads);
+	if (!worker.run(host.c_str(), port))
+	{
+		fprintf(stderr, "Lost the coordinator at %s after %llu ranges\n", options.worker.c_str(),
+			(unsigned long long)worker.getRangesPlayed());
+		return 1;
+	}
+	return 0;
+}
+
+// Hands the games out to workers and reports on the merged results
+static int runCoordinator(const SimulatorOptions& options, const char* program)
+{
+	SimulationCoordinator coordinator(options.bot, options.seed, (uint64_t)options.games, options.chunk);
+	if (!coordinator.listen((uint16_t)options.coordinatePort))
+	{
+		fprintf(stderr, "Couldn't listen on port %d\n", options.coordinatePort);
+		return 1;
+	}
+	printf("Handing out %lld %s games from seed %llu in %llu ranges on port %u, beam %dx%d, up to %u pieces\n",
+		(long long)options.games, options.bot.placements ? "placement" : "tick", (unsigned long long)options.seed,
+		(unsigned long long)coordinator.getRanges(), coordinator.getPort(), options.bot.width, options.bot.depth,
+		options.bot.pieces);
+	fflush(stdout);
+
+	std::vector<WorkerProcess> spawned;
+	for (int i = 0; i < options.spawn; i++)
+	{
+		WorkerProcess process;
+		if (spawnWorker(program, coordinator.getPort(), options.threads, process))
+		{
+			spawned.push_back(process);
+		}
+	}
+
+	ResultSummary summary;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	bool done = coordinator.run(summary, options.timeout, stderr);
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	for (size_t i = 0; i < spawned.size(); i++)
+	{
+		waitWorker(spawned[i]);
+	}
+
+	summary.print(stdout, seconds);
+	printf("\nworkers lost %d, ranges handed out again %llu\n", coordinator.getWorkersLost(),
+		(unsigned long long)coordinator.getReassigned());
+	if (!done)
+	{
+		fprintf(stderr, "Gave up with no workers left, the results are partial\n");
+		return 2;
+	}
+	return 0;
+}
+
+int main(int argc, char** argv)
+{
+	SimulatorOptions options;
+	if (!parseOptions(argc, argv, options))
+	{
+		printUsage();
+		return 1;
+	}
+	if (!options.worker.empty())
+	{
+		return runWorker(options);
+	}
+	if (options.coordinatePort >= 0)
+	{
+		return runCoordinator(options, argv[0]);
+	}
+
+	WorkStealingPool pool(options.threads);
+	ResultSummary summary;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	int failed = 0;
+	if (options.replays.empty())
+	{
+		printf("Playing %lld %s games from seed %llu on %d threads, beam %dx%d, up to %u pieces\n",
+			(long long)options.games, options.bot.placements ? "placement" : "tick", (unsigned long long)options.seed,
+			pool.getThreads(), options.bot.width, options.bot.depth, options.bot.pieces);
+		BotGameJob job(options.bot, pool.getThreads());
+		job.setRange(options.seed, (uint64_t)options.games);
+		pool.run(options.games, job);
+		job.summarize(summary);
+	}
+	else
+	{
+		printf("%s %d replays on %d threads\n", options.convert ? "Converting and playing" : "Playing",
+			(int)options.replays.size(), pool.getThreads());
+		ReplayJob job(options.replays, pool.getThreads(), options.stopTick, options.convert);
+		pool.run((int64_t)options.replays.size(), job);
+		job.summarize(summary);
+		failed = job.getFailed();
+	}
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	summary.print(stdout, seconds);
+	printf("\nwork steals %llu\n", (unsigned long long)pool.getSteals());
+	return failed > 0 ? 2 : 0;
+}
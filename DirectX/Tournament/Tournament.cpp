@@ -0,0 +1,175 @@
+// ----------------------------------------------------------------------------
+//  Bot tournament
+//
+//  Plays a round robin of versus matches between registered bots on every
+//  core and rates them with Elo and Glicko-2, for judging a bot change on
+//  thousands of games rather than a handful.
+//
+//    Tournament [options]
+//
+//  Options:
+//    --bots A,B,...   Bots to enter (default greedy,beam-4x2,beam-8x2,beam-16x2)
+//    --rounds R       Matches every pair plays, two games each (default 100)
+//    --seed S         Seed of the first round, round r uses S + r (default 1)
+//    --pieces P       Blocks per player before a game goes to whoever
+//                     sent more garbage (default 500)
+//    --attack A       Garbage rules: classic, modern, or rows for 1-4
+//                     lines as a,b,c,d (default classic)
+//    --threads N      Threads to use, 0 for one per core (default 0)
+//    --list           Lists the registered bots
+// ----------------------------------------------------------------------------
+
+#include "BotTournament.h"
+
+#include <algorithm>
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+
+// Bots entered unless told otherwise: the ones that play the same
+// game every run
+#define DEFAULT_BOTS "greedy,beam-4x2,beam-8x2,beam-16x2"
+
+// Settings of a run, from the command line
+struct TournamentOptions
+{
+	TournamentSettings settings;
+	std::vector<int> bots;
+	int threads;
+	bool list;
+};
+
+// Writes how to run the tournament
+static void printUsage()
+{
+	fprintf(stderr,
+		"Usage: Tournament [options]\n"
+		"  --bots A,B,...   bots to enter (default %s)\n"
+		"  --rounds R       matches every pair plays (default 100)\n"
+		"  --seed S         seed of the first round (default 1)\n"
+		"  --pieces P       blocks per player before garbage sent decides (default %d)\n"
+		"  --attack A       classic, modern or rows for 1-4 lines as a,b,c,d (default classic)\n"
+		"  --threads N      threads, 0 for one per core (default 0)\n"
+		"  --list           list the registered bots\n",
+		DEFAULT_BOTS, VERSUS_MAX_PIECES);
+}
+
+// Looks up comma-separated bot names, returning false if one isn't
+// registered or is named twice
+static bool parseBots(const char* text, std::vector<int>& bots)
+{
+	bots.clear();
+	std::string names = text;
+	size_t start = 0;
+	while (start <= names.size())
+	{
+		size_t end = names.find(',', start);
+		end = end == std::string::npos ? names.size() : end;
+		int bot = findBot(names.substr(start, end - start).c_str());
+		if (bot < 0)
+		{
+			fprintf(stderr, "No bot called %s, see --list\n", names.substr(start, end - start).c_str());
+			return false;
+		}
+		if (std::find(bots.begin(), bots.end(), bot) != bots.end())
+		{
+			return false;
+		}
+		bots.push_back(bot);
+		start = end + 1;
+	}
+	return bots.size() >= 2;
+}
+
+// Reads the command line, returning false if it doesn't make sense
+static bool parseOptions(int argc, char** argv, TournamentOptions& options)
+{
+	options.settings.rounds = 100;
+	options.settings.firstSeed = 1;
+	options.settings.pieces = VERSUS_MAX_PIECES;
+	options.settings.attack = CLASSIC_ATTACK;
+	options.threads = 0;
+	options.list = false;
+	const char* bots = DEFAULT_BOTS;
+	for (int i = 1; i < argc; i++)
+	{
+		const char* arg = argv[i];
+		if (strcmp(arg, "--list") == 0)
+		{
+			options.list = true;
+			continue;
+		}
+		if (i + 1 >= argc)
+		{
+			return false;
+		}
+		const char* value = argv[++i];
+		if (strcmp(arg, "--bots") == 0)
+		{
+			bots = value;
+		}
+		else if (strcmp(arg, "--rounds") == 0)
+		{
+			options.settings.rounds = atoi(value);
+		}
+		else if (strcmp(arg, "--seed") == 0)
+		{
+			options.settings.firstSeed = strtoull(value, NULL, 10);
+		}
+		else if (strcmp(arg, "--pieces") == 0)
+		{
+			options.settings.pieces = (uint32_t)strtoul(value, NULL, 10);
+		}
+		else if (strcmp(arg, "--attack") == 0)
+		{
+			if (!parseAttackTable(value, options.settings.attack))
+			{
+				return false;
+			}
+		}
+		else if (strcmp(arg, "--threads") == 0)
+		{
+			options.threads = atoi(value);
+		}
+		else
+		{
+			return false;
+		}
+	}
+	return options.list || (parseBots(bots, options.bots) && options.settings.rounds > 0 && options.settings.pieces > 0);
+}
+
+int main(int argc, char** argv)
+{
+	TournamentOptions options;
+	if (!parseOptions(argc, argv, options))
+	{
+		printUsage();
+		return 1;
+	}
+	if (options.list)
+	{
+		for (int i = 0; i < getBotCount(); i++)
+		{
+			printf("%s\n", getBotName(i));
+		}
+		return 0;
+	}
+
+	WorkStealingPool pool(options.threads);
+	BotTournament tournament(options.bots, options.settings, pool.getThreads());
+	printf("Playing %lld matches of %d bots over %d rounds from seed %llu on %d threads, up to %u pieces\n",
+		(long long)tournament.getMatches(), (int)options.bots.size(), options.settings.rounds,
+		(unsigned long long)options.settings.firstSeed, pool.getThreads(), options.settings.pieces);
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	tournament.run(pool);
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	printf("%.2f s, %.1f games/s, %.0f pieces/s, %llu work steals\n\n", seconds, 2 * tournament.getMatches() / seconds,
+		tournament.getPieces() / seconds, (unsigned long long)pool.getSteals());
+	tournament.print(stdout);
+	return 0;
+}
@@ -0,0 +1,229 @@
+// ----------------------------------------------------------------------------
+//  Weight tuner
+//
+//  Tunes the bot's board feature weights and score weight with CMA-ES,
+//  playing thousands of fixed-seed headless games per candidate on every
+//  core. Each generation's timings double as the end-to-end throughput
+//  benchmark of the search and simulation code.
+//
+//    Tuner [options]
+//
+//  Options:
+//    --generations G  Generations to reach, counting resumed ones (default 100)
+//    --population P   Candidates per generation, 0 for 4 + 3 ln n (default 0)
+//    --games K        Games per candidate (default 1000)
+//    --seed S         Seed of the first game, game i uses S + i (default 1)
+//    --pieces P       Most blocks placed in a game (default 500)
+//    --width W        Beam width of the bot (default 8)
+//    --depth D        Placements the bot looks ahead (default 2)
+//    --sigma X        First step size, as a fraction of each weight (default 0.3)
+//    --start W        Weights to start from, as Simulator --weights takes
+//    --random R       Seed of the tuner's own sampling (default 1)
+//    --threads N      Threads to use, 0 for one per core (default 0)
+//    --checkpoint F   Saves the run to F after every generation, and picks
+//                     it up from F if it exists, settings included
+// ----------------------------------------------------------------------------
+
+#include "WeightTuner.h"
+
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+
+// Settings of a run, from the command line
+struct TunerOptions
+{
+	TunerSettings settings;
+	int generations;
+	int32_t start[TUNED_WEIGHTS];
+	uint64_t random;
+	int threads;
+	std::string checkpoint;
+};
+
+// Writes how to run the tuner
+static void printUsage()
+{
+	fprintf(stderr,
+		"Usage: Tuner [options]\n"
+		"  --generations G  generations to reach (default 100)\n"
+		"  --population P   candidates per generation, 0 for 4 + 3 ln n (default 0)\n"
+		"  --games K        games per candidate (default %d)\n"
+		"  --seed S         seed of the first game (default 1)\n"
+		"  --pieces P       most blocks per game (default %d)\n"
+		"  --width W        bot beam width (default %d)\n"
+		"  --depth D        bot look ahead (default %d)\n"
+		"  --sigma X        first step size, as a fraction of each weight (default %.1f)\n"
+		"  --start W        weights to start from, comma separated\n"
+		"  --random R       seed of the tuner's sampling (default 1)\n"
+		"  --threads N      threads, 0 for one per core (default 0)\n"
+		"  --checkpoint F   save to and resume from F\n",
+		TUNER_GAMES, TUNER_PIECES, BOT_WIDTH, BOT_DEPTH, TUNER_SIGMA);
+}
+
+// Reads comma-separated weights, the feature weights and optionally
+// the score weight
+static bool parseWeights(const char* text, int32_t* weights)
+{
+	int count = 0;
+	while (true)
+	{
+		char* end;
+		long value = strtol(text, &end, 10);
+		if (end == text || count >= TUNED_WEIGHTS || (*end != ',' && *end != '\0'))
+		{
+			return false;
+		}
+		weights[count++] = (int32_t)value;
+		if (*end == '\0')
+		{
+			break;
+		}
+		text = end + 1;
+	}
+	return count >= NUM_FEATURES;
+}
+
+// Writes weights the way parseWeights() and Simulator --weights read them
+static void printWeights(FILE* out, const int32_t* weights)
+{
+	for (int i = 0; i < TUNED_WEIGHTS; i++)
+	{
+		fprintf(out, i == 0 ? "%d" : ",%d", weights[i]);
+	}
+	fprintf(out, "\n");
+}
+
+// Reads the command line, returning false if it doesn't make sense
+static bool parseOptions(int argc, char** argv, TunerOptions& options)
+{
+	setDefaultTuner(options.settings);
+	options.generations = 100;
+	memcpy(options.start, DEFAULT_WEIGHTS, sizeof(DEFAULT_WEIGHTS));
+	options.start[NUM_FEATURES] = SCORE_WEIGHT;
+	options.random = 1;
+	options.threads = 0;
+	for (int i = 1; i + 1 < argc; i += 2)
+	{
+		const char* arg = argv[i];
+		const char* value = argv[i + 1];
+		if (strcmp(arg, "--generations") == 0)
+		{
+			options.generations = atoi(value);
+		}
+		else if (strcmp(arg, "--population") == 0)
+		{
+			options.settings.population = atoi(value);
+		}
+		else if (strcmp(arg, "--games") == 0)
+		{
+			options.settings.games = strtoull(value, NULL, 10);
+		}
+		else if (strcmp(arg, "--seed") == 0)
+		{
+			options.settings.firstSeed = strtoull(value, NULL, 10);
+		}
+		else if (strcmp(arg, "--pieces") == 0)
+		{
+			options.settings.pieces = (uint32_t)strtoul(value, NULL, 10);
+		}
+		else if (strcmp(arg, "--width") == 0)
+		{
+			options.settings.width = atoi(value);
+		}
+		else if (strcmp(arg, "--depth") == 0)
+		{
+			options.settings.depth = atoi(value);
+		}
+		else if (strcmp(arg, "--sigma") == 0)
+		{
+			options.settings.sigma = atof(value);
+		}
+		else if (strcmp(arg, "--start") == 0)
+		{
+			if (!parseWeights(value, options.start))
+			{
+				return false;
+			}
+		}
+		else if (strcmp(arg, "--random") == 0)
+		{
+			options.random = strtoull(value, NULL, 10);
+		}
+		else if (strcmp(arg, "--threads") == 0)
+		{
+			options.threads = atoi(value);
+		}
+		else if (strcmp(arg, "--checkpoint") == 0)
+		{
+			options.checkpoint = value;
+		}
+		else
+		{
+			return false;
+		}
+	}
+	return argc % 2 == 1 && options.generations > 0 && options.settings.population >= 0 &&
+		options.settings.games > 0 && options.settings.pieces > 0 && options.settings.width > 0 &&
+		options.settings.depth > 0 && options.settings.sigma > 0;
+}
+
+int main(int argc, char** argv)
+{
+	TunerOptions options;
+	if (!parseOptions(argc, argv, options))
+	{
+		printUsage();
+		return 1;
+	}
+
+	WeightTuner tuner(options.settings, options.random, options.threads);
+	tuner.start(options.start);
+	if (!options.checkpoint.empty() && tuner.load(options.checkpoint.c_str()))
+	{
+		printf("Resuming %s at generation %d, with its settings\n", options.checkpoint.c_str(),
+			tuner.getGeneration());
+	}
+	const TunerSettings& settings = tuner.getSettings();
+	printf("Tuning with %d candidates of %llu games from seed %llu, beam %dx%d, up to %u pieces, on %d threads\n",
+		tuner.getPopulation(), (unsigned long long)settings.games, (unsigned long long)settings.firstSeed,
+		settings.width, settings.depth, settings.pieces, tuner.getThreads());
+	printf("%5s %10s %10s %10s %8s %10s %10s\n", "gen", "best", "mean", "best ever", "sigma", "games/s", "pieces/s");
+
+	std::chrono::steady_clock::time_point runStart = std::chrono::steady_clock::now();
+	uint64_t gamesBefore = tuner.getGamesPlayed();
+	uint64_t piecesBefore = tuner.getPiecesPlayed();
+	while (tuner.getGeneration() < options.generations)
+	{
+		uint64_t games = tuner.getGamesPlayed();
+		uint64_t pieces = tuner.getPiecesPlayed();
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		tuner.runGeneration();
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		printf("%5d %10.1f %10.1f %10.1f %8.4f %10.1f %10.0f\n", tuner.getGeneration(), tuner.getGenerationBest(),
+			tuner.getGenerationMean(), tuner.getBestFitness(), tuner.getSigma(),
+			(tuner.getGamesPlayed() - games) / seconds, (tuner.getPiecesPlayed() - pieces) / seconds);
+		fflush(stdout);
+		if (!options.checkpoint.empty() && !tuner.save(options.checkpoint.c_str()))
+		{
+			fprintf(stderr, "Couldn't save %s\n", options.checkpoint.c_str());
+			return 2;
+		}
+	}
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - runStart).count();
+
+	int32_t weights[TUNED_WEIGHTS];
+	tuner.getMeanWeights(weights);
+	printf("\nbest candidate   ");
+	printWeights(stdout, tuner.getBestWeights());
+	printf("mean of search   ");
+	printWeights(stdout, weights);
+	if (seconds > 0)
+	{
+		printf("\n%.1f s, %.1f games/s, %.0f pieces/s\n", seconds, (tuner.getGamesPlayed() - gamesBefore) / seconds,
+			(tuner.getPiecesPlayed() - piecesBefore) / seconds);
+	}
+	return 0;
+}